@@ -2,9 +2,13 @@ TEMPLATE = subdirs
 
 SUBDIRS += \
     SpeechRecogniser \
-    SpeechRecogniserTest
+    SpeechRecogniserTest \
+    SpeechRecogniserBenchmark
 
 SpeechRecogniser.subdir = SpeechRecogniser
 
 SpeechRecogniserTest.subdir = SpeechRecogniserTest
 SpeechRecogniserTest.depends = SpeechRecogniser
+
+SpeechRecogniserBenchmark.subdir = SpeechRecogniserBenchmark
+SpeechRecogniserBenchmark.depends = SpeechRecogniser
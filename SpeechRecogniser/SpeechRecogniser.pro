@@ -1,4 +1,4 @@
-QT += gui widgets
+QT += gui network widgets
 
 TARGET   = SpeechRecogniser
 TEMPLATE = lib
@@ -17,22 +17,101 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# The sample conversion kernels use SSE2 or NEON by default, uncomment to
+# build the AVX2 kernels for machines that have it.
+#QMAKE_CXXFLAGS += -mavx2
+
+# The trace spans through the capture and detection path are only built in
+# with qmake CONFIG+=tracing, see Tracer.
+tracing: DEFINES += SPEECHRECOGNISER_TRACING
+
+# Allocations and locks on the real time path are only counted with qmake
+# CONFIG+=rtaudit, see RealtimeAudit. Not for release builds, it replaces
+# malloc() and pthread_mutex_lock() for the whole process.
+rtaudit {
+    DEFINES += SPEECHRECOGNISER_RTAUDIT
+    LIBS += -ldl
+}
+
 # header file for common projects
 INCLUDEPATH += ../include
 
 SOURCES += \
+    audioblock.cpp \
+    audiosource.cpp \
+    beamformer.cpp \
+    capturesimulator.cpp \
+    capturegroup.cpp \
+    chunkpolicy.cpp \
+    detectionpipeline.cpp \
+    detectionserver.cpp \
+    deviceclock.cpp \
+    echocanceller.cpp \
+    energygate.cpp \
+    featureextractor.cpp \
+    feedbackplayer.cpp \
+    fft.cpp \
+    fileaudiosource.cpp \
+    gaincontrol.cpp \
+    losslesscodec.cpp \
+    metrics.cpp \
+    metricsserver.cpp \
     microphoneplot.cpp \
     microphonereader.cpp \
-    speechrecogniser.cpp
+    noisesuppressor.cpp \
+    playbackgate.cpp \
+    realtimeaudit.cpp \
+    sampleconversion.cpp \
+    spectrogram.cpp \
+    speechrecogniser.cpp \
+    streamaligner.cpp \
+    tracing.cpp \
+    wavfile.cpp \
+    wavrecorder.cpp \
+    workstealingpool.cpp
 
 HEADERS += \
     SpeechRecogniser_global.h \
     SpeechRecognition_global.h \
+    audioblock.h \
+    audiosource.h \
+    beamformer.h \
+    capturesimulator.h \
+    capturegroup.h \
+    chunkpolicy.h \
+    detectionpipeline.h \
+    detectionserver.h \
+    deviceclock.h \
+    echocanceller.h \
+    energygate.h \
+    featureextractor.h \
+    feedbackplayer.h \
+    fft.h \
+    fileaudiosource.h \
+    gaincontrol.h \
+    losslesscodec.h \
+    metrics.h \
+    metricsserver.h \
     microphoneplot.h \
     microphonereader.h \
-    speechrecogniser.h
+    noisesuppressor.h \
+    playbackgate.h \
+    realtimeaudit.h \
+    sampleconversion.h \
+    spectrogram.h \
+    speechrecogniser.h \
+    streamaligner.h \
+    tracing.h \
+    wavfile.h \
+    wavrecorder.h \
+    workstealingpool.h
 
 
 unix|win32: {
     LIBS += -L/usr/local/lib -lportaudiocpp
 }
+
+# the prebuilt snowboy library in ../lib was built with the pre C++11
+# std::string ABI and needs a cblas implementation.
+DEFINES += _GLIBCXX_USE_CXX11_ABI=0
+LIBS += -L$$PWD/../lib -lsnowboy-detect -lcblas
@@ -0,0 +1,161 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "audioblock.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \brief Creates an empty block.
+*/
+AudioBlock::AudioBlock()
+  : m_channels(0)
+  , m_frames(0)
+  , m_sequence(0)
+  , m_adcTime(0.0)
+  , m_captureTime(0)
+{}
+
+/*!
+  \brief Creates a block of channels by frames samples, all zero.
+*/
+AudioBlock::AudioBlock(int channels, int frames)
+  : m_channels(channels)
+  , m_frames(frames)
+  , m_sequence(0)
+  , m_adcTime(0.0)
+  , m_captureTime(0)
+  , m_samples(channels * frames, 0.0f)
+{}
+
+/*!
+  \brief Returns the number of channels.
+*/
+int
+AudioBlock::channels() const
+{
+  return m_channels;
+}
+
+/*!
+  \brief Returns the number of frames, the samples in each channel.
+*/
+int
+AudioBlock::frames() const
+{
+  return m_frames;
+}
+
+/*!
+  \brief Returns true if the block holds no samples.
+*/
+bool
+AudioBlock::isEmpty() const
+{
+  return m_samples.isEmpty();
+}
+
+/*!
+  \brief Returns true if the samples are shared with another copy of the
+  block, so writing to them would first copy them.
+*/
+bool
+AudioBlock::isShared() const
+{
+  return !m_samples.isDetached();
+}
+
+/*!
+  \brief Returns a writable pointer to the frames of a channel.
+*/
+float*
+AudioBlock::channel(int channel)
+{
+  return m_samples.data() + channel * m_frames;
+}
+
+/*!
+  \brief Returns a pointer to the frames of a channel.
+*/
+const float*
+AudioBlock::channel(int channel) const
+{
+  return m_samples.constData() + channel * m_frames;
+}
+
+/*!
+  \brief Returns a copy of the frames of a channel.
+*/
+QVector<float>
+AudioBlock::channelData(int channel) const
+{
+  return m_samples.mid(channel * m_frames, m_frames);
+}
+
+/*!
+  \brief Returns the sequence number given by the source, counting up from
+  zero. A gap means blocks were lost.
+*/
+quint64
+AudioBlock::sequence() const
+{
+  return m_sequence;
+}
+
+void
+AudioBlock::setSequence(quint64 sequence)
+{
+  m_sequence = sequence;
+}
+
+/*!
+  \brief Returns the capture time of the first frame in seconds, in the time
+  base of the source. For a microphone this is PortAudio's stream time.
+*/
+double
+AudioBlock::adcTime() const
+{
+  return m_adcTime;
+}
+
+void
+AudioBlock::setAdcTime(double adcTime)
+{
+  m_adcTime = adcTime;
+}
+
+/*!
+  \brief Returns the capture time of the first frame in steady clock
+  nanoseconds, the shared time base of all sources.
+*/
+qint64
+AudioBlock::captureTime() const
+{
+  return m_captureTime;
+}
+
+void
+AudioBlock::setCaptureTime(qint64 captureTime)
+{
+  m_captureTime = captureTime;
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,82 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef AUDIOBLOCK_H
+#define AUDIOBLOCK_H
+
+#include <QMetaType>
+#include <QVector>
+
+#include "SpeechRecogniser_global.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \class AudioBlock
+  \brief The AudioBlock class holds one captured buffer of planar,
+  multi-channel float audio.
+
+  Each channel's frames are stored together, channel after channel, so that
+  per channel processing such as beamforming works on contiguous memory. The
+  samples are implicitly shared, so blocks are cheap to pass through queued
+  signals.
+
+  Every block carries the sequence number given to it by its source and the
+  time its first frame was captured, both in the source's own time base and
+  mapped onto the steady clock so blocks from different sources can be
+  lined up.
+*/
+class SPEECHRECOGNISER_EXPORT AudioBlock
+{
+public:
+  AudioBlock();
+  AudioBlock(int channels, int frames);
+
+  int channels() const;
+  int frames() const;
+  bool isEmpty() const;
+  bool isShared() const;
+
+  float* channel(int channel);
+  const float* channel(int channel) const;
+  QVector<float> channelData(int channel) const;
+
+  quint64 sequence() const;
+  void setSequence(quint64 sequence);
+  double adcTime() const;
+  void setAdcTime(double adcTime);
+  qint64 captureTime() const;
+  void setCaptureTime(qint64 captureTime);
+
+private:
+  int m_channels;
+  int m_frames;
+  quint64 m_sequence;
+  double m_adcTime;
+  qint64 m_captureTime;
+  QVector<float> m_samples;
+};
+
+} // end of namespace SpeechRecognition
+
+Q_DECLARE_METATYPE(SpeechRecognition::AudioBlock)
+
+#endif // AUDIOBLOCK_H
@@ -0,0 +1,193 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "audiosource.h"
+#include "metrics.h"
+#include "tracing.h"
+
+namespace SpeechRecognition {
+
+AudioSource::AudioSource(QObject* parent)
+  : QObject(parent)
+  , m_running(true)
+  , m_queuedSamples(0)
+  , m_sequence(0)
+  , m_overflows(0)
+  , m_ringWritten(0)
+  , m_ringRead(0)
+{}
+
+AudioSource::~AudioSource() {}
+
+/*!
+   \brief Asks the source to stop. record() returns soon after and
+   finished() is emitted.
+*/
+void
+AudioSource::stop()
+{
+  QMutexLocker locker(&m_mutex);
+  m_running = false;
+}
+
+/*!
+   \brief Returns the fraction of a core the source's own callback is using,
+   for sources that have one. The default returns 0.
+*/
+double
+AudioSource::callbackLoad() const
+{
+  return 0.0;
+}
+
+/*!
+   \brief Checks that the source is still running and returns true if it is,
+   otherwise returns false.
+*/
+bool
+AudioSource::isRunning() const
+{
+  return m_running;
+}
+
+/*!
+  \brief Custom method wrapper for the output signal which takes as a parameter
+  an AudioBlock. The block is given the next sequence number.
+
+  This is used by callback methods as they cannot access the Qt signals
+  directly.
+*/
+void
+AudioSource::emitBlock(AudioBlock block)
+{
+  const PipelineMetrics& metrics = PipelineMetrics::instance();
+  block.setSequence(m_sequence++);
+  SR_TRACE_SCOPE_SEQ("emitBlock", "capture", block.sequence());
+  SR_TRACE_FLOW_BEGIN("block", block.sequence());
+  m_queuedSamples.fetchAndAddRelaxed(block.frames());
+  metrics.blocksCaptured->add();
+  metrics.queueDepth->add(block.frames());
+  emit sendBlock(block);
+}
+
+/*!
+  \brief Returns the next block of the ring, shaped to channels by frames,
+  for a callback to fill and publish with commitBlock(). Returns nullptr,
+  counting an overflow, if the ring is full because the source's thread has
+  fallen behind.
+
+  A block is only replaced, which allocates, if a consumer still holds a
+  copy of it from RING_BLOCKS blocks ago or the shape has changed. It must
+  only ever be called from one thread.
+*/
+AudioBlock*
+AudioSource::beginBlock(int channels, int frames)
+{
+  quint64 written = m_ringWritten.load(std::memory_order_relaxed);
+
+  if (written - m_ringRead.load(std::memory_order_acquire) >=
+      quint64(RING_BLOCKS)) {
+    countOverflow();
+    return nullptr;
+  }
+
+  AudioBlock& block = m_ring[written % RING_BLOCKS];
+
+  if (block.channels() != channels || block.frames() != frames ||
+      block.isShared()) {
+    block = AudioBlock(channels, frames);
+  }
+
+  return &block;
+}
+
+/*!
+  \brief Publishes the block filled since beginBlock() to emitPending().
+*/
+void
+AudioSource::commitBlock()
+{
+  m_ringWritten.store(m_ringWritten.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_release);
+}
+
+/*!
+  \brief Sends every block published since the last call through
+  emitBlock() and returns how many there were. Called from the source's own
+  thread.
+*/
+int
+AudioSource::emitPending()
+{
+  quint64 read = m_ringRead.load(std::memory_order_relaxed);
+  quint64 written = m_ringWritten.load(std::memory_order_acquire);
+  int count = 0;
+
+  for (; read < written; read++) {
+    emitBlock(m_ring[read % RING_BLOCKS]);
+    m_ringRead.store(read + 1, std::memory_order_release);
+    count++;
+  }
+
+  return count;
+}
+
+/*!
+  \brief Returns the number of frames sent that the consumer has not yet
+  reported as consumed through samplesConsumed().
+
+  This lets a consumer on another thread see how far it is behind the
+  source.
+*/
+int
+AudioSource::queuedSamples() const
+{
+  return m_queuedSamples.loadAcquire();
+}
+
+/*!
+  \brief Reports that the consumer has finished with count frames.
+*/
+void
+AudioSource::samplesConsumed(int count)
+{
+  m_queuedSamples.fetchAndAddRelease(-count);
+  PipelineMetrics::instance().queueDepth->add(-count);
+}
+
+/*!
+  \brief Returns the number of blocks lost because the consumer, or for a
+  device its callback, ran late.
+*/
+quint64
+AudioSource::overflowCount() const
+{
+  return m_overflows.loadAcquire();
+}
+
+void
+AudioSource::countOverflow()
+{
+  m_overflows.fetchAndAddRelaxed(1);
+  PipelineMetrics::instance().overflows->add();
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,105 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef AUDIOSOURCE_H
+#define AUDIOSOURCE_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QObject>
+#include <QtDebug>
+
+#include <atomic>
+
+#include "SpeechRecogniser_global.h"
+#include "audioblock.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \class AudioSource
+  \brief The AudioSource class is the base of everything that produces audio
+  for a SpeechRecogniser.
+
+  A source is moved to its own thread, where record() runs until stop() is
+  called or the audio runs out, sending planar AudioBlocks through
+  sendBlock() and finally emitting finished().
+
+  The source counts the frames it has sent that the consumer has not yet
+  reported through samplesConsumed(), so the consumer can tell how far
+  behind it is, and counts the blocks it had to throw away because the
+  consumer was too far behind. Both also go to the process wide
+  PipelineMetrics, summed over every source.
+
+  A device callback must not send a queued signal, which allocates the
+  event and a copy of its arguments and locks the receiver's event queue.
+  Instead it fills a block of the source's ring with beginBlock() and
+  publishes it with commitBlock(), and the source's own thread sends the
+  published blocks with emitPending(). A ring block is reused once every
+  copy sent on has been let go, so in steady state the callback neither
+  allocates nor locks.
+*/
+class SPEECHRECOGNISER_EXPORT AudioSource : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit AudioSource(QObject* parent = nullptr);
+  ~AudioSource() override;
+
+  virtual void record() = 0;
+  virtual void stop();
+  virtual int channelCount() const = 0;
+  virtual double sampleRate() const = 0;
+  virtual double callbackLoad() const;
+
+  bool isRunning() const;
+  void emitBlock(AudioBlock block);
+  AudioBlock* beginBlock(int channels, int frames);
+  void commitBlock();
+  int emitPending();
+  int queuedSamples() const;
+  void samplesConsumed(int count);
+  quint64 overflowCount() const;
+
+signals:
+  void sendBlock(SpeechRecognition::AudioBlock);
+  void finished();
+
+protected:
+  static const int RING_BLOCKS = 32;
+
+  bool m_running;
+  QMutex m_mutex;
+  QAtomicInt m_queuedSamples;
+  quint64 m_sequence;
+  QAtomicInteger<quint64> m_overflows;
+  AudioBlock m_ring[RING_BLOCKS];
+  std::atomic<quint64> m_ringWritten;
+  std::atomic<quint64> m_ringRead;
+
+  void countOverflow();
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // AUDIOSOURCE_H
@@ -0,0 +1,346 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <QVarLengthArray>
+#include <QtMath>
+
+#include "beamformer.h"
+
+namespace SpeechRecognition {
+
+/* out[i] += wa * a[i] + wb * b[i], the inner loop of both the downmix and
+   the beamformer.*/
+static void
+accumulate(const float* a, float wa, const float* b, float wb, float* out, int n)
+{
+  int i = 0;
+
+#if defined(__SSE2__)
+  const __m128 va = _mm_set1_ps(wa), vb = _mm_set1_ps(wb);
+
+  for (; i + 4 <= n; i += 4) {
+    __m128 x = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a + i), va),
+                          _mm_mul_ps(_mm_loadu_ps(b + i), vb));
+    _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), x));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t x = vmlaq_n_f32(vld1q_f32(out + i), vld1q_f32(a + i), wa);
+    vst1q_f32(out + i, vmlaq_n_f32(x, vld1q_f32(b + i), wb));
+  }
+#endif
+
+  for (; i < n; i++) {
+    out[i] += wa * a[i] + wb * b[i];
+  }
+}
+
+/*!
+  \brief Averages channelCount planar channels of frames samples into out.
+*/
+void
+downmix(const float* const* channels, int channelCount, int frames, float* out)
+{
+  if (channelCount <= 0) {
+    return;
+  }
+
+  const float weight = 1.0f / float(channelCount);
+  std::memset(out, 0, size_t(frames) * sizeof(float));
+  int c = 0;
+
+  // two channels per pass halves the read-modify-write traffic on out.
+  for (; c + 2 <= channelCount; c += 2) {
+    accumulate(channels[c], weight, channels[c + 1], weight, out, frames);
+  }
+
+  if (c < channelCount) {
+    accumulate(channels[c], weight, channels[c], 0.0f, out, frames);
+  }
+}
+
+/*!
+  \brief Averages the channels of a block into out, which must have room for
+  block.frames() samples.
+*/
+void
+downmix(const AudioBlock& block, float* out)
+{
+  QVarLengthArray<const float*, 16> channels(block.channels());
+
+  for (int c = 0; c < block.channels(); c++) {
+    channels[c] = block.channel(c);
+  }
+
+  downmix(channels.constData(), block.channels(), block.frames(), out);
+}
+
+/*!
+  \brief Creates a beamformer for audio at sampleRate samples per second.
+  It has no geometry until setGeometry() or setDelays() is called.
+*/
+DelayAndSumBeamformer::DelayAndSumBeamformer(int sampleRate)
+  : m_sampleRate(sampleRate)
+  , m_speedOfSound(343.0f)
+  , m_azimuth(0.0f)
+  , m_elevation(0.0f)
+  , m_history(1)
+  , m_frames(0)
+{}
+
+/*!
+  \brief Returns the number of channels the beamformer expects.
+*/
+int
+DelayAndSumBeamformer::channels() const
+{
+  return m_delays.size();
+}
+
+/*!
+  \brief Returns the microphone positions in metres.
+*/
+QVector<QVector3D>
+DelayAndSumBeamformer::geometry() const
+{
+  return m_geometry;
+}
+
+/*!
+  \brief Sets the microphone positions in metres, one per channel, and
+  recalculates the delays for the current steering.
+*/
+void
+DelayAndSumBeamformer::setGeometry(const QVector<QVector3D>& positions)
+{
+  m_geometry = positions;
+  updateDelays();
+}
+
+/*!
+  \brief Returns the steering azimuth in degrees.
+*/
+float
+DelayAndSumBeamformer::azimuth() const
+{
+  return m_azimuth;
+}
+
+/*!
+  \brief Returns the steering elevation in degrees.
+*/
+float
+DelayAndSumBeamformer::elevation() const
+{
+  return m_elevation;
+}
+
+/*!
+  \brief Steers the beam. Azimuth is measured in degrees from the x axis
+  towards the y axis and elevation in degrees up from the x-y plane.
+*/
+void
+DelayAndSumBeamformer::setSteering(float azimuth, float elevation)
+{
+  m_azimuth = azimuth;
+  m_elevation = elevation;
+  updateDelays();
+}
+
+/*!
+  \brief Returns the speed of sound in metres per second. Defaults to 343.
+*/
+float
+DelayAndSumBeamformer::speedOfSound() const
+{
+  return m_speedOfSound;
+}
+
+void
+DelayAndSumBeamformer::setSpeedOfSound(float metresPerSecond)
+{
+  m_speedOfSound = metresPerSecond;
+  updateDelays();
+}
+
+void
+DelayAndSumBeamformer::setSampleRate(int sampleRate)
+{
+  m_sampleRate = sampleRate;
+  updateDelays();
+}
+
+/*!
+  \brief Returns the delay applied to each channel in samples.
+*/
+QVector<float>
+DelayAndSumBeamformer::delays() const
+{
+  return m_delays;
+}
+
+/*!
+  \brief Sets the delay of each channel in samples directly, for arrays
+  whose geometry is not known. Negative delays are treated as zero.
+*/
+void
+DelayAndSumBeamformer::setDelays(const QVector<float>& delays)
+{
+  m_geometry.clear();
+  m_delays = delays;
+  applyDelays();
+}
+
+/*!
+  \brief Beamforms frames samples of each channel into out.
+
+  \param channels - channels() pointers to planar input.
+*/
+void
+DelayAndSumBeamformer::process(const float* const* channels,
+                               int frames,
+                               float* out)
+{
+  const int count = m_delays.size();
+  std::memset(out, 0, size_t(frames) * sizeof(float));
+
+  if (count == 0) {
+    return;
+  }
+
+  if (frames != m_frames) {
+    // a new block size, only ever happens on the first block of a stream.
+    m_frames = frames;
+
+    for (auto& buffer : m_buffers) {
+      buffer.resize(size_t(m_history + frames), 0.0f);
+    }
+  }
+
+  const float weight = 1.0f / float(count);
+
+  for (int c = 0; c < count; c++) {
+    std::vector<float>& buffer = m_buffers[size_t(c)];
+    float* current = buffer.data() + m_history;
+    std::memcpy(current, channels[c], size_t(frames) * sizeof(float));
+
+    // x[n - d] for d = w + f is (1 - f) * x[n - w] + f * x[n - w - 1].
+    const float* newer = current - m_whole[size_t(c)];
+    float fraction = m_fraction[size_t(c)];
+    accumulate(newer, weight * (1.0f - fraction), newer - 1, weight * fraction,
+               out, frames);
+
+    // keep the tail as history for the next block.
+    std::memmove(buffer.data(), buffer.data() + frames,
+                 size_t(m_history) * sizeof(float));
+  }
+}
+
+/*!
+  \brief Beamforms a block into out, which must have room for block.frames()
+  samples. The block must have channels() channels.
+*/
+void
+DelayAndSumBeamformer::process(const AudioBlock& block, float* out)
+{
+  QVarLengthArray<const float*, 16> channels(block.channels());
+
+  for (int c = 0; c < block.channels(); c++) {
+    channels[c] = block.channel(c);
+  }
+
+  process(channels.constData(), block.frames(), out);
+}
+
+/*!
+  \brief Clears the delay history, for example after a gap in the capture.
+*/
+void
+DelayAndSumBeamformer::reset()
+{
+  for (auto& buffer : m_buffers) {
+    std::fill(buffer.begin(), buffer.end(), 0.0f);
+  }
+}
+
+void
+DelayAndSumBeamformer::updateDelays()
+{
+  if (m_geometry.isEmpty()) {
+    return;
+  }
+
+  const float az = qDegreesToRadians(m_azimuth);
+  const float el = qDegreesToRadians(m_elevation);
+  const QVector3D towards(
+    std::cos(el) * std::cos(az), std::cos(el) * std::sin(az), std::sin(el));
+
+  // microphones further along the steering direction hear the source first,
+  // so they are delayed the most to line up with the last to hear it.
+  QVector<float> lead;
+
+  for (const QVector3D& position : m_geometry) {
+    lead.append(QVector3D::dotProduct(position, towards) / m_speedOfSound *
+                float(m_sampleRate));
+  }
+
+  float minLead = *std::min_element(lead.begin(), lead.end());
+  m_delays.clear();
+
+  for (float value : lead) {
+    m_delays.append(value - minLead);
+  }
+
+  applyDelays();
+}
+
+void
+DelayAndSumBeamformer::applyDelays()
+{
+  const int count = m_delays.size();
+  m_whole.assign(size_t(count), 0);
+  m_fraction.assign(size_t(count), 0.0f);
+  int longest = 0;
+
+  for (int c = 0; c < count; c++) {
+    float delay = std::max(0.0f, m_delays.at(c));
+    m_whole[size_t(c)] = int(std::floor(delay));
+    m_fraction[size_t(c)] = delay - float(m_whole[size_t(c)]);
+    longest = std::max(longest, m_whole[size_t(c)]);
+  }
+
+  // one extra for the interpolation tap.
+  m_history = longest + 1;
+  m_frames = 0;
+  m_buffers.assign(size_t(count), std::vector<float>());
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,98 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef BEAMFORMER_H
+#define BEAMFORMER_H
+
+#include <QVector3D>
+#include <QVector>
+
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+#include "audioblock.h"
+
+namespace SpeechRecognition {
+
+SPEECHRECOGNISER_EXPORT void downmix(const float* const* channels,
+                                     int channelCount,
+                                     int frames,
+                                     float* out);
+SPEECHRECOGNISER_EXPORT void downmix(const AudioBlock& block, float* out);
+
+/*!
+  \class DelayAndSumBeamformer
+  \brief The DelayAndSumBeamformer class combines the channels of a
+  microphone array into a single channel steered towards one direction.
+
+  Each channel is delayed so that sound arriving from the steering
+  direction lines up across the array, then the channels are averaged.
+  Sound from the steering direction adds coherently while uncorrelated
+  noise does not, so an array of N microphones gains up to 10log10(N) dB of
+  SNR over a single one.
+
+  The delays are worked out from the microphone positions, in metres, and
+  the steering azimuth and elevation, in degrees, with azimuth 0 along the x
+  axis. Alternatively they can be set directly in samples. Fractional
+  delays are linearly interpolated.
+*/
+class SPEECHRECOGNISER_EXPORT DelayAndSumBeamformer
+{
+public:
+  explicit DelayAndSumBeamformer(int sampleRate = 16000);
+
+  int channels() const;
+  QVector<QVector3D> geometry() const;
+  void setGeometry(const QVector<QVector3D>& positions);
+  float azimuth() const;
+  float elevation() const;
+  void setSteering(float azimuth, float elevation = 0.0f);
+  float speedOfSound() const;
+  void setSpeedOfSound(float metresPerSecond);
+  void setSampleRate(int sampleRate);
+
+  QVector<float> delays() const;
+  void setDelays(const QVector<float>& delays);
+
+  void process(const float* const* channels, int frames, float* out);
+  void process(const AudioBlock& block, float* out);
+  void reset();
+
+private:
+  int m_sampleRate;
+  float m_speedOfSound;
+  float m_azimuth;
+  float m_elevation;
+  QVector<QVector3D> m_geometry;
+  QVector<float> m_delays;
+  std::vector<int> m_whole;
+  std::vector<float> m_fraction;
+  int m_history;
+  int m_frames;
+  std::vector<std::vector<float>> m_buffers;
+
+  void updateDelays();
+  void applyDelays();
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // BEAMFORMER_H
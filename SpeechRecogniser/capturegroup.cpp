@@ -0,0 +1,263 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QFile>
+#include <QThread>
+
+#include "beamformer.h"
+#include "capturegroup.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \brief Creates an empty group whose detection pool has threadCount
+  workers, one per core if zero.
+*/
+CaptureGroup::CaptureGroup(int threadCount, QObject* parent)
+  : QObject(parent)
+  , m_running(0)
+  , m_server(threadCount)
+  , m_aligner(SAMPLE_RATE)
+{
+  qRegisterMetaType<SpeechRecognition::AudioBlock>(
+    "SpeechRecognition::AudioBlock");
+  connect(&m_server,
+          &DetectionServer::hotwordDetected,
+          this,
+          [this](int stream, int hotword) {
+            int device = deviceOfStream(stream);
+
+            if (device >= 0) {
+              emit hotwordDetected(device, hotword);
+            }
+          });
+}
+
+/*!
+  \brief Stops the readers. Their threads finish on their own.
+*/
+CaptureGroup::~CaptureGroup()
+{
+  stop();
+}
+
+/*!
+  \brief Sets the detector used for devices added after this call. Returns
+  false if any of the files are missing.
+
+  \param resourceFile - the snowboy resource file, normally common.res.
+  \param models - a comma separated list of model files.
+  \param sensitivity - a comma separated list of sensitivities, one per
+  hotword. If empty the model defaults are used.
+*/
+bool
+CaptureGroup::setDetector(const QString& resourceFile,
+                          const QString& models,
+                          const QString& sensitivity)
+{
+  QStringList files = models.split(',');
+  files.prepend(resourceFile);
+
+  for (const QString& file : files) {
+    if (!QFile::exists(file)) {
+      qWarning() << tr("unable to find detector file %1.").arg(file);
+      return false;
+    }
+  }
+
+  m_resourceFile = resourceFile;
+  m_models = models;
+  m_sensitivity = sensitivity;
+  return true;
+}
+
+/*!
+  \brief Opens a device and returns its index in the group, or -1 if it
+  could not be used. All devices must be added before start().
+*/
+int
+CaptureGroup::addDevice(const CaptureSettings& settings)
+{
+  if (int(settings.sampleRate) != SAMPLE_RATE) {
+    qWarning() << tr("capture groups run at %1 Hz, not %2 Hz.")
+                    .arg(SAMPLE_RATE)
+                    .arg(settings.sampleRate);
+    return -1;
+  }
+
+  int stream = -1;
+
+  if (!m_models.isEmpty()) {
+    stream = m_server.addStream(m_resourceFile, m_models, m_sensitivity);
+
+    if (stream < 0) {
+      return -1;
+    }
+  }
+
+  int device = m_readers.size();
+  MicrophoneReader* reader = new MicrophoneReader(settings);
+  m_readers.append(reader);
+  m_streams.append(stream);
+  m_aligner.addSource(reader->channelCount());
+
+  // runs on the reader's thread, which sends the blocks its callback left in
+  // the reader's ring, never on the callback itself.
+  connect(reader,
+          &MicrophoneReader::sendBlock,
+          this,
+          [this, device, reader](const AudioBlock& block) {
+            receiveBlock(device, reader, block);
+          },
+          Qt::DirectConnection);
+
+  return device;
+}
+
+/*!
+  \brief Returns the number of devices.
+*/
+int
+CaptureGroup::deviceCount() const
+{
+  return m_readers.size();
+}
+
+/*!
+  \brief Returns the reader of a device, for its counters and clock, or
+  nullptr once the reader has finished.
+*/
+MicrophoneReader*
+CaptureGroup::reader(int device) const
+{
+  return m_readers.value(device);
+}
+
+/*!
+  \brief Starts every reader on its own thread.
+*/
+void
+CaptureGroup::start()
+{
+  for (MicrophoneReader* reader : m_readers) {
+    if (!reader) {
+      continue;
+    }
+
+    QThread* thread = new QThread;
+    connect(thread, &QThread::started, reader, &MicrophoneReader::record);
+    connect(reader, &MicrophoneReader::finished, thread, &QThread::quit);
+    connect(reader, &MicrophoneReader::finished, reader, &QObject::deleteLater);
+    connect(reader, &MicrophoneReader::finished, thread, &QObject::deleteLater);
+    connect(reader, &MicrophoneReader::finished, this, [this] {
+      if (--m_running == 0) {
+        emit finished();
+      }
+    });
+    m_running++;
+
+    reader->moveToThread(thread);
+    thread->start();
+  }
+}
+
+/*!
+  \brief Stops every reader.
+*/
+void
+CaptureGroup::stop()
+{
+  for (MicrophoneReader* reader : m_readers) {
+    if (reader) {
+      reader->stop();
+    }
+  }
+}
+
+/*!
+  \brief Returns the DetectionServer stream of device, or -1 if the device
+  has no detector or there is no such device.
+*/
+int
+CaptureGroup::stream(int device) const
+{
+  return m_streams.value(device, -1);
+}
+
+/*!
+  \brief Returns the device whose detection runs on stream of the server,
+  or -1 if it is none of the group's.
+*/
+int
+CaptureGroup::deviceOfStream(int stream) const
+{
+  return stream < 0 ? -1 : m_streams.indexOf(stream);
+}
+
+/*!
+  \brief Returns the detection server shared by the devices. Streams are
+  numbered in the order the server's streams were added, so map between
+  them and devices with stream() and deviceOfStream().
+*/
+DetectionServer*
+CaptureGroup::server()
+{
+  return &m_server;
+}
+
+/*!
+  \brief Returns the aligner holding every device's blocks, to read them
+  lined up by capture time. Source n of the aligner is device n.
+*/
+StreamAligner*
+CaptureGroup::aligner()
+{
+  return &m_aligner;
+}
+
+void
+CaptureGroup::receiveBlock(int device,
+                           MicrophoneReader* reader,
+                           const AudioBlock& block)
+{
+  if (!block.isEmpty()) {
+    m_aligner.push(device, block);
+
+    if (m_streams.at(device) >= 0) {
+      QVector<float> mono;
+
+      if (block.channels() == 1) {
+        mono = block.channelData(0);
+
+      } else {
+        mono.resize(block.frames());
+        downmix(block, mono.data());
+      }
+
+      m_server.pushData(m_streams.at(device), mono);
+    }
+  }
+
+  // the server keeps its own backlog, so the reader's is done with at once.
+  reader->samplesConsumed(block.frames());
+}
+
+} // end of namespace SpeechRecognition
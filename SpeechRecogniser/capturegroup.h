@@ -0,0 +1,102 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef CAPTUREGROUP_H
+#define CAPTUREGROUP_H
+
+#include <QObject>
+#include <QPointer>
+#include <QVector>
+#include <QtDebug>
+
+#include "SpeechRecogniser_global.h"
+#include "detectionserver.h"
+#include "microphonereader.h"
+#include "streamaligner.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \class CaptureGroup
+  \brief The CaptureGroup class captures from several input devices at once
+  and runs hotword detection for all of them on one shared DetectionServer.
+
+  Every device gets its own MicrophoneReader, with its own stream
+  parameters, PortAudio callback, DeviceClock and overflow counts. A
+  callback only copies its block into its own reader's preallocated ring,
+  so the callbacks never wait for each other or for the detectors. Each
+  reader's thread then takes the blocks off its ring, downmixes them, hands
+  them to its own DetectionServer stream and pushes them into the
+  StreamAligner.
+
+  A device's detector is a stream of server(), found with stream(); the
+  devices of hotwordDetected() are already mapped back from the server's
+  streams.
+
+  Consumers that want the devices together, say to beamform across them,
+  read aligned blocks from aligner(). Detection runs at 16 kHz so every
+  device must be captured at that rate.
+*/
+class SPEECHRECOGNISER_EXPORT CaptureGroup : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit CaptureGroup(int threadCount = 0, QObject* parent = nullptr);
+  ~CaptureGroup() override;
+
+  bool setDetector(const QString& resourceFile,
+                   const QString& models,
+                   const QString& sensitivity = QString());
+  int addDevice(const CaptureSettings& settings);
+  int deviceCount() const;
+  MicrophoneReader* reader(int device) const;
+  int stream(int device) const;
+  int deviceOfStream(int stream) const;
+
+  void start();
+  void stop();
+
+  DetectionServer* server();
+  StreamAligner* aligner();
+
+signals:
+  void hotwordDetected(int device, int hotword);
+  void finished();
+
+private:
+  QString m_resourceFile;
+  QString m_models;
+  QString m_sensitivity;
+  QVector<QPointer<MicrophoneReader>> m_readers;
+  QVector<int> m_streams;
+  int m_running;
+  DetectionServer m_server;
+  StreamAligner m_aligner;
+
+  void receiveBlock(int device,
+                    MicrophoneReader* reader,
+                    const AudioBlock& block);
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // CAPTUREGROUP_H
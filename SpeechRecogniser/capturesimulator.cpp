@@ -0,0 +1,435 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QFile>
+#include <QTextStream>
+#include <QtDebug>
+
+#include <cmath>
+#include <limits>
+
+#include "audiosource.h"
+#include "beamformer.h"
+#include "capturesimulator.h"
+#include "detectionpipeline.h"
+
+namespace SpeechRecognition {
+
+// the simulated steady clock starts here, as capture time 0 means none.
+static const qint64 START_NS = 1000000000;
+// and the device's stream time here, as an ADC time of 0 means none.
+static const double STREAM_START = 1000.0;
+static const qint64 NEVER = std::numeric_limits<qint64>::max();
+
+/* The AudioSource the simulated callback sends its blocks through, so the
+   queue is counted exactly as it is for a MicrophoneReader.*/
+class CaptureSimulator::Source : public AudioSource
+{
+public:
+  Source(int channels, double sampleRate)
+    : m_channels(channels)
+    , m_sampleRate(sampleRate)
+  {}
+
+  void record() override {}
+  int channelCount() const override { return m_channels; }
+  double sampleRate() const override { return m_sampleRate; }
+  void overflow() { countOverflow(); }
+
+private:
+  int m_channels;
+  double m_sampleRate;
+};
+
+/*!
+  \brief Returns the name of kind, for the CSV.
+*/
+const char*
+SimulationEvent::kindName(Kind kind)
+{
+  static const char* const names[] = {
+    "callback", "host_overflow", "dropped", "consumed", "detection"
+  };
+  return names[kind];
+}
+
+/*!
+  \brief Creates a simulator of the device, scheduler and consumer in
+  config.
+*/
+CaptureSimulator::CaptureSimulator(const SimulationConfig& config)
+  : m_config(config)
+  , m_pipeline(nullptr)
+  , m_hotword(0)
+  , m_random(config.seed)
+{
+  m_config.channels = qMax(1, m_config.channels);
+  m_config.framesPerBuffer = qMax(1, m_config.framesPerBuffer);
+  m_config.hostBuffers = qMax(1, m_config.hostBuffers);
+  m_periodNs = m_config.framesPerBuffer * 1.0e9 / m_config.sampleRate /
+               (1.0 + m_config.clockDriftPpm * 1.0e-6);
+  m_input.resize(size_t(m_config.framesPerBuffer * m_config.channels));
+  m_mono.resize(size_t(m_config.framesPerBuffer));
+  m_source.reset(new Source(m_config.channels, m_config.sampleRate));
+
+  QObject::connect(
+    m_source.get(),
+    &AudioSource::sendBlock,
+    m_source.get(),
+    [this](const SpeechRecognition::AudioBlock& block) {
+      m_queue.push_back({ block, 0, 0 });
+    },
+    Qt::DirectConnection);
+}
+
+CaptureSimulator::~CaptureSimulator() {}
+
+SimulationConfig
+CaptureSimulator::config() const
+{
+  return m_config;
+}
+
+/*!
+  \brief Sets what the simulated microphone hears, interleaved with
+  config().channels channels. It is repeated for as long as the simulation
+  runs. Without audio the device captures silence.
+*/
+void
+CaptureSimulator::setAudio(const std::vector<float>& interleaved)
+{
+  m_audio = interleaved;
+}
+
+/*!
+  \brief Sets the pipeline the consumer passes each block through. Without
+  one the consumer only takes the time its real time factor gives it.
+*/
+void
+CaptureSimulator::setPipeline(DetectionPipeline* pipeline)
+{
+  m_pipeline = pipeline;
+}
+
+/*!
+  \brief Simulates seconds of capture from stream time zero, then lets the
+  consumer finish what is queued. A simulator is run once.
+*/
+void
+CaptureSimulator::run(double seconds)
+{
+  const qint64 end = START_NS + qint64(std::llround(seconds * 1.0e9));
+  quint64 buffer = 0;    // the next buffer the callback delivers
+  quint64 completed = 0; // the buffers the device has filled
+  qint64 consumerFree = START_NS;
+  qint64 consumerDone = NEVER;
+
+  auto schedule = [this](quint64 next, qint64 captureFree) {
+    qint64 delay = 0;
+
+    if (m_config.callbackJitterUs > 0) {
+      delay = qint64(random() % quint32(m_config.callbackJitterUs)) * 1000;
+    }
+
+    if (chance(m_config.callbackStallProbability)) {
+      delay += qint64(m_config.callbackStallMs) * 1000000;
+    }
+
+    return qMax(bufferDone(next) + delay, captureFree);
+  };
+
+  qint64 nextCallback = schedule(buffer, START_NS);
+
+  for (;;) {
+    qint64 nextConsumer = consumerDone;
+
+    if (nextConsumer == NEVER && !m_queue.empty()) {
+      nextConsumer = qMax(consumerFree, m_queue.front().readyAt);
+    }
+
+    const bool capturing = nextCallback < end;
+
+    if (!capturing && nextConsumer == NEVER) {
+      break;
+    }
+
+    // the callback goes first when both fall at the same time.
+    if (capturing && nextCallback <= nextConsumer) {
+      const qint64 time = nextCallback;
+      bool overflow = false;
+
+      while (bufferDone(completed) <= time) {
+        completed++;
+      }
+
+      if (completed - buffer > quint64(m_config.hostBuffers)) {
+        quint64 lost = completed - buffer - quint64(m_config.hostBuffers);
+        record(SimulationEvent::HostOverflow, time, buffer, 0, int(lost));
+        m_stats.lostBuffers += lost;
+        buffer += lost;
+        overflow = true;
+      }
+
+      callback(time, buffer, overflow);
+      buffer++;
+      nextCallback = schedule(
+        buffer, time + qint64(m_config.callbackCostUs) * 1000);
+
+    } else if (consumerDone != NEVER) {
+      finishConsuming(consumerDone);
+      consumerFree = consumerDone;
+      consumerDone = NEVER;
+
+    } else {
+      consumerDone = startConsuming(nextConsumer);
+    }
+  }
+
+  m_stats.overflows = m_source->overflowCount();
+}
+
+/*!
+  \brief Returns everything that happened, in time order.
+*/
+const std::vector<SimulationEvent>&
+CaptureSimulator::events() const
+{
+  return m_events;
+}
+
+SimulationStats
+CaptureSimulator::stats() const
+{
+  return m_stats;
+}
+
+/*!
+  \brief Returns a 64 bit FNV-1a hash of every field of every event, so two
+  runs can be compared bit for bit.
+*/
+quint64
+CaptureSimulator::digest() const
+{
+  quint64 hash = 14695981039346656037ull;
+
+  auto add = [&hash](quint64 value) {
+    for (int byte = 0; byte < 8; byte++) {
+      hash ^= (value >> (8 * byte)) & 0xff;
+      hash *= 1099511628211ull;
+    }
+  };
+
+  for (const SimulationEvent& event : m_events) {
+    add(quint64(event.kind));
+    add(quint64(event.time));
+    add(event.buffer);
+    add(quint64(event.captureTime));
+    add(quint64(qint64(event.queued)));
+    add(quint64(qint64(event.value)));
+  }
+
+  return hash;
+}
+
+/*!
+  \brief Writes the events as comma separated values.
+*/
+bool
+CaptureSimulator::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "event,time_ns,buffer,capture_time_ns,queued,value\n";
+
+  for (const SimulationEvent& e : m_events) {
+    out << SimulationEvent::kindName(e.kind) << ',' << e.time << ','
+        << e.buffer << ',' << e.captureTime << ',' << e.queued << ','
+        << e.value << '\n';
+  }
+
+  return true;
+}
+
+/* The same generator as FileAudioSource.*/
+quint32
+CaptureSimulator::random()
+{
+  m_random = m_random * 1664525u + 1013904223u;
+  return m_random;
+}
+
+/* Returns true with probability, drawing a number only if it is above 0 so
+   that turning a stall off leaves the other delays as they were.*/
+bool
+CaptureSimulator::chance(double probability)
+{
+  return probability > 0.0 &&
+         random() < quint32(probability * 4294967295.0);
+}
+
+/* Returns the steady time at which the device has filled buffer.*/
+qint64
+CaptureSimulator::bufferDone(quint64 buffer) const
+{
+  return START_NS + qint64(std::llround(double(buffer + 1) * m_periodNs));
+}
+
+/* Returns the device's stream time at a steady time, its clock runs from
+   the start of the simulation at its own rate.*/
+double
+CaptureSimulator::streamTime(qint64 time) const
+{
+  return STREAM_START + double(time - START_NS) * 1.0e-9 *
+                          (1.0 + m_config.clockDriftPpm * 1.0e-6);
+}
+
+/* Runs the callback for buffer at time, as recordCallback() would.*/
+void
+CaptureSimulator::callback(qint64 time, quint64 buffer, bool overflow)
+{
+  const int frames = m_config.framesPerBuffer;
+  const size_t count = m_input.size();
+
+  if (m_audio.empty()) {
+    std::fill(m_input.begin(), m_input.end(), 0.0f);
+
+  } else {
+    size_t from = size_t((buffer * count) % m_audio.size());
+
+    for (size_t i = 0; i < count; i++) {
+      m_input[i] = m_audio[(from + i) % m_audio.size()];
+    }
+  }
+
+  PaStreamCallbackTimeInfo timeInfo;
+  timeInfo.currentTime = streamTime(time);
+  timeInfo.inputBufferAdcTime =
+    (m_config.adcTimeReported
+       ? STREAM_START + double(buffer) * frames / m_config.sampleRate
+       : 0.0);
+  timeInfo.outputBufferDacTime = 0.0;
+
+  AudioBlock block(m_config.channels, frames);
+  MicrophoneReader::captureBlock(block,
+                                 m_input.data(),
+                                 &timeInfo,
+                                 m_config.inputLatency,
+                                 m_config.sampleRate,
+                                 &m_clock,
+                                 time);
+  m_stats.callbacks++;
+
+  if (overflow) {
+    m_source->overflow();
+  }
+
+  if (m_config.maxQueued > 0 &&
+      m_source->queuedSamples() > m_config.maxQueued) {
+    m_source->overflow();
+    m_stats.droppedBlocks++;
+    record(SimulationEvent::Dropped, time, buffer, block.captureTime(), 0);
+    return;
+  }
+
+  m_source->emitBlock(block);
+  m_queue.back().buffer = buffer;
+  m_queue.back().readyAt = time + qint64(m_config.handoffUs) * 1000;
+  record(SimulationEvent::Callback, time, buffer, block.captureTime(), 0);
+  m_stats.maxQueued = qMax(m_stats.maxQueued, m_source->queuedSamples());
+}
+
+/* Takes the first queued block at time and returns when the consumer is
+   done with it, as SpeechRecogniser::receiveBlock() would.*/
+qint64
+CaptureSimulator::startConsuming(qint64 time)
+{
+  m_current = m_queue.front();
+  m_queue.pop_front();
+  const AudioBlock& block = m_current.block;
+  m_hotword = 0;
+
+  if (m_pipeline) {
+    const float* mono = block.channel(0);
+
+    if (block.channels() > 1) {
+      downmix(block, m_mono.data());
+      mono = m_mono.data();
+    }
+
+    int backlog = m_source->queuedSamples() - block.frames();
+    m_hotword = m_pipeline->process(
+      mono, block.frames(), backlog, block.captureTime());
+  }
+
+  qint64 cost = qint64(std::llround(block.frames() * 1.0e9 /
+                                    m_config.sampleRate *
+                                    m_config.consumerRealTimeFactor));
+
+  if (chance(m_config.consumerStallProbability)) {
+    cost += qint64(m_config.consumerStallMs) * 1000000;
+  }
+
+  return time + cost;
+}
+
+/* Reports the block the consumer was working on as done at time.*/
+void
+CaptureSimulator::finishConsuming(qint64 time)
+{
+  const AudioBlock& block = m_current.block;
+  m_source->samplesConsumed(block.frames());
+  m_stats.consumedBlocks++;
+  record(SimulationEvent::Consumed,
+         time,
+         m_current.buffer,
+         block.captureTime(),
+         0);
+
+  if (m_hotword > 0) {
+    m_stats.detections++;
+    m_stats.maxLatencyMs = qMax(
+      m_stats.maxLatencyMs, double(time - block.captureTime()) * 1.0e-6);
+    record(SimulationEvent::Detection,
+           time,
+           m_current.buffer,
+           block.captureTime(),
+           m_hotword);
+  }
+}
+
+void
+CaptureSimulator::record(SimulationEvent::Kind kind,
+                         qint64 time,
+                         quint64 buffer,
+                         qint64 captureTime,
+                         int value)
+{
+  m_events.push_back(
+    { kind, time, buffer, captureTime, m_source->queuedSamples(), value });
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,197 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef CAPTURESIMULATOR_H
+#define CAPTURESIMULATOR_H
+
+#include <QString>
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+#include "audioblock.h"
+#include "deviceclock.h"
+#include "microphonereader.h"
+
+namespace SpeechRecognition {
+
+class DetectionPipeline;
+
+/*!
+  \brief The device, scheduler and consumer a CaptureSimulator simulates.
+  All random choices come from seed.
+*/
+struct SPEECHRECOGNISER_EXPORT SimulationConfig
+{
+  //! The seed of every random delay and stall.
+  quint32 seed = 1;
+  int channels = NUM_CHANNELS;
+  double sampleRate = SAMPLE_RATE;
+  int framesPerBuffer = FRAMES_PER_BUFFER;
+  //! The buffers the host holds for a late callback before it overflows.
+  int hostBuffers = 4;
+  //! How far the device's clock runs fast of the steady clock.
+  double clockDriftPpm = 0.0;
+  double inputLatency = 0.01;
+  //! False for host APIs that leave the ADC time at zero.
+  bool adcTimeReported = true;
+  //! The most a callback is woken late by the scheduler.
+  int callbackJitterUs = 500;
+  double callbackStallProbability = 0.0;
+  int callbackStallMs = 0;
+  int callbackCostUs = 20;
+  //! The time the queued signal takes to reach the consumer's thread.
+  int handoffUs = 100;
+  //! The consumer's time for a block, as a fraction of its duration.
+  double consumerRealTimeFactor = 0.05;
+  double consumerStallProbability = 0.0;
+  int consumerStallMs = 0;
+  //! Frames queued beyond which a block is dropped, 0 never drops, as
+  //! MicrophoneReader.
+  int maxQueued = 0;
+};
+
+/*!
+  \brief One thing that happened in a simulation. Times are simulated
+  steady clock nanoseconds.
+*/
+struct SPEECHRECOGNISER_EXPORT SimulationEvent
+{
+  enum Kind
+  {
+    Callback,
+    HostOverflow,
+    Dropped,
+    Consumed,
+    Detection,
+  };
+
+  Kind kind;
+  qint64 time;
+  //! The device buffer, counted from the start of the stream.
+  quint64 buffer;
+  //! The block's capture time, 0 for events without a block.
+  qint64 captureTime;
+  //! The frames sent that the consumer had not finished with afterwards.
+  int queued;
+  //! The buffers lost for HostOverflow, the hotword for Detection.
+  int value;
+
+  static const char* kindName(Kind kind);
+};
+
+/*!
+  \brief The totals of a simulation.
+*/
+struct SPEECHRECOGNISER_EXPORT SimulationStats
+{
+  quint64 callbacks = 0;
+  quint64 lostBuffers = 0;
+  quint64 overflows = 0;
+  quint64 droppedBlocks = 0;
+  quint64 consumedBlocks = 0;
+  quint64 detections = 0;
+  int maxQueued = 0;
+  double maxLatencyMs = 0.0;
+};
+
+/*!
+  \class CaptureSimulator
+  \brief The CaptureSimulator class drives the MicrophoneReader callback
+  path from a simulated clock, so that behaviour under load can be
+  repeated exactly.
+
+  A simulated device completes a buffer every framesPerBuffer frames. The
+  callback for it is woken late by a random delay, and now and then stalled
+  for longer, and runs MicrophoneReader::captureBlock() with the stream and
+  steady times of that moment, then hands the block on through a real
+  AudioSource, which keeps the queue depth. When the callback falls more
+  than hostBuffers behind, the host drops the oldest buffers and flags an
+  overflow, as PortAudio does. A simulated consumer takes the queued blocks
+  in order, each for a time set by its real time factor plus random
+  stalls, and passes them through a DetectionPipeline if one is given.
+
+  Everything happens on the calling thread in time order, with every
+  random choice taken from the seed, so the same configuration gives the
+  same events down to the nanosecond and the same digest() on any machine
+  with the same build.
+*/
+class SPEECHRECOGNISER_EXPORT CaptureSimulator
+{
+public:
+  explicit CaptureSimulator(
+    const SimulationConfig& config = SimulationConfig());
+  ~CaptureSimulator();
+
+  SimulationConfig config() const;
+  void setAudio(const std::vector<float>& interleaved);
+  void setPipeline(DetectionPipeline* pipeline);
+
+  void run(double seconds);
+  const std::vector<SimulationEvent>& events() const;
+  SimulationStats stats() const;
+  quint64 digest() const;
+  bool writeCsv(const QString& filename) const;
+
+private:
+  class Source;
+
+  struct Queued
+  {
+    AudioBlock block;
+    quint64 buffer;
+    qint64 readyAt;
+  };
+
+  SimulationConfig m_config;
+  std::vector<float> m_audio;
+  DetectionPipeline* m_pipeline;
+  std::unique_ptr<Source> m_source;
+  DeviceClock m_clock;
+  std::deque<Queued> m_queue;
+  std::vector<SimulationEvent> m_events;
+  SimulationStats m_stats;
+  std::vector<float> m_input;
+  std::vector<float> m_mono;
+  Queued m_current;
+  int m_hotword;
+  quint32 m_random;
+  double m_periodNs;
+
+  quint32 random();
+  bool chance(double probability);
+  qint64 bufferDone(quint64 buffer) const;
+  double streamTime(qint64 time) const;
+  void callback(qint64 time, quint64 buffer, bool overflow);
+  qint64 startConsuming(qint64 time);
+  void finishConsuming(qint64 time);
+  void record(SimulationEvent::Kind kind,
+              qint64 time,
+              quint64 buffer,
+              qint64 captureTime,
+              int value);
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // CAPTURESIMULATOR_H
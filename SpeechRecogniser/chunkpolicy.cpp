@@ -0,0 +1,135 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <algorithm>
+
+#include "chunkpolicy.h"
+
+namespace SpeechRecognition {
+
+/*!
+   \brief Creates a policy of the given mode.
+*/
+ChunkPolicy::ChunkPolicy(Mode mode, const ChunkPolicyConfig& config)
+  : m_mode(mode)
+{
+  setConfig(config);
+}
+
+/*!
+   \brief Returns the policy mode.
+*/
+ChunkPolicy::Mode
+ChunkPolicy::mode() const
+{
+  return m_mode;
+}
+
+/*!
+   \brief Sets the policy mode. This resets the current chunk size.
+*/
+void
+ChunkPolicy::setMode(Mode mode)
+{
+  m_mode = mode;
+  reset();
+}
+
+/*!
+   \brief Returns the chunk limits.
+*/
+ChunkPolicyConfig
+ChunkPolicy::config() const
+{
+  return m_config;
+}
+
+/*!
+   \brief Sets the chunk limits. This resets the current chunk size.
+
+   The maximum is raised to the minimum if it is smaller, and the fixed size
+   is clamped between the two.
+*/
+void
+ChunkPolicy::setConfig(const ChunkPolicyConfig& config)
+{
+  m_config = config;
+  m_config.minChunk = std::max(1, m_config.minChunk);
+  m_config.maxChunk = std::max(m_config.minChunk, m_config.maxChunk);
+  m_config.fixedChunk =
+    std::min(m_config.maxChunk, std::max(m_config.minChunk, m_config.fixedChunk));
+  reset();
+}
+
+/*!
+   \brief Returns the number of samples to pass to the next RunDetection()
+   call.
+*/
+int
+ChunkPolicy::chunkSize() const
+{
+  return m_chunkSize;
+}
+
+/*!
+   \brief Updates the chunk size after a detection.
+
+   \param detectionResult - the RunDetection() return value, -2 is silence and
+   anything else is treated as voice.
+   \param backlogSamples - the samples captured but not yet detected.
+*/
+void
+ChunkPolicy::update(int detectionResult, int backlogSamples)
+{
+  if (m_mode == Fixed) {
+    return;
+  }
+
+  bool behind = (backlogSamples > m_config.behindSamples);
+
+  if (detectionResult != -2 && !behind) {
+    // voice, get the rest of a possible hotword through as soon as possible.
+    m_silentRun = 0;
+    m_chunkSize = m_config.minChunk;
+    return;
+  }
+
+  if (detectionResult == -2) {
+    m_silentRun++;
+  }
+
+  if (behind || m_silentRun >= m_config.silenceChunks) {
+    m_chunkSize = std::min(m_config.maxChunk, m_chunkSize * 2);
+  }
+}
+
+/*!
+   \brief Returns to the starting chunk size, the minimum for Adaptive as
+   nothing is known about the audio yet.
+*/
+void
+ChunkPolicy::reset()
+{
+  m_silentRun = 0;
+  m_chunkSize = (m_mode == Fixed ? m_config.fixedChunk : m_config.minChunk);
+}
+
+} // end of namespace SpeechRecognition
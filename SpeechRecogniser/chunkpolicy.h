@@ -0,0 +1,88 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef CHUNKPOLICY_H
+#define CHUNKPOLICY_H
+
+#include "SpeechRecogniser_global.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \brief The limits used by ChunkPolicy, all in samples at the detector rate.
+
+  The defaults, at 16 kHz, are 50mS to 400mS with the snowboy suggested
+  100mS as the fixed size.
+*/
+struct SPEECHRECOGNISER_EXPORT ChunkPolicyConfig
+{
+  int minChunk = 800;
+  int maxChunk = 6400;
+  int fixedChunk = 1600;
+  //! Silent chunks in a row before the chunk starts to grow.
+  int silenceChunks = 3;
+  //! Queued samples above which the detector is considered to be behind.
+  int behindSamples = 3200;
+};
+
+/*!
+  \class ChunkPolicy
+  \brief The ChunkPolicy class decides how many captured samples are batched
+  into each RunDetection() call.
+
+  Snowboy costs less CPU per sample the larger the chunk, but a hotword is
+  only reported once the chunk holding its end is complete. The Adaptive
+  policy drops straight to the minimum chunk as soon as the detector reports
+  voice, and doubles it up to the maximum after a run of silent chunks or
+  whenever the detector falls behind the capture. Fixed always uses the
+  fixed chunk size.
+*/
+class SPEECHRECOGNISER_EXPORT ChunkPolicy
+{
+public:
+  enum Mode
+  {
+    Fixed,
+    Adaptive,
+  };
+
+  explicit ChunkPolicy(Mode mode = Adaptive,
+                       const ChunkPolicyConfig& config = ChunkPolicyConfig());
+
+  Mode mode() const;
+  void setMode(Mode mode);
+  ChunkPolicyConfig config() const;
+  void setConfig(const ChunkPolicyConfig& config);
+
+  int chunkSize() const;
+  void update(int detectionResult, int backlogSamples);
+  void reset();
+
+private:
+  Mode m_mode;
+  ChunkPolicyConfig m_config;
+  int m_chunkSize;
+  int m_silentRun;
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // CHUNKPOLICY_H
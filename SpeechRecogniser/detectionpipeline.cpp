@@ -0,0 +1,688 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QFile>
+#include <QObject>
+#include <QStringList>
+#include <QtDebug>
+
+#include <chrono>
+#include <cmath>
+
+#include "detectionpipeline.h"
+#include "deviceclock.h"
+#include "metrics.h"
+#include "realtimeaudit.h"
+#include "sampleconversion.h"
+#include "snowboy-detect.h"
+#include "tracing.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \brief Returns the seconds of audio processed.
+*/
+double
+PipelineLoad::seconds() const
+{
+  return double(samples) / sampleRate;
+}
+
+/*!
+  \brief Returns the real time factor of one stage.
+*/
+double
+PipelineLoad::realTimeFactor(Stage stage) const
+{
+  return (samples > 0 ? stageNs[stage] * 1.0e-9 / seconds() : 0.0);
+}
+
+/*!
+  \brief Returns the real time factor of the whole pipeline.
+*/
+double
+PipelineLoad::realTimeFactor() const
+{
+  double total = 0;
+
+  for (int stage = 0; stage < StageCount; stage++) {
+    total += realTimeFactor(Stage(stage));
+  }
+
+  return total;
+}
+
+/*!
+  \brief Returns the load between earlier, a copy taken from the same
+  pipeline, and this one.
+*/
+PipelineLoad
+PipelineLoad::since(const PipelineLoad& earlier) const
+{
+  PipelineLoad load = *this;
+
+  for (int stage = 0; stage < StageCount; stage++) {
+    load.stageNs[stage] -= earlier.stageNs[stage];
+  }
+
+  load.samples -= earlier.samples;
+  return load;
+}
+
+/*!
+  \brief Returns the name of stage, for reports.
+*/
+const char*
+PipelineLoad::stageName(Stage stage)
+{
+  static const char* const names[StageCount] = {
+    "echo",     "playback", "noise",      "gain",
+    "features", "vad",      "conversion", "detection"
+  };
+  return names[stage];
+}
+
+DetectionPipeline::DetectionPipeline()
+  : m_detector(nullptr)
+  , m_gateEnabled(false)
+  , m_echoEnabled(false)
+  , m_playbackEnabled(false)
+  , m_playbackSkipping(false)
+  , m_noiseEnabled(false)
+  , m_agcEnabled(false)
+  , m_featuresEnabled(false)
+  , m_detectorGain(1.0f)
+  , m_pendingStart(0)
+{}
+
+DetectionPipeline::~DetectionPipeline()
+{
+  delete m_detector;
+}
+
+/*!
+  \brief Loads the hotword detector. Returns false if any of the files are
+  missing.
+
+  \param resourceFile - the snowboy resource file, normally common.res.
+  \param models - a comma separated list of model files.
+  \param sensitivity - a comma separated list of sensitivities, one per
+  hotword. If empty the model defaults are used.
+*/
+bool
+DetectionPipeline::setDetector(const QString& resourceFile,
+                               const QString& models,
+                               const QString& sensitivity)
+{
+  // snowboy aborts on a missing file so check them all up front.
+  QStringList files = models.split(',');
+  files.prepend(resourceFile);
+
+  for (const QString& file : files) {
+    if (!QFile::exists(file)) {
+      qWarning() << QObject::tr("unable to find detector file %1.").arg(file);
+      return false;
+    }
+  }
+
+  delete m_detector;
+  m_detector = new snowboy::SnowboyDetect(resourceFile.toStdString(),
+                                          models.toStdString());
+
+  if (!sensitivity.isEmpty()) {
+    m_detector->SetSensitivity(sensitivity.toStdString());
+  }
+
+  m_gate.setSampleRate(m_detector->SampleRate());
+  m_echo.setSampleRate(m_detector->SampleRate());
+  m_playback.setSampleRate(m_detector->SampleRate());
+  m_noise.setSampleRate(m_detector->SampleRate());
+  m_agc.setSampleRate(m_detector->SampleRate());
+
+  // a new configuration starts a new ring, so only when it has to.
+  if (m_features.config().sampleRate != m_detector->SampleRate()) {
+    FeatureConfig features = m_features.config();
+    features.sampleRate = m_detector->SampleRate();
+    m_features.setConfig(features);
+  }
+
+  m_load.sampleRate = m_detector->SampleRate();
+  m_detectorGain = 1.0f;
+  reset();
+  return true;
+}
+
+/*!
+  \brief Returns the detector, or nullptr if none has been set.
+*/
+snowboy::SnowboyDetect*
+DetectionPipeline::detector() const
+{
+  return m_detector;
+}
+
+/*!
+  \brief Returns the policy used to batch blocks into detection chunks.
+*/
+ChunkPolicy
+DetectionPipeline::chunkPolicy() const
+{
+  return m_policy;
+}
+
+/*!
+  \brief Sets the policy used to batch blocks into detection chunks.
+*/
+void
+DetectionPipeline::setChunkPolicy(const ChunkPolicy& policy)
+{
+  m_policy = policy;
+}
+
+/*!
+  \brief Returns true if blocks pass through the energy gate. Defaults to
+  false.
+*/
+bool
+DetectionPipeline::isEnergyGateEnabled() const
+{
+  return m_gateEnabled;
+}
+
+/*!
+  \brief Enables or disables the energy gate in front of the detector.
+*/
+void
+DetectionPipeline::setEnergyGateEnabled(bool enabled)
+{
+  if (enabled != m_gateEnabled) {
+    m_gateEnabled = enabled;
+    m_gate.reset();
+  }
+}
+
+/*!
+  \brief Returns the energy gate, to set its thresholds or read its state.
+*/
+EnergyGate&
+DetectionPipeline::energyGate()
+{
+  return m_gate;
+}
+
+/*!
+  \brief Returns true if the echo of the device's playback is cancelled.
+  Defaults to false.
+*/
+bool
+DetectionPipeline::isEchoCancellerEnabled() const
+{
+  return m_echoEnabled;
+}
+
+/*!
+  \brief Enables or disables the echo canceller at the front of the
+  pipeline.
+*/
+void
+DetectionPipeline::setEchoCancellerEnabled(bool enabled)
+{
+  if (enabled != m_echoEnabled) {
+    m_echoEnabled = enabled;
+    m_echo.reset();
+  }
+}
+
+/*!
+  \brief Returns the echo canceller, to write the reference, tune it or read
+  its totals.
+*/
+EchoCanceller&
+DetectionPipeline::echoCanceller()
+{
+  return m_echo;
+}
+
+/*!
+  \brief Returns true if blocks are checked against the sounds being played.
+  Defaults to false.
+*/
+bool
+DetectionPipeline::isPlaybackGateEnabled() const
+{
+  return m_playbackEnabled;
+}
+
+/*!
+  \brief Enables or disables the playback gate in front of the energy gate.
+*/
+void
+DetectionPipeline::setPlaybackGateEnabled(bool enabled)
+{
+  if (enabled != m_playbackEnabled) {
+    m_playbackEnabled = enabled;
+    m_playbackSkipping = false;
+    m_playback.reset();
+  }
+}
+
+/*!
+  \brief Returns the playback gate, to schedule sounds, add prompts or read
+  its totals.
+*/
+PlaybackGate&
+DetectionPipeline::playbackGate()
+{
+  return m_playback;
+}
+
+/*!
+  \brief Returns true if background noise is suppressed before detection.
+  Defaults to false.
+*/
+bool
+DetectionPipeline::isNoiseSuppressorEnabled() const
+{
+  return m_noiseEnabled;
+}
+
+/*!
+  \brief Enables or disables the noise suppressor in front of the energy
+  gate.
+*/
+void
+DetectionPipeline::setNoiseSuppressorEnabled(bool enabled)
+{
+  if (enabled != m_noiseEnabled) {
+    m_noiseEnabled = enabled;
+    m_noise.reset();
+  }
+}
+
+/*!
+  \brief Returns the noise suppressor, to tune it or read its noise floor.
+*/
+NoiseSuppressor&
+DetectionPipeline::noiseSuppressor()
+{
+  return m_noise;
+}
+
+/*!
+  \brief Returns true if the speech level is controlled. Defaults to false.
+*/
+bool
+DetectionPipeline::isGainControlEnabled() const
+{
+  return m_agcEnabled;
+}
+
+/*!
+  \brief Enables or disables the automatic gain control in front of the
+  energy gate.
+*/
+void
+DetectionPipeline::setGainControlEnabled(bool enabled)
+{
+  if (enabled != m_agcEnabled) {
+    m_agcEnabled = enabled;
+    m_agc.reset();
+    setDetectorGain(1.0f);
+  }
+}
+
+/*!
+  \brief Returns the gain control, to set its mode and target or read the
+  gain.
+*/
+GainControl&
+DetectionPipeline::gainControl()
+{
+  return m_agc;
+}
+
+/*!
+  \brief Returns true if feature frames are computed. Defaults to false.
+*/
+bool
+DetectionPipeline::isFeatureExtractorEnabled() const
+{
+  return m_featuresEnabled;
+}
+
+/*!
+  \brief Enables or disables the feature extractor. It sees the audio after
+  the gain control, ahead of the energy gate, so its frames carry on while
+  the gate is closed.
+*/
+void
+DetectionPipeline::setFeatureExtractorEnabled(bool enabled)
+{
+  if (enabled != m_featuresEnabled) {
+    m_featuresEnabled = enabled;
+    m_features.reset();
+  }
+}
+
+/*!
+  \brief Returns the feature extractor, to configure it or to take its
+  ring().
+*/
+FeatureExtractor&
+DetectionPipeline::featureExtractor()
+{
+  return m_features;
+}
+
+/*!
+  \brief Processes one captured block of float samples in the range -1.0 to
+  1.0.
+
+  Returns the index of a hotword detected while processing the block, or 0 if
+  there was none.
+
+  \param backlogSamples - captured samples still queued behind this block,
+  used by the chunk policy to tell when detection is falling behind.
+  \param captureTime - the steady clock time of the first sample, used by the
+  echo canceller and the playback gate. Zero if the block is not timed.
+*/
+int
+DetectionPipeline::process(const float* data,
+                           int count,
+                           int backlogSamples,
+                           qint64 captureTime)
+{
+  if (!m_detector) {
+    return 0;
+  }
+
+  SR_TRACE_SCOPE("process", "dsp");
+  SR_REALTIME_SCOPE("DetectionPipeline::process");
+  m_stats.blocks++;
+  m_load.samples += quint64(count);
+
+  const bool cancel = m_echoEnabled && captureTime != 0;
+  const bool subtract =
+    m_playbackEnabled && m_playback.mode() == PlaybackGate::Subtract;
+  float* echoFree = nullptr;
+
+  // echo and noise removal and the gain work on a copy, the caller's block
+  // may be shared.
+  if (cancel || subtract || m_noiseEnabled || m_agcEnabled) {
+    m_echoFree.assign(data, data + count);
+    echoFree = m_echoFree.data();
+    data = echoFree;
+  }
+
+  qint64 mark = DeviceClock::steadyNow();
+
+  if (cancel) {
+    SR_TRACE_SCOPE("echo", "dsp");
+
+    if (!m_echo.process(echoFree, count, captureTime)) {
+      PipelineMetrics::instance().echoRejectedBlocks->add();
+    }
+
+    mark = lap(PipelineLoad::Echo, mark);
+  }
+
+  if (m_playbackEnabled) {
+    PlaybackGate::Result result =
+      m_playback.process(subtract ? echoFree : nullptr, count, captureTime);
+    mark = lap(PipelineLoad::Playback, mark);
+
+    if (result == PlaybackGate::Skipped) {
+      m_stats.playbackSkippedBlocks++;
+      m_stats.playbackSkippedSamples += quint64(count);
+
+      // whatever was heard before the sound started is cut short by it.
+      if (!m_playbackSkipping) {
+        m_playbackSkipping = true;
+        endUtterance();
+        m_gate.reset();
+      }
+
+      return 0;
+    }
+
+    m_playbackSkipping = false;
+  }
+
+  if (m_noiseEnabled) {
+    SR_TRACE_SCOPE("noise", "dsp");
+    m_noise.process(echoFree, count);
+    mark = lap(PipelineLoad::Noise, mark);
+  }
+
+  if (m_agcEnabled) {
+    SR_TRACE_SCOPE("gain", "dsp");
+    m_agc.process(echoFree, count);
+    mark = lap(PipelineLoad::Gain, mark);
+  }
+
+  if (m_featuresEnabled) {
+    SR_TRACE_SCOPE("features", "dsp");
+    m_features.process(data, count);
+    mark = lap(PipelineLoad::Features, mark);
+  }
+
+  if (m_gateEnabled) {
+    SR_TRACE_SCOPE("gate", "dsp");
+    EnergyGate::State state = m_gate.process(data, count);
+    mark = lap(PipelineLoad::Vad, mark);
+    countGate(state);
+
+    switch (state) {
+      case EnergyGate::Closed:
+        m_stats.gatedBlocks++;
+        return 0;
+
+      case EnergyGate::Closing:
+        m_stats.gatedBlocks++;
+        endUtterance();
+        return 0;
+
+      case EnergyGate::Opening:
+        append(m_gate.lookback().data(), int(m_gate.lookback().size()));
+        break;
+
+      case EnergyGate::Open:
+        break;
+    }
+  }
+
+  append(data, count);
+  mark = lap(PipelineLoad::Conversion, mark);
+  quint64 callsBefore = m_stats.detectionCalls;
+  int hotword = detect(backlogSamples);
+  lap(PipelineLoad::Detection, mark);
+
+  // the latency runs from the last sample captured to the detector's
+  // answer on it.
+  if (captureTime != 0 && m_stats.detectionCalls != callsBefore) {
+    qint64 captured =
+      captureTime + qint64(count) * 1000000000 / m_detector->SampleRate();
+    PipelineMetrics::instance().detectionLatency->observe(
+      double(DeviceClock::steadyNow() - captured) * 1.0e-9);
+  }
+
+  return hotword;
+}
+
+/*!
+  \brief Drops any part filled chunk and resets the detector, the chunk
+  policy, the energy gate, the playback gate, the echo canceller, the
+  noise suppressor, the gain control and any part filled feature frame.
+*/
+void
+DetectionPipeline::reset()
+{
+  endUtterance();
+  m_gate.reset();
+  m_echo.reset();
+  m_playback.reset();
+  m_playbackSkipping = false;
+  m_noise.reset();
+  m_agc.reset();
+  m_features.reset();
+  setDetectorGain(1.0f);
+}
+
+/*!
+  \brief Returns the running totals.
+*/
+DetectionStats
+DetectionPipeline::stats() const
+{
+  return m_stats;
+}
+
+/*!
+  \brief Returns the time spent in each stage and the audio processed since
+  the pipeline was created or resetLoad() was called.
+*/
+PipelineLoad
+DetectionPipeline::load() const
+{
+  return m_load;
+}
+
+/*!
+  \brief Clears the stage times and the audio count.
+*/
+void
+DetectionPipeline::resetLoad()
+{
+  int sampleRate = m_load.sampleRate;
+  m_load = PipelineLoad();
+  m_load.sampleRate = sampleRate;
+}
+
+void
+DetectionPipeline::append(const float* data, int count)
+{
+  size_t start = m_pending.size();
+  m_pending.resize(start + size_t(count));
+  convertSamples<SampleFormat::Float32, SampleFormat::Int16>(
+    data, m_pending.data() + start, size_t(count));
+}
+
+int
+DetectionPipeline::detect(int backlogSamples)
+{
+  const PipelineMetrics& metrics = PipelineMetrics::instance();
+  int hotword = 0;
+  int chunk = m_policy.chunkSize();
+
+  while (m_pending.size() - m_pendingStart >= size_t(chunk)) {
+    SR_TRACE_SCOPE("RunDetection", "detection");
+    if (m_agcEnabled && m_agc.mode() == GainControl::Detector) {
+      setDetectorGain(m_agc.gain());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int result;
+
+    {
+      // whatever snowboy allocates is out of our hands, count it apart.
+      SR_REALTIME_ALLOW();
+      result =
+        m_detector->RunDetection(m_pending.data() + m_pendingStart, chunk);
+    }
+
+    std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+    m_pendingStart += size_t(chunk);
+    m_stats.detectionCalls++;
+    metrics.detectionCalls->add();
+    metrics.detectionSeconds->observe(elapsed.count());
+    m_stats.detectedSamples += quint64(chunk);
+
+    if (result > 0) {
+      m_stats.hotwords++;
+      hotword = result;
+
+    } else if (result == -1) {
+      qWarning() << QObject::tr("hotword detection failed.");
+    }
+
+    int backlog = int(m_pending.size() - m_pendingStart) + backlogSamples;
+    m_policy.update(result, backlog);
+    chunk = m_policy.chunkSize();
+  }
+
+  // keep the left over samples at the front of the buffer.
+  m_pending.erase(m_pending.begin(), m_pending.begin() + long(m_pendingStart));
+  m_pendingStart = 0;
+  return hotword;
+}
+
+void
+DetectionPipeline::endUtterance()
+{
+  m_pending.clear();
+  m_pendingStart = 0;
+  m_policy.reset();
+
+  if (m_detector) {
+    m_detector->Reset();
+  }
+}
+
+/* Counts one block through the energy gate in the process wide metrics.*/
+void
+DetectionPipeline::countGate(EnergyGate::State state)
+{
+  const PipelineMetrics& metrics = PipelineMetrics::instance();
+  metrics.vadBlocks->add();
+
+  if (state == EnergyGate::Opening || state == EnergyGate::Open) {
+    metrics.vadSpeechBlocks->add();
+  }
+
+  unsigned long long total = m_gate.blocksPassed() + m_gate.blocksGated();
+
+  if (total > 0) {
+    metrics.vadRatio->set(double(m_gate.blocksPassed()) / double(total));
+  }
+}
+
+/* Adds the time from since to now to stage and returns now, the start of
+   the next stage.*/
+qint64
+DetectionPipeline::lap(PipelineLoad::Stage stage, qint64 since)
+{
+  qint64 now = DeviceClock::steadyNow();
+  m_load.stageNs[stage] += now - since;
+  return now;
+}
+
+/* Passes a gain to the detector, skipping changes too small to hear.*/
+void
+DetectionPipeline::setDetectorGain(float gain)
+{
+  if (m_detector && std::fabs(gain - m_detectorGain) > 0.01f * m_detectorGain) {
+    m_detector->SetAudioGain(gain);
+    m_detectorGain = gain;
+  }
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,208 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef DETECTIONPIPELINE_H
+#define DETECTIONPIPELINE_H
+
+#include <QString>
+
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+#include "chunkpolicy.h"
+#include "echocanceller.h"
+#include "energygate.h"
+#include "featureextractor.h"
+#include "gaincontrol.h"
+#include "noisesuppressor.h"
+#include "playbackgate.h"
+
+namespace snowboy {
+class SnowboyDetect;
+}
+
+namespace SpeechRecognition {
+
+/*!
+  \brief Running totals kept by DetectionPipeline.
+*/
+struct DetectionStats
+{
+  quint64 blocks = 0;
+  quint64 gatedBlocks = 0;
+  quint64 detectionCalls = 0;
+  quint64 detectedSamples = 0;
+  quint64 hotwords = 0;
+  quint64 playbackSkippedBlocks = 0;
+  quint64 playbackSkippedSamples = 0;
+};
+
+/*!
+  \brief The time DetectionPipeline has spent in each of its stages and the
+  audio it has taken, from which the real time factor of each follows.
+
+  A real time factor is the processing time over the audio time, so 0.01
+  is one percent of a core.
+*/
+struct SPEECHRECOGNISER_EXPORT PipelineLoad
+{
+  enum Stage
+  {
+    Echo,
+    Playback,
+    Noise,
+    Gain,
+    Features,
+    Vad,
+    Conversion,
+    Detection,
+    StageCount,
+  };
+
+  qint64 stageNs[StageCount] = {};
+  quint64 samples = 0;
+  int sampleRate = 16000;
+
+  double seconds() const;
+  double realTimeFactor(Stage stage) const;
+  double realTimeFactor() const;
+  PipelineLoad since(const PipelineLoad& earlier) const;
+  static const char* stageName(Stage stage);
+};
+
+/*!
+  \class DetectionPipeline
+  \brief The DetectionPipeline class takes captured float blocks through to
+  hotword detection.
+
+  Each block optionally passes the EnergyGate first. Blocks the gate lets
+  through are converted to 16 bit and batched into chunks sized by the
+  ChunkPolicy, which are then run through the detector. When the gate closes
+  the detector is reset, which snowboy expects at the end of every segment
+  found by an external VAD.
+
+  Ahead of the energy gate an optional GainControl brings speech to a
+  steady level, either on the samples or through the detector's own audio
+  gain, set between chunks. Ahead of that an optional NoiseSuppressor
+  removes steady background noise, and ahead of that an optional
+  PlaybackGate drops, or removes the echo from, blocks captured while the
+  device's own feedback sounds play. Ahead of that an optional
+  EchoCanceller removes the echo of anything the device plays, given what
+  it plays through EchoCanceller::writeReference(). Timed blocks that are
+  not a whole number of canceller blocks pass through it untouched and are
+  counted in PipelineMetrics::echoRejectedBlocks.
+
+  Alongside the gate an optional FeatureExtractor computes log mel and
+  MFCC frames from the same audio into its FeatureRing, once for the
+  stream, for voice activity detection, analytics or our own detectors to
+  read.
+
+  Detector calls, their time and latency and the energy gate's decisions
+  are also counted in the process wide PipelineMetrics. The time spent in
+  each stage is kept in a PipelineLoad.
+
+  This is the processing SpeechRecogniser does on its thread, kept separate
+  so that it can be driven directly by replay tools and benchmarks.
+*/
+class SPEECHRECOGNISER_EXPORT DetectionPipeline
+{
+public:
+  DetectionPipeline();
+  ~DetectionPipeline();
+
+  DetectionPipeline(const DetectionPipeline&) = delete;
+  DetectionPipeline& operator=(const DetectionPipeline&) = delete;
+
+  bool setDetector(const QString& resourceFile,
+                   const QString& models,
+                   const QString& sensitivity = QString());
+  snowboy::SnowboyDetect* detector() const;
+
+  ChunkPolicy chunkPolicy() const;
+  void setChunkPolicy(const ChunkPolicy& policy);
+
+  bool isEnergyGateEnabled() const;
+  void setEnergyGateEnabled(bool enabled);
+  EnergyGate& energyGate();
+
+  bool isEchoCancellerEnabled() const;
+  void setEchoCancellerEnabled(bool enabled);
+  EchoCanceller& echoCanceller();
+
+  bool isPlaybackGateEnabled() const;
+  void setPlaybackGateEnabled(bool enabled);
+  PlaybackGate& playbackGate();
+
+  bool isNoiseSuppressorEnabled() const;
+  void setNoiseSuppressorEnabled(bool enabled);
+  NoiseSuppressor& noiseSuppressor();
+
+  bool isGainControlEnabled() const;
+  void setGainControlEnabled(bool enabled);
+  GainControl& gainControl();
+
+  bool isFeatureExtractorEnabled() const;
+  void setFeatureExtractorEnabled(bool enabled);
+  FeatureExtractor& featureExtractor();
+
+  int process(const float* data,
+              int count,
+              int backlogSamples = 0,
+              qint64 captureTime = 0);
+  void reset();
+  DetectionStats stats() const;
+  PipelineLoad load() const;
+  void resetLoad();
+
+private:
+  snowboy::SnowboyDetect* m_detector;
+  ChunkPolicy m_policy;
+  EnergyGate m_gate;
+  bool m_gateEnabled;
+  EchoCanceller m_echo;
+  bool m_echoEnabled;
+  PlaybackGate m_playback;
+  bool m_playbackEnabled;
+  bool m_playbackSkipping;
+  NoiseSuppressor m_noise;
+  bool m_noiseEnabled;
+  GainControl m_agc;
+  bool m_agcEnabled;
+  FeatureExtractor m_features;
+  bool m_featuresEnabled;
+  float m_detectorGain;
+  std::vector<float> m_echoFree;
+  std::vector<int16_t> m_pending;
+  size_t m_pendingStart;
+  DetectionStats m_stats;
+  PipelineLoad m_load;
+
+  void append(const float* data, int count);
+  int detect(int backlogSamples);
+  void endUtterance();
+  void countGate(EnergyGate::State state);
+  qint64 lap(PipelineLoad::Stage stage, qint64 since);
+  void setDetectorGain(float gain);
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // DETECTIONPIPELINE_H
@@ -0,0 +1,387 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QFile>
+#include <QStringList>
+
+#include <chrono>
+#include <deque>
+
+#include "detectionserver.h"
+#include "realtimeaudit.h"
+#include "sampleconversion.h"
+#include "snowboy-detect.h"
+
+namespace SpeechRecognition {
+
+struct DetectionServer::Stream
+{
+  struct Chunk
+  {
+    std::vector<int16_t> samples;
+    quint64 sequence;
+    qint64 enqueuedNs;
+  };
+
+  int index;
+  std::unique_ptr<snowboy::SnowboyDetect> detector;
+  std::mutex mutex;
+  std::deque<Chunk> pending;
+  bool scheduled = false;
+  bool resetPending = false;
+  quint64 nextSequence = 0;
+  std::atomic<quint64> processed{ 0 };
+  std::atomic<quint64> dropped{ 0 };
+  std::atomic<qint64> busyNs{ 0 };
+  std::atomic<quint64> samples{ 0 };
+};
+
+/*!
+   \brief Creates a server with a pool of threadCount workers.
+
+   If threadCount is zero or less the pool is sized to the number of cores.
+*/
+DetectionServer::DetectionServer(int threadCount, QObject* parent)
+  : QObject(parent)
+  , m_maxPendingChunks(8)
+  , m_chunksPerTask(4)
+  , m_inFlight(0)
+  , m_pool(threadCount)
+{}
+
+DetectionServer::~DetectionServer() {}
+
+/*!
+   \brief Adds a stream with its own detector and returns the stream index,
+   or -1 if the detector could not be created.
+
+   \param resourceFile - the snowboy resource file, normally common.res.
+   \param models - a comma separated list of model files.
+   \param sensitivity - a comma separated list of sensitivities, one per
+   hotword. If empty the model defaults are used.
+*/
+int
+DetectionServer::addStream(const QString& resourceFile,
+                           const QString& models,
+                           const QString& sensitivity)
+{
+  // snowboy aborts on a missing file so check them all up front.
+  QStringList files = models.split(',');
+  files.prepend(resourceFile);
+
+  for (const QString& file : files) {
+    if (!QFile::exists(file)) {
+      qWarning() << tr("unable to find detector file %1.").arg(file);
+      return -1;
+    }
+  }
+
+  std::unique_ptr<Stream> stream(new Stream);
+  stream->index = int(m_streams.size());
+  stream->detector.reset(new snowboy::SnowboyDetect(
+    resourceFile.toStdString(), models.toStdString()));
+
+  if (!sensitivity.isEmpty()) {
+    stream->detector->SetSensitivity(sensitivity.toStdString());
+  }
+
+  m_streams.push_back(std::move(stream));
+  return int(m_streams.size()) - 1;
+}
+
+/*!
+   \brief Returns the number of streams added.
+*/
+int
+DetectionServer::streamCount() const
+{
+  return int(m_streams.size());
+}
+
+/*!
+   \brief Returns the number of worker threads in the pool.
+*/
+int
+DetectionServer::threadCount() const
+{
+  return m_pool.threadCount();
+}
+
+/*!
+   \brief Returns the maximum number of chunks a stream may have waiting
+   before the oldest are dropped. Defaults to 8.
+*/
+int
+DetectionServer::maxPendingChunks() const
+{
+  return m_maxPendingChunks;
+}
+
+/*!
+   \brief Sets the maximum number of chunks a stream may have waiting. This
+   bounds the worst case latency of a stream to this many chunks.
+*/
+void
+DetectionServer::setMaxPendingChunks(int maxPendingChunks)
+{
+  m_maxPendingChunks = qMax(1, maxPendingChunks);
+}
+
+/*!
+   \brief Returns the number of chunks a stream task detects before yielding
+   its worker to other streams. Defaults to 4.
+*/
+int
+DetectionServer::chunksPerTask() const
+{
+  return m_chunksPerTask;
+}
+
+/*!
+   \brief Sets the number of chunks a stream task detects before yielding.
+
+   Larger values cost less scheduling but let a busy stream hold a worker
+   longer.
+*/
+void
+DetectionServer::setChunksPerTask(int chunksPerTask)
+{
+  m_chunksPerTask = qMax(1, chunksPerTask);
+}
+
+/*!
+   \brief Sets a handler that is called on the worker thread after every
+   detection. It must be set before data is pushed and must be thread safe.
+*/
+void
+DetectionServer::setResultHandler(ResultHandler handler)
+{
+  m_resultHandler = std::move(handler);
+}
+
+/*!
+   \brief Queues a chunk of 16 bit samples for detection on a stream.
+
+   Returns false if the stream does not exist.
+*/
+bool
+DetectionServer::pushData(int stream, const int16_t* data, int count)
+{
+  if (stream < 0 || stream >= int(m_streams.size()) || count <= 0) {
+    return false;
+  }
+
+  Stream* s = m_streams[size_t(stream)].get();
+  Stream::Chunk chunk;
+  chunk.samples.assign(data, data + count);
+  chunk.enqueuedNs = now();
+  bool schedule = false;
+
+  {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    chunk.sequence = s->nextSequence++;
+    m_inFlight++;
+
+    while (int(s->pending.size()) >= m_maxPendingChunks) {
+      s->pending.pop_front();
+      s->resetPending = true;
+      s->dropped++;
+      chunkDone();
+    }
+
+    s->pending.push_back(std::move(chunk));
+
+    if (!s->scheduled) {
+      s->scheduled = true;
+      schedule = true;
+    }
+  }
+
+  if (schedule) {
+    m_pool.submit([this, s] { drain(s); });
+  }
+
+  return true;
+}
+
+/*!
+   \brief Queues a chunk of float samples in the range -1.0 to 1.0 for
+   detection on a stream.
+
+   Returns false if the stream does not exist.
+*/
+bool
+DetectionServer::pushData(int stream, const QVector<float>& data)
+{
+  std::vector<int16_t> samples(size_t(data.size()));
+  convertSamples<SampleFormat::Float32, SampleFormat::Int16>(
+    data.constData(), samples.data(), samples.size());
+
+  return pushData(stream, samples.data(), int(samples.size()));
+}
+
+/*!
+   \brief Returns the number of chunks detected on a stream so far.
+*/
+quint64
+DetectionServer::processedChunks(int stream) const
+{
+  return m_streams[size_t(stream)]->processed;
+}
+
+/*!
+   \brief Returns the number of chunks dropped from a stream because it fell
+   too far behind.
+*/
+quint64
+DetectionServer::droppedChunks(int stream) const
+{
+  return m_streams[size_t(stream)]->dropped;
+}
+
+/*!
+   \brief Returns the time a stream's detector has spent over the duration
+   of the audio it has detected, 0.01 being one percent of a core.
+*/
+double
+DetectionServer::realTimeFactor(int stream) const
+{
+  const Stream* s = m_streams[size_t(stream)].get();
+  quint64 samples = s->samples;
+
+  if (samples == 0) {
+    return 0.0;
+  }
+
+  double seconds = double(samples) / s->detector->SampleRate();
+  return s->busyNs * 1.0e-9 / seconds;
+}
+
+/*!
+   \brief Blocks until every chunk pushed so far has been detected or dropped.
+*/
+void
+DetectionServer::waitForIdle()
+{
+  std::unique_lock<std::mutex> lock(m_idleMutex);
+  m_idle.wait(lock, [this] { return m_inFlight.load() == 0; });
+}
+
+/*!
+   \brief Returns the steady clock time in nanoseconds, the time base of
+   DetectionResult.
+*/
+qint64
+DetectionServer::now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+void
+DetectionServer::chunkDone()
+{
+  if (--m_inFlight == 0) {
+    std::lock_guard<std::mutex> lock(m_idleMutex);
+    m_idle.notify_all();
+  }
+}
+
+/* Runs up to chunksPerTask() chunks of one stream. Only one drain per stream
+   is ever queued or running, which is what keeps the chunks in order.*/
+void
+DetectionServer::drain(Stream* stream)
+{
+  int budget = m_chunksPerTask;
+
+  for (int i = 0; i < budget; i++) {
+    Stream::Chunk chunk;
+    bool reset;
+
+    {
+      std::lock_guard<std::mutex> lock(stream->mutex);
+
+      if (stream->pending.empty()) {
+        stream->scheduled = false;
+        return;
+      }
+
+      chunk = std::move(stream->pending.front());
+      stream->pending.pop_front();
+      reset = stream->resetPending;
+      stream->resetPending = false;
+    }
+
+    DetectionResult result;
+
+    // emitting the result and waking waitForIdle() come after the real time
+    // part, the wake takes a lock.
+    {
+      SR_REALTIME_SCOPE("DetectionServer::drain");
+
+      if (reset) {
+        stream->detector->Reset();
+      }
+
+      result.stream = stream->index;
+      result.sequence = chunk.sequence;
+      result.enqueuedNs = chunk.enqueuedNs;
+      result.startedNs = now();
+
+      {
+        SR_REALTIME_ALLOW();
+        result.result = stream->detector->RunDetection(
+          chunk.samples.data(), int(chunk.samples.size()));
+      }
+
+      result.finishedNs = now();
+      stream->processed++;
+      stream->busyNs += result.finishedNs - result.startedNs;
+      stream->samples += chunk.samples.size();
+
+      if (m_resultHandler) {
+        m_resultHandler(result);
+      }
+    }
+
+    if (result.result > 0) {
+      emit hotwordDetected(stream->index, result.result);
+    }
+
+    chunkDone();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(stream->mutex);
+
+    if (stream->pending.empty()) {
+      stream->scheduled = false;
+      return;
+    }
+  }
+
+  // still behind, go to the back of this worker's queue so other streams get
+  // a turn (or a thief picks us up).
+  m_pool.defer([this, stream] { drain(stream); });
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,130 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef DETECTIONSERVER_H
+#define DETECTIONSERVER_H
+
+#include <QObject>
+#include <QVector>
+#include <QtDebug>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+#include "workstealingpool.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \brief The outcome of one RunDetection() call on one stream chunk.
+
+  All times are steady clock nanoseconds.
+*/
+struct DetectionResult
+{
+  int stream;
+  quint64 sequence;
+  int result;
+  qint64 enqueuedNs;
+  qint64 startedNs;
+  qint64 finishedNs;
+};
+
+/*!
+  \class DetectionServer
+  \brief The DetectionServer class runs hotword detection for many audio
+  streams on one shared WorkStealingPool.
+
+  Each stream owns its own SnowboyDetect and a small queue of pending chunks.
+  At most one task per stream is ever queued or running, so the chunks of a
+  stream are always detected in the order they were pushed, while different
+  streams run in parallel on whichever worker is free.
+
+  Latency is bounded in two ways. A stream task handles at most
+  chunksPerTask() chunks before yielding its worker to other streams, and a
+  stream never holds more than maxPendingChunks() chunks. When a stream falls
+  further behind than that the oldest chunks are dropped, the drop is counted
+  and the detector is reset before the next chunk as the audio is no longer
+  continuous.
+
+  Audio must already be in the detector format, 16 kHz mono. All streams must
+  be added before data is pushed.
+*/
+class SPEECHRECOGNISER_EXPORT DetectionServer : public QObject
+{
+  Q_OBJECT
+
+public:
+  using ResultHandler = std::function<void(const DetectionResult&)>;
+
+  explicit DetectionServer(int threadCount = 0, QObject* parent = nullptr);
+  ~DetectionServer() override;
+
+  int addStream(const QString& resourceFile,
+                const QString& models,
+                const QString& sensitivity = QString());
+  int streamCount() const;
+  int threadCount() const;
+
+  int maxPendingChunks() const;
+  void setMaxPendingChunks(int maxPendingChunks);
+  int chunksPerTask() const;
+  void setChunksPerTask(int chunksPerTask);
+  void setResultHandler(ResultHandler handler);
+
+  bool pushData(int stream, const int16_t* data, int count);
+  bool pushData(int stream, const QVector<float>& data);
+
+  quint64 processedChunks(int stream) const;
+  quint64 droppedChunks(int stream) const;
+  double realTimeFactor(int stream) const;
+  void waitForIdle();
+
+  static qint64 now();
+
+signals:
+  void hotwordDetected(int stream, int hotword);
+
+private:
+  struct Stream;
+
+  std::vector<std::unique_ptr<Stream>> m_streams;
+  std::atomic<int> m_maxPendingChunks;
+  std::atomic<int> m_chunksPerTask;
+  ResultHandler m_resultHandler;
+  std::atomic<qint64> m_inFlight;
+  std::mutex m_idleMutex;
+  std::condition_variable m_idle;
+  // declared last so the workers are joined before the streams they use go.
+  WorkStealingPool m_pool;
+
+  void drain(Stream* stream);
+  void chunkDone();
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // DETECTIONSERVER_H
@@ -0,0 +1,125 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <chrono>
+#include <cmath>
+
+#include "deviceclock.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \brief Creates a clock that refreshes its offset every window callbacks.
+*/
+DeviceClock::DeviceClock(int window)
+  : m_window(window > 0 ? window : 1)
+  , m_count(0)
+  , m_windowMin(0)
+  , m_offset(0)
+  , m_valid(false)
+{}
+
+/*!
+  \brief Pairs the stream time reported to the current callback with the
+  steady clock now.
+*/
+void
+DeviceClock::update(double streamTime)
+{
+  update(streamTime, steadyNow());
+}
+
+/*!
+  \brief Pairs the stream time reported to the current callback with
+  steadyTime, for callbacks driven from a simulated clock.
+*/
+void
+DeviceClock::update(double streamTime, qint64 steadyTime)
+{
+  qint64 measured = steadyTime - qint64(std::llround(streamTime * 1.0e9));
+
+  if (m_count == 0 || measured < m_windowMin) {
+    m_windowMin = measured;
+  }
+
+  // the first callback sets the offset straight away, after that it only
+  // moves once per window.
+  if (!m_valid) {
+    m_offset = measured;
+    m_valid = true;
+  }
+
+  if (++m_count >= m_window) {
+    m_offset = m_windowMin;
+    m_count = 0;
+  }
+}
+
+/*!
+  \brief Returns a stream time as steady clock nanoseconds.
+*/
+qint64
+DeviceClock::toSteady(double streamTime) const
+{
+  return qint64(std::llround(streamTime * 1.0e9)) + m_offset.load();
+}
+
+/*!
+  \brief Returns the steady clock time at stream time zero, in nanoseconds.
+*/
+qint64
+DeviceClock::offset() const
+{
+  return m_offset;
+}
+
+/*!
+  \brief Returns true once update() has been called.
+*/
+bool
+DeviceClock::isValid() const
+{
+  return m_valid;
+}
+
+/*!
+  \brief Forgets the offset, for when the stream is reopened.
+*/
+void
+DeviceClock::reset()
+{
+  m_count = 0;
+  m_valid = false;
+  m_offset = 0;
+}
+
+/*!
+  \brief Returns the steady clock time in nanoseconds.
+*/
+qint64
+DeviceClock::steadyNow()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+} // end of namespace SpeechRecognition
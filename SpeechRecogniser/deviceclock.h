@@ -0,0 +1,73 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef DEVICECLOCK_H
+#define DEVICECLOCK_H
+
+#include <QtGlobal>
+
+#include <atomic>
+
+#include "SpeechRecogniser_global.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \class DeviceClock
+  \brief The DeviceClock class maps one audio device's stream time onto the
+  steady clock.
+
+  Every PortAudio stream has its own time base, which on some host APIs runs
+  from the sound card's own crystal. Each callback reports the stream time
+  it was called at, and update() pairs that with the steady clock. The
+  callback always runs a little after its stream time was read, so the
+  smallest difference seen over a window of callbacks is the best estimate
+  of the offset. Starting a new window every so often follows any drift
+  between the two clocks.
+
+  update() must only be called from the one capture thread. offset() and
+  toSteady() may be called from anywhere.
+*/
+class SPEECHRECOGNISER_EXPORT DeviceClock
+{
+public:
+  explicit DeviceClock(int window = 64);
+
+  void update(double streamTime);
+  void update(double streamTime, qint64 steadyTime);
+  qint64 toSteady(double streamTime) const;
+  qint64 offset() const;
+  bool isValid() const;
+  void reset();
+
+  static qint64 steadyNow();
+
+private:
+  int m_window;
+  int m_count;
+  qint64 m_windowMin;
+  std::atomic<qint64> m_offset;
+  std::atomic<bool> m_valid;
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // DEVICECLOCK_H
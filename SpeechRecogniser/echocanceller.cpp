@@ -0,0 +1,436 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "echocanceller.h"
+
+namespace SpeechRecognition {
+
+/*!
+   \brief Creates a canceller for audio at sampleRate.
+*/
+EchoCanceller::EchoCanceller(int sampleRate, const EchoCancellerConfig& config)
+  : m_sampleRate(sampleRate)
+  , m_written(0)
+  , m_origin(0)
+  , m_blocks(0)
+  , m_adapted(0)
+  , m_doubleTalk(0)
+  , m_rejected(0)
+  , m_captureEnergy(0.0)
+  , m_outputEnergy(0.0)
+{
+  setConfig(config);
+}
+
+EchoCancellerConfig
+EchoCanceller::config() const
+{
+  return m_config;
+}
+
+/*!
+   \brief Sets the configuration and starts learning the echo path again.
+   The block size is rounded up to a power of two.
+
+   This allocates, so it must not be called while either process() or
+   writeReference() may be running.
+*/
+void
+EchoCanceller::setConfig(const EchoCancellerConfig& config)
+{
+  m_config = config;
+  m_fft = Fft(2 * qMax(8, config.blockSize));
+  m_blockSize = m_fft.size() / 2;
+  m_bins = m_fft.bins();
+  int tail = qMax(1, config.tailMs) * m_sampleRate / 1000;
+  m_partitions = qMax(1, (tail + m_blockSize - 1) / m_blockSize);
+
+  size_t spectra = size_t(m_partitions * m_bins);
+  m_history.assign(size_t(2 * m_blockSize), 0.0f);
+  m_time.assign(size_t(2 * m_blockSize), 0.0f);
+  m_referenceRe.assign(spectra, 0.0f);
+  m_referenceIm.assign(spectra, 0.0f);
+  m_referencePower.assign(spectra, 0.0f);
+  m_filterRe.assign(spectra, 0.0f);
+  m_filterIm.assign(spectra, 0.0f);
+  m_power.assign(size_t(m_bins), 0.0f);
+  m_step.assign(size_t(m_bins), 0.0f);
+  m_echoRe.assign(size_t(m_bins), 0.0f);
+  m_echoIm.assign(size_t(m_bins), 0.0f);
+  m_errorRe.assign(size_t(m_bins), 0.0f);
+  m_errorIm.assign(size_t(m_bins), 0.0f);
+  m_peaks.assign(size_t(m_partitions), 0.0f);
+  m_aligned.assign(size_t(m_blockSize), 0.0f);
+
+  // a second of reference, far more than any capture queue holds.
+  size_t ring = 1024;
+
+  while (ring < size_t(m_sampleRate)) {
+    ring *= 2;
+  }
+
+  m_ring.assign(ring, 0.0f);
+  m_written = 0;
+  reset();
+}
+
+/*!
+   \brief Sets the sample rate of the capture and reference, which resizes
+   the filter to keep the same tail.
+*/
+void
+EchoCanceller::setSampleRate(int sampleRate)
+{
+  if (sampleRate != m_sampleRate) {
+    m_sampleRate = sampleRate;
+    setConfig(m_config);
+  }
+}
+
+/*!
+   \brief Returns the number of blocks the echo path is split into.
+*/
+int
+EchoCanceller::partitions() const
+{
+  return m_partitions;
+}
+
+/*!
+   \brief Adds count samples of what the device is playing, the first of
+   which reaches the speaker at time, in steady clock nanoseconds.
+
+   This never blocks or allocates and may be called from the playback
+   callback, but only ever from one thread at a time. A pause in the
+   reference is filled with silence.
+*/
+void
+EchoCanceller::writeReference(const float* data, int count, qint64 time)
+{
+  const size_t mask = m_ring.size() - 1;
+  quint64 written = m_written.load(std::memory_order_relaxed);
+  qint64 origin = m_origin.load(std::memory_order_relaxed);
+  double expected = double(origin) + double(written) * 1.0e9 / m_sampleRate;
+  double gap = (double(time) - expected) * m_sampleRate / 1.0e9;
+
+  if (written > 0 && gap >= m_blockSize && gap < double(m_ring.size())) {
+    for (quint64 i = 0; i < quint64(gap); i++) {
+      m_ring[size_t(written + i) & mask] = 0.0f;
+    }
+
+    written += quint64(gap);
+
+  } else if (written == 0 || std::fabs(gap) >= m_blockSize) {
+    // a jump or drift the silence cannot cover, start the timeline again.
+    m_origin.store(
+      time - qint64(double(written) * 1.0e9 / m_sampleRate),
+      std::memory_order_release);
+  }
+
+  for (int i = 0; i < count; i++) {
+    m_ring[size_t(written + quint64(i)) & mask] = data[i];
+  }
+
+  m_written.store(written + quint64(count), std::memory_order_release);
+}
+
+/*!
+   \brief Cancels the echo of reference in count samples of capture,
+   writing the result to output, which may be the same as capture.
+
+   Returns false, passing the capture through unchanged, unless count is a
+   whole number of blocks. Those calls are counted in rejectedCalls().
+*/
+bool
+EchoCanceller::process(const float* capture,
+                       const float* reference,
+                       float* output,
+                       int count)
+{
+  if (count % m_blockSize != 0) {
+    if (output != capture) {
+      std::memcpy(output, capture, size_t(count) * sizeof(float));
+    }
+
+    m_rejected++;
+    return false;
+  }
+
+  for (int offset = 0; offset < count; offset += m_blockSize) {
+    processBlock(capture + offset, reference + offset, output + offset);
+  }
+
+  return true;
+}
+
+/*!
+   \brief Cancels, in place, the echo of the reference written with
+   writeReference() from count samples captured from captureTime.
+
+   Returns false, leaving the data alone, unless count is a whole number of
+   blocks. Those calls are counted in rejectedCalls(). The remainder is not
+   held over to the next call, as that would delay the output by a block
+   and leave it out of step with its capture time.
+*/
+bool
+EchoCanceller::process(float* data, int count, qint64 captureTime)
+{
+  if (count % m_blockSize != 0) {
+    m_rejected++;
+    return false;
+  }
+
+  for (int offset = 0; offset < count; offset += m_blockSize) {
+    readReference(
+      captureTime + qint64(double(offset) * 1.0e9 / m_sampleRate),
+      m_blockSize);
+    processBlock(data + offset, m_aligned.data(), data + offset);
+  }
+
+  return true;
+}
+
+/*!
+   \brief Forgets the echo path learned so far. The reference already
+   written is kept.
+*/
+void
+EchoCanceller::reset()
+{
+  std::fill(m_history.begin(), m_history.end(), 0.0f);
+  std::fill(m_referenceRe.begin(), m_referenceRe.end(), 0.0f);
+  std::fill(m_referenceIm.begin(), m_referenceIm.end(), 0.0f);
+  std::fill(m_referencePower.begin(), m_referencePower.end(), 0.0f);
+  std::fill(m_filterRe.begin(), m_filterRe.end(), 0.0f);
+  std::fill(m_filterIm.begin(), m_filterIm.end(), 0.0f);
+  std::fill(m_power.begin(), m_power.end(), 0.0f);
+  std::fill(m_peaks.begin(), m_peaks.end(), 0.0f);
+  m_newest = 0;
+  m_constrain = 0;
+}
+
+/*!
+   \brief Returns the number of blocks processed.
+*/
+unsigned long long
+EchoCanceller::blocks() const
+{
+  return m_blocks;
+}
+
+/*!
+   \brief Returns the number of blocks the filter adapted on.
+*/
+unsigned long long
+EchoCanceller::adaptedBlocks() const
+{
+  return m_adapted;
+}
+
+/*!
+   \brief Returns the number of blocks in which the near end was heard over
+   the echo, so the filter was held.
+*/
+unsigned long long
+EchoCanceller::doubleTalkBlocks() const
+{
+  return m_doubleTalk;
+}
+
+/*!
+   \brief Returns the number of calls to process() passed through untouched
+   because their count was not a whole number of blocks.
+*/
+unsigned long long
+EchoCanceller::rejectedCalls() const
+{
+  return m_rejected;
+}
+
+/*!
+   \brief Returns the echo return loss enhancement, in dB, measured on the
+   blocks with only the far end playing.
+
+   Any near end noise in those blocks is counted as echo that was not
+   removed, so this is a lower bound.
+*/
+double
+EchoCanceller::erleDb() const
+{
+  if (m_captureEnergy <= 0.0 || m_outputEnergy <= 0.0) {
+    return 0.0;
+  }
+
+  return 10.0 * std::log10(m_captureEnergy / m_outputEnergy);
+}
+
+/* Filters one block of reference, subtracts the echo estimate from the
+   capture and, unless held, adapts the filter on the error.*/
+void
+EchoCanceller::processBlock(const float* capture,
+                            const float* reference,
+                            float* output)
+{
+  const int size = m_blockSize;
+
+  // overlap save, each reference spectrum covers this block and the last.
+  std::memmove(m_history.data(),
+               m_history.data() + size,
+               size_t(size) * sizeof(float));
+  std::memcpy(
+    m_history.data() + size, reference, size_t(size) * sizeof(float));
+  m_newest = (m_newest + m_partitions - 1) % m_partitions;
+  m_fft.forward(m_history.data(),
+                partition(m_referenceRe, m_newest),
+                partition(m_referenceIm, m_newest));
+  Fft::power(partition(m_referenceRe, m_newest),
+             partition(m_referenceIm, m_newest),
+             partition(m_referencePower, m_newest),
+             m_bins);
+
+  std::fill(m_echoRe.begin(), m_echoRe.end(), 0.0f);
+  std::fill(m_echoIm.begin(), m_echoIm.end(), 0.0f);
+
+  for (int p = 0; p < m_partitions; p++) {
+    int age = (m_newest + p) % m_partitions;
+    Fft::multiplyAccumulate(partition(m_referenceRe, age),
+                            partition(m_referenceIm, age),
+                            partition(m_filterRe, p),
+                            partition(m_filterIm, p),
+                            m_echoRe.data(),
+                            m_echoIm.data(),
+                            m_bins);
+  }
+
+  m_fft.inverse(m_echoRe.data(), m_echoIm.data(), m_time.data());
+
+  float capturePeak = 0.0f;
+  float referencePeak = 0.0f;
+  double captureEnergy = 0.0;
+  double referenceEnergy = 0.0;
+  double outputEnergy = 0.0;
+
+  for (int i = 0; i < size; i++) {
+    capturePeak = std::max(capturePeak, std::fabs(capture[i]));
+    referencePeak = std::max(referencePeak, std::fabs(reference[i]));
+    captureEnergy += double(capture[i]) * capture[i];
+    referenceEnergy += double(reference[i]) * reference[i];
+    // capture may be output, read it before it is written.
+    output[i] = capture[i] - m_time[size_t(size + i)];
+    outputEnergy += double(output[i]) * output[i];
+  }
+
+  m_peaks[size_t(m_newest)] = referencePeak;
+  referencePeak = *std::max_element(m_peaks.begin(), m_peaks.end());
+  m_blocks++;
+
+  const float minimumPower =
+    std::pow(10.0f, m_config.minimumReferenceDb / 10.0f);
+
+  if (referenceEnergy < minimumPower * size) {
+    return;
+  }
+
+  if (capturePeak > m_config.doubleTalkRatio * referencePeak) {
+    m_doubleTalk++;
+    return;
+  }
+
+  m_captureEnergy += captureEnergy;
+  m_outputEnergy += outputEnergy;
+
+  // the error is only known for this block, the first half is zero.
+  std::fill(m_time.begin(), m_time.begin() + size, 0.0f);
+  std::copy(output, output + size, m_time.begin() + size);
+  m_fft.forward(m_time.data(), m_errorRe.data(), m_errorIm.data());
+
+  // the power follows a rise at once, so the step is never too big when
+  // the reference starts, and falls smoothly. A floor keeps quiet bins from
+  // taking huge steps.
+  const float smoothing = m_config.powerSmoothing;
+  const float floor = minimumPower * 2 * size * m_partitions;
+
+  for (int k = 0; k < m_bins; k++) {
+    float total = 0.0f;
+
+    for (int p = 0; p < m_partitions; p++) {
+      total += m_referencePower[size_t(p * m_bins + k)];
+    }
+
+    m_power[size_t(k)] = std::max(
+      total, smoothing * m_power[size_t(k)] + (1.0f - smoothing) * total);
+    m_step[size_t(k)] = m_config.stepSize / (m_power[size_t(k)] + floor);
+  }
+
+  for (int p = 0; p < m_partitions; p++) {
+    int age = (m_newest + p) % m_partitions;
+    Fft::conjugateMultiplyAccumulate(partition(m_referenceRe, age),
+                                     partition(m_referenceIm, age),
+                                     m_errorRe.data(),
+                                     m_errorIm.data(),
+                                     m_step.data(),
+                                     partition(m_filterRe, p),
+                                     partition(m_filterIm, p),
+                                     m_bins);
+  }
+
+  // the update leaks into the second half of each partition's impulse
+  // response, which would wrap around. Trimming one partition a block
+  // keeps the error small at a fraction of the cost of trimming them all.
+  float* re = partition(m_filterRe, m_constrain);
+  float* im = partition(m_filterIm, m_constrain);
+  m_fft.inverse(re, im, m_time.data());
+  std::fill(m_time.begin() + size, m_time.end(), 0.0f);
+  m_fft.forward(m_time.data(), re, im);
+  m_constrain = (m_constrain + 1) % m_partitions;
+  m_adapted++;
+}
+
+/* Fills m_aligned with count samples of the reference from time, silence
+   where none was written.*/
+void
+EchoCanceller::readReference(qint64 time, int count)
+{
+  const quint64 written = m_written.load(std::memory_order_acquire);
+  const qint64 origin = m_origin.load(std::memory_order_acquire);
+  const size_t mask = m_ring.size() - 1;
+  const qint64 first =
+    qint64(std::llround(double(time - origin) * m_sampleRate / 1.0e9));
+
+  for (int i = 0; i < count; i++) {
+    qint64 index = first + i;
+    bool held = (written > 0 && index >= 0 && quint64(index) < written &&
+                 written - quint64(index) < m_ring.size());
+    m_aligned[size_t(i)] = (held ? m_ring[size_t(index) & mask] : 0.0f);
+  }
+}
+
+float*
+EchoCanceller::partition(std::vector<float>& spectra, int index)
+{
+  return spectra.data() + size_t(index * m_bins);
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,167 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef ECHOCANCELLER_H
+#define ECHOCANCELLER_H
+
+#include <QtGlobal>
+
+#include <atomic>
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+#include "fft.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \brief The settings of EchoCanceller.
+*/
+struct SPEECHRECOGNISER_EXPORT EchoCancellerConfig
+{
+  //! Samples per block, the FFT is twice this. The capture block must be a
+  //! whole number of blocks.
+  int blockSize = 256;
+  //! The longest echo path cancelled, in milliseconds.
+  int tailMs = 128;
+  //! The normalised adaptation step, above 0 and below 1.
+  float stepSize = 0.5f;
+  //! How much of each bin's reference power carries over to the next
+  //! block, 0 to 1.
+  float powerSmoothing = 0.8f;
+  //! Adaptation stops while the capture peak is above this fraction of the
+  //! reference peak over the tail, taken to be the near end talking.
+  float doubleTalkRatio = 0.5f;
+  //! The reference RMS, in dB full scale, below which there is no echo to
+  //! learn from and adaptation stops.
+  float minimumReferenceDb = -70.0f;
+};
+
+/*!
+  \class EchoCanceller
+  \brief The EchoCanceller class removes the echo of the device's own
+  playback from the capture before detection.
+
+  It is a multidelay block frequency domain NLMS filter. The echo path, up
+  to tailMs long, is split into partitions of one block each and held as
+  spectra, so filtering and adaptation are a handful of complex
+  multiplications per bin per partition. Each block takes three FFTs of
+  twice the block size plus two more to constrain one partition, round
+  robin, back to a linear convolution. The step in each bin is normalised
+  by that bin's reference power over all the partitions.
+
+  Adaptation stops while the near end talks, found by the Geigel test, and
+  while the reference is silent, so speech does not unlearn the echo path.
+
+  The budget is 2% of one core per stream. With the defaults, 256 sample
+  blocks and a 128 ms tail at 16 kHz, a block of 16 ms costs about 20
+  microseconds on a desktop x86 core, near 0.1%, leaving room for slower
+  ARM boards and longer tails. `SpeechRecogniserBenchmark echo` checks it.
+
+  The reference is whatever the device plays, mono at the capture rate.
+  Either pass it alongside each capture block, or write it from the
+  playback callback with writeReference(), stamped with the steady clock
+  time its first sample reaches the speaker, and let process() line it up
+  with each capture block by its capture time. The acoustic delay must fit
+  in the tail.
+
+  Every capture block must be a whole number of blocks, so the capture
+  buffer size should be a multiple of blockSize. Other blocks pass through
+  uncancelled and are counted in rejectedCalls().
+*/
+class SPEECHRECOGNISER_EXPORT EchoCanceller
+{
+public:
+  explicit EchoCanceller(
+    int sampleRate = 16000,
+    const EchoCancellerConfig& config = EchoCancellerConfig());
+
+  EchoCancellerConfig config() const;
+  void setConfig(const EchoCancellerConfig& config);
+  void setSampleRate(int sampleRate);
+  int partitions() const;
+
+  void writeReference(const float* data, int count, qint64 time);
+
+  bool process(const float* capture,
+               const float* reference,
+               float* output,
+               int count);
+  bool process(float* data, int count, qint64 captureTime);
+  void reset();
+
+  unsigned long long blocks() const;
+  unsigned long long adaptedBlocks() const;
+  unsigned long long doubleTalkBlocks() const;
+  unsigned long long rejectedCalls() const;
+  double erleDb() const;
+
+private:
+  EchoCancellerConfig m_config;
+  int m_sampleRate;
+  int m_blockSize;
+  int m_bins;
+  int m_partitions;
+  Fft m_fft;
+
+  // the last two reference blocks, transformed together each block.
+  std::vector<float> m_history;
+  // reference spectra, newest at m_newest, and the filter, one partition
+  // each, split into real and imaginary parts.
+  std::vector<float> m_referenceRe;
+  std::vector<float> m_referenceIm;
+  std::vector<float> m_referencePower;
+  std::vector<float> m_filterRe;
+  std::vector<float> m_filterIm;
+  int m_newest;
+  int m_constrain;
+  std::vector<float> m_power;
+  std::vector<float> m_step;
+  std::vector<float> m_peaks;
+  std::vector<float> m_time;
+  std::vector<float> m_echoRe;
+  std::vector<float> m_echoIm;
+  std::vector<float> m_errorRe;
+  std::vector<float> m_errorIm;
+
+  // written by writeReference() only, read by process().
+  std::vector<float> m_ring;
+  std::atomic<quint64> m_written;
+  std::atomic<qint64> m_origin;
+  std::vector<float> m_aligned;
+
+  unsigned long long m_blocks;
+  unsigned long long m_adapted;
+  unsigned long long m_doubleTalk;
+  unsigned long long m_rejected;
+  double m_captureEnergy;
+  double m_outputEnergy;
+
+  void processBlock(const float* capture,
+                    const float* reference,
+                    float* output);
+  void readReference(qint64 time, int count);
+  float* partition(std::vector<float>& spectra, int index);
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // ECHOCANCELLER_H
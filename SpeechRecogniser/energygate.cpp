@@ -0,0 +1,328 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "energygate.h"
+
+namespace SpeechRecognition {
+
+static float
+fromDb(float db)
+{
+  return std::pow(10.0f, db / 20.0f);
+}
+
+/*!
+   \brief Creates a gate for audio at sampleRate samples per second.
+*/
+EnergyGate::EnergyGate(int sampleRate, const EnergyGateConfig& config)
+  : m_config(config)
+  , m_sampleRate(sampleRate)
+  , m_passed(0)
+  , m_gated(0)
+{
+  setConfig(config);
+}
+
+/*!
+   \brief Returns the gate thresholds.
+*/
+EnergyGateConfig
+EnergyGate::config() const
+{
+  return m_config;
+}
+
+/*!
+   \brief Sets the gate thresholds. This resets the gate.
+*/
+void
+EnergyGate::setConfig(const EnergyGateConfig& config)
+{
+  m_config = config;
+  size_t lookback = size_t(std::max(0, m_config.lookbackMs)) *
+                    size_t(m_sampleRate) / 1000;
+  // sized once here so that process() never allocates.
+  m_history.assign(lookback, 0.0f);
+  m_lookback.clear();
+  m_lookback.reserve(lookback);
+  reset();
+}
+
+/*!
+   \brief Sets the sample rate of the audio. This resets the gate.
+*/
+void
+EnergyGate::setSampleRate(int sampleRate)
+{
+  m_sampleRate = sampleRate;
+  setConfig(m_config);
+}
+
+/*!
+   \brief Returns the RMS and peak absolute value of count samples.
+
+   This is the only per sample work the gate does so it is vectorised with
+   SSE2 or NEON where available.
+*/
+void
+EnergyGate::measure(const float* data, int count, float& rms, float& peak)
+{
+  float sum = 0.0f, max = 0.0f;
+  int i = 0;
+
+#if defined(__SSE2__)
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+  __m128 sum4 = _mm_setzero_ps(), max4 = _mm_setzero_ps();
+
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(data + i);
+    sum4 = _mm_add_ps(sum4, _mm_mul_ps(x, x));
+    max4 = _mm_max_ps(max4, _mm_andnot_ps(signMask, x));
+  }
+
+  float lanes[4];
+  _mm_storeu_ps(lanes, sum4);
+  sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  _mm_storeu_ps(lanes, max4);
+  max = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#elif defined(__ARM_NEON)
+  float32x4_t sum4 = vdupq_n_f32(0.0f), max4 = vdupq_n_f32(0.0f);
+
+  for (; i + 4 <= count; i += 4) {
+    float32x4_t x = vld1q_f32(data + i);
+    sum4 = vmlaq_f32(sum4, x, x);
+    max4 = vmaxq_f32(max4, vabsq_f32(x));
+  }
+
+  float lanes[4];
+  vst1q_f32(lanes, sum4);
+  sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  vst1q_f32(lanes, max4);
+  max = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+
+  for (; i < count; i++) {
+    sum += data[i] * data[i];
+    max = std::max(max, std::fabs(data[i]));
+  }
+
+  rms = (count > 0 ? std::sqrt(sum / float(count)) : 0.0f);
+  peak = max;
+}
+
+/*!
+   \brief Measures a block and updates the gate.
+
+   Returns Closed if the block should be skipped, Opening if the gate has just
+   opened, in which case lookback() holds the audio to feed ahead of this
+   block, Open if the block should be passed on and Closing if the gate has
+   just closed. A Closing block is skipped and marks the end of an utterance.
+*/
+EnergyGate::State
+EnergyGate::process(const float* data, int count)
+{
+  measure(data, count, m_rms, m_peak);
+
+  float minimum = fromDb(m_config.minimumFloorDb);
+
+  if (!m_floorValid) {
+    m_floor = std::max(m_rms, minimum);
+    m_floorValid = true;
+
+  } else if (m_rms < m_floor) {
+    m_floor = std::max(m_rms, minimum);
+
+  } else {
+    float seconds = float(count) / float(m_sampleRate);
+    m_floor = std::min(m_rms, m_floor * fromDb(m_config.floorRiseDb * seconds));
+  }
+
+  bool loud = (m_rms > m_floor * fromDb(m_config.openDb) ||
+               m_peak > m_floor * fromDb(m_config.peakDb));
+  int hangover = m_config.hangoverMs * m_sampleRate / 1000;
+
+  if (!m_open) {
+    if (loud) {
+      m_open = true;
+      m_hangover = hangover;
+      m_lookback.clear();
+
+      if (m_historyFull) {
+        m_lookback.insert(m_lookback.end(),
+                          m_history.begin() + long(m_historyPos),
+                          m_history.end());
+      }
+
+      m_lookback.insert(m_lookback.end(),
+                        m_history.begin(),
+                        m_history.begin() + long(m_historyPos));
+      m_historyPos = 0;
+      m_historyFull = false;
+      m_passed++;
+      return Opening;
+    }
+
+    remember(data, count);
+    m_gated++;
+    return Closed;
+  }
+
+  if (m_rms >= m_floor * fromDb(m_config.closeDb)) {
+    m_hangover = hangover;
+
+  } else {
+    m_hangover -= count;
+
+    if (m_hangover <= 0) {
+      m_open = false;
+      remember(data, count);
+      m_gated++;
+      return Closing;
+    }
+  }
+
+  m_passed++;
+  return Open;
+}
+
+/*!
+   \brief Returns true while blocks are being passed on.
+*/
+bool
+EnergyGate::isOpen() const
+{
+  return m_open;
+}
+
+/*!
+   \brief Returns the audio captured just before the gate opened, oldest
+   first. Only valid straight after process() has returned Opening.
+*/
+const std::vector<float>&
+EnergyGate::lookback() const
+{
+  return m_lookback;
+}
+
+/*!
+   \brief Closes the gate and forgets the noise floor and lookback. The
+   counters are kept.
+*/
+void
+EnergyGate::reset()
+{
+  m_open = false;
+  m_floorValid = false;
+  m_floor = 0.0f;
+  m_rms = 0.0f;
+  m_peak = 0.0f;
+  m_hangover = 0;
+  m_historyPos = 0;
+  m_historyFull = false;
+  m_lookback.clear();
+}
+
+/*!
+   \brief Returns the RMS of the last block.
+*/
+float
+EnergyGate::rms() const
+{
+  return m_rms;
+}
+
+/*!
+   \brief Returns the peak absolute value of the last block.
+*/
+float
+EnergyGate::peak() const
+{
+  return m_peak;
+}
+
+/*!
+   \brief Returns the tracked noise floor as an RMS value.
+*/
+float
+EnergyGate::noiseFloor() const
+{
+  return m_floor;
+}
+
+/*!
+   \brief Returns the number of blocks passed on since creation.
+*/
+unsigned long long
+EnergyGate::blocksPassed() const
+{
+  return m_passed;
+}
+
+/*!
+   \brief Returns the number of blocks skipped since creation.
+*/
+unsigned long long
+EnergyGate::blocksGated() const
+{
+  return m_gated;
+}
+
+/* Keeps the most recent lookbackMs of gated audio in a ring.*/
+void
+EnergyGate::remember(const float* data, int count)
+{
+  size_t capacity = m_history.size();
+
+  if (capacity == 0 || count <= 0) {
+    return;
+  }
+
+  size_t n = size_t(count);
+
+  if (n >= capacity) {
+    std::memcpy(m_history.data(), data + (n - capacity), capacity * sizeof(float));
+    m_historyPos = 0;
+    m_historyFull = true;
+    return;
+  }
+
+  size_t first = std::min(n, capacity - m_historyPos);
+  std::memcpy(m_history.data() + m_historyPos, data, first * sizeof(float));
+  std::memcpy(m_history.data(), data + first, (n - first) * sizeof(float));
+
+  if (m_historyPos + n >= capacity) {
+    m_historyFull = true;
+  }
+
+  m_historyPos = (m_historyPos + n) % capacity;
+}
+
+} // end of namespace SpeechRecognition
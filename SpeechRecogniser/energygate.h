@@ -0,0 +1,120 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef ENERGYGATE_H
+#define ENERGYGATE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \brief The thresholds used by EnergyGate. Levels are in dB relative to the
+  tracked noise floor unless stated otherwise.
+*/
+struct SPEECHRECOGNISER_EXPORT EnergyGateConfig
+{
+  //! RMS above the floor that opens the gate.
+  float openDb = 9.0f;
+  //! RMS above the floor below which an open gate starts its hangover.
+  float closeDb = 5.0f;
+  //! Peak above the floor RMS that opens the gate, catching sharp onsets.
+  float peakDb = 20.0f;
+  //! How fast the floor may rise, in dB per second.
+  float floorRiseDb = 2.0f;
+  //! The lowest floor tracked, in dB full scale, so that digital silence
+  //! does not open the gate on the first bit of noise.
+  float minimumFloorDb = -80.0f;
+  int hangoverMs = 300;
+  int lookbackMs = 400;
+};
+
+/*!
+  \class EnergyGate
+  \brief The EnergyGate class is a cheap voice activity pre-gate that runs on
+  the capture blocks ahead of the detector.
+
+  Each block costs one vectorised pass for its RMS and peak. A noise floor
+  follows the RMS down at once and up only slowly, and the gate opens when a
+  block is well above the floor. Once open it stays open until the level has
+  been near the floor for the hangover time, so the end of a hotword is never
+  cut.
+
+  While closed the gate keeps the last lookbackMs of audio. When it opens the
+  caller should feed lookback() to the detector ahead of the opening block,
+  as a hotword usually starts quieter than the part that opens the gate.
+*/
+class SPEECHRECOGNISER_EXPORT EnergyGate
+{
+public:
+  enum State
+  {
+    Closed,
+    Opening,
+    Open,
+    Closing,
+  };
+
+  explicit EnergyGate(int sampleRate = 16000,
+                      const EnergyGateConfig& config = EnergyGateConfig());
+
+  EnergyGateConfig config() const;
+  void setConfig(const EnergyGateConfig& config);
+  void setSampleRate(int sampleRate);
+
+  State process(const float* data, int count);
+  bool isOpen() const;
+  const std::vector<float>& lookback() const;
+  void reset();
+
+  float rms() const;
+  float peak() const;
+  float noiseFloor() const;
+  unsigned long long blocksPassed() const;
+  unsigned long long blocksGated() const;
+
+  static void measure(const float* data, int count, float& rms, float& peak);
+
+private:
+  EnergyGateConfig m_config;
+  int m_sampleRate;
+  bool m_open;
+  bool m_floorValid;
+  float m_floor;
+  float m_rms;
+  float m_peak;
+  int m_hangover;
+  std::vector<float> m_history;
+  size_t m_historyPos;
+  bool m_historyFull;
+  std::vector<float> m_lookback;
+  unsigned long long m_passed;
+  unsigned long long m_gated;
+
+  void remember(const float* data, int count);
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // ENERGYGATE_H
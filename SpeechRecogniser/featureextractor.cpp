@@ -0,0 +1,526 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "featureextractor.h"
+
+namespace SpeechRecognition {
+
+/* The floor under the log of a band, so silence gives a finite value.*/
+static const float LOG_FLOOR = 1.0e-10f;
+
+static float
+toMel(float hz)
+{
+  return 1127.0f * std::log(1.0f + hz / 700.0f);
+}
+
+static float
+fromMel(float mel)
+{
+  return 700.0f * (std::exp(mel / 1127.0f) - 1.0f);
+}
+
+/* Returns the sum of a[i] * b[i] over count values.*/
+static float
+dot(const float* a, const float* b, int count)
+{
+  float sum = 0.0f;
+  int i = 0;
+
+#if defined(__SSE2__)
+  __m128 sum4 = _mm_setzero_ps();
+
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(a + i), y = _mm_loadu_ps(b + i);
+    sum4 = _mm_add_ps(sum4, _mm_mul_ps(x, y));
+  }
+
+  float lanes[4];
+  _mm_storeu_ps(lanes, sum4);
+  sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__ARM_NEON)
+  float32x4_t sum4 = vdupq_n_f32(0.0f);
+
+  for (; i + 4 <= count; i += 4) {
+    sum4 = vmlaq_f32(sum4, vld1q_f32(a + i), vld1q_f32(b + i));
+  }
+
+  float lanes[4];
+  vst1q_f32(lanes, sum4);
+  sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+
+  for (; i < count; i++) {
+    sum += a[i] * b[i];
+  }
+
+  return sum;
+}
+
+/* out[i] = a[i] * b[i] over count values.*/
+static void
+multiply(const float* a, const float* b, float* out, int count)
+{
+  int i = 0;
+
+#if defined(__SSE2__)
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(a + i), y = _mm_loadu_ps(b + i);
+    _mm_storeu_ps(out + i, _mm_mul_ps(x, y));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 4 <= count; i += 4) {
+    vst1q_f32(out + i, vmulq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+  }
+#endif
+
+  for (; i < count; i++) {
+    out[i] = a[i] * b[i];
+  }
+}
+
+/*!
+  \brief Creates a ring of capacity frames of frameSize values.
+*/
+FeatureRing::FeatureRing(int frameSize, int capacity)
+  : m_frameSize(qMax(1, frameSize))
+  , m_capacity(qMax(2, capacity))
+  , m_frames(size_t(m_frameSize) * size_t(m_capacity), 0.0f)
+  , m_written(0)
+{}
+
+int
+FeatureRing::frameSize() const
+{
+  return m_frameSize;
+}
+
+int
+FeatureRing::capacity() const
+{
+  return m_capacity;
+}
+
+/*!
+  \brief Returns the number of frames written, which is also the index the
+  next frame will have.
+*/
+quint64
+FeatureRing::written() const
+{
+  return m_written.load(std::memory_order_acquire);
+}
+
+/*!
+  \brief Returns the index of the oldest frame that can still be read. The
+  slot after the newest may be being rewritten, so it is one less than the
+  capacity behind.
+*/
+quint64
+FeatureRing::oldest() const
+{
+  quint64 written = this->written();
+  quint64 held = quint64(m_capacity - 1);
+  return (written > held ? written - held : 0);
+}
+
+/*!
+  \brief Returns the bytes the frames take.
+*/
+size_t
+FeatureRing::memoryBytes() const
+{
+  return m_frames.size() * sizeof(float) + sizeof(*this);
+}
+
+/*!
+  \brief Returns the slot for the next frame. Only the writer may call
+  this, and endWrite() publishes the frame.
+*/
+float*
+FeatureRing::beginWrite()
+{
+  quint64 index = m_written.load(std::memory_order_relaxed);
+
+  // the count that took this slot's old frame out of oldest() must be seen
+  // before any of the new frame's stores, or on a weakly ordered CPU read()
+  // could pass its recheck with a torn copy.
+  std::atomic_thread_fence(std::memory_order_release);
+  return m_frames.data() + size_t(index % quint64(m_capacity)) * m_frameSize;
+}
+
+void
+FeatureRing::endWrite()
+{
+  m_written.fetch_add(1, std::memory_order_release);
+}
+
+/*!
+  \brief Copies the frame at index into frame, which must hold frameSize()
+  values. Returns false if the frame has not been written yet or has been,
+  or might have been while it was copied, overwritten.
+*/
+bool
+FeatureRing::read(quint64 index, float* frame) const
+{
+  if (index >= written() || index < oldest()) {
+    return false;
+  }
+
+  const float* slot =
+    m_frames.data() + size_t(index % quint64(m_capacity)) * m_frameSize;
+  std::memcpy(frame, slot, sizeof(float) * size_t(m_frameSize));
+
+  // the writer starts on the slot again once index + capacity - 1 frames
+  // are written, so if that has happened the copy may be torn.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return index >= oldest();
+}
+
+/*!
+  \brief Creates a reader on ring, from the next frame written.
+*/
+FeatureReader::FeatureReader(std::shared_ptr<const FeatureRing> ring)
+  : m_ring(ring)
+  , m_next(ring ? ring->written() : 0)
+  , m_lost(0)
+{}
+
+/*!
+  \brief Copies the next frame into frame and moves on. Returns false if
+  there is no new frame yet.
+*/
+bool
+FeatureReader::next(float* frame)
+{
+  if (!m_ring) {
+    return false;
+  }
+
+  while (m_next < m_ring->written()) {
+    if (m_ring->read(m_next, frame)) {
+      m_next++;
+      return true;
+    }
+
+    // overwritten before it was read, skip to what is still there.
+    quint64 oldest = m_ring->oldest();
+    m_lost += (oldest > m_next ? oldest - m_next : 1);
+    m_next = std::max(oldest, m_next + 1);
+  }
+
+  return false;
+}
+
+/*!
+  \brief Returns the index of the next frame to be read.
+*/
+quint64
+FeatureReader::position() const
+{
+  return m_next;
+}
+
+/*!
+  \brief Returns the frames overwritten before this reader got to them.
+*/
+quint64
+FeatureReader::lost() const
+{
+  return m_lost;
+}
+
+FeatureExtractor::FeatureExtractor(const FeatureConfig& config)
+  : m_filled(0)
+  , m_previous(0.0f)
+  , m_frames(0)
+{
+  setConfig(config);
+}
+
+FeatureConfig
+FeatureExtractor::config() const
+{
+  return m_config;
+}
+
+/*!
+  \brief Sets the configuration and builds the window, filterbank and DCT
+  for it. The extractor starts a new ring; readers of the old one keep it
+  but it gets no more frames.
+*/
+void
+FeatureExtractor::setConfig(const FeatureConfig& config)
+{
+  m_config = config;
+  m_config.frameLength = qMax(16, m_config.frameLength);
+  m_config.hopSize = qBound(1, m_config.hopSize, m_config.frameLength);
+  m_config.melBands = qMax(1, m_config.melBands);
+  m_config.cepstra = qBound(0, m_config.cepstra, m_config.melBands);
+  m_config.highHz = qMin(m_config.highHz, m_config.sampleRate / 2.0f);
+  m_config.lowHz = qBound(0.0f, m_config.lowHz, m_config.highHz);
+
+  const int length = m_config.frameLength;
+  const int bands = m_config.melBands;
+  m_fft = Fft(length);
+  const int bins = m_fft.bins();
+
+  m_window.resize(size_t(length));
+
+  for (int i = 0; i < length; i++) {
+    m_window[size_t(i)] =
+      float(0.54 - 0.46 * std::cos(2.0 * M_PI * i / (length - 1)));
+  }
+
+  // bands + 2 edges evenly spaced in mel, each band a triangle from one
+  // edge through the next to the one after.
+  std::vector<float> edges(size_t(bands + 2));
+  const float lowMel = toMel(m_config.lowHz);
+  const float highMel = toMel(m_config.highHz);
+
+  for (int e = 0; e < bands + 2; e++) {
+    edges[size_t(e)] =
+      fromMel(lowMel + (highMel - lowMel) * e / float(bands + 1));
+  }
+
+  const float binHz = float(m_config.sampleRate) / m_fft.size();
+  m_bandStart.assign(size_t(bands), 0);
+  m_bandLength.assign(size_t(bands), 0);
+  m_bandOffset.assign(size_t(bands), 0);
+  m_weights.clear();
+
+  for (int b = 0; b < bands; b++) {
+    float left = edges[size_t(b)], centre = edges[size_t(b + 1)],
+          right = edges[size_t(b + 2)];
+    int first = -1;
+
+    for (int k = 0; k < bins; k++) {
+      float hz = k * binHz;
+      float weight = 0.0f;
+
+      if (hz > left && hz <= centre) {
+        weight = (hz - left) / (centre - left);
+
+      } else if (hz > centre && hz < right) {
+        weight = (right - hz) / (right - centre);
+      }
+
+      if (weight > 0.0f) {
+        if (first < 0) {
+          first = k;
+          m_bandOffset[size_t(b)] = int(m_weights.size());
+        }
+
+        // a band narrower than a bin may skip one in between.
+        while (first + m_bandLength[size_t(b)] < k) {
+          m_weights.push_back(0.0f);
+          m_bandLength[size_t(b)]++;
+        }
+
+        m_weights.push_back(weight);
+        m_bandLength[size_t(b)]++;
+      }
+    }
+
+    m_bandStart[size_t(b)] = qMax(0, first);
+  }
+
+  const int cepstra = m_config.cepstra;
+  m_dct.resize(size_t(cepstra * bands));
+
+  for (int c = 0; c < cepstra; c++) {
+    double scale = std::sqrt((c == 0 ? 1.0 : 2.0) / bands);
+
+    for (int b = 0; b < bands; b++) {
+      m_dct[size_t(c * bands + b)] =
+        float(scale * std::cos(M_PI * c * (b + 0.5) / bands));
+    }
+  }
+
+  m_history.assign(size_t(length), 0.0f);
+  m_frame.assign(size_t(m_fft.size()), 0.0f);
+  m_re.assign(size_t(bins), 0.0f);
+  m_im.assign(size_t(bins), 0.0f);
+  m_power.assign(size_t(bins), 0.0f);
+  m_ring = std::make_shared<FeatureRing>(frameSize(), m_config.ringFrames);
+  reset();
+}
+
+/*!
+  \brief Returns the ring the frames are written to.
+*/
+std::shared_ptr<FeatureRing>
+FeatureExtractor::ring() const
+{
+  return m_ring;
+}
+
+/*!
+  \brief Returns the values in each frame: the log energy, melBands log mel
+  energies and cepstra coefficients.
+*/
+int
+FeatureExtractor::frameSize() const
+{
+  return 1 + m_config.melBands + m_config.cepstra;
+}
+
+/*!
+  \brief Returns where in a frame the log mel energies start.
+*/
+int
+FeatureExtractor::melOffset() const
+{
+  return 1;
+}
+
+/*!
+  \brief Returns where in a frame the cepstra start.
+*/
+int
+FeatureExtractor::cepstraOffset() const
+{
+  return 1 + m_config.melBands;
+}
+
+/*!
+  \brief Adds count samples and writes every frame they complete to the
+  ring. Returns the number of frames written.
+*/
+int
+FeatureExtractor::process(const float* data, int count)
+{
+  const int length = m_config.frameLength;
+  const float alpha = m_config.preemphasis;
+  int written = 0;
+
+  for (int i = 0; i < count;) {
+    int take = qMin(count - i, length - m_filled);
+    float* out = m_history.data() + m_filled;
+
+    for (int k = 0; k < take; k++) {
+      float x = data[i + k];
+      out[k] = x - alpha * m_previous;
+      m_previous = x;
+    }
+
+    m_filled += take;
+    i += take;
+
+    if (m_filled == length) {
+      computeFrame();
+      written++;
+
+      // keep the overlap with the next frame at the front.
+      int keep = length - m_config.hopSize;
+      std::memmove(m_history.data(),
+                   m_history.data() + m_config.hopSize,
+                   sizeof(float) * size_t(keep));
+      m_filled = keep;
+    }
+  }
+
+  return written;
+}
+
+/*!
+  \brief Drops any part filled frame, for a break in the audio. The ring
+  and its frames are kept.
+*/
+void
+FeatureExtractor::reset()
+{
+  m_filled = 0;
+  m_previous = 0.0f;
+}
+
+/*!
+  \brief Returns the frames computed since the extractor was configured.
+*/
+quint64
+FeatureExtractor::frames() const
+{
+  return m_frames;
+}
+
+/*!
+  \brief Returns the bytes the extractor and its ring use between them.
+*/
+size_t
+FeatureExtractor::memoryBytes() const
+{
+  size_t floats = m_window.size() + m_weights.size() + m_dct.size() +
+                  m_history.size() + m_frame.size() + m_re.size() +
+                  m_im.size() + m_power.size();
+  size_t ints = m_bandStart.size() + m_bandLength.size() + m_bandOffset.size();
+  // about what the FFT keeps for its twiddles, scratch and bit reversal.
+  size_t fft = size_t(m_fft.size()) * (3 * sizeof(float) + sizeof(int));
+  return sizeof(*this) + floats * sizeof(float) + ints * sizeof(int) + fft +
+         m_ring->memoryBytes();
+}
+
+/* Windows, transforms and reduces the full history to one frame in the
+   ring.*/
+void
+FeatureExtractor::computeFrame()
+{
+  const int length = m_config.frameLength;
+  const int bands = m_config.melBands;
+  float* slot = m_ring->beginWrite();
+
+  slot[0] = std::log(
+    std::max(dot(m_history.data(), m_history.data(), length), LOG_FLOOR));
+
+  // the tail of m_frame past the window stays zero.
+  multiply(m_history.data(), m_window.data(), m_frame.data(), length);
+  m_fft.forward(m_frame.data(), m_re.data(), m_im.data());
+  Fft::power(m_re.data(), m_im.data(), m_power.data(), m_fft.bins());
+
+  float* mel = slot + melOffset();
+
+  for (int b = 0; b < bands; b++) {
+    float energy = dot(m_power.data() + m_bandStart[size_t(b)],
+                       m_weights.data() + m_bandOffset[size_t(b)],
+                       m_bandLength[size_t(b)]);
+    mel[b] = std::log(std::max(energy, LOG_FLOOR));
+  }
+
+  float* cepstra = slot + cepstraOffset();
+
+  for (int c = 0; c < m_config.cepstra; c++) {
+    cepstra[c] = dot(m_dct.data() + size_t(c * bands), mel, bands);
+  }
+
+  m_ring->endWrite();
+  m_frames++;
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,179 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef FEATUREEXTRACTOR_H
+#define FEATUREEXTRACTOR_H
+
+#include <QtGlobal>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+#include "fft.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \brief The settings of FeatureExtractor. The defaults are the usual
+  speech front end, 25 ms frames every 10 ms at 16 kHz.
+*/
+struct SPEECHRECOGNISER_EXPORT FeatureConfig
+{
+  int sampleRate = 16000;
+  //! Samples in a frame. The FFT is the next power of two.
+  int frameLength = 400;
+  //! Samples between the starts of frames.
+  int hopSize = 160;
+  int melBands = 40;
+  float lowHz = 20.0f;
+  float highHz = 7600.0f;
+  //! Cepstral coefficients after the log mel bands, 0 for log mel only.
+  int cepstra = 13;
+  //! The pre-emphasis coefficient, 0 for none.
+  float preemphasis = 0.97f;
+  //! Frames the ring keeps, three seconds at the default hop.
+  int ringFrames = 300;
+};
+
+/*!
+  \class FeatureRing
+  \brief The FeatureRing class holds the most recent feature frames of a
+  stream for any number of readers.
+
+  One writer, the FeatureExtractor, fills the next slot and publishes it;
+  readers on any thread copy frames out by index and find out if a frame
+  was overwritten while they copied it, so nobody waits on anybody. The
+  ring is shared through a std::shared_ptr, so a reader keeps it alive
+  even after the extractor has moved on to a new one.
+*/
+class SPEECHRECOGNISER_EXPORT FeatureRing
+{
+public:
+  FeatureRing(int frameSize, int capacity);
+
+  int frameSize() const;
+  int capacity() const;
+  quint64 written() const;
+  quint64 oldest() const;
+  size_t memoryBytes() const;
+
+  float* beginWrite();
+  void endWrite();
+
+  bool read(quint64 index, float* frame) const;
+
+private:
+  int m_frameSize;
+  int m_capacity;
+  std::vector<float> m_frames;
+  std::atomic<quint64> m_written;
+};
+
+/*!
+  \class FeatureReader
+  \brief The FeatureReader class follows a FeatureRing from the frame
+  after the newest when it was made, for one consumer such as a voice
+  activity detector or an analytics thread.
+
+  A reader that falls more than the ring's capacity behind skips to the
+  oldest frame still held and counts the frames it lost.
+*/
+class SPEECHRECOGNISER_EXPORT FeatureReader
+{
+public:
+  explicit FeatureReader(std::shared_ptr<const FeatureRing> ring);
+
+  bool next(float* frame);
+  quint64 position() const;
+  quint64 lost() const;
+
+private:
+  std::shared_ptr<const FeatureRing> m_ring;
+  quint64 m_next;
+  quint64 m_lost;
+};
+
+/*!
+  \class FeatureExtractor
+  \brief The FeatureExtractor class computes log mel filterbank energies
+  and mel frequency cepstral coefficients from a stream of capture blocks,
+  once, for everything that wants them.
+
+  Blocks of any size are pre-emphasised and cut into frames of
+  frameLength samples every hopSize. Each frame is Hamming windowed,
+  transformed by Fft and reduced to its power spectrum, then to melBands
+  triangular mel bands, whose logs are the log mel energies, and cepstra
+  of those by a DCT-II are the MFCCs. The window, the packed filterbank
+  weights and the DCT are computed once by setConfig() and the kernels run
+  four bins at a time with SSE or NEON; process() never allocates.
+
+  Each frame is written to ring() as the frame's log energy, then the log
+  mel energies, then the cepstra, frameSize() values in all.
+*/
+class SPEECHRECOGNISER_EXPORT FeatureExtractor
+{
+public:
+  explicit FeatureExtractor(const FeatureConfig& config = FeatureConfig());
+
+  FeatureConfig config() const;
+  void setConfig(const FeatureConfig& config);
+
+  std::shared_ptr<FeatureRing> ring() const;
+  int frameSize() const;
+  int melOffset() const;
+  int cepstraOffset() const;
+
+  int process(const float* data, int count);
+  void reset();
+
+  quint64 frames() const;
+  size_t memoryBytes() const;
+
+private:
+  FeatureConfig m_config;
+  Fft m_fft;
+  std::vector<float> m_window;
+  // each band's weights are packed one after the other, starting at its
+  // first bin.
+  std::vector<int> m_bandStart;
+  std::vector<int> m_bandLength;
+  std::vector<int> m_bandOffset;
+  std::vector<float> m_weights;
+  // cepstra rows of melBands values.
+  std::vector<float> m_dct;
+  std::vector<float> m_history;
+  int m_filled;
+  float m_previous;
+  std::vector<float> m_frame;
+  std::vector<float> m_re;
+  std::vector<float> m_im;
+  std::vector<float> m_power;
+  std::shared_ptr<FeatureRing> m_ring;
+  quint64 m_frames;
+
+  void computeFrame();
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // FEATUREEXTRACTOR_H
@@ -0,0 +1,486 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "feedbackplayer.h"
+#include "playbackgate.h"
+#include "sampleconversion.h"
+#include "wavfile.h"
+
+namespace SpeechRecognition {
+
+// how often the player's thread emits played() for the sounds started.
+static const int PLAYED_INTERVAL = 10;
+
+/*!
+   \brief PortAudio callback method, hands the output buffer to the player
+   given as the user data.
+*/
+static int
+playbackCallback(const void* /*inputBuffer*/,
+                 void* outputBuffer,
+                 unsigned long framesPerBuffer,
+                 const PaStreamCallbackTimeInfo* timeInfo,
+                 PaStreamCallbackFlags statusFlags,
+                 void* sender)
+{
+  FeedbackPlayer* player = static_cast<FeedbackPlayer*>(sender);
+  player->render(static_cast<float*>(outputBuffer),
+                 int(framesPerBuffer),
+                 timeInfo,
+                 statusFlags);
+  return paContinue;
+}
+
+/*!
+   \brief Creates a player for the output device and stream parameters in
+   settings. The device is looked up straight away but nothing is opened
+   until open().
+*/
+FeedbackPlayer::FeedbackPlayer(const PlaybackSettings& settings,
+                               QObject* parent)
+  : QObject(parent)
+  , m_settings(settings)
+  , m_stream(nullptr)
+  , m_outputLatency(0.0)
+  , m_initialised(false)
+  , m_request(-1)
+  , m_requestTime(0)
+  , m_underflows(0)
+  , m_gate(nullptr)
+  , m_playedWritten(0)
+  , m_playedRead(0)
+  , m_playing(-1)
+  , m_position(0)
+{
+  connect(&m_playedTimer, &QTimer::timeout, this, &FeedbackPlayer::emitPlayed);
+
+  if (Pa_Initialize() != paNoError) {
+    qWarning() << tr("unable to intialise PortAudio.");
+    return;
+  }
+
+  m_initialised = true;
+  resolveDevice();
+}
+
+FeedbackPlayer::~FeedbackPlayer()
+{
+  close();
+
+  if (m_initialised) {
+    Pa_Terminate();
+  }
+}
+
+/*!
+   \brief Loads a WAV file and prepares it for the output stream. Returns
+   the sound's number for play(), or -1 if the file could not be read.
+
+   The samples are resampled to the stream rate, mono sounds go to every
+   output channel, and the result is kept in memory as interleaved float.
+*/
+int
+FeedbackPlayer::addSound(const QString& filename)
+{
+  if (isOpen()) {
+    qWarning() << tr("sounds must be added before the player is opened.");
+    return -1;
+  }
+
+  if (m_settings.sampleRate <= 0.0) {
+    return -1;
+  }
+
+  WavFile file;
+
+  if (!file.open(filename)) {
+    return -1;
+  }
+
+  const int inChannels = file.format().channels;
+  const int outChannels = m_settings.channelCount;
+  std::vector<std::vector<float>> planes(
+    size_t(inChannels), std::vector<float>(size_t(file.frames())));
+  std::vector<float*> pointers;
+
+  for (auto& plane : planes) {
+    pointers.push_back(plane.data());
+  }
+
+  file.readFrames(0, file.frames(), pointers.data());
+
+  for (auto& plane : planes) {
+    plane = resample(plane, file.format().sampleRate, m_settings.sampleRate);
+  }
+
+  const size_t frames = planes[0].size();
+  std::vector<float> sound(frames * size_t(outChannels));
+
+  for (int c = 0; c < outChannels; c++) {
+    const std::vector<float>& plane = planes[size_t(std::min(c, inChannels - 1))];
+
+    for (size_t i = 0; i < frames; i++) {
+      sound[i * size_t(outChannels) + size_t(c)] = plane[i];
+    }
+  }
+
+  m_sounds.push_back(std::move(sound));
+  return int(m_sounds.size()) - 1;
+}
+
+int
+FeedbackPlayer::soundCount() const
+{
+  return int(m_sounds.size());
+}
+
+/*!
+   \brief Returns how long a sound plays for in nanoseconds.
+*/
+qint64
+FeedbackPlayer::soundDuration(int sound) const
+{
+  if (sound < 0 || sound >= soundCount()) {
+    return 0;
+  }
+
+  qint64 frames =
+    qint64(m_sounds[size_t(sound)].size()) / m_settings.channelCount;
+  return qint64(double(frames) * 1.0e9 / m_settings.sampleRate);
+}
+
+/*!
+   \brief Opens and starts the output stream, which then plays silence
+   until a sound is played. Returns false if the stream could not be
+   opened.
+*/
+bool
+FeedbackPlayer::open()
+{
+  if (isOpen()) {
+    return true;
+  }
+
+  if (!m_initialised || m_settings.device < 0) {
+    return false;
+  }
+
+  const PaDeviceInfo* info = Pa_GetDeviceInfo(m_settings.device);
+  PaStreamParameters outputParameters;
+  outputParameters.device = m_settings.device;
+  outputParameters.channelCount = m_settings.channelCount;
+  outputParameters.sampleFormat = paFloat32;
+  outputParameters.suggestedLatency = m_settings.suggestedLatency > 0.0
+                                        ? m_settings.suggestedLatency
+                                        : info->defaultLowOutputLatency;
+  outputParameters.hostApiSpecificStreamInfo = nullptr;
+
+  PaError err = Pa_OpenStream(&m_stream,
+                              nullptr,
+                              &outputParameters,
+                              m_settings.sampleRate,
+                              unsigned(m_settings.framesPerBuffer),
+                              paClipOff,
+                              playbackCallback,
+                              this);
+
+  if (err != paNoError) {
+    qWarning() << tr("unable to open output stream: %1")
+                    .arg(Pa_GetErrorText(err));
+    m_stream = nullptr;
+    return false;
+  }
+
+  const PaStreamInfo* streamInfo = Pa_GetStreamInfo(m_stream);
+
+  if (streamInfo) {
+    m_outputLatency = streamInfo->outputLatency;
+  }
+
+  m_clock.reset();
+  m_playedRead = m_playedWritten.load(std::memory_order_acquire);
+  err = Pa_StartStream(m_stream);
+
+  if (err != paNoError) {
+    qWarning() << tr("unable to start output stream");
+    Pa_CloseStream(m_stream);
+    m_stream = nullptr;
+    return false;
+  }
+
+  m_playedTimer.start(PLAYED_INTERVAL);
+  return true;
+}
+
+/*!
+   \brief Stops and closes the output stream.
+*/
+void
+FeedbackPlayer::close()
+{
+  if (!m_stream) {
+    return;
+  }
+
+  Pa_StopStream(m_stream);
+  Pa_CloseStream(m_stream);
+  m_stream = nullptr;
+  m_playing = -1;
+  m_playedTimer.stop();
+  emitPlayed();
+}
+
+bool
+FeedbackPlayer::isOpen() const
+{
+  return m_stream != nullptr;
+}
+
+/*!
+   \brief Starts a sound at the next output buffer. Returns false if the
+   player is not open or there is no such sound.
+
+   This only stores the request, so it is safe to call from any thread,
+   including straight from the detection thread on a hotword.
+*/
+bool
+FeedbackPlayer::play(int sound)
+{
+  if (!isOpen() || sound < 0 || sound >= soundCount()) {
+    return false;
+  }
+
+  m_requestTime.store(DeviceClock::steadyNow(), std::memory_order_relaxed);
+  m_request.store(sound, std::memory_order_release);
+  return true;
+}
+
+/*!
+   \brief Returns the gate every sound is scheduled on as it starts, or
+   nullptr if there is none.
+*/
+PlaybackGate*
+FeedbackPlayer::playbackGate() const
+{
+  return m_gate.load(std::memory_order_acquire);
+}
+
+/*!
+   \brief Schedules every sound on gate, from the audio callback, as its
+   first sample reaches the speaker. The callback becomes the gate's only
+   writer, and the gate must outlive the player or be replaced first.
+*/
+void
+FeedbackPlayer::setPlaybackGate(PlaybackGate* gate)
+{
+  m_gate.store(gate, std::memory_order_release);
+}
+
+/*!
+   \brief Returns the stream parameters, with the device, rate and channel
+   count actually used.
+*/
+PlaybackSettings
+FeedbackPlayer::settings() const
+{
+  return m_settings;
+}
+
+/*!
+   \brief Returns the output latency reported by PortAudio in seconds.
+*/
+double
+FeedbackPlayer::outputLatency() const
+{
+  return m_outputLatency;
+}
+
+/*!
+   \brief Returns the clock that maps the output stream time onto the
+   steady clock.
+*/
+DeviceClock*
+FeedbackPlayer::clock()
+{
+  return &m_clock;
+}
+
+/*!
+   \brief Returns the number of callbacks in which the device ran out of
+   output.
+*/
+quint64
+FeedbackPlayer::underflowCount() const
+{
+  return m_underflows;
+}
+
+/*!
+   \brief Fills one output buffer. Called by the callback.
+
+   This starts any requested sound, copies the next part of the sound
+   playing, and pads with silence. A start is scheduled on the playback
+   gate and queued for played(), both lock free, so it neither allocates
+   nor locks.
+*/
+void
+FeedbackPlayer::render(float* output,
+                       int frames,
+                       const PaStreamCallbackTimeInfo* timeInfo,
+                       PaStreamCallbackFlags flags)
+{
+  const int channels = m_settings.channelCount;
+
+  if (flags & paOutputUnderflow) {
+    m_underflows++;
+  }
+
+  if (timeInfo) {
+    m_clock.update(timeInfo->currentTime);
+  }
+
+  int request = m_request.exchange(-1, std::memory_order_acquire);
+
+  if (request >= 0) {
+    m_playing = request;
+    m_position = 0;
+
+    // not every host API fills in the DAC time, estimate it from the
+    // callback time and the output latency.
+    double dacTime = (timeInfo ? timeInfo->outputBufferDacTime : 0.0);
+
+    if (dacTime <= 0.0 && timeInfo) {
+      dacTime = timeInfo->currentTime + m_outputLatency;
+    }
+
+    qint64 firstSample = m_clock.toSteady(dacTime);
+    PlaybackGate* gate = m_gate.load(std::memory_order_acquire);
+
+    if (gate) {
+      gate->schedule(request, firstSample, soundDuration(request));
+    }
+
+    quint64 written = m_playedWritten.load(std::memory_order_relaxed);
+    PlayedSlot& slot = m_played[written % PLAYED_SLOTS];
+    slot.sound.store(request, std::memory_order_relaxed);
+    slot.requested.store(m_requestTime.load(std::memory_order_relaxed),
+                         std::memory_order_relaxed);
+    slot.firstSample.store(firstSample, std::memory_order_relaxed);
+    m_playedWritten.store(written + 1, std::memory_order_release);
+  }
+
+  size_t wanted = size_t(frames) * size_t(channels);
+  size_t copied = 0;
+
+  if (m_playing >= 0) {
+    const std::vector<float>& sound = m_sounds[size_t(m_playing)];
+    copied = std::min(wanted, sound.size() - m_position);
+    std::memcpy(output, sound.data() + m_position, copied * sizeof(float));
+    m_position += copied;
+
+    if (m_position >= sound.size()) {
+      m_playing = -1;
+    }
+  }
+
+  std::fill(output + copied, output + wanted, 0.0f);
+}
+
+/* Emits played() for every start the callback has queued since the last
+   call. Starts that were overwritten before they could be read, more than
+   PLAYED_SLOTS in one interval, are skipped.*/
+void
+FeedbackPlayer::emitPlayed()
+{
+  quint64 written = m_playedWritten.load(std::memory_order_acquire);
+
+  if (written - m_playedRead > quint64(PLAYED_SLOTS)) {
+    m_playedRead = written - quint64(PLAYED_SLOTS);
+  }
+
+  for (; m_playedRead < written; m_playedRead++) {
+    const PlayedSlot& slot = m_played[m_playedRead % PLAYED_SLOTS];
+    int sound = slot.sound.load(std::memory_order_relaxed);
+    qint64 requested = slot.requested.load(std::memory_order_relaxed);
+    qint64 firstSample = slot.firstSample.load(std::memory_order_relaxed);
+
+    // the callback may have reused the slot while we read it.
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (m_playedWritten.load(std::memory_order_relaxed) - m_playedRead >
+        quint64(PLAYED_SLOTS)) {
+      continue;
+    }
+
+    emit played(sound, requested, firstSample);
+  }
+}
+
+/* Looks up the output device and fills in the rate and channel count it
+   defaults to.*/
+bool
+FeedbackPlayer::resolveDevice()
+{
+  PaDeviceIndex device = paNoDevice;
+
+  if (m_settings.device < 0) {
+    device = Pa_GetDefaultOutputDevice();
+
+  } else if (m_settings.device < Pa_GetDeviceCount()) {
+    device = m_settings.device;
+  }
+
+  if (device == paNoDevice) {
+    qWarning() << tr("Error: No output device %1.").arg(m_settings.device);
+    m_settings.device = -1;
+    m_settings.sampleRate = 0.0;
+    return false;
+  }
+
+  const PaDeviceInfo* info = Pa_GetDeviceInfo(device);
+
+  if (!info || info->maxOutputChannels <= 0) {
+    qWarning() << tr("device %1 has no outputs.").arg(device);
+    m_settings.device = -1;
+    m_settings.sampleRate = 0.0;
+    return false;
+  }
+
+  m_settings.device = device;
+
+  if (m_settings.sampleRate <= 0.0) {
+    m_settings.sampleRate = info->defaultSampleRate;
+  }
+
+  if (m_settings.channelCount <= 0) {
+    m_settings.channelCount = std::min(2, info->maxOutputChannels);
+  }
+
+  m_settings.channelCount =
+    std::min(m_settings.channelCount, info->maxOutputChannels);
+  return true;
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,156 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef FEEDBACKPLAYER_H
+#define FEEDBACKPLAYER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QtDebug>
+
+#include <atomic>
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+#include "deviceclock.h"
+#include "portaudio.h"
+
+namespace SpeechRecognition {
+
+class PlaybackGate;
+
+/*!
+  \brief The stream parameters of the feedback output device.
+
+  A device of -1 is the default output device. A sample rate or channel
+  count of zero is taken from the device, its default rate and at most two
+  channels, and a suggested latency of zero is its default low latency.
+*/
+struct PlaybackSettings
+{
+  int device = -1;
+  double sampleRate = 0.0;
+  int channelCount = 0;
+  int framesPerBuffer = 256;
+  double suggestedLatency = 0.0;
+};
+
+/*!
+  \class FeedbackPlayer
+  \brief The FeedbackPlayer class plays short acknowledgement sounds, such
+  as resources/ding.wav and dong.wav, with as little delay as possible.
+
+  Sounds are decoded once by addSound(), resampled and spread over the
+  output channels, and kept as interleaved float at the stream's rate, so
+  the audio callback only copies. The output stream is opened once by
+  open() and runs for the life of the player, playing silence between
+  sounds, so a sound never waits for a device to open.
+
+  play() is lock free and may be called from any thread, the detection
+  thread included. It stamps the request with the steady clock and the
+  callback starts the sound at the beginning of its next buffer. The DAC
+  time PortAudio gives for that buffer is mapped onto the steady clock, so
+  played() reports exactly when the first sample of each sound reached the
+  speaker, and so the latency from the request. A new sound cuts off one
+  that is still playing.
+
+  The callback never emits a signal, which would allocate and lock. It
+  hands each start to a small lock free queue, and a timer on the player's
+  own thread emits played() from it within about 10 ms. Anything that
+  must know at once, such as the detection pipeline's PlaybackGate, is
+  given to setPlaybackGate() and scheduled straight from the callback.
+
+  The device is looked up when the player is created, so sounds can be
+  prepared for it, and all sounds must be added before open().
+*/
+class SPEECHRECOGNISER_EXPORT FeedbackPlayer : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit FeedbackPlayer(const PlaybackSettings& settings = PlaybackSettings(),
+                          QObject* parent = nullptr);
+  ~FeedbackPlayer() override;
+
+  int addSound(const QString& filename);
+  int soundCount() const;
+  qint64 soundDuration(int sound) const;
+
+  bool open();
+  void close();
+  bool isOpen() const;
+
+  bool play(int sound);
+
+  PlaybackGate* playbackGate() const;
+  void setPlaybackGate(PlaybackGate* gate);
+
+  PlaybackSettings settings() const;
+  double outputLatency() const;
+  DeviceClock* clock();
+  quint64 underflowCount() const;
+
+  void render(float* output,
+              int frames,
+              const PaStreamCallbackTimeInfo* timeInfo,
+              PaStreamCallbackFlags flags);
+
+signals:
+  void played(int sound, qint64 requested, qint64 firstSample);
+
+private:
+  // the starts the callback has queued for played(), a power of two.
+  static const int PLAYED_SLOTS = 16;
+
+  struct PlayedSlot
+  {
+    std::atomic<int> sound;
+    std::atomic<qint64> requested;
+    std::atomic<qint64> firstSample;
+  };
+
+  PlaybackSettings m_settings;
+  PaStream* m_stream;
+  double m_outputLatency;
+  DeviceClock m_clock;
+  bool m_initialised;
+  std::vector<std::vector<float>> m_sounds;
+
+  std::atomic<int> m_request;
+  std::atomic<qint64> m_requestTime;
+  std::atomic<quint64> m_underflows;
+  std::atomic<PlaybackGate*> m_gate;
+  PlayedSlot m_played[PLAYED_SLOTS];
+  std::atomic<quint64> m_playedWritten;
+  quint64 m_playedRead;
+  QTimer m_playedTimer;
+
+  // owned by the callback.
+  int m_playing;
+  size_t m_position;
+
+  bool resolveDevice();
+  void emitPlayed();
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // FEEDBACKPLAYER_H
@@ -0,0 +1,392 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "fft.h"
+
+namespace SpeechRecognition {
+
+/* One stage's butterflies on a group of n pairs, a += w * b and
+   b = a - w * b, with the twiddles for the group in wr, wi.*/
+static void
+butterflies(float* ar,
+            float* ai,
+            float* br,
+            float* bi,
+            const float* wr,
+            const float* wi,
+            int n)
+{
+  int k = 0;
+
+#if defined(__AVX2__)
+  for (; k + 8 <= n; k += 8) {
+    __m256 xr = _mm256_loadu_ps(br + k), xi = _mm256_loadu_ps(bi + k);
+    __m256 cr = _mm256_loadu_ps(wr + k), ci = _mm256_loadu_ps(wi + k);
+    __m256 tr = _mm256_sub_ps(_mm256_mul_ps(xr, cr), _mm256_mul_ps(xi, ci));
+    __m256 ti = _mm256_add_ps(_mm256_mul_ps(xr, ci), _mm256_mul_ps(xi, cr));
+    __m256 yr = _mm256_loadu_ps(ar + k), yi = _mm256_loadu_ps(ai + k);
+    _mm256_storeu_ps(br + k, _mm256_sub_ps(yr, tr));
+    _mm256_storeu_ps(bi + k, _mm256_sub_ps(yi, ti));
+    _mm256_storeu_ps(ar + k, _mm256_add_ps(yr, tr));
+    _mm256_storeu_ps(ai + k, _mm256_add_ps(yi, ti));
+  }
+#elif defined(__SSE2__)
+  for (; k + 4 <= n; k += 4) {
+    __m128 xr = _mm_loadu_ps(br + k), xi = _mm_loadu_ps(bi + k);
+    __m128 cr = _mm_loadu_ps(wr + k), ci = _mm_loadu_ps(wi + k);
+    __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, cr), _mm_mul_ps(xi, ci));
+    __m128 ti = _mm_add_ps(_mm_mul_ps(xr, ci), _mm_mul_ps(xi, cr));
+    __m128 yr = _mm_loadu_ps(ar + k), yi = _mm_loadu_ps(ai + k);
+    _mm_storeu_ps(br + k, _mm_sub_ps(yr, tr));
+    _mm_storeu_ps(bi + k, _mm_sub_ps(yi, ti));
+    _mm_storeu_ps(ar + k, _mm_add_ps(yr, tr));
+    _mm_storeu_ps(ai + k, _mm_add_ps(yi, ti));
+  }
+#elif defined(__ARM_NEON)
+  for (; k + 4 <= n; k += 4) {
+    float32x4_t xr = vld1q_f32(br + k), xi = vld1q_f32(bi + k);
+    float32x4_t cr = vld1q_f32(wr + k), ci = vld1q_f32(wi + k);
+    float32x4_t tr = vmlsq_f32(vmulq_f32(xr, cr), xi, ci);
+    float32x4_t ti = vmlaq_f32(vmulq_f32(xr, ci), xi, cr);
+    float32x4_t yr = vld1q_f32(ar + k), yi = vld1q_f32(ai + k);
+    vst1q_f32(br + k, vsubq_f32(yr, tr));
+    vst1q_f32(bi + k, vsubq_f32(yi, ti));
+    vst1q_f32(ar + k, vaddq_f32(yr, tr));
+    vst1q_f32(ai + k, vaddq_f32(yi, ti));
+  }
+#endif
+
+  for (; k < n; k++) {
+    float tr = br[k] * wr[k] - bi[k] * wi[k];
+    float ti = br[k] * wi[k] + bi[k] * wr[k];
+    br[k] = ar[k] - tr;
+    bi[k] = ai[k] - ti;
+    ar[k] += tr;
+    ai[k] += ti;
+  }
+}
+
+/*!
+   \brief Creates a transform of size real samples, rounded up to a power
+   of two of at least 4.
+*/
+Fft::Fft(int size)
+  : m_size(4)
+{
+  while (m_size < size) {
+    m_size *= 2;
+  }
+
+  m_half = m_size / 2;
+  m_reverse.resize(size_t(m_half));
+  m_workRe.resize(size_t(m_half));
+  m_workIm.resize(size_t(m_half));
+  int bits = 0;
+
+  while ((1 << bits) < m_half) {
+    bits++;
+  }
+
+  for (int n = 0; n < m_half; n++) {
+    int reversed = 0;
+
+    for (int b = 0; b < bits; b++) {
+      reversed |= ((n >> b) & 1) << (bits - 1 - b);
+    }
+
+    m_reverse[size_t(n)] = reversed;
+  }
+
+  for (int h = 1; h < m_half; h *= 2) {
+    for (int k = 0; k < h; k++) {
+      double angle = -M_PI * k / h;
+      m_stageRe.push_back(float(std::cos(angle)));
+      m_stageIm.push_back(float(std::sin(angle)));
+    }
+  }
+
+  for (int k = 0; k <= m_half; k++) {
+    double angle = -2.0 * M_PI * k / m_size;
+    m_packRe.push_back(float(std::cos(angle)));
+    m_packIm.push_back(float(std::sin(angle)));
+  }
+}
+
+/*!
+   \brief Returns the number of real samples in a block.
+*/
+int
+Fft::size() const
+{
+  return m_size;
+}
+
+/*!
+   \brief Returns the number of bins in a spectrum, size() / 2 + 1.
+*/
+int
+Fft::bins() const
+{
+  return m_half + 1;
+}
+
+/*!
+   \brief Transforms size() real samples from input into bins() bins in re
+   and im.
+*/
+void
+Fft::forward(const float* input, float* re, float* im)
+{
+  for (int n = 0; n < m_half; n++) {
+    m_workRe[size_t(m_reverse[size_t(n)])] = input[2 * n];
+    m_workIm[size_t(m_reverse[size_t(n)])] = input[2 * n + 1];
+  }
+
+  transform();
+
+  // the even and odd samples were transformed together as one complex
+  // block, pull the two halves apart and combine them.
+  const float* zr = m_workRe.data();
+  const float* zi = m_workIm.data();
+  re[0] = zr[0] + zi[0];
+  im[0] = 0.0f;
+  re[m_half] = zr[0] - zi[0];
+  im[m_half] = 0.0f;
+
+  for (int k = 1; k < m_half; k++) {
+    float ar = zr[k], ai = zi[k];
+    float br = zr[m_half - k], bi = -zi[m_half - k];
+    float evenRe = 0.5f * (ar + br), evenIm = 0.5f * (ai + bi);
+    float oddRe = 0.5f * (ai - bi), oddIm = -0.5f * (ar - br);
+    float wr = m_packRe[size_t(k)], wi = m_packIm[size_t(k)];
+    re[k] = evenRe + wr * oddRe - wi * oddIm;
+    im[k] = evenIm + wr * oddIm + wi * oddRe;
+  }
+}
+
+/*!
+   \brief Transforms bins() bins in re and im back into size() real
+   samples in output, scaled by 1/size().
+*/
+void
+Fft::inverse(const float* re, const float* im, float* output)
+{
+  // the inverse is the forward transform of the conjugate, conjugated.
+  for (int k = 0; k < m_half; k++) {
+    float ar = re[k], ai = im[k];
+    float br = re[m_half - k], bi = -im[m_half - k];
+    float evenRe = 0.5f * (ar + br), evenIm = 0.5f * (ai + bi);
+    float dr = 0.5f * (ar - br), di = 0.5f * (ai - bi);
+    float wr = m_packRe[size_t(k)], wi = m_packIm[size_t(k)];
+    float oddRe = dr * wr + di * wi, oddIm = di * wr - dr * wi;
+    m_workRe[size_t(m_reverse[size_t(k)])] = evenRe - oddIm;
+    m_workIm[size_t(m_reverse[size_t(k)])] = -(evenIm + oddRe);
+  }
+
+  transform();
+  const float scale = 1.0f / float(m_half);
+
+  for (int n = 0; n < m_half; n++) {
+    output[2 * n] = m_workRe[size_t(n)] * scale;
+    output[2 * n + 1] = -m_workIm[size_t(n)] * scale;
+  }
+}
+
+/*!
+   \brief Adds the products of count complex bins a and b to c.
+*/
+void
+Fft::multiplyAccumulate(const float* ar,
+                        const float* ai,
+                        const float* br,
+                        const float* bi,
+                        float* cr,
+                        float* ci,
+                        int count)
+{
+  int k = 0;
+
+#if defined(__AVX2__)
+  for (; k + 8 <= count; k += 8) {
+    __m256 xr = _mm256_loadu_ps(ar + k), xi = _mm256_loadu_ps(ai + k);
+    __m256 yr = _mm256_loadu_ps(br + k), yi = _mm256_loadu_ps(bi + k);
+    __m256 pr = _mm256_sub_ps(_mm256_mul_ps(xr, yr), _mm256_mul_ps(xi, yi));
+    __m256 pi = _mm256_add_ps(_mm256_mul_ps(xr, yi), _mm256_mul_ps(xi, yr));
+    _mm256_storeu_ps(cr + k, _mm256_add_ps(_mm256_loadu_ps(cr + k), pr));
+    _mm256_storeu_ps(ci + k, _mm256_add_ps(_mm256_loadu_ps(ci + k), pi));
+  }
+#elif defined(__SSE2__)
+  for (; k + 4 <= count; k += 4) {
+    __m128 xr = _mm_loadu_ps(ar + k), xi = _mm_loadu_ps(ai + k);
+    __m128 yr = _mm_loadu_ps(br + k), yi = _mm_loadu_ps(bi + k);
+    __m128 pr = _mm_sub_ps(_mm_mul_ps(xr, yr), _mm_mul_ps(xi, yi));
+    __m128 pi = _mm_add_ps(_mm_mul_ps(xr, yi), _mm_mul_ps(xi, yr));
+    _mm_storeu_ps(cr + k, _mm_add_ps(_mm_loadu_ps(cr + k), pr));
+    _mm_storeu_ps(ci + k, _mm_add_ps(_mm_loadu_ps(ci + k), pi));
+  }
+#elif defined(__ARM_NEON)
+  for (; k + 4 <= count; k += 4) {
+    float32x4_t xr = vld1q_f32(ar + k), xi = vld1q_f32(ai + k);
+    float32x4_t yr = vld1q_f32(br + k), yi = vld1q_f32(bi + k);
+    float32x4_t r = vmlsq_f32(vmlaq_f32(vld1q_f32(cr + k), xr, yr), xi, yi);
+    float32x4_t i = vmlaq_f32(vmlaq_f32(vld1q_f32(ci + k), xr, yi), xi, yr);
+    vst1q_f32(cr + k, r);
+    vst1q_f32(ci + k, i);
+  }
+#endif
+
+  for (; k < count; k++) {
+    float pr = ar[k] * br[k] - ai[k] * bi[k];
+    float pi = ar[k] * bi[k] + ai[k] * br[k];
+    cr[k] += pr;
+    ci[k] += pi;
+  }
+}
+
+/*!
+   \brief Adds the products of the conjugate of count complex bins a with
+   b, each scaled by a real scale, to c.
+*/
+void
+Fft::conjugateMultiplyAccumulate(const float* ar,
+                                 const float* ai,
+                                 const float* br,
+                                 const float* bi,
+                                 const float* scale,
+                                 float* cr,
+                                 float* ci,
+                                 int count)
+{
+  int k = 0;
+
+#if defined(__AVX2__)
+  for (; k + 8 <= count; k += 8) {
+    __m256 xr = _mm256_loadu_ps(ar + k), xi = _mm256_loadu_ps(ai + k);
+    __m256 yr = _mm256_loadu_ps(br + k), yi = _mm256_loadu_ps(bi + k);
+    __m256 s = _mm256_loadu_ps(scale + k);
+    __m256 pr = _mm256_add_ps(_mm256_mul_ps(xr, yr), _mm256_mul_ps(xi, yi));
+    __m256 pi = _mm256_sub_ps(_mm256_mul_ps(xr, yi), _mm256_mul_ps(xi, yr));
+    _mm256_storeu_ps(
+      cr + k, _mm256_add_ps(_mm256_loadu_ps(cr + k), _mm256_mul_ps(pr, s)));
+    _mm256_storeu_ps(
+      ci + k, _mm256_add_ps(_mm256_loadu_ps(ci + k), _mm256_mul_ps(pi, s)));
+  }
+#elif defined(__SSE2__)
+  for (; k + 4 <= count; k += 4) {
+    __m128 xr = _mm_loadu_ps(ar + k), xi = _mm_loadu_ps(ai + k);
+    __m128 yr = _mm_loadu_ps(br + k), yi = _mm_loadu_ps(bi + k);
+    __m128 s = _mm_loadu_ps(scale + k);
+    __m128 pr = _mm_add_ps(_mm_mul_ps(xr, yr), _mm_mul_ps(xi, yi));
+    __m128 pi = _mm_sub_ps(_mm_mul_ps(xr, yi), _mm_mul_ps(xi, yr));
+    _mm_storeu_ps(cr + k, _mm_add_ps(_mm_loadu_ps(cr + k), _mm_mul_ps(pr, s)));
+    _mm_storeu_ps(ci + k, _mm_add_ps(_mm_loadu_ps(ci + k), _mm_mul_ps(pi, s)));
+  }
+#elif defined(__ARM_NEON)
+  for (; k + 4 <= count; k += 4) {
+    float32x4_t xr = vld1q_f32(ar + k), xi = vld1q_f32(ai + k);
+    float32x4_t yr = vld1q_f32(br + k), yi = vld1q_f32(bi + k);
+    float32x4_t s = vld1q_f32(scale + k);
+    float32x4_t pr = vmlaq_f32(vmulq_f32(xr, yr), xi, yi);
+    float32x4_t pi = vmlsq_f32(vmulq_f32(xr, yi), xi, yr);
+    vst1q_f32(cr + k, vmlaq_f32(vld1q_f32(cr + k), pr, s));
+    vst1q_f32(ci + k, vmlaq_f32(vld1q_f32(ci + k), pi, s));
+  }
+#endif
+
+  for (; k < count; k++) {
+    float pr = ar[k] * br[k] + ai[k] * bi[k];
+    float pi = ar[k] * bi[k] - ai[k] * br[k];
+    cr[k] += pr * scale[k];
+    ci[k] += pi * scale[k];
+  }
+}
+
+/*!
+   \brief Writes the power, re^2 + im^2, of count complex bins to out.
+*/
+void
+Fft::power(const float* re, const float* im, float* out, int count)
+{
+  int k = 0;
+
+#if defined(__AVX2__)
+  for (; k + 8 <= count; k += 8) {
+    __m256 r = _mm256_loadu_ps(re + k), i = _mm256_loadu_ps(im + k);
+    _mm256_storeu_ps(out + k,
+                     _mm256_add_ps(_mm256_mul_ps(r, r), _mm256_mul_ps(i, i)));
+  }
+#elif defined(__SSE2__)
+  for (; k + 4 <= count; k += 4) {
+    __m128 r = _mm_loadu_ps(re + k), i = _mm_loadu_ps(im + k);
+    _mm_storeu_ps(out + k, _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(i, i)));
+  }
+#elif defined(__ARM_NEON)
+  for (; k + 4 <= count; k += 4) {
+    float32x4_t r = vld1q_f32(re + k), i = vld1q_f32(im + k);
+    vst1q_f32(out + k, vmlaq_f32(vmulq_f32(r, r), i, i));
+  }
+#endif
+
+  for (; k < count; k++) {
+    out[k] = re[k] * re[k] + im[k] * im[k];
+  }
+}
+
+/* Runs the butterfly stages over the bit reversed work block.*/
+void
+Fft::transform()
+{
+  float* re = m_workRe.data();
+  float* im = m_workIm.data();
+
+  // the first stage's only twiddle is one.
+  for (int g = 0; g < m_half; g += 2) {
+    float r = re[g + 1], i = im[g + 1];
+    re[g + 1] = re[g] - r;
+    im[g + 1] = im[g] - i;
+    re[g] += r;
+    im[g] += i;
+  }
+
+  const float* wr = m_stageRe.data() + 1;
+  const float* wi = m_stageIm.data() + 1;
+
+  for (int h = 2; h < m_half; h *= 2) {
+    for (int g = 0; g < m_half; g += 2 * h) {
+      butterflies(re + g, im + g, re + g + h, im + g + h, wr, wi, h);
+    }
+
+    wr += h;
+    wi += h;
+  }
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,93 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef FFT_H
+#define FFT_H
+
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \class Fft
+  \brief The Fft class transforms real blocks of a fixed power of two size
+  to and from the frequency domain.
+
+  A real block of size() samples is packed into a complex block of half
+  the size, transformed by an iterative radix 2 FFT and unpacked into the
+  bins() bins from DC to Nyquist. Spectra are kept split, the real and
+  imaginary parts in separate arrays, so every butterfly stage and the
+  spectral kernels below run four or eight bins at a time with SSE, AVX or
+  NEON. The forward transform is unscaled and the inverse is scaled by
+  1/size(), so one undoes the other.
+
+  Twiddles and scratch space are allocated by the constructor, transforms
+  never allocate. A transform is not thread safe, use one Fft per thread.
+*/
+class SPEECHRECOGNISER_EXPORT Fft
+{
+public:
+  explicit Fft(int size = 512);
+
+  int size() const;
+  int bins() const;
+
+  void forward(const float* input, float* re, float* im);
+  void inverse(const float* re, const float* im, float* output);
+
+  static void multiplyAccumulate(const float* ar,
+                                 const float* ai,
+                                 const float* br,
+                                 const float* bi,
+                                 float* cr,
+                                 float* ci,
+                                 int count);
+  static void conjugateMultiplyAccumulate(const float* ar,
+                                          const float* ai,
+                                          const float* br,
+                                          const float* bi,
+                                          const float* scale,
+                                          float* cr,
+                                          float* ci,
+                                          int count);
+  static void power(const float* re, const float* im, float* out, int count);
+
+private:
+  int m_size;
+  int m_half;
+  std::vector<int> m_reverse;
+  // e^(-i pi k / h) for k < h, for each stage h = 1, 2, 4 ... in turn.
+  std::vector<float> m_stageRe;
+  std::vector<float> m_stageIm;
+  // e^(-2 pi i k / size) for k <= size / 2, for packing and unpacking.
+  std::vector<float> m_packRe;
+  std::vector<float> m_packIm;
+  std::vector<float> m_workRe;
+  std::vector<float> m_workIm;
+
+  void transform();
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // FFT_H
@@ -0,0 +1,287 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QVarLengthArray>
+
+#include <chrono>
+#include <thread>
+
+#include "deviceclock.h"
+#include "fileaudiosource.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \brief Creates a source with no file, replaying in real time in blocks of
+  512 frames.
+*/
+FileAudioSource::FileAudioSource(QObject* parent)
+  : AudioSource(parent)
+  , m_pacing(RealTime)
+  , m_framesPerBuffer(512)
+  , m_loops(1)
+  , m_maxQueued(16000)
+  , m_jitter(0)
+  , m_stallProbability(0.0)
+  , m_stall(0)
+  , m_seed(1)
+  , m_blocksSent(0)
+{}
+
+FileAudioSource::~FileAudioSource() {}
+
+/*!
+  \brief Opens a WAV file, or a compressed one written by LosslessEncoder,
+  to replay. Returns false if it cannot be used.
+*/
+bool
+FileAudioSource::open(const QString& filename)
+{
+  return m_file.open(filename);
+}
+
+/*!
+  \brief Opens a raw PCM file to replay, by default 16 kHz mono 16 bit.
+*/
+bool
+FileAudioSource::openRaw(const QString& filename, const WavFormat& format)
+{
+  return m_file.openRaw(filename, format);
+}
+
+/*!
+  \brief Sends the file block by block until it has been played loops()
+  times or stop() is called.
+*/
+void
+FileAudioSource::record()
+{
+  if (!m_file.isOpen()) {
+    qWarning() << tr("no file to replay.");
+    emit finished();
+    return;
+  }
+
+  using Clock = std::chrono::steady_clock;
+  const int channels = m_file.format().channels;
+  const double rate = m_file.format().sampleRate;
+  const Clock::time_point start = Clock::now();
+  const qint64 startNs = DeviceClock::steadyNow();
+  Clock::time_point stalledUntil = start;
+  qint64 sent = 0; // frames, over all loops
+  QVarLengthArray<float*, 16> planes(channels);
+
+  for (int loop = 0; m_loops <= 0 || loop < m_loops; loop++) {
+    for (qint64 first = 0; first < m_file.frames() && m_running;
+         first += m_framesPerBuffer) {
+      int frames = int(qMin<qint64>(m_framesPerBuffer, m_file.frames() - first));
+
+      if (m_pacing == RealTime) {
+        // the block is complete once its last frame has been captured.
+        auto due = start + std::chrono::nanoseconds(qint64(
+                             double(sent + frames) * 1.0e9 / rate));
+
+        if (m_stallProbability > 0.0 &&
+            random() < quint32(m_stallProbability * 4294967295.0)) {
+          stalledUntil = due + std::chrono::milliseconds(m_stall);
+        }
+
+        if (m_jitter > 0) {
+          due += std::chrono::microseconds(random() % quint32(m_jitter * 1000));
+        }
+
+        std::this_thread::sleep_until(std::max(due, stalledUntil));
+
+        if (m_maxQueued > 0 && queuedSamples() > m_maxQueued) {
+          countOverflow();
+          sent += frames;
+          continue;
+        }
+
+      } else {
+        while (m_running && m_maxQueued > 0 &&
+               queuedSamples() > m_maxQueued) {
+          std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+      }
+
+      AudioBlock block(channels, frames);
+
+      for (int c = 0; c < channels; c++) {
+        planes[c] = block.channel(c);
+      }
+
+      m_file.readFrames(first, frames, planes.data());
+      block.setAdcTime(double(sent) / rate);
+      block.setCaptureTime(startNs + qint64(double(sent) * 1.0e9 / rate));
+      sent += frames;
+      m_blocksSent.fetchAndAddRelaxed(1);
+      emitBlock(block);
+    }
+
+    if (!m_running) {
+      break;
+    }
+  }
+
+  m_running = false;
+  emit finished();
+}
+
+/*!
+  \brief Returns the number of channels in the file.
+*/
+int
+FileAudioSource::channelCount() const
+{
+  return m_file.format().channels;
+}
+
+/*!
+  \brief Returns the sample rate of the file.
+*/
+double
+FileAudioSource::sampleRate() const
+{
+  return m_file.format().sampleRate;
+}
+
+/*!
+  \brief Returns the frames in one play of the file.
+*/
+qint64
+FileAudioSource::frames() const
+{
+  return m_file.frames();
+}
+
+FileAudioSource::Pacing
+FileAudioSource::pacing() const
+{
+  return m_pacing;
+}
+
+/*!
+  \brief Sets whether the file is replayed at the speed it would be captured
+  or as fast as the consumer takes it. Defaults to RealTime.
+*/
+void
+FileAudioSource::setPacing(Pacing pacing)
+{
+  m_pacing = pacing;
+}
+
+int
+FileAudioSource::framesPerBuffer() const
+{
+  return m_framesPerBuffer;
+}
+
+/*!
+  \brief Sets the frames in each block. Defaults to 512, the same as
+  MicrophoneReader.
+*/
+void
+FileAudioSource::setFramesPerBuffer(int frames)
+{
+  m_framesPerBuffer = qMax(1, frames);
+}
+
+int
+FileAudioSource::loops() const
+{
+  return m_loops;
+}
+
+/*!
+  \brief Sets the number of times the file is played, zero or less loops
+  until stop() is called. Defaults to once.
+*/
+void
+FileAudioSource::setLoops(int loops)
+{
+  m_loops = loops;
+}
+
+int
+FileAudioSource::maxQueued() const
+{
+  return m_maxQueued;
+}
+
+/*!
+  \brief Sets how many frames the consumer may fall behind before blocks are
+  dropped, or in AsFastAsPossible pacing before the source waits. Zero
+  never drops or waits. Defaults to 16000, one second at 16 kHz.
+*/
+void
+FileAudioSource::setMaxQueued(int frames)
+{
+  m_maxQueued = qMax(0, frames);
+}
+
+/*!
+  \brief Delays the delivery of each block by a random time of up to
+  maxMilliseconds. Only applies to RealTime pacing.
+*/
+void
+FileAudioSource::setJitter(int maxMilliseconds)
+{
+  m_jitter = qMax(0, maxMilliseconds);
+}
+
+/*!
+  \brief Holds up delivery for milliseconds before a block with the given
+  probability. Only applies to RealTime pacing.
+*/
+void
+FileAudioSource::setStalls(double probability, int milliseconds)
+{
+  m_stallProbability = qBound(0.0, probability, 1.0);
+  m_stall = qMax(0, milliseconds);
+}
+
+/*!
+  \brief Sets the seed of the jitter and stall delays. Defaults to 1.
+*/
+void
+FileAudioSource::setSeed(quint32 seed)
+{
+  m_seed = seed;
+}
+
+/*!
+  \brief Returns the number of blocks sent, not counting those dropped.
+*/
+quint64
+FileAudioSource::blocksSent() const
+{
+  return m_blocksSent.loadAcquire();
+}
+
+quint32
+FileAudioSource::random()
+{
+  m_seed = m_seed * 1664525u + 1013904223u;
+  return m_seed;
+}
+
+} // end of namespace SpeechRecognition
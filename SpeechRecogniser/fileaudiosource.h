@@ -0,0 +1,107 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef FILEAUDIOSOURCE_H
+#define FILEAUDIOSOURCE_H
+
+#include <QObject>
+#include <QtDebug>
+
+#include "SpeechRecogniser_global.h"
+#include "audiosource.h"
+#include "wavfile.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \class FileAudioSource
+  \brief The FileAudioSource class replays a WAV or raw PCM file as if it
+  were being captured.
+
+  In RealTime pacing each block is sent when a microphone would have
+  delivered it, stamped with the capture time of its first frame. Jitter
+  delays the delivery of each block by a random amount up to a maximum, and
+  stalls hold up delivery for longer with a given probability per block,
+  after which the blocks that fell due arrive together, just as they do
+  from a busy audio thread. The random delays come from a fixed seed so a
+  run can be repeated exactly.
+
+  If the consumer falls more than maxQueued() frames behind, a block that
+  falls due is dropped and counted as an overflow, as a device's ring
+  buffer would. In AsFastAsPossible pacing the source instead waits for the
+  consumer, so no audio is lost and the replay runs at the speed of the
+  pipeline.
+*/
+class SPEECHRECOGNISER_EXPORT FileAudioSource : public AudioSource
+{
+  Q_OBJECT
+
+public:
+  enum Pacing
+  {
+    RealTime,
+    AsFastAsPossible,
+  };
+
+  explicit FileAudioSource(QObject* parent = nullptr);
+  ~FileAudioSource() override;
+
+  bool open(const QString& filename);
+  bool openRaw(const QString& filename, const WavFormat& format = WavFormat());
+
+  void record() override;
+  int channelCount() const override;
+  double sampleRate() const override;
+  qint64 frames() const;
+
+  Pacing pacing() const;
+  void setPacing(Pacing pacing);
+  int framesPerBuffer() const;
+  void setFramesPerBuffer(int frames);
+  int loops() const;
+  void setLoops(int loops);
+  int maxQueued() const;
+  void setMaxQueued(int frames);
+
+  void setJitter(int maxMilliseconds);
+  void setStalls(double probability, int milliseconds);
+  void setSeed(quint32 seed);
+
+  quint64 blocksSent() const;
+
+private:
+  WavFile m_file;
+  Pacing m_pacing;
+  int m_framesPerBuffer;
+  int m_loops;
+  int m_maxQueued;
+  int m_jitter;
+  double m_stallProbability;
+  int m_stall;
+  quint32 m_seed;
+  QAtomicInteger<quint64> m_blocksSent;
+
+  quint32 random();
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // FILEAUDIOSOURCE_H
@@ -0,0 +1,293 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QtGlobal>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "gaincontrol.h"
+
+namespace SpeechRecognition {
+
+static float
+fromDb(float db)
+{
+  return std::pow(10.0f, db / 20.0f);
+}
+
+/*!
+   \brief Creates a gain control for audio at sampleRate, in Samples mode.
+*/
+GainControl::GainControl(int sampleRate, const GainControlConfig& config)
+  : m_sampleRate(sampleRate)
+  , m_mode(Samples)
+  , m_vad(sampleRate)
+  , m_levelValid(false)
+  , m_level(0.0f)
+  , m_gainDb(0.0f)
+  , m_applied(1.0f)
+  , m_gain(1.0f)
+  , m_speechBlocks(0)
+  , m_limitedBlocks(0)
+{
+  setConfig(config);
+}
+
+GainControlConfig
+GainControl::config() const
+{
+  return m_config;
+}
+
+/*!
+   \brief Sets the configuration. This resets the gain to 0 dB.
+*/
+void
+GainControl::setConfig(const GainControlConfig& config)
+{
+  m_config = config;
+  // only the gate's decision is used, so it keeps no lookback.
+  EnergyGateConfig vad = m_vad.config();
+  vad.lookbackMs = 0;
+  m_vad.setConfig(vad);
+  reset();
+}
+
+/*!
+   \brief Sets the sample rate of the audio. This resets the gain.
+*/
+void
+GainControl::setSampleRate(int sampleRate)
+{
+  m_sampleRate = sampleRate;
+  m_vad.setSampleRate(sampleRate);
+  reset();
+}
+
+/*!
+   \brief Returns where the gain is applied.
+*/
+GainControl::Mode
+GainControl::mode() const
+{
+  return m_mode;
+}
+
+/*!
+   \brief Sets where the gain is applied.
+*/
+void
+GainControl::setMode(Mode mode)
+{
+  m_mode = mode;
+}
+
+/*!
+   \brief Returns the voice activity detector, to tune its thresholds.
+*/
+EnergyGate&
+GainControl::voiceDetector()
+{
+  return m_vad;
+}
+
+/*!
+   \brief Measures count samples and updates the gain. In Samples mode the
+   gain is also applied to them in place.
+*/
+void
+GainControl::process(float* data, int count)
+{
+  if (count <= 0) {
+    return;
+  }
+
+  EnergyGate::State state = m_vad.process(data, count);
+  const float seconds = float(count) / float(m_sampleRate);
+  const float rms = m_vad.rms();
+  const float peak = m_vad.peak();
+
+  if (state == EnergyGate::Opening || state == EnergyGate::Open) {
+    // averaged as power, so a loud syllable counts for what it is.
+    float power = rms * rms;
+
+    if (m_levelValid) {
+      float keep = std::exp(-seconds / qMax(0.01f, m_config.levelSeconds));
+      m_level = keep * m_level + (1.0f - keep) * power;
+
+    } else {
+      m_level = power;
+      m_levelValid = true;
+    }
+
+    m_speechBlocks++;
+  }
+
+  if (m_levelValid && m_level > 0.0f) {
+    float wanted = m_config.targetDb - 10.0f * std::log10(m_level);
+    wanted = qBound(m_config.minimumGainDb, wanted, m_config.maximumGainDb);
+
+    if (wanted > m_gainDb) {
+      m_gainDb = std::min(wanted, m_gainDb + m_config.riseDb * seconds);
+
+    } else {
+      m_gainDb = std::max(wanted, m_gainDb - m_config.fallDb * seconds);
+    }
+  }
+
+  float gain = fromDb(m_gainDb);
+  float from = m_applied;
+
+  if (peak > 0.0f && peak * gain > fromDb(m_config.peakLimitDb)) {
+    m_gainDb = m_config.peakLimitDb - 20.0f * std::log10(peak);
+    gain = fromDb(m_gainDb);
+    // no ramp, the start of the block would still be too loud.
+    from = gain;
+    m_limitedBlocks++;
+  }
+
+  if (m_mode == Samples) {
+    applyGain(data, count, from, gain);
+  }
+
+  m_applied = gain;
+  m_gain.store(gain, std::memory_order_relaxed);
+}
+
+/*!
+   \brief Sets the gain back to 0 dB and forgets the speech level. The
+   totals are kept.
+*/
+void
+GainControl::reset()
+{
+  m_vad.reset();
+  m_levelValid = false;
+  m_level = 0.0f;
+  m_gainDb = 0.0f;
+  m_applied = 1.0f;
+  m_gain.store(1.0f, std::memory_order_relaxed);
+}
+
+/*!
+   \brief Returns the gain as a factor.
+*/
+float
+GainControl::gain() const
+{
+  return m_gain.load(std::memory_order_relaxed);
+}
+
+/*!
+   \brief Returns the gain in dB.
+*/
+float
+GainControl::gainDb() const
+{
+  return 20.0f * std::log10(gain());
+}
+
+/*!
+   \brief Returns the average speech level before the gain, in dB full
+   scale, or -100 if no speech has been heard.
+*/
+float
+GainControl::speechLevelDb() const
+{
+  return (m_levelValid && m_level > 0.0f ? 10.0f * std::log10(m_level)
+                                         : -100.0f);
+}
+
+/*!
+   \brief Returns the number of blocks taken as speech.
+*/
+unsigned long long
+GainControl::speechBlocks() const
+{
+  return m_speechBlocks;
+}
+
+/*!
+   \brief Returns the number of blocks whose peak forced the gain down.
+*/
+unsigned long long
+GainControl::limitedBlocks() const
+{
+  return m_limitedBlocks;
+}
+
+/*!
+   \brief Multiplies count samples by a gain that moves in a straight line
+   from from towards to, reaching it at the last sample.
+*/
+void
+GainControl::applyGain(float* data, int count, float from, float to)
+{
+  const float step = (count > 0 ? (to - from) / float(count) : 0.0f);
+  int i = 0;
+
+#if defined(__AVX2__)
+  const __m256 lanes =
+    _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+  __m256 g = _mm256_add_ps(_mm256_set1_ps(from + step),
+                           _mm256_mul_ps(_mm256_set1_ps(step), lanes));
+  const __m256 advance = _mm256_set1_ps(8.0f * step);
+
+  for (; i + 8 <= count; i += 8) {
+    _mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), g));
+    g = _mm256_add_ps(g, advance);
+  }
+#elif defined(__SSE2__)
+  __m128 g = _mm_add_ps(
+    _mm_set1_ps(from + step),
+    _mm_mul_ps(_mm_set1_ps(step), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f)));
+  const __m128 advance = _mm_set1_ps(4.0f * step);
+
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), g));
+    g = _mm_add_ps(g, advance);
+  }
+#elif defined(__ARM_NEON)
+  const float lanes[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+  float32x4_t g = vmlaq_n_f32(vdupq_n_f32(from + step), vld1q_f32(lanes), step);
+  const float32x4_t advance = vdupq_n_f32(4.0f * step);
+
+  for (; i + 4 <= count; i += 4) {
+    vst1q_f32(data + i, vmulq_f32(vld1q_f32(data + i), g));
+    g = vaddq_f32(g, advance);
+  }
+#endif
+
+  for (; i < count; i++) {
+    data[i] *= from + step * float(i + 1);
+  }
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,121 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef GAINCONTROL_H
+#define GAINCONTROL_H
+
+#include <atomic>
+
+#include "SpeechRecogniser_global.h"
+#include "energygate.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \brief The settings of GainControl. Levels are RMS in dB full scale.
+*/
+struct SPEECHRECOGNISER_EXPORT GainControlConfig
+{
+  //! The speech level the gain aims for.
+  float targetDb = -20.0f;
+  //! The lowest gain, in dB.
+  float minimumGainDb = -10.0f;
+  //! The highest gain, in dB. Much more than this only lifts the noise.
+  float maximumGainDb = 30.0f;
+  //! The seconds of speech the level is averaged over.
+  float levelSeconds = 1.0f;
+  //! How fast the gain may rise, in dB per second.
+  float riseDb = 6.0f;
+  //! How fast the gain may fall, in dB per second.
+  float fallDb = 30.0f;
+  //! The peak the gain may lift a block to, in dB full scale. A louder
+  //! block drops the gain at once.
+  float peakLimitDb = -1.0f;
+};
+
+/*!
+  \class GainControl
+  \brief The GainControl class keeps the speech reaching the detector at a
+  steady level, whatever the microphone.
+
+  Each block is measured by an EnergyGate used as a voice activity
+  detector. Only blocks it passes count towards the speech level, so the
+  gain does not creep up through silence and then blast the next word. The
+  gain moves towards the one that would bring the speech level to the
+  target, rising slowly and falling faster, and drops at once if a block
+  would otherwise peak above peakLimitDb.
+
+  In Samples mode the gain is applied to the float samples, ramped across
+  each block, before they are converted to 16 bit, so a weak microphone
+  keeps its resolution and a hot one does not clip. In Detector mode the
+  samples are left alone and DetectionPipeline passes gain() to
+  SnowboyDetect::SetAudioGain() between chunks instead.
+
+  Nothing allocates or locks after setConfig(). gain() may be read from
+  any thread.
+*/
+class SPEECHRECOGNISER_EXPORT GainControl
+{
+public:
+  enum Mode
+  {
+    Samples,
+    Detector,
+  };
+
+  explicit GainControl(int sampleRate = 16000,
+                       const GainControlConfig& config = GainControlConfig());
+
+  GainControlConfig config() const;
+  void setConfig(const GainControlConfig& config);
+  void setSampleRate(int sampleRate);
+  Mode mode() const;
+  void setMode(Mode mode);
+  EnergyGate& voiceDetector();
+
+  void process(float* data, int count);
+  void reset();
+
+  float gain() const;
+  float gainDb() const;
+  float speechLevelDb() const;
+  unsigned long long speechBlocks() const;
+  unsigned long long limitedBlocks() const;
+
+  static void applyGain(float* data, int count, float from, float to);
+
+private:
+  GainControlConfig m_config;
+  int m_sampleRate;
+  Mode m_mode;
+  EnergyGate m_vad;
+  bool m_levelValid;
+  float m_level;
+  float m_gainDb;
+  float m_applied;
+  std::atomic<float> m_gain;
+  unsigned long long m_speechBlocks;
+  unsigned long long m_limitedBlocks;
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // GAINCONTROL_H
@@ -0,0 +1,974 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QObject>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "losslesscodec.h"
+#include "sampleconversion.h"
+
+namespace SpeechRecognition {
+
+static const char STREAM_MAGIC[4] = { 'S', 'R', 'L', 'A' };
+static const char BLOCK_MAGIC[4] = { 'S', 'R', 'L', 'B' };
+static const int VERSION = 1;
+static const int BLOCK_HEADER_BYTES = 12;
+// with 16 bit samples, 13 bit coefficients and at most 12 taps a prediction
+// is under 2^31 so it can be summed in 32 bits.
+static const int COEFFICIENT_BITS = 13;
+static const int MAX_COEFFICIENT = (1 << (COEFFICIENT_BITS - 1)) - 1;
+static const int MAX_SHIFT = 15;
+static const int PARTITION = 256;
+static const int RICE_BITS = 5;
+static const int ESCAPE = (1 << RICE_BITS) - 1;
+static const int MAX_RICE = ESCAPE - 1;
+
+static inline uint32_t
+lowBits(int bits)
+{
+  return (bits >= 32 ? 0xFFFFFFFFu : (1u << bits) - 1);
+}
+
+static inline uint32_t
+zigzag(int32_t value)
+{
+  return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+static inline int32_t
+unzigzag(uint32_t value)
+{
+  return int32_t(value >> 1) ^ -int32_t(value & 1);
+}
+
+static inline int
+leadingZeros(uint64_t value)
+{
+#if defined(__GNUC__)
+  return __builtin_clzll(value);
+#else
+  int count = 0;
+
+  while (!(value & (uint64_t(1) << 63))) {
+    value <<= 1;
+    count++;
+  }
+
+  return count;
+#endif
+}
+
+static void
+put16(uint8_t* p, quint16 value)
+{
+  p[0] = uint8_t(value & 0xFF);
+  p[1] = uint8_t(value >> 8);
+}
+
+static void
+put32(uint8_t* p, quint32 value)
+{
+  put16(p, quint16(value & 0xFFFF));
+  put16(p + 2, quint16(value >> 16));
+}
+
+static quint16
+get16(const uint8_t* p)
+{
+  return quint16(p[0] | (p[1] << 8));
+}
+
+static quint32
+get32(const uint8_t* p)
+{
+  return quint32(get16(p)) | (quint32(get16(p + 2)) << 16);
+}
+
+/* Writes bits most significant first.*/
+struct LosslessEncoder::BitWriter
+{
+  std::vector<uint8_t>& bytes;
+  uint64_t cache = 0;
+  int count = 0;
+
+  explicit BitWriter(std::vector<uint8_t>& out)
+    : bytes(out)
+  {}
+
+  // up to 32 bits at a time.
+  void write(uint32_t value, int bits)
+  {
+    cache = (cache << bits) | (value & lowBits(bits));
+    count += bits;
+
+    while (count >= 8) {
+      count -= 8;
+      bytes.push_back(uint8_t(cache >> count));
+    }
+  }
+
+  void writeRice(uint32_t value, int parameter)
+  {
+    uint32_t quotient = value >> parameter;
+
+    // the common case, the whole code in one go.
+    if (quotient + 1 + uint32_t(parameter) <= 32) {
+      write((1u << parameter) | (value & lowBits(parameter)),
+            int(quotient) + 1 + parameter);
+      return;
+    }
+
+    for (; quotient >= 32; quotient -= 32) {
+      write(0, 32);
+    }
+
+    write(1, int(quotient) + 1);
+    write(value, parameter);
+  }
+
+  void align()
+  {
+    if (count > 0) {
+      write(0, 8 - count);
+    }
+  }
+};
+
+/* Reads what a BitWriter wrote. Reading past the end gives zeros and is
+   reported by overrun().*/
+class BitReader
+{
+public:
+  BitReader(const uint8_t* data, qint64 size)
+    : m_data(data)
+    , m_end(data + size)
+    , m_cache(0)
+    , m_count(0)
+    , m_padding(0)
+  {}
+
+  uint32_t read(int bits)
+  {
+    if (bits == 0) {
+      return 0;
+    }
+
+    if (m_count < bits) {
+      refill();
+    }
+
+    m_count -= bits;
+    return uint32_t(m_cache >> m_count) & lowBits(bits);
+  }
+
+  bool readUnary(uint32_t& value)
+  {
+    value = 0;
+
+    for (;;) {
+      if (m_count == 0) {
+        refill();
+      }
+
+      uint64_t window = m_cache << (64 - m_count);
+
+      if (window != 0) {
+        int zeros = leadingZeros(window);
+        value += uint32_t(zeros);
+        m_count -= zeros + 1;
+        return true;
+      }
+
+      value += uint32_t(m_count);
+      m_count = 0;
+
+      if (overrun()) {
+        return false;
+      }
+    }
+  }
+
+  bool overrun() const { return m_padding * 8 > m_count; }
+
+private:
+  const uint8_t* m_data;
+  const uint8_t* m_end;
+  uint64_t m_cache;
+  int m_count;
+  int m_padding;
+
+  void refill()
+  {
+    while (m_count <= 56) {
+      uint8_t byte = 0;
+
+      if (m_data < m_end) {
+        byte = *m_data++;
+
+      } else {
+        m_padding++;
+      }
+
+      m_cache = (m_cache << 8) | byte;
+      m_count += 8;
+    }
+  }
+};
+
+/*!
+   \brief Creates an encoder for 16 bit audio with the given number of
+   channels, coding blockFrames frames per block.
+*/
+LosslessEncoder::LosslessEncoder(int channels, int sampleRate, int blockFrames)
+  : m_channels(qMax(1, channels))
+  , m_sampleRate(sampleRate)
+  , m_blockFrames(qBound(256, blockFrames, 65535))
+  , m_maxOrder(MAX_ORDER)
+  , m_frames(0)
+  , m_pending(0)
+  , m_block(size_t(m_channels) * size_t(m_blockFrames))
+  , m_prediction(size_t(m_blockFrames))
+  , m_residual(size_t(m_blockFrames))
+  , m_windowed(size_t(m_blockFrames))
+{}
+
+int
+LosslessEncoder::channels() const
+{
+  return m_channels;
+}
+
+int
+LosslessEncoder::sampleRate() const
+{
+  return m_sampleRate;
+}
+
+/*!
+   \brief Returns the frames per block. Defaults to 4096, 256 ms at 16 kHz.
+*/
+int
+LosslessEncoder::blockFrames() const
+{
+  return m_blockFrames;
+}
+
+/*!
+   \brief Returns the highest predictor order tried. Defaults to MAX_ORDER.
+*/
+int
+LosslessEncoder::maxOrder() const
+{
+  return m_maxOrder;
+}
+
+/*!
+   \brief Sets the highest predictor order tried, from 0, no prediction at
+   all, up to MAX_ORDER. Lower orders encode faster and compress less.
+*/
+void
+LosslessEncoder::setMaxOrder(int order)
+{
+  m_maxOrder = qBound(0, order, int(MAX_ORDER));
+}
+
+/*!
+   \brief Returns the frames passed to encode() so far.
+*/
+qint64
+LosslessEncoder::frames() const
+{
+  return m_frames;
+}
+
+/*!
+   \brief Returns the stream header, which must come before the blocks.
+
+   The total frame count in it is frames(). A stream written as it goes can
+   be given its header up front and have the count patched at
+   TOTAL_FRAMES_OFFSET once it is finished. A count of zero is taken to
+   mean the stream runs to its last complete block.
+*/
+QByteArray
+LosslessEncoder::header() const
+{
+  QByteArray bytes(HEADER_BYTES, '\0');
+  uint8_t* h = reinterpret_cast<uint8_t*>(bytes.data());
+  std::memcpy(h, STREAM_MAGIC, 4);
+  h[4] = VERSION;
+  h[5] = 16;
+  put16(h + 6, quint16(m_channels));
+  put32(h + 8, quint32(m_sampleRate));
+  put32(h + 12, quint32(m_blockFrames));
+  put32(h + TOTAL_FRAMES_OFFSET, quint32(quint64(m_frames) & 0xFFFFFFFF));
+  put32(h + TOTAL_FRAMES_OFFSET + 4, quint32(quint64(m_frames) >> 32));
+  return bytes;
+}
+
+/*!
+   \brief Encodes frames of interleaved samples, appending every block
+   completed to out. Part of a block is held back until it fills or
+   flush() is called.
+*/
+void
+LosslessEncoder::encode(const int16_t* interleaved, int frames, QByteArray& out)
+{
+  while (frames > 0) {
+    int count = std::min(frames, m_blockFrames - m_pending);
+
+    for (int c = 0; c < m_channels; c++) {
+      int32_t* dst = m_block.data() + size_t(c) * size_t(m_blockFrames) +
+                     m_pending;
+      const int16_t* src = interleaved + c;
+
+      for (int i = 0; i < count; i++) {
+        dst[i] = src[i * m_channels];
+      }
+    }
+
+    interleaved += count * m_channels;
+    frames -= count;
+    m_pending += count;
+    m_frames += count;
+
+    if (m_pending == m_blockFrames) {
+      encodeBlock(out);
+    }
+  }
+}
+
+/*!
+   \brief Encodes whatever is left as a final short block.
+*/
+void
+LosslessEncoder::flush(QByteArray& out)
+{
+  if (m_pending > 0) {
+    encodeBlock(out);
+  }
+}
+
+void
+LosslessEncoder::encodeBlock(QByteArray& out)
+{
+  m_bytes.assign(size_t(BLOCK_HEADER_BYTES), 0);
+  BitWriter bits(m_bytes);
+
+  for (int c = 0; c < m_channels; c++) {
+    encodeChannel(
+      m_block.data() + size_t(c) * size_t(m_blockFrames), m_pending, bits);
+  }
+
+  bits.align();
+  uint8_t* h = m_bytes.data();
+  std::memcpy(h, BLOCK_MAGIC, 4);
+  put32(h + 4, quint32(m_bytes.size()) - BLOCK_HEADER_BYTES);
+  put32(h + 8, quint32(m_pending));
+  out.append(reinterpret_cast<const char*>(m_bytes.data()),
+             int(m_bytes.size()));
+  m_pending = 0;
+}
+
+void
+LosslessEncoder::encodeChannel(const int32_t* samples,
+                               int frames,
+                               BitWriter& bits)
+{
+  int32_t coefficients[MAX_ORDER];
+  int shift = 0;
+  int order = analyse(samples, frames, coefficients, shift);
+
+  bits.write(uint32_t(order), 4);
+
+  if (order > 0) {
+    bits.write(uint32_t(shift), 4);
+
+    for (int j = 0; j < order; j++) {
+      bits.write(uint32_t(coefficients[j]), COEFFICIENT_BITS);
+    }
+
+    for (int j = 0; j < order; j++) {
+      bits.write(uint32_t(samples[j]), 16);
+    }
+  }
+
+  predict(samples, frames, order, coefficients, shift);
+
+  const uint32_t* residual = m_residual.data();
+  int count = frames - order;
+
+  for (int start = 0; start < count; start += PARTITION) {
+    int n = std::min(PARTITION, count - start);
+    const uint32_t* u = residual + start;
+    uint64_t sum = 0;
+    uint32_t largest = 0;
+
+    for (int i = 0; i < n; i++) {
+      sum += u[i];
+      largest = std::max(largest, u[i]);
+    }
+
+    // the mean gives the parameter to within one, so cost that and the
+    // next one up exactly.
+    int parameter = 0;
+
+    while (parameter < MAX_RICE - 1 &&
+           (uint64_t(n) << (parameter + 1)) < sum) {
+      parameter++;
+    }
+
+    uint64_t cost = 0;
+    uint64_t costUp = 0;
+
+    for (int i = 0; i < n; i++) {
+      cost += u[i] >> parameter;
+      costUp += u[i] >> (parameter + 1);
+    }
+
+    cost += uint64_t(n) * uint64_t(parameter + 1);
+    costUp += uint64_t(n) * uint64_t(parameter + 2);
+
+    if (costUp < cost) {
+      parameter++;
+      cost = costUp;
+    }
+
+    int width = (largest == 0 ? 0 : 64 - leadingZeros(largest));
+
+    if (uint64_t(n) * uint64_t(width) + 6 < cost) {
+      bits.write(uint32_t(ESCAPE), RICE_BITS);
+      bits.write(uint32_t(width), 6);
+
+      for (int i = 0; i < n; i++) {
+        bits.write(u[i], width);
+      }
+
+      continue;
+    }
+
+    bits.write(uint32_t(parameter), RICE_BITS);
+
+    for (int i = 0; i < n; i++) {
+      bits.writeRice(u[i], parameter);
+    }
+  }
+}
+
+/* Fits a predictor to the samples and returns its order, filling in the
+   quantised coefficients and their shift. Zero means no prediction.*/
+int
+LosslessEncoder::analyse(const int32_t* samples,
+                         int frames,
+                         int32_t* coefficients,
+                         int& shift)
+{
+  int maxOrder = std::min(m_maxOrder, frames / 4);
+
+  if (maxOrder <= 0) {
+    return 0;
+  }
+
+  // a Welch window, recomputed only for the short last block.
+  if (int(m_window.size()) != frames) {
+    m_window.resize(size_t(frames));
+    double half = (frames - 1) / 2.0;
+    double scale = (frames + 1) / 2.0;
+
+    for (int i = 0; i < frames; i++) {
+      double x = (i - half) / scale;
+      m_window[size_t(i)] = 1.0 - x * x;
+    }
+  }
+
+  double* windowed = m_windowed.data();
+
+  for (int i = 0; i < frames; i++) {
+    windowed[i] = samples[i] * m_window[size_t(i)];
+  }
+
+  double autoc[MAX_ORDER + 1];
+
+  for (int lag = 0; lag <= maxOrder; lag++) {
+    double sum = 0.0;
+
+    for (int i = lag; i < frames; i++) {
+      sum += windowed[i] * windowed[i - lag];
+    }
+
+    autoc[lag] = sum;
+  }
+
+  if (autoc[0] <= 0.0) {
+    return 0;
+  }
+
+  // Levinson-Durbin, keeping the predictor and its error at every order.
+  double lpc[MAX_ORDER];
+  double predictors[MAX_ORDER][MAX_ORDER];
+  double errors[MAX_ORDER];
+  double error = autoc[0];
+  int orders = maxOrder;
+
+  for (int i = 0; i < maxOrder; i++) {
+    double r = -autoc[i + 1];
+
+    for (int j = 0; j < i; j++) {
+      r -= lpc[j] * autoc[i - j];
+    }
+
+    r /= error;
+    lpc[i] = r;
+    int j = 0;
+
+    for (; j < (i >> 1); j++) {
+      double tmp = lpc[j];
+      lpc[j] += r * lpc[i - 1 - j];
+      lpc[i - 1 - j] += r * tmp;
+    }
+
+    if (i & 1) {
+      lpc[j] += lpc[j] * r;
+    }
+
+    error *= (1.0 - r * r);
+
+    for (j = 0; j <= i; j++) {
+      predictors[i][j] = -lpc[j];
+    }
+
+    errors[i] = error;
+
+    if (error <= 0.0) {
+      orders = i + 1;
+      break;
+    }
+  }
+
+  // pick the order with the fewest estimated bits, residual plus header.
+  double errorScale = 0.5 / frames;
+  auto estimate = [&](double e, int order) {
+    double bps = (e > 0.0 ? 0.5 * std::log2(errorScale * e) : 0.0);
+    return std::max(0.0, bps) * (frames - order) +
+           order * (COEFFICIENT_BITS + 16);
+  };
+
+  int order = 0;
+  double best = estimate(autoc[0], 0);
+
+  for (int i = 0; i < orders; i++) {
+    double bits = estimate(errors[i], i + 1);
+
+    if (bits < best) {
+      best = bits;
+      order = i + 1;
+    }
+  }
+
+  if (order == 0) {
+    return 0;
+  }
+
+  // quantise, carrying the rounding error on so it does not build up.
+  const double* predictor = predictors[order - 1];
+  double largest = 0.0;
+
+  for (int j = 0; j < order; j++) {
+    largest = std::max(largest, std::fabs(predictor[j]));
+  }
+
+  if (largest <= 0.0) {
+    return 0;
+  }
+
+  int exponent;
+  std::frexp(largest, &exponent);
+  shift = qBound(0, COEFFICIENT_BITS - 1 - exponent, MAX_SHIFT);
+  double carry = 0.0;
+
+  for (int j = 0; j < order; j++) {
+    carry += predictor[j] * double(1 << shift);
+    long q = std::lround(carry);
+    q = std::max<long>(-MAX_COEFFICIENT, std::min<long>(MAX_COEFFICIENT, q));
+    carry -= double(q);
+    coefficients[j] = int32_t(q);
+  }
+
+  return order;
+}
+
+/* Fills m_residual with the zigzagged prediction error of every sample
+   after the first order. The prediction is summed one tap at a time across
+   the whole block, so the inner loop is a straight vector multiply-add.*/
+void
+LosslessEncoder::predict(const int32_t* samples,
+                         int frames,
+                         int order,
+                         const int32_t* coefficients,
+                         int shift)
+{
+  int count = frames - order;
+  uint32_t* residual = m_residual.data();
+
+  if (order == 0) {
+    for (int i = 0; i < count; i++) {
+      residual[i] = zigzag(samples[i]);
+    }
+
+    return;
+  }
+
+  int32_t* sum = m_prediction.data();
+  std::fill(sum, sum + count, 0);
+
+  for (int j = 0; j < order; j++) {
+    const int32_t c = coefficients[j];
+    const int32_t* src = samples + order - 1 - j;
+    int i = 0;
+
+#if defined(__AVX2__)
+    const __m256i vc = _mm256_set1_epi32(c);
+
+    for (; i + 8 <= count; i += 8) {
+      __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<__m256i*>(sum + i));
+      a = _mm256_add_epi32(a, _mm256_mullo_epi32(s, vc));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(sum + i), a);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= count; i += 4) {
+      vst1q_s32(sum + i, vmlaq_n_s32(vld1q_s32(sum + i), vld1q_s32(src + i), c));
+    }
+#endif
+
+    for (; i < count; i++) {
+      sum[i] += c * src[i];
+    }
+  }
+
+  const int32_t* target = samples + order;
+
+  for (int i = 0; i < count; i++) {
+    residual[i] = zigzag(target[i] - (sum[i] >> shift));
+  }
+}
+
+LosslessDecoder::LosslessDecoder()
+  : m_data(nullptr)
+  , m_size(0)
+  , m_channels(0)
+  , m_sampleRate(0)
+  , m_blockFrames(0)
+  , m_frames(0)
+  , m_decodedBlock(-1)
+{}
+
+/*!
+   \brief Returns true if data starts with a LosslessEncoder stream header.
+*/
+bool
+LosslessDecoder::isLossless(const char* data, qint64 size)
+{
+  return size >= LosslessEncoder::HEADER_BYTES &&
+         std::memcmp(data, STREAM_MAGIC, 4) == 0;
+}
+
+/*!
+   \brief Opens an encoded stream and indexes its blocks. Returns false if
+   the header is invalid.
+
+   The data must stay valid until the decoder is closed. A damaged or
+   incomplete block ends the stream.
+*/
+bool
+LosslessDecoder::open(const char* data, qint64 size)
+{
+  close();
+
+  if (!isLossless(data, size)) {
+    qWarning() << QObject::tr("not a lossless audio stream");
+    return false;
+  }
+
+  const uint8_t* h = reinterpret_cast<const uint8_t*>(data);
+  m_channels = get16(h + 6);
+  m_sampleRate = int(get32(h + 8));
+  m_blockFrames = int(get32(h + 12));
+
+  if (h[4] != VERSION || h[5] != 16 || m_channels <= 0 || m_sampleRate <= 0 ||
+      m_blockFrames <= 0 || m_blockFrames > 65535) {
+    qWarning() << QObject::tr("unsupported lossless audio stream");
+    m_channels = 0;
+    return false;
+  }
+
+  m_data = h;
+  m_size = size;
+  qint64 position = LosslessEncoder::HEADER_BYTES;
+
+  while (position + BLOCK_HEADER_BYTES <= size) {
+    const uint8_t* block = h + position;
+    qint64 payload = get32(block + 4);
+    int frames = int(get32(block + 8));
+
+    if (std::memcmp(block, BLOCK_MAGIC, 4) != 0 ||
+        payload > size - position - BLOCK_HEADER_BYTES || frames <= 0 ||
+        frames > m_blockFrames) {
+      break;
+    }
+
+    m_index.push_back({ position, m_frames, frames });
+    m_frames += frames;
+    position += BLOCK_HEADER_BYTES + payload;
+  }
+
+  m_decoded.resize(size_t(m_channels) * size_t(m_blockFrames));
+  return true;
+}
+
+void
+LosslessDecoder::close()
+{
+  m_data = nullptr;
+  m_size = 0;
+  m_channels = 0;
+  m_sampleRate = 0;
+  m_blockFrames = 0;
+  m_frames = 0;
+  m_index.clear();
+  m_decodedBlock = -1;
+}
+
+bool
+LosslessDecoder::isOpen() const
+{
+  return m_data != nullptr;
+}
+
+int
+LosslessDecoder::channels() const
+{
+  return m_channels;
+}
+
+int
+LosslessDecoder::sampleRate() const
+{
+  return m_sampleRate;
+}
+
+/*!
+   \brief Returns the number of frames in the complete blocks.
+*/
+qint64
+LosslessDecoder::frames() const
+{
+  return m_frames;
+}
+
+/*!
+   \brief Returns the byte offset of the block holding frame, for read
+   ahead hints.
+*/
+qint64
+LosslessDecoder::byteOffset(qint64 frame) const
+{
+  int block = findBlock(frame);
+  return (block < 0 ? m_size : m_index[size_t(block)].offset);
+}
+
+/*!
+   \brief Decodes up to count frames starting at first into planar 16 bit
+   channels, one pointer per channel. Returns the frames read, which is
+   short if a block turns out to be damaged.
+*/
+qint64
+LosslessDecoder::readFrames(qint64 first, qint64 count, int16_t* const* channels)
+{
+  qint64 done = 0;
+
+  while (done < count) {
+    int block = findBlock(first + done);
+
+    if (block < 0 || !decodeBlock(block)) {
+      break;
+    }
+
+    const Block& b = m_index[size_t(block)];
+    int offset = int(first + done - b.firstFrame);
+    int n = int(std::min<qint64>(b.frames - offset, count - done));
+
+    for (int c = 0; c < m_channels; c++) {
+      std::memcpy(channels[c] + done,
+                  m_decoded.data() + size_t(c) * size_t(m_blockFrames) + offset,
+                  size_t(n) * sizeof(int16_t));
+    }
+
+    done += n;
+  }
+
+  return done;
+}
+
+/*!
+   \brief Decodes up to count frames starting at first into planar float
+   channels, one pointer per channel. Returns the frames read.
+*/
+qint64
+LosslessDecoder::readFrames(qint64 first, qint64 count, float* const* channels)
+{
+  qint64 done = 0;
+
+  while (done < count) {
+    int block = findBlock(first + done);
+
+    if (block < 0 || !decodeBlock(block)) {
+      break;
+    }
+
+    const Block& b = m_index[size_t(block)];
+    int offset = int(first + done - b.firstFrame);
+    int n = int(std::min<qint64>(b.frames - offset, count - done));
+
+    for (int c = 0; c < m_channels; c++) {
+      convertSamples<SampleFormat::Int16, SampleFormat::Float32>(
+        m_decoded.data() + size_t(c) * size_t(m_blockFrames) + offset,
+        channels[c] + done,
+        size_t(n));
+    }
+
+    done += n;
+  }
+
+  return done;
+}
+
+/* Returns the index of the block holding frame, or -1.*/
+int
+LosslessDecoder::findBlock(qint64 frame) const
+{
+  if (frame < 0 || frame >= m_frames) {
+    return -1;
+  }
+
+  auto it = std::upper_bound(
+    m_index.begin(), m_index.end(), frame, [](qint64 f, const Block& b) {
+      return f < b.firstFrame;
+    });
+  return int(it - m_index.begin()) - 1;
+}
+
+bool
+LosslessDecoder::decodeBlock(int block)
+{
+  if (block == m_decodedBlock) {
+    return true;
+  }
+
+  const Block& b = m_index[size_t(block)];
+  const uint8_t* payload = m_data + b.offset + BLOCK_HEADER_BYTES;
+  BitReader bits(payload, qint64(get32(m_data + b.offset + 4)));
+  m_decodedBlock = -1;
+
+  for (int c = 0; c < m_channels; c++) {
+    int16_t* out = m_decoded.data() + size_t(c) * size_t(m_blockFrames);
+    int order = int(bits.read(4));
+    int shift = 0;
+    int32_t coefficients[LosslessEncoder::MAX_ORDER];
+
+    if (order > LosslessEncoder::MAX_ORDER || order > b.frames) {
+      return false;
+    }
+
+    if (order > 0) {
+      shift = int(bits.read(4));
+
+      for (int j = 0; j < order; j++) {
+        uint32_t value = bits.read(COEFFICIENT_BITS);
+        coefficients[j] = int32_t(value << (32 - COEFFICIENT_BITS)) >>
+                          (32 - COEFFICIENT_BITS);
+      }
+
+      for (int j = 0; j < order; j++) {
+        out[j] = int16_t(bits.read(16));
+      }
+    }
+
+    for (int i = order; i < b.frames;) {
+      int n = std::min(PARTITION, b.frames - i);
+      int parameter = int(bits.read(RICE_BITS));
+      int width = (parameter == ESCAPE ? int(bits.read(6)) : 0);
+
+      if (width > 32) {
+        return false;
+      }
+
+      for (int end = i + n; i < end; i++) {
+        uint32_t u;
+
+        if (parameter == ESCAPE) {
+          u = bits.read(width);
+
+        } else {
+          uint32_t quotient;
+
+          if (!bits.readUnary(quotient)) {
+            return false;
+          }
+
+          u = (quotient << parameter) | bits.read(parameter);
+        }
+
+        // the prediction is rebuilt from the samples already decoded.
+        int64_t sum = 0;
+
+        for (int j = 0; j < order; j++) {
+          sum += int64_t(coefficients[j]) * out[i - 1 - j];
+        }
+
+        int64_t sample = int64_t(unzigzag(u)) + (sum >> shift);
+
+        if (sample < -32768 || sample > 32767) {
+          return false;
+        }
+
+        out[i] = int16_t(sample);
+      }
+    }
+
+    if (bits.overrun()) {
+      return false;
+    }
+  }
+
+  m_decodedBlock = block;
+  return true;
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,165 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef LOSSLESSCODEC_H
+#define LOSSLESSCODEC_H
+
+#include <QByteArray>
+#include <QtDebug>
+
+#include <cstdint>
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \class LosslessEncoder
+  \brief The LosslessEncoder class compresses 16 bit audio without loss,
+  with linear prediction and Rice coding in the manner of FLAC.
+
+  Samples are cut into blocks of blockFrames() frames and each channel of a
+  block is coded on its own. A predictor of up to maxOrder() taps is fitted
+  to the block by Levinson-Durbin, its order chosen from the estimated
+  residual cost, and its coefficients quantised to 13 bits. The residual,
+  the difference between each sample and its prediction, is Rice coded in
+  partitions of 256 samples with a parameter per partition, falling back
+  to fixed width where Rice would cost more.
+
+  The predictor is worked out across a run of samples one tap at a time, a
+  pure multiply-add of 32 bit integers that vectorises, and the bounds on
+  the samples, coefficients and order mean it can never overflow.
+
+  Every block is independent and starts with a small header giving its
+  length, so a LosslessDecoder can find and decode any block without the
+  ones before it, and a file cut short by a crash is readable up to the
+  last complete block.
+
+  The encoder holds only one block of state, so one core can keep many
+  streams going. It writes to a QByteArray and does no I/O of its own.
+*/
+class SPEECHRECOGNISER_EXPORT LosslessEncoder
+{
+public:
+  LosslessEncoder(int channels = 1,
+                  int sampleRate = 16000,
+                  int blockFrames = 4096);
+
+  int channels() const;
+  int sampleRate() const;
+  int blockFrames() const;
+  int maxOrder() const;
+  void setMaxOrder(int order);
+  qint64 frames() const;
+
+  QByteArray header() const;
+  void encode(const int16_t* interleaved, int frames, QByteArray& out);
+  void flush(QByteArray& out);
+
+  //! The size of the stream header.
+  static const int HEADER_BYTES = 24;
+  //! Where the total frame count sits in the header.
+  static const int TOTAL_FRAMES_OFFSET = 16;
+  //! The highest predictor order.
+  static const int MAX_ORDER = 12;
+
+private:
+  struct BitWriter;
+
+  int m_channels;
+  int m_sampleRate;
+  int m_blockFrames;
+  int m_maxOrder;
+  qint64 m_frames;
+  int m_pending;
+  std::vector<int32_t> m_block;
+  std::vector<int32_t> m_prediction;
+  std::vector<uint32_t> m_residual;
+  std::vector<double> m_windowed;
+  std::vector<double> m_window;
+  std::vector<uint8_t> m_bytes;
+
+  void encodeBlock(QByteArray& out);
+  void encodeChannel(const int32_t* samples, int frames, BitWriter& bits);
+  int analyse(const int32_t* samples, int frames, int32_t* coefficients,
+              int& shift);
+  void predict(const int32_t* samples, int frames, int order,
+               const int32_t* coefficients, int shift);
+};
+
+/*!
+  \class LosslessDecoder
+  \brief The LosslessDecoder class reads back the output of a
+  LosslessEncoder.
+
+  It works straight from the encoded bytes, normally a memory mapped file,
+  which it does not own. Opening walks the block headers to build an index,
+  so any frame can be sought to, and the most recently decoded block is
+  kept so sequential reads decode each block once.
+
+  WavFile uses this to open compressed files, so anything that reads a
+  WavFile, FileAudioSource included, reads them too.
+*/
+class SPEECHRECOGNISER_EXPORT LosslessDecoder
+{
+public:
+  LosslessDecoder();
+
+  static bool isLossless(const char* data, qint64 size);
+
+  bool open(const char* data, qint64 size);
+  void close();
+  bool isOpen() const;
+
+  int channels() const;
+  int sampleRate() const;
+  qint64 frames() const;
+  qint64 byteOffset(qint64 frame) const;
+
+  qint64 readFrames(qint64 first, qint64 count, int16_t* const* channels);
+  qint64 readFrames(qint64 first, qint64 count, float* const* channels);
+
+private:
+  struct Block
+  {
+    qint64 offset;
+    qint64 firstFrame;
+    int frames;
+  };
+
+  const uint8_t* m_data;
+  qint64 m_size;
+  int m_channels;
+  int m_sampleRate;
+  int m_blockFrames;
+  qint64 m_frames;
+  std::vector<Block> m_index;
+  std::vector<int16_t> m_decoded;
+  qint64 m_decodedBlock;
+
+  int findBlock(qint64 frame) const;
+  bool decodeBlock(int block);
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // LOSSLESSCODEC_H
@@ -0,0 +1,467 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QObject>
+#include <QtDebug>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+
+#include "metrics.h"
+
+namespace SpeechRecognition {
+
+// the alignment of the histogram shards.
+static const size_t CACHE_LINE = 64;
+
+static quint64
+toBits(double value)
+{
+  quint64 bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static double
+fromBits(quint64 bits)
+{
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/* Adds to a double held as bits. Only the histogram sums and Gauge::add()
+   need this, a plain store is enough everywhere else.*/
+static void
+addBits(std::atomic<quint64>& bits, double delta)
+{
+  quint64 expected = bits.load(std::memory_order_relaxed);
+
+  while (!bits.compare_exchange_weak(expected,
+                                     toBits(fromBits(expected) + delta),
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+static QByteArray
+formatValue(double value)
+{
+  if (std::isinf(value)) {
+    return (value > 0 ? "+Inf" : "-Inf");
+  }
+
+  return QByteArray::number(value, 'g', 12);
+}
+
+Counter::Counter() {}
+
+/*!
+   \brief Adds count to the counter. Safe to call from any thread, including
+   an audio callback, it never blocks or allocates.
+*/
+void
+Counter::add(quint64 count)
+{
+  m_slots[shard()].value.fetch_add(count, std::memory_order_relaxed);
+}
+
+/*!
+   \brief Returns the total over every thread.
+*/
+quint64
+Counter::value() const
+{
+  quint64 total = 0;
+
+  for (const Slot& slot : m_slots) {
+    total += slot.value.load(std::memory_order_relaxed);
+  }
+
+  return total;
+}
+
+/*!
+   \brief Returns the shard the calling thread records into. Threads are
+   given shards in turn the first time they record, so up to SHARDS threads
+   each have one to themselves.
+*/
+int
+Counter::shard()
+{
+  static std::atomic<int> next(0);
+  thread_local int index =
+    next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+  return index;
+}
+
+Gauge::Gauge()
+  : m_bits(toBits(0.0))
+{}
+
+/*!
+   \brief Sets the gauge to value.
+*/
+void
+Gauge::set(double value)
+{
+  m_bits.store(toBits(value), std::memory_order_relaxed);
+}
+
+/*!
+   \brief Adds delta, which may be negative, to the gauge.
+*/
+void
+Gauge::add(double delta)
+{
+  addBits(m_bits, delta);
+}
+
+/*!
+   \brief Returns the current value.
+*/
+double
+Gauge::value() const
+{
+  return fromBits(m_bits.load(std::memory_order_relaxed));
+}
+
+/*!
+   \brief Creates a histogram with the given bucket upper bounds, which must
+   be in increasing order. A last bucket for everything larger is added.
+*/
+Histogram::Histogram(const std::vector<double>& bounds)
+  : m_bounds(bounds)
+  // a shard is the buckets, the overflow bucket and the sum, rounded up to
+  // whole cache lines, and the shards start on a cache line so no two share
+  // one.
+  , m_stride((bounds.size() + 2 + 7) / 8 * 8)
+  , m_slots(static_cast<std::atomic<quint64>*>(
+      qMallocAligned(m_stride * Counter::SHARDS * sizeof(std::atomic<quint64>),
+                     CACHE_LINE)))
+{
+  for (size_t i = 0; i < m_stride * Counter::SHARDS; i++) {
+    new (m_slots + i) std::atomic<quint64>(0);
+  }
+
+  for (int s = 0; s < Counter::SHARDS; s++) {
+    m_slots[size_t(s) * m_stride + m_bounds.size() + 1].store(
+      toBits(0.0), std::memory_order_relaxed);
+  }
+}
+
+Histogram::~Histogram()
+{
+  qFreeAligned(m_slots);
+}
+
+/*!
+   \brief Records one observation. Safe to call from any thread, it never
+   blocks or allocates.
+*/
+void
+Histogram::observe(double value)
+{
+  std::atomic<quint64>* shard =
+    m_slots + size_t(Counter::shard()) * m_stride;
+  size_t bucket = size_t(
+    std::lower_bound(m_bounds.begin(), m_bounds.end(), value) -
+    m_bounds.begin());
+  shard[bucket].fetch_add(1, std::memory_order_relaxed);
+  addBits(shard[m_bounds.size() + 1], value);
+}
+
+/*!
+   \brief Returns the bucket upper bounds, without the last open bucket.
+*/
+const std::vector<double>&
+Histogram::bounds() const
+{
+  return m_bounds;
+}
+
+/*!
+   \brief Returns the number of observations in each bucket, not cumulative,
+   the last being those above every bound.
+*/
+std::vector<quint64>
+Histogram::bucketCounts() const
+{
+  std::vector<quint64> counts(m_bounds.size() + 1, 0);
+
+  for (int s = 0; s < Counter::SHARDS; s++) {
+    const std::atomic<quint64>* shard = m_slots + size_t(s) * m_stride;
+
+    for (size_t b = 0; b < counts.size(); b++) {
+      counts[b] += shard[b].load(std::memory_order_relaxed);
+    }
+  }
+
+  return counts;
+}
+
+/*!
+   \brief Returns the number of observations.
+*/
+quint64
+Histogram::count() const
+{
+  quint64 total = 0;
+
+  for (quint64 bucket : bucketCounts()) {
+    total += bucket;
+  }
+
+  return total;
+}
+
+/*!
+   \brief Returns the sum of the observations.
+*/
+double
+Histogram::sum() const
+{
+  double total = 0;
+
+  for (int s = 0; s < Counter::SHARDS; s++) {
+    total += fromBits(m_slots[size_t(s) * m_stride + m_bounds.size() + 1].load(
+      std::memory_order_relaxed));
+  }
+
+  return total;
+}
+
+/*!
+   \brief Returns count bounds starting at start, each factor times the
+   last.
+*/
+std::vector<double>
+Histogram::exponentialBounds(double start, double factor, int count)
+{
+  std::vector<double> bounds;
+
+  for (int i = 0; i < count; i++, start *= factor) {
+    bounds.push_back(start);
+  }
+
+  return bounds;
+}
+
+MetricsRegistry::MetricsRegistry() {}
+
+/*!
+   \brief Returns the process wide registry.
+*/
+MetricsRegistry&
+MetricsRegistry::instance()
+{
+  static MetricsRegistry registry;
+  return registry;
+}
+
+/*!
+   \brief Returns the counter called name, creating it if need be.
+
+   Names follow the Prometheus rules, counters ending in _total.
+*/
+Counter*
+MetricsRegistry::counter(const QString& name, const QString& help)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Entry* entry = find(name, CounterType);
+
+  if (!entry->counter) {
+    entry->help = help;
+    entry->counter.reset(new Counter());
+  }
+
+  return entry->counter.get();
+}
+
+/*!
+   \brief Returns the gauge called name, creating it if need be.
+*/
+Gauge*
+MetricsRegistry::gauge(const QString& name, const QString& help)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Entry* entry = find(name, GaugeType);
+
+  if (!entry->gauge) {
+    entry->help = help;
+    entry->gauge.reset(new Gauge());
+  }
+
+  return entry->gauge.get();
+}
+
+/*!
+   \brief Returns the histogram called name, creating it with bounds if need
+   be. An existing histogram keeps its own bounds.
+*/
+Histogram*
+MetricsRegistry::histogram(const QString& name,
+                           const QString& help,
+                           const std::vector<double>& bounds)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  Entry* entry = find(name, HistogramType);
+
+  if (!entry->histogram) {
+    entry->help = help;
+    entry->histogram.reset(new Histogram(bounds));
+  }
+
+  return entry->histogram.get();
+}
+
+/*!
+   \brief Returns every metric in the Prometheus text exposition format,
+   version 0.0.4, in the order they were created.
+*/
+QByteArray
+MetricsRegistry::exposition() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  QByteArray text;
+
+  for (const std::unique_ptr<Entry>& entry : m_entries) {
+    QByteArray name = entry->name.toUtf8();
+    text += "# HELP " + name + ' ' + entry->help.toUtf8() + '\n';
+
+    switch (entry->type) {
+      case CounterType:
+        text += "# TYPE " + name + " counter\n";
+        text += name + ' ' + QByteArray::number(entry->counter->value()) + '\n';
+        break;
+
+      case GaugeType:
+        text += "# TYPE " + name + " gauge\n";
+        text += name + ' ' + formatValue(entry->gauge->value()) + '\n';
+        break;
+
+      case HistogramType: {
+        const Histogram* histogram = entry->histogram.get();
+        std::vector<quint64> counts = histogram->bucketCounts();
+        quint64 cumulative = 0;
+        text += "# TYPE " + name + " histogram\n";
+
+        for (size_t b = 0; b < counts.size(); b++) {
+          double bound = (b < histogram->bounds().size()
+                            ? histogram->bounds()[b]
+                            : HUGE_VAL);
+          cumulative += counts[b];
+          text += name + "_bucket{le=\"" + formatValue(bound) + "\"} " +
+                  QByteArray::number(cumulative) + '\n';
+        }
+
+        text += name + "_sum " + formatValue(histogram->sum()) + '\n';
+        text += name + "_count " + QByteArray::number(cumulative) + '\n';
+        break;
+      }
+    }
+  }
+
+  return text;
+}
+
+/* Returns the entry called name, adding an empty one of type if there is
+   none. A name already used for another type gets a warning and an entry
+   that is never written out, so the caller still has something to record
+   into.*/
+MetricsRegistry::Entry*
+MetricsRegistry::find(const QString& name, Type type)
+{
+  std::vector<std::unique_ptr<Entry>>* entries = &m_entries;
+
+  for (const std::unique_ptr<Entry>& entry : m_entries) {
+    if (entry->name == name) {
+      if (entry->type == type) {
+        return entry.get();
+      }
+
+      qWarning() << QObject::tr("metric %1 already has another type.")
+                      .arg(name);
+      entries = &m_detached;
+      break;
+    }
+  }
+
+  entries->emplace_back(new Entry());
+  entries->back()->name = name;
+  entries->back()->type = type;
+  return entries->back().get();
+}
+
+/*!
+   \brief Returns the pipeline's metrics, creating them on the first call.
+*/
+const PipelineMetrics&
+PipelineMetrics::instance()
+{
+  static const PipelineMetrics metrics = [] {
+    MetricsRegistry& registry = MetricsRegistry::instance();
+    // detector calls take around a millisecond, latency includes the chunk
+    // being filled and paints can take tens of milliseconds.
+    std::vector<double> fast = Histogram::exponentialBounds(0.0001, 2, 12);
+    std::vector<double> slow = Histogram::exponentialBounds(0.001, 2, 12);
+    PipelineMetrics m;
+    m.blocksCaptured = registry.counter(
+      "speechrecogniser_blocks_captured_total", "Blocks sent by the sources.");
+    m.overflows = registry.counter(
+      "speechrecogniser_overflows_total",
+      "Blocks lost because a consumer or device callback ran late.");
+    m.queueDepth = registry.gauge(
+      "speechrecogniser_queue_depth_samples",
+      "Samples sent by the sources and not yet consumed.");
+    m.detectionCalls =
+      registry.counter("speechrecogniser_detection_calls_total",
+                       "Calls to the hotword detector.");
+    m.detectionSeconds =
+      registry.histogram("speechrecogniser_detection_seconds",
+                         "Time taken by each call to the hotword detector.",
+                         fast);
+    m.detectionLatency = registry.histogram(
+      "speechrecogniser_detection_latency_seconds",
+      "Time from the end of a block's capture to its detection result.",
+      slow);
+    m.vadBlocks = registry.counter("speechrecogniser_vad_blocks_total",
+                                   "Blocks seen by the energy gate.");
+    m.vadSpeechBlocks =
+      registry.counter("speechrecogniser_vad_speech_blocks_total",
+                       "Blocks the energy gate passed as speech.");
+    m.echoRejectedBlocks = registry.counter(
+      "speechrecogniser_echo_rejected_blocks_total",
+      "Blocks the echo canceller passed through, not whole echo blocks.");
+    m.vadRatio =
+      registry.gauge("speechrecogniser_vad_ratio",
+                     "Fraction of blocks the energy gate passed as speech.");
+    m.paintSeconds = registry.histogram("speechrecogniser_plot_paint_seconds",
+                                        "Time taken to paint the plot.",
+                                        slow);
+    return m;
+  }();
+
+  return metrics;
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,215 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <QString>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \class Counter
+  \brief The Counter class is a monotonic count, such as blocks captured,
+  that any number of threads can add to without contending.
+
+  The count is split over SHARDS cache line sized slots and each thread adds
+  to its own slot with a relaxed atomic add, so the capture callback and the
+  detection thread never bounce a cache line between them. value() sums the
+  slots, which is only done when the metrics are read.
+*/
+class SPEECHRECOGNISER_EXPORT Counter
+{
+public:
+  static const int SHARDS = 16;
+
+  Counter();
+
+  Counter(const Counter&) = delete;
+  Counter& operator=(const Counter&) = delete;
+
+  void add(quint64 count = 1);
+  quint64 value() const;
+
+  static int shard();
+
+private:
+  struct alignas(64) Slot
+  {
+    std::atomic<quint64> value{ 0 };
+  };
+
+  Slot m_slots[SHARDS];
+};
+
+/*!
+  \class Gauge
+  \brief The Gauge class is a value that goes up and down, such as the
+  capture queue depth. The last value set wins.
+*/
+class SPEECHRECOGNISER_EXPORT Gauge
+{
+public:
+  Gauge();
+
+  Gauge(const Gauge&) = delete;
+  Gauge& operator=(const Gauge&) = delete;
+
+  void set(double value);
+  void add(double delta);
+  double value() const;
+
+private:
+  alignas(64) std::atomic<quint64> m_bits;
+};
+
+/*!
+  \class Histogram
+  \brief The Histogram class counts observations, such as detection
+  latencies, into fixed buckets.
+
+  The bucket upper bounds are given when the histogram is created and never
+  change. Like Counter each thread records into its own shard, the bucket
+  counts, the total count and the sum of one shard sharing as few cache
+  lines as they need, and each shard starting on a cache line of its own.
+*/
+class SPEECHRECOGNISER_EXPORT Histogram
+{
+public:
+  explicit Histogram(const std::vector<double>& bounds);
+  ~Histogram();
+
+  Histogram(const Histogram&) = delete;
+  Histogram& operator=(const Histogram&) = delete;
+
+  void observe(double value);
+
+  const std::vector<double>& bounds() const;
+  std::vector<quint64> bucketCounts() const;
+  quint64 count() const;
+  double sum() const;
+
+  static std::vector<double> exponentialBounds(double start,
+                                               double factor,
+                                               int count);
+
+private:
+  std::vector<double> m_bounds;
+  size_t m_stride;
+  std::atomic<quint64>* m_slots;
+};
+
+/*!
+  \class MetricsRegistry
+  \brief The MetricsRegistry class holds every metric of the process and
+  writes them out in the Prometheus text format.
+
+  Metrics are created once, by name, and live as long as the process, so
+  the pointers returned can be kept and used from any thread without
+  looking the name up again. Asking for a name that already exists returns
+  the existing metric.
+*/
+class SPEECHRECOGNISER_EXPORT MetricsRegistry
+{
+public:
+  static MetricsRegistry& instance();
+
+  MetricsRegistry(const MetricsRegistry&) = delete;
+  MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+  Counter* counter(const QString& name, const QString& help);
+  Gauge* gauge(const QString& name, const QString& help);
+  Histogram* histogram(const QString& name,
+                       const QString& help,
+                       const std::vector<double>& bounds);
+
+  QByteArray exposition() const;
+
+private:
+  enum Type
+  {
+    CounterType,
+    GaugeType,
+    HistogramType,
+  };
+
+  struct Entry
+  {
+    QString name;
+    QString help;
+    Type type;
+    std::unique_ptr<Counter> counter;
+    std::unique_ptr<Gauge> gauge;
+    std::unique_ptr<Histogram> histogram;
+  };
+
+  mutable std::mutex m_mutex;
+  std::vector<std::unique_ptr<Entry>> m_entries;
+  std::vector<std::unique_ptr<Entry>> m_detached;
+
+  MetricsRegistry();
+  Entry* find(const QString& name, Type type);
+};
+
+/*!
+  \brief The metrics recorded by the capture and detection path, created in
+  the MetricsRegistry on first use.
+*/
+struct SPEECHRECOGNISER_EXPORT PipelineMetrics
+{
+  //! Blocks sent by every AudioSource.
+  Counter* blocksCaptured;
+  //! Blocks lost because a consumer or a device callback ran late.
+  Counter* overflows;
+  //! Samples sent by the sources and not yet consumed.
+  Gauge* queueDepth;
+  //! Calls to the hotword detector.
+  Counter* detectionCalls;
+  //! The time taken by each call to the detector, in seconds.
+  Histogram* detectionSeconds;
+  //! From the end of a timed block's capture to its detection result.
+  Histogram* detectionLatency;
+  //! Blocks seen by energy gates.
+  Counter* vadBlocks;
+  //! Blocks energy gates passed on as speech.
+  Counter* vadSpeechBlocks;
+  //! Capture blocks the echo canceller passed through because they were not
+  //! a whole number of its blocks.
+  Counter* echoRejectedBlocks;
+  //! The fraction of blocks the last energy gate to run passed as speech.
+  Gauge* vadRatio;
+  //! The time MicrophonePlot takes to paint, in seconds.
+  Histogram* paintSeconds;
+
+  static const PipelineMetrics& instance();
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // METRICS_H
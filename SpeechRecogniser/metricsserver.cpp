@@ -0,0 +1,212 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QtDebug>
+
+#include "metrics.h"
+#include "metricsserver.h"
+
+namespace SpeechRecognition {
+
+// far more than a scrape's headers, a longer request is refused unread.
+static const int MAX_REQUEST_BYTES = 8192;
+
+MetricsServer::MetricsServer(QObject* parent)
+  : QObject(parent)
+  , m_tcp(nullptr)
+  , m_local(nullptr)
+  , m_scrapes(0)
+{}
+
+MetricsServer::~MetricsServer()
+{
+  close();
+}
+
+/*!
+   \brief Listens on port of the loopback interface, zero picking a free
+   port. Returns false if the port could not be opened.
+*/
+bool
+MetricsServer::listen(quint16 port)
+{
+  delete m_tcp;
+  m_tcp = new QTcpServer(this);
+
+  if (!m_tcp->listen(QHostAddress::LocalHost, port)) {
+    qWarning() << tr("unable to serve metrics on port %1, %2.")
+                    .arg(port)
+                    .arg(m_tcp->errorString());
+    delete m_tcp;
+    m_tcp = nullptr;
+    return false;
+  }
+
+  connect(
+    m_tcp, &QTcpServer::newConnection, this, &MetricsServer::acceptTcp);
+  return true;
+}
+
+/*!
+   \brief Listens on a Unix socket, or a named pipe on Windows, called
+   socketName. A socket left behind by an earlier run is removed first.
+   Returns false if the socket could not be opened.
+
+   Scrape it with curl --unix-socket.
+*/
+bool
+MetricsServer::listen(const QString& socketName)
+{
+  delete m_local;
+  m_local = new QLocalServer(this);
+  QLocalServer::removeServer(socketName);
+
+  if (!m_local->listen(socketName)) {
+    qWarning() << tr("unable to serve metrics on %1, %2.")
+                    .arg(socketName)
+                    .arg(m_local->errorString());
+    delete m_local;
+    m_local = nullptr;
+    return false;
+  }
+
+  connect(m_local,
+          &QLocalServer::newConnection,
+          this,
+          &MetricsServer::acceptLocal);
+  return true;
+}
+
+/*!
+   \brief Stops listening on both the port and the socket.
+*/
+void
+MetricsServer::close()
+{
+  delete m_tcp;
+  m_tcp = nullptr;
+  delete m_local;
+  m_local = nullptr;
+}
+
+/*!
+   \brief Returns the port listened on, or 0 if there is none.
+*/
+quint16
+MetricsServer::port() const
+{
+  return (m_tcp ? m_tcp->serverPort() : 0);
+}
+
+/*!
+   \brief Returns the full path of the socket listened on, or an empty
+   string if there is none.
+*/
+QString
+MetricsServer::socketPath() const
+{
+  return (m_local ? m_local->fullServerName() : QString());
+}
+
+/*!
+   \brief Returns the number of requests served.
+*/
+quint64
+MetricsServer::scrapes() const
+{
+  return m_scrapes;
+}
+
+void
+MetricsServer::acceptTcp()
+{
+  while (QTcpSocket* socket = m_tcp->nextPendingConnection()) {
+    socket->setReadBufferSize(MAX_REQUEST_BYTES);
+    connect(socket, &QTcpSocket::readyRead, socket, [this, socket]() {
+      serve(socket);
+    });
+    connect(
+      socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+  }
+}
+
+void
+MetricsServer::acceptLocal()
+{
+  while (QLocalSocket* socket = m_local->nextPendingConnection()) {
+    socket->setReadBufferSize(MAX_REQUEST_BYTES);
+    connect(socket, &QLocalSocket::readyRead, socket, [this, socket]() {
+      serve(socket);
+    });
+    connect(
+      socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+  }
+}
+
+/* Answers once the request headers have arrived. Headers that do not end
+   within MAX_REQUEST_BYTES get a 431, anything that is not a GET a 405 and
+   everything else the metrics.*/
+void
+MetricsServer::serve(QIODevice* socket)
+{
+  QByteArray request = socket->peek(MAX_REQUEST_BYTES);
+  bool complete = request.contains("\r\n\r\n") || request.contains("\n\n");
+
+  if (!complete && request.size() < MAX_REQUEST_BYTES) {
+    return;
+  }
+
+  socket->readAll();
+  QByteArray response;
+
+  if (!complete) {
+    response = "HTTP/1.0 431 Request Header Fields Too Large\r\n"
+               "Content-Length: 0\r\n\r\n";
+
+  } else if (request.startsWith("GET ")) {
+    QByteArray body = MetricsRegistry::instance().exposition();
+    response = "HTTP/1.0 200 OK\r\n"
+               "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+               "Content-Length: " +
+               QByteArray::number(body.size()) + "\r\n\r\n" + body;
+    m_scrapes++;
+
+  } else {
+    response = "HTTP/1.0 405 Method Not Allowed\r\n"
+               "Content-Length: 0\r\n\r\n";
+  }
+
+  socket->write(response);
+
+  // close once written, an HTTP/1.0 response ends with the connection.
+  if (QTcpSocket* tcp = qobject_cast<QTcpSocket*>(socket)) {
+    tcp->disconnectFromHost();
+
+  } else if (QLocalSocket* local = qobject_cast<QLocalSocket*>(socket)) {
+    local->disconnectFromServer();
+  }
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,75 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QString>
+
+#include "SpeechRecogniser_global.h"
+
+class QIODevice;
+class QLocalServer;
+class QTcpServer;
+
+namespace SpeechRecognition {
+
+/*!
+  \class MetricsServer
+  \brief The MetricsServer class serves the MetricsRegistry to Prometheus,
+  or to curl, over HTTP on a localhost port or a Unix socket.
+
+  Every request, whatever its path, gets the exposition text and the
+  connection is closed. At most 8 KB of a request is buffered, a request
+  whose headers run longer is refused. The server runs on the event loop
+  of the thread it belongs to, normally the GUI thread, and only reads the
+  metrics, so a scrape never holds up capture or detection.
+*/
+class SPEECHRECOGNISER_EXPORT MetricsServer : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit MetricsServer(QObject* parent = nullptr);
+  ~MetricsServer() override;
+
+  bool listen(quint16 port);
+  bool listen(const QString& socketName);
+  void close();
+
+  quint16 port() const;
+  QString socketPath() const;
+  quint64 scrapes() const;
+
+private:
+  QTcpServer* m_tcp;
+  QLocalServer* m_local;
+  quint64 m_scrapes;
+
+  void acceptTcp();
+  void acceptLocal();
+  void serve(QIODevice* socket);
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // METRICSSERVER_H
@@ -1,12 +1,23 @@
 
 #include <QPainter>
+#include <QThread>
 #include <QWidget>
 #include <qglobal.h>
 
+#include <chrono>
+
+#include "metrics.h"
 #include "microphoneplot.h"
+#include "spectrogram.h"
+#include "tracing.h"
 
 namespace SpeechRecognition {
 
+// the amplitude plot repaints at 20 and the spectrogram at 60 frames a
+// second.
+static const int AMPLITUDE_INTERVAL = 50;
+static const int SPECTROGRAM_INTERVAL = 16;
+
 /*!
   \brief Display plot for microphone amplitude.
 
@@ -31,19 +42,33 @@ MicrophonePlot::MicrophonePlot(
   , m_background(QColor("white"))
   , m_lineColor(QColor("black"))
   , m_sampleColor(QColor("blue"))
+  , m_mode(AmplitudeMode)
+  , m_spectrogramTime(10000)
+  , m_spectrogramThread(nullptr)
+  , m_spectrogram(nullptr)
+  , m_paintedColumns(0)
 {
   //  setFrameStyle(QFrame::Box);
   setMinimumSize(QSize(100, 100));
   //  setMaximumSize(QSize(1000, 100));
-  m_updateTimer.start(50);
+  m_updateTimer.start(AMPLITUDE_INTERVAL);
   connect(
     &m_updateTimer, &QTimer::timeout, this, &MicrophonePlot::updateDisplay);
 }
 
+MicrophonePlot::~MicrophonePlot()
+{
+  if (m_spectrogramThread) {
+    m_spectrogramThread->quit();
+    m_spectrogramThread->wait();
+  }
+}
+
 /*!
   \brief Adds samples to the data set.
 
-  The data supplied is added to the end of the data set.
+  The data supplied is added to the end of the data set. In SpectrogramMode
+  it is also queued to the spectrogram's thread.
 
   \param data - a QVector of double amplitude values.
 */
@@ -51,6 +76,14 @@ void
 MicrophonePlot::addData(QVector<float> data)
 {
   *m_buffer << data;
+
+  if (m_spectrogram) {
+    Spectrogram* spectrogram = m_spectrogram;
+    QMetaObject::invokeMethod(
+      spectrogram,
+      [spectrogram, data] { spectrogram->addData(data); },
+      Qt::QueuedConnection);
+  }
 }
 
 void
@@ -59,6 +92,7 @@ MicrophonePlot::setSampleRate(int sampleRate)
   if (sampleRate != m_sampleRate) {
     m_sampleRate = sampleRate;
     m_buffer->resize(int(m_displayTime * m_sampleRate));
+    configureSpectrogram();
   }
 }
 
@@ -85,11 +119,92 @@ MicrophonePlot::setDisplayTime(double displayTime)
   }
 }
 
+/*!
+   \brief Returns whether the plot draws the amplitude or a spectrogram.
+   Defaults to AmplitudeMode.
+*/
+MicrophonePlot::Mode
+MicrophonePlot::mode() const
+{
+  return m_mode;
+}
+
+/*!
+   \brief Sets whether the plot draws the amplitude or a spectrogram. The
+   spectrogram's worker thread runs only while in SpectrogramMode, and it
+   starts empty each time.
+*/
+void
+MicrophonePlot::setMode(Mode mode)
+{
+  if (mode == m_mode) {
+    return;
+  }
+
+  m_mode = mode;
+
+  if (m_mode == SpectrogramMode) {
+    startSpectrogram();
+    m_updateTimer.start(SPECTROGRAM_INTERVAL);
+
+  } else {
+    stopSpectrogram();
+    m_updateTimer.start(AMPLITUDE_INTERVAL);
+  }
+
+  update();
+}
+
+/*!
+   \brief Returns the time the spectrogram shows in milliseconds. Defaults
+   to 10 seconds.
+*/
+int
+MicrophonePlot::spectrogramTime() const
+{
+  return m_spectrogramTime;
+}
+
+/*!
+   \brief Sets the time the spectrogram shows in milliseconds. A running
+   spectrogram starts again empty.
+*/
+void
+MicrophonePlot::setSpectrogramTime(int spectrogramTime)
+{
+  if (spectrogramTime != m_spectrogramTime) {
+    m_spectrogramTime = spectrogramTime;
+    configureSpectrogram();
+  }
+}
+
 void
 MicrophonePlot::paintEvent(QPaintEvent* /*event*/)
 {
+  SR_TRACE_THREAD_NAME("gui");
+  SR_TRACE_SCOPE("paint", "gui");
+  auto start = std::chrono::steady_clock::now();
   QPainter painter(this);
 
+  if (m_spectrogram) {
+    // the worker has done the transforms, this is only a blit.
+    m_spectrogram->paint(&painter, rect());
+
+  } else {
+    paintAmplitude(painter);
+  }
+
+  painter.end();
+
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+  PipelineMetrics::instance().paintSeconds->observe(elapsed.count());
+}
+
+/* Draws the grid and the amplitude of the samples in the buffer.*/
+void
+MicrophonePlot::paintAmplitude(QPainter& painter)
+{
   auto r = rect();
   int h = r.height();
   int h2 = int(h / 2);
@@ -247,7 +362,72 @@ MicrophonePlot::alignScales(QWidget* /*canvas*/)
 void
 MicrophonePlot::updateDisplay()
 {
+  // a spectrogram only changes when a column is added.
+  if (m_spectrogram) {
+    quint64 written = m_spectrogram->columnsWritten();
+
+    if (written == m_paintedColumns) {
+      return;
+    }
+
+    m_paintedColumns = written;
+  }
+
   update();
 }
 
+/* Creates the spectrogram and moves it to a thread of its own.*/
+void
+MicrophonePlot::startSpectrogram()
+{
+  SpectrogramConfig config;
+  config.sampleRate = m_sampleRate;
+  config.displayTime = m_spectrogramTime;
+
+  m_spectrogramThread = new QThread;
+  m_spectrogram = new Spectrogram(config);
+  m_spectrogram->moveToThread(m_spectrogramThread);
+  connect(m_spectrogramThread,
+          &QThread::finished,
+          m_spectrogram,
+          &QObject::deleteLater);
+  connect(m_spectrogramThread,
+          &QThread::finished,
+          m_spectrogramThread,
+          &QObject::deleteLater);
+  m_spectrogramThread->start();
+  m_paintedColumns = 0;
+}
+
+/* Stops the spectrogram's thread, which deletes the spectrogram and then
+   itself. Data already queued to it is dropped.*/
+void
+MicrophonePlot::stopSpectrogram()
+{
+  if (m_spectrogramThread) {
+    m_spectrogramThread->quit();
+    m_spectrogramThread = nullptr;
+    m_spectrogram = nullptr;
+  }
+}
+
+/* Rebuilds a running spectrogram for the current sample rate and time, on
+   its own thread.*/
+void
+MicrophonePlot::configureSpectrogram()
+{
+  if (!m_spectrogram) {
+    return;
+  }
+
+  SpectrogramConfig config;
+  config.sampleRate = m_sampleRate;
+  config.displayTime = m_spectrogramTime;
+  Spectrogram* spectrogram = m_spectrogram;
+  QMetaObject::invokeMethod(
+    spectrogram,
+    [spectrogram, config] { spectrogram->setConfig(config); },
+    Qt::QueuedConnection);
+}
+
 } // end of namespace SpeechRecognition
@@ -8,8 +8,13 @@
 #include "SpeechRecogniser_global.h"
 #include "circularbuffer.h"
 
+class QPainter;
+class QThread;
+
 namespace SpeechRecognition {
 
+class Spectrogram;
+
 /*!
   \class MicrophonePlot
   \brief The MicrophonePlot class is a display widget for microphone amplitude.
@@ -17,17 +22,29 @@ namespace SpeechRecognition {
   The MicrophonePlot class allows the user to modify the sample format, sample
   rate and display length through it's own methods and store the result in an
   internal buffer.
+
+  In SpectrogramMode it draws a scrolling spectrogram of the last
+  spectrogramTime() instead. The transforms run on a worker thread of the
+  plot's own, so painting is only a blit of the finished image and the plot
+  repaints at 60 frames a second when there is a new column.
 */
 class SPEECHRECOGNISER_EXPORT MicrophonePlot : public QFrame
 {
   Q_OBJECT
 
 public:
+  enum Mode
+  {
+    AmplitudeMode,
+    SpectrogramMode,
+  };
+
   MicrophonePlot(/*double updateInterval,*/
                  int sampleRate,
                  int displayTime,
                  //                 SampleFormat format,
                  QWidget* parent = nullptr);
+  ~MicrophonePlot() override;
 
   void addData(QVector<float> data);
 
@@ -35,6 +52,11 @@ public:
   double displayTime() const;
   void setDisplayTime(double displayTime);
 
+  Mode mode() const;
+  void setMode(Mode mode);
+  int spectrogramTime() const;
+  void setSpectrogramTime(int spectrogramTime);
+
   //  void startSampling();
   //  void stopSampling();
 
@@ -68,9 +90,18 @@ private:
   QBrush m_background;
   QColor m_lineColor;
   QColor m_sampleColor;
+  Mode m_mode;
+  int m_spectrogramTime;
+  QThread* m_spectrogramThread;
+  Spectrogram* m_spectrogram;
+  quint64 m_paintedColumns;
 
   void alignScales(QWidget* canvas);
   void updateDisplay();
+  void paintAmplitude(QPainter& painter);
+  void startSpectrogram();
+  void stopSpectrogram();
+  void configureSpectrogram();
 };
 
 } // end of namespace SpeechRecognition
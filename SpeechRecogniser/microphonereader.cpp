@@ -19,7 +19,12 @@
   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
   SOFTWARE.
 */
+#include <QVarLengthArray>
+
 #include "microphonereader.h"
+#include "realtimeaudit.h"
+#include "sampleconversion.h"
+#include "tracing.h"
 
 namespace SpeechRecognition {
 
@@ -27,19 +32,19 @@ namespace SpeechRecognition {
    \brief PortAudio callback method.
 
    Takes as parameters the input data buffer, the number of frames passed
-   and the sender object, in this case a MicrophoneReader object. Data is
-   passed on to the calling application via the
-  MicrophoneReader::sendData(QVector<float>) signal.
+   and the sender object, in this case a MicrophoneReader object. The
+   interleaved input is split into a planar AudioBlock, stamped with its
+   capture time, and passed on to the calling application via the
+  MicrophoneReader::sendBlock(AudioBlock) signal.
 
-  As we are not using an output buffer of the time info or status flags these
-  are nulled out.
+  As we are not using an output buffer it is nulled out.
 */
 static int
 recordCallback(const void* inputBuffer,
                void* /*outputBuffer*/,
                unsigned long framesPerBuffer,
-               const PaStreamCallbackTimeInfo* /*timeInfo*/,
-               PaStreamCallbackFlags /*statusFlags*/,
+               const PaStreamCallbackTimeInfo* timeInfo,
+               PaStreamCallbackFlags statusFlags,
                void* sender)
 {
   /* Don't think that I am supposed to use the void* data pointer to
@@ -47,36 +52,147 @@ recordCallback(const void* inputBuffer,
     to pass a data object pointer, but that is the only way I could think
     of to send a Qt signal off with the data.*/
   MicrophoneReader* reader = static_cast<MicrophoneReader*>(sender);
+  SR_TRACE_THREAD_NAME("capture");
+  SR_TRACE_SCOPE("recordCallback", "capture");
+  SR_REALTIME_SCOPE("recordCallback");
 
   if (!reader->isRunning()) {
     // This tells PortAudio that we have finished recording.
     return paComplete;
   }
 
+  reader->countStatus(statusFlags);
+
   const SAMPLE* rptr = (const SAMPLE*)inputBuffer;
-  long framesToCalc = framesPerBuffer;
-  long i;
-  int finished;
-  QVector<float> out_data;
 
-  finished = paContinue;
+  // the block is sent on from the reader's thread, see record().
+  if (inputBuffer != nullptr) {
+    MicrophoneReader::deliverBlock(reader,
+                                   rptr,
+                                   reader->channelCount(),
+                                   framesPerBuffer,
+                                   timeInfo,
+                                   reader->inputLatency(),
+                                   reader->settings().sampleRate,
+                                   reader->clock());
+  }
+
+  return paContinue;
+}
 
-  if (inputBuffer == nullptr) {
-    out_data.clear();
+/*!
+   \brief Does the work of one PortAudio callback for source: converts the
+   input into the next block of the source's ring, stamps it and publishes
+   it for the source's thread to send. Returns false if the ring was full,
+   the block being dropped and counted as an overflow.
 
-  } else {
-    for (i = 0; i < framesToCalc; i++) {
-      out_data.append(*rptr++);
-    }
+   Once the ring has warmed up this neither allocates nor locks, which
+   `SpeechRecogniserBenchmark audit` checks.
+*/
+bool
+MicrophoneReader::deliverBlock(AudioSource* source,
+                               const SAMPLE* input,
+                               int channels,
+                               unsigned long frames,
+                               const PaStreamCallbackTimeInfo* timeInfo,
+                               double inputLatency,
+                               double sampleRate,
+                               DeviceClock* clock)
+{
+  SR_REALTIME_SCOPE("MicrophoneReader::deliverBlock");
+  AudioBlock* block = source->beginBlock(channels, int(frames));
+
+  if (!block) {
+    return false;
+  }
+
+  captureBlock(*block,
+               input,
+               timeInfo,
+               inputLatency,
+               sampleRate,
+               clock,
+               DeviceClock::steadyNow());
+  source->commitBlock();
+  return true;
+}
+
+/*!
+   \brief Fills block, already shaped to the callback's channels and frames,
+   from one callback's interleaved input and stamps it with its capture
+   time. This is the conversion the PortAudio callback does, apart so that
+   CaptureSimulator can drive it from a simulated clock.
+
+   \param steadyTime - the steady clock time of the callback, paired with
+   the callback's stream time in clock.
+*/
+void
+MicrophoneReader::captureBlock(AudioBlock& block,
+                               const SAMPLE* input,
+                               const PaStreamCallbackTimeInfo* timeInfo,
+                               double inputLatency,
+                               double sampleRate,
+                               DeviceClock* clock,
+                               qint64 steadyTime)
+{
+  const int channels = block.channels();
+  const unsigned long frames = (unsigned long)block.frames();
+  QVarLengthArray<float*, 16> planes(channels);
+
+  for (int c = 0; c < channels; c++) {
+    planes[c] = block.channel(c);
   }
 
-  reader->emitData(out_data);
-  return finished;
+  interleavedToPlanar<SampleFormat::Float32, SampleFormat::Float32>(
+    input, planes.data(), channels, frames);
+
+  if (timeInfo) {
+    double adcTime = timeInfo->inputBufferAdcTime;
+
+    // not every host API fills in the ADC time, estimate it from the
+    // callback time and the input latency.
+    if (adcTime <= 0.0) {
+      adcTime =
+        timeInfo->currentTime - inputLatency - double(frames) / sampleRate;
+    }
+
+    clock->update(timeInfo->currentTime, steadyTime);
+    block.setAdcTime(adcTime);
+    block.setCaptureTime(clock->toSteady(adcTime));
+
+  } else {
+    // a reused block still has the last one's times.
+    block.setAdcTime(0.0);
+    block.setCaptureTime(0);
+  }
 }
 
-MicrophoneReader::MicrophoneReader(QObject* parent)
-  : QObject(parent)
-  , m_running(true)
+/*!
+   \brief Creates a reader capturing channelCount channels from the default
+   input device. If the device has fewer channels the count is reduced to
+   match.
+*/
+MicrophoneReader::MicrophoneReader(int channelCount, QObject* parent)
+  : MicrophoneReader(
+      CaptureSettings{ -1, channelCount, SAMPLE_RATE, FRAMES_PER_BUFFER, 0.0 },
+      parent)
+{}
+
+/*!
+   \brief Creates a reader capturing from the device and with the stream
+   parameters in settings.
+
+   Any number of readers may be open at once, on the same or different
+   devices. Each has its own PortAudio stream, callback, DeviceClock and
+   overflow counts.
+*/
+MicrophoneReader::MicrophoneReader(const CaptureSettings& settings,
+                                   QObject* parent)
+  : AudioSource(parent)
+  , m_channelCount(qMax(1, settings.channelCount))
+  , m_settings(settings)
+  , m_inputLatency(0.0)
+  , m_underflows(0)
   , m_stream(nullptr)
 {
   initialise();
@@ -102,18 +218,38 @@ MicrophoneReader::initialise()
     return;
   }
 
-  inputParameters.device =
-    Pa_GetDefaultInputDevice(); /* default input device */
+  if (m_settings.device < 0) {
+    inputParameters.device =
+      Pa_GetDefaultInputDevice(); /* default input device */
+
+  } else if (m_settings.device < Pa_GetDeviceCount()) {
+    inputParameters.device = m_settings.device;
+
+  } else {
+    inputParameters.device = paNoDevice;
+  }
 
   if (inputParameters.device == paNoDevice) {
-    qWarning() << tr("Error: No default input device.");
+    qWarning() << tr("Error: No input device %1.").arg(m_settings.device);
     return;
   }
 
-  inputParameters.channelCount = 1; /* mono input */
+  const PaDeviceInfo* info = Pa_GetDeviceInfo(inputParameters.device);
+  m_deviceName = QString::fromLocal8Bit(info->name);
+  int maxChannels = info->maxInputChannels;
+
+  if (m_channelCount > maxChannels) {
+    qWarning() << tr("input device only has %1 channels.").arg(maxChannels);
+    m_channelCount = qMax(1, maxChannels);
+  }
+
+  m_settings.device = inputParameters.device;
+  m_settings.channelCount = m_channelCount;
+  inputParameters.channelCount = m_channelCount;
   inputParameters.sampleFormat = PA_SAMPLE_TYPE;
-  inputParameters.suggestedLatency =
-    Pa_GetDeviceInfo(inputParameters.device)->defaultLowInputLatency;
+  inputParameters.suggestedLatency = m_settings.suggestedLatency > 0.0
+                                       ? m_settings.suggestedLatency
+                                       : info->defaultLowInputLatency;
   inputParameters.hostApiSpecificStreamInfo = nullptr;
 
   /*
@@ -125,8 +261,8 @@ MicrophoneReader::initialise()
   err = Pa_OpenStream(&m_stream,
                       &inputParameters,
                       nullptr, /* &outputParameters, No output in this case*/
-                      SAMPLE_RATE,
-                      FRAMES_PER_BUFFER,
+                      m_settings.sampleRate,
+                      unsigned(m_settings.framesPerBuffer),
                       paClipOff, /* we won't output out of range samples so
                                     don't bother clipping them */
                       recordCallback,
@@ -137,6 +273,12 @@ MicrophoneReader::initialise()
   }
 
   if (m_stream) {
+    const PaStreamInfo* streamInfo = Pa_GetStreamInfo(m_stream);
+
+    if (streamInfo) {
+      m_inputLatency = streamInfo->inputLatency;
+    }
+
     err = Pa_StartStream(m_stream);
 
     if (err != paNoError) {
@@ -148,26 +290,6 @@ MicrophoneReader::initialise()
   }
 }
 
-/*!
-   \brief Stops and closes down the recorder.
-*/
-void
-MicrophoneReader::stop()
-{
-  QMutexLocker locker(&m_mutex);
-  m_running = false;
-}
-
-/*!
-   \brief Checks that the worker is still running and returns true if it is,
-   otherwise returns false.
-*/
-bool
-MicrophoneReader::isRunning() const
-{
-  return m_running;
-}
-
 /*! \brief This method does the actual work of the worker thread.
 
    Checks that the portaudio stream is  active and allows data to be passed
@@ -177,10 +299,15 @@ void
 MicrophoneReader::record()
 {
   PaError err = paNoError;
+  // the callback only publishes its blocks, they are sent from here at
+  // most a quarter of a buffer later.
+  long poll =
+    qMax(1L, long(250.0 * m_settings.framesPerBuffer / m_settings.sampleRate));
 
   while (m_running) {
     while ((err = Pa_IsStreamActive(m_stream)) == 1) {
-      Pa_Sleep(100);
+      Pa_Sleep(poll);
+      emitPending();
     }
 
     if (err != paNoError) {
@@ -196,21 +323,142 @@ MicrophoneReader::record()
   }
 
   Pa_Terminate();
+  emitPending();
 
   emit finished();
 }
 
 /*!
-  \brief Custom method wrapper for the output signal which takes as a parameter
-  a QVector<float>.
+  \brief Returns the number of channels captured.
+*/
+int
+MicrophoneReader::channelCount() const
+{
+  return m_channelCount;
+}
+
+/*!
+  \brief Returns the capture sample rate.
+*/
+double
+MicrophoneReader::sampleRate() const
+{
+  return m_settings.sampleRate;
+}
+
+/*!
+  \brief Returns PortAudio's estimate of the fraction of a core the stream's
+  callback is using, from Pa_GetStreamCpuLoad(), or 0 if the stream is not
+  running.
+*/
+double
+MicrophoneReader::callbackLoad() const
+{
+  if (!m_stream || Pa_IsStreamActive(m_stream) != 1) {
+    return 0.0;
+  }
+
+  return Pa_GetStreamCpuLoad(m_stream);
+}
+
+/*!
+  \brief Returns the stream parameters. After the stream is opened the
+  device and channel count are the ones actually used.
+*/
+CaptureSettings
+MicrophoneReader::settings() const
+{
+  return m_settings;
+}
 
-  This is used by the callback method as it cannot access the Qt signals
-  directly.
+/*!
+  \brief Returns the PortAudio name of the capture device.
+*/
+QString
+MicrophoneReader::deviceName() const
+{
+  return m_deviceName;
+}
+
+/*!
+  \brief Returns the PortAudio index of the first input device whose name
+  contains name, or -1 if there is none. A number is taken as the index
+  itself.
+*/
+int
+MicrophoneReader::findInputDevice(const QString& name)
+{
+  bool isIndex = false;
+  int index = name.toInt(&isIndex);
+
+  if (isIndex) {
+    return index;
+  }
+
+  // PortAudio counts initialisations so this is safe while streams are open.
+  if (Pa_Initialize() != paNoError) {
+    return -1;
+  }
+
+  int found = -1;
+
+  for (int device = 0; device < Pa_GetDeviceCount(); device++) {
+    const PaDeviceInfo* info = Pa_GetDeviceInfo(device);
+
+    if (info && info->maxInputChannels > 0 &&
+        QString::fromLocal8Bit(info->name).contains(name)) {
+      found = device;
+      break;
+    }
+  }
+
+  Pa_Terminate();
+  return found;
+}
+
+/*!
+  \brief Returns the clock that maps this device's stream time onto the
+  steady clock.
+*/
+DeviceClock*
+MicrophoneReader::clock()
+{
+  return &m_clock;
+}
+
+/*!
+  \brief Returns the input latency reported by PortAudio in seconds.
+*/
+double
+MicrophoneReader::inputLatency() const
+{
+  return m_inputLatency;
+}
+
+/*!
+  \brief Counts the overflow and underflow flags of one callback. Called by
+  the callback.
 */
 void
-MicrophoneReader::emitData(QVector<float> data)
+MicrophoneReader::countStatus(PaStreamCallbackFlags flags)
+{
+  if (flags & paInputOverflow) {
+    countOverflow();
+  }
+
+  if (flags & paInputUnderflow) {
+    m_underflows.fetchAndAddRelaxed(1);
+  }
+}
+
+/*!
+  \brief Returns the number of callbacks in which the device reported that
+  it had too little input.
+*/
+quint64
+MicrophoneReader::underflowCount() const
 {
-  emit sendData(data);
+  return m_underflows.loadAcquire();
 }
 
 } // end of namespace SpeechRecognition
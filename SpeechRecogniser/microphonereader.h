@@ -22,6 +22,7 @@
 #ifndef MICROPHONEREADER_H
 #define MICROPHONEREADER_H
 
+#include <QAtomicInt>
 #include <QMutex>
 #include <QMutexLocker>
 #include <QObject>
@@ -29,11 +30,14 @@
 #include <QtDebug>
 
 #include "SpeechRecogniser_global.h"
+#include "audioblock.h"
+#include "audiosource.h"
 #include "circularbuffer.h"
+#include "deviceclock.h"
 #include "portaudio.h"
 
 typedef float SAMPLE;
-#define SAMPLE_RATE 44100
+#define SAMPLE_RATE 16000
 #define FRAMES_PER_BUFFER 512
 #define NUM_SECONDS 5
 #define NUM_CHANNELS 1
@@ -44,27 +48,68 @@ typedef float SAMPLE;
 
 namespace SpeechRecognition {
 
-class SPEECHRECOGNISER_EXPORT MicrophoneReader : public QObject
+/*!
+  \brief The stream parameters of one capture device.
+
+  A device of -1 is the default input device and a suggested latency of zero
+  is the device's default low latency.
+*/
+struct CaptureSettings
+{
+  int device = -1;
+  int channelCount = NUM_CHANNELS;
+  double sampleRate = SAMPLE_RATE;
+  int framesPerBuffer = FRAMES_PER_BUFFER;
+  double suggestedLatency = 0.0;
+};
+
+class SPEECHRECOGNISER_EXPORT MicrophoneReader : public AudioSource
 {
   Q_OBJECT
 
 public:
-  explicit MicrophoneReader(QObject* parent = nullptr);
-  ~MicrophoneReader();
-
-  void record();
-  void stop();
-  void emitData(QVector<float> data);
-
-  bool isRunning() const;
-
-signals:
-  void sendData(QVector<float>);
-  void finished();
+  explicit MicrophoneReader(int channelCount = NUM_CHANNELS,
+                            QObject* parent = nullptr);
+  explicit MicrophoneReader(const CaptureSettings& settings,
+                            QObject* parent = nullptr);
+  ~MicrophoneReader() override;
+
+  static int findInputDevice(const QString& name);
+  static void captureBlock(AudioBlock& block,
+                           const SAMPLE* input,
+                           const PaStreamCallbackTimeInfo* timeInfo,
+                           double inputLatency,
+                           double sampleRate,
+                           DeviceClock* clock,
+                           qint64 steadyTime);
+  static bool deliverBlock(AudioSource* source,
+                           const SAMPLE* input,
+                           int channels,
+                           unsigned long frames,
+                           const PaStreamCallbackTimeInfo* timeInfo,
+                           double inputLatency,
+                           double sampleRate,
+                           DeviceClock* clock);
+
+  void record() override;
+  int channelCount() const override;
+  double sampleRate() const override;
+  double callbackLoad() const override;
+  CaptureSettings settings() const;
+  QString deviceName() const;
+
+  DeviceClock* clock();
+  double inputLatency() const;
+  void countStatus(PaStreamCallbackFlags flags);
+  quint64 underflowCount() const;
 
 protected:
-  bool m_running;
-  QMutex m_mutex;
+  int m_channelCount;
+  CaptureSettings m_settings;
+  QString m_deviceName;
+  DeviceClock m_clock;
+  double m_inputLatency;
+  QAtomicInteger<quint64> m_underflows;
 
   PaStream* m_stream;
   void initialise();
@@ -0,0 +1,516 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QtGlobal>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "noisesuppressor.h"
+
+namespace SpeechRecognition {
+
+// the noise floor is the minimum over this many sub windows.
+static const int SUBWINDOWS = 8;
+// keeps the gain finite in digital silence.
+static const float MINIMUM_NOISE = 1.0e-12f;
+
+#if defined(__ARM_NEON)
+/* a / b, with two Newton steps on the reciprocal estimate where there is
+   no divide instruction.*/
+static inline float32x4_t
+divide(float32x4_t a, float32x4_t b)
+{
+#if defined(__aarch64__)
+  return vdivq_f32(a, b);
+#else
+  float32x4_t r = vrecpeq_f32(b);
+  r = vmulq_f32(r, vrecpsq_f32(b, r));
+  r = vmulq_f32(r, vrecpsq_f32(b, r));
+  return vmulq_f32(a, r);
+#endif
+}
+#endif
+
+/*!
+   \brief Creates a suppressor for audio at sampleRate.
+*/
+NoiseSuppressor::NoiseSuppressor(int sampleRate,
+                                 const NoiseSuppressorConfig& config)
+  : m_sampleRate(sampleRate)
+  , m_floorStarted(false)
+  , m_binsStarted(false)
+  , m_bypassed(true)
+  , m_floorPower(0.0f)
+  , m_frames(0)
+  , m_bypassedFrames(0)
+{
+  setConfig(config);
+}
+
+NoiseSuppressorConfig
+NoiseSuppressor::config() const
+{
+  return m_config;
+}
+
+/*!
+   \brief Sets the configuration and starts tracking the noise again. The
+   hop size is rounded up to a power of two.
+
+   This allocates, so it must not be called while process() may be running.
+*/
+void
+NoiseSuppressor::setConfig(const NoiseSuppressorConfig& config)
+{
+  m_config = config;
+  m_fft = Fft(2 * qMax(8, config.hopSize));
+  m_hop = m_fft.size() / 2;
+  m_bins = m_fft.bins();
+
+  // square root periodic Hann, applied before and after, sums to one at
+  // half overlap.
+  const int size = m_fft.size();
+  m_window.resize(size_t(size));
+  m_hann.resize(size_t(size));
+
+  for (int i = 0; i < size; i++) {
+    double hann = 0.5 - 0.5 * std::cos(2.0 * M_PI * i / size);
+    m_window[size_t(i)] = float(std::sqrt(hann));
+    m_hann[size_t(i)] = float(hann);
+  }
+
+  m_frame.assign(size_t(size), 0.0f);
+  m_time.assign(size_t(size), 0.0f);
+  m_overlap.assign(size_t(m_hop), 0.0f);
+  m_output.assign(size_t(m_hop), 0.0f);
+  m_re.assign(size_t(m_bins), 0.0f);
+  m_im.assign(size_t(m_bins), 0.0f);
+  m_power.assign(size_t(m_bins), 0.0f);
+  m_noise.assign(size_t(m_bins), 0.0f);
+  m_clean.assign(size_t(m_bins), 0.0f);
+  m_gain.assign(size_t(m_bins), 1.0f);
+
+  int frames = int(std::lround(double(config.windowSeconds) * m_sampleRate /
+                               (m_hop * SUBWINDOWS)));
+  m_binMinimum.resize(m_bins, SUBWINDOWS, qMax(1, frames));
+  m_floorMinimum.resize(1, SUBWINDOWS, qMax(1, frames));
+  reset();
+}
+
+/*!
+   \brief Sets the sample rate of the audio, which resizes the noise window
+   to keep the same length in seconds.
+*/
+void
+NoiseSuppressor::setSampleRate(int sampleRate)
+{
+  if (sampleRate != m_sampleRate) {
+    m_sampleRate = sampleRate;
+    setConfig(m_config);
+  }
+}
+
+/*!
+   \brief Returns the delay through the suppressor in samples.
+*/
+int
+NoiseSuppressor::latency() const
+{
+  return 2 * m_hop;
+}
+
+/*!
+   \brief Suppresses the noise in count samples in place. The samples
+   written back are those passed in latency() samples earlier.
+*/
+void
+NoiseSuppressor::process(float* data, int count)
+{
+  while (count > 0) {
+    int n = qMin(count, m_hop - m_position);
+    float* newest = m_frame.data() + m_hop + m_position;
+    const float* ready = m_output.data() + m_position;
+
+    for (int i = 0; i < n; i++) {
+      float sample = data[i];
+      data[i] = ready[i];
+      newest[i] = sample;
+    }
+
+    data += n;
+    count -= n;
+    m_position += n;
+
+    if (m_position == m_hop) {
+      processFrame();
+      m_position = 0;
+    }
+  }
+}
+
+/*!
+   \brief Clears the audio held and starts tracking the noise again. The
+   totals are kept.
+*/
+void
+NoiseSuppressor::reset()
+{
+  std::fill(m_frame.begin(), m_frame.end(), 0.0f);
+  std::fill(m_overlap.begin(), m_overlap.end(), 0.0f);
+  std::fill(m_output.begin(), m_output.end(), 0.0f);
+  m_position = 0;
+  m_floorStarted = false;
+  m_binsStarted = false;
+  m_bypassed = true;
+  m_floorPower = 0.0f;
+}
+
+/*!
+   \brief Returns true if the noise floor is low enough that the audio is
+   passed through.
+*/
+bool
+NoiseSuppressor::isBypassed() const
+{
+  return m_bypassed;
+}
+
+/*!
+   \brief Returns the broadband noise floor, in dB full scale.
+*/
+double
+NoiseSuppressor::noiseFloorDb() const
+{
+  return 10.0 * std::log10(std::max(double(m_floorPower), 1.0e-20));
+}
+
+/*!
+   \brief Returns the number of frames processed.
+*/
+unsigned long long
+NoiseSuppressor::frames() const
+{
+  return m_frames;
+}
+
+/*!
+   \brief Returns the number of frames passed through without being
+   transformed.
+*/
+unsigned long long
+NoiseSuppressor::bypassedFrames() const
+{
+  return m_bypassedFrames;
+}
+
+/*!
+   \brief Works out the Wiener gain of count bins from their power and
+   noise power, the gain kernel of the suppressor.
+
+   \param clean - the clean power of the last frame, used for the decision
+   directed a priori SNR and replaced with this frame's.
+   \param priorSmoothing - the weight given to the last frame, 0 to 1.
+   \param gainFloor - the lowest gain, as a factor.
+*/
+void
+NoiseSuppressor::wienerGain(const float* power,
+                            const float* noise,
+                            float* clean,
+                            float* gain,
+                            float priorSmoothing,
+                            float gainFloor,
+                            int count)
+{
+  const float a = priorSmoothing;
+  const float b = 1.0f - priorSmoothing;
+  int k = 0;
+
+#if defined(__AVX2__)
+  const __m256 va = _mm256_set1_ps(a), vb = _mm256_set1_ps(b);
+  const __m256 one = _mm256_set1_ps(1.0f), zero = _mm256_setzero_ps();
+  const __m256 vfloor = _mm256_set1_ps(gainFloor);
+
+  for (; k + 8 <= count; k += 8) {
+    __m256 p = _mm256_loadu_ps(power + k);
+    __m256 inverse = _mm256_div_ps(one, _mm256_loadu_ps(noise + k));
+    __m256 posterior = _mm256_sub_ps(_mm256_mul_ps(p, inverse), one);
+    __m256 prior = _mm256_add_ps(
+      _mm256_mul_ps(va, _mm256_mul_ps(_mm256_loadu_ps(clean + k), inverse)),
+      _mm256_mul_ps(vb, _mm256_max_ps(posterior, zero)));
+    __m256 g = _mm256_max_ps(
+      _mm256_div_ps(prior, _mm256_add_ps(one, prior)), vfloor);
+    _mm256_storeu_ps(gain + k, g);
+    _mm256_storeu_ps(clean + k, _mm256_mul_ps(_mm256_mul_ps(g, g), p));
+  }
+#elif defined(__SSE2__)
+  const __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b);
+  const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+  const __m128 vfloor = _mm_set1_ps(gainFloor);
+
+  for (; k + 4 <= count; k += 4) {
+    __m128 p = _mm_loadu_ps(power + k);
+    __m128 inverse = _mm_div_ps(one, _mm_loadu_ps(noise + k));
+    __m128 posterior = _mm_sub_ps(_mm_mul_ps(p, inverse), one);
+    __m128 prior =
+      _mm_add_ps(_mm_mul_ps(va, _mm_mul_ps(_mm_loadu_ps(clean + k), inverse)),
+                 _mm_mul_ps(vb, _mm_max_ps(posterior, zero)));
+    __m128 g = _mm_max_ps(_mm_div_ps(prior, _mm_add_ps(one, prior)), vfloor);
+    _mm_storeu_ps(gain + k, g);
+    _mm_storeu_ps(clean + k, _mm_mul_ps(_mm_mul_ps(g, g), p));
+  }
+#elif defined(__ARM_NEON)
+  const float32x4_t one = vdupq_n_f32(1.0f), zero = vdupq_n_f32(0.0f);
+  const float32x4_t vfloor = vdupq_n_f32(gainFloor);
+
+  for (; k + 4 <= count; k += 4) {
+    float32x4_t p = vld1q_f32(power + k);
+    float32x4_t inverse = divide(one, vld1q_f32(noise + k));
+    float32x4_t posterior = vsubq_f32(vmulq_f32(p, inverse), one);
+    float32x4_t prior =
+      vmlaq_n_f32(vmulq_n_f32(vmulq_f32(vld1q_f32(clean + k), inverse), a),
+                  vmaxq_f32(posterior, zero),
+                  b);
+    float32x4_t g = vmaxq_f32(divide(prior, vaddq_f32(one, prior)), vfloor);
+    vst1q_f32(gain + k, g);
+    vst1q_f32(clean + k, vmulq_f32(vmulq_f32(g, g), p));
+  }
+#endif
+
+  for (; k < count; k++) {
+    float inverse = 1.0f / noise[k];
+    float prior =
+      a * clean[k] * inverse + b * std::max(power[k] * inverse - 1.0f, 0.0f);
+    float g = std::max(prior / (1.0f + prior), gainFloor);
+    gain[k] = g;
+    clean[k] = g * g * power[k];
+  }
+}
+
+/*!
+   \brief Scales count bins of a split spectrum by their gains.
+*/
+void
+NoiseSuppressor::applyGain(float* re, float* im, const float* gain, int count)
+{
+  int k = 0;
+
+#if defined(__AVX2__)
+  for (; k + 8 <= count; k += 8) {
+    __m256 g = _mm256_loadu_ps(gain + k);
+    _mm256_storeu_ps(re + k, _mm256_mul_ps(_mm256_loadu_ps(re + k), g));
+    _mm256_storeu_ps(im + k, _mm256_mul_ps(_mm256_loadu_ps(im + k), g));
+  }
+#elif defined(__SSE2__)
+  for (; k + 4 <= count; k += 4) {
+    __m128 g = _mm_loadu_ps(gain + k);
+    _mm_storeu_ps(re + k, _mm_mul_ps(_mm_loadu_ps(re + k), g));
+    _mm_storeu_ps(im + k, _mm_mul_ps(_mm_loadu_ps(im + k), g));
+  }
+#elif defined(__ARM_NEON)
+  for (; k + 4 <= count; k += 4) {
+    float32x4_t g = vld1q_f32(gain + k);
+    vst1q_f32(re + k, vmulq_f32(vld1q_f32(re + k), g));
+    vst1q_f32(im + k, vmulq_f32(vld1q_f32(im + k), g));
+  }
+#endif
+
+  for (; k < count; k++) {
+    re[k] *= gain[k];
+    im[k] *= gain[k];
+  }
+}
+
+/* Runs a full frame, the last two hops, and adds it to the output.*/
+void
+NoiseSuppressor::processFrame()
+{
+  const int hop = m_hop;
+  const float* newest = m_frame.data() + hop;
+  float energy = 0.0f;
+
+  for (int i = 0; i < hop; i++) {
+    energy += newest[i] * newest[i];
+  }
+
+  energy /= hop;
+
+  if (m_floorStarted) {
+    m_floorMinimum.update(&energy, m_config.powerSmoothing);
+
+  } else {
+    m_floorMinimum.start(&energy);
+    m_floorStarted = true;
+  }
+
+  m_floorPower = m_config.bias * m_floorMinimum.minimum(0);
+  double floorDb = noiseFloorDb();
+
+  if (m_bypassed &&
+      floorDb > m_config.bypassDb + m_config.bypassHysteresisDb) {
+    m_bypassed = false;
+    m_binsStarted = false;
+
+  } else if (!m_bypassed && floorDb < m_config.bypassDb) {
+    m_bypassed = true;
+  }
+
+  m_frames++;
+
+  if (m_bypassed) {
+    // what a gain of one would give, without the transforms.
+    m_bypassedFrames++;
+
+    for (int i = 0; i < 2 * hop; i++) {
+      m_time[size_t(i)] = m_frame[size_t(i)] * m_hann[size_t(i)];
+    }
+
+  } else {
+    suppress();
+  }
+
+  for (int i = 0; i < hop; i++) {
+    m_output[size_t(i)] = m_overlap[size_t(i)] + m_time[size_t(i)];
+    m_overlap[size_t(i)] = m_time[size_t(hop + i)];
+  }
+
+  std::memcpy(m_frame.data(), newest, size_t(hop) * sizeof(float));
+}
+
+/* Leaves the windowed, noise suppressed frame in m_time.*/
+void
+NoiseSuppressor::suppress()
+{
+  const int size = 2 * m_hop;
+
+  for (int i = 0; i < size; i++) {
+    m_time[size_t(i)] = m_frame[size_t(i)] * m_window[size_t(i)];
+  }
+
+  m_fft.forward(m_time.data(), m_re.data(), m_im.data());
+  Fft::power(m_re.data(), m_im.data(), m_power.data(), m_bins);
+
+  if (m_binsStarted) {
+    m_binMinimum.update(m_power.data(), m_config.powerSmoothing);
+
+  } else {
+    m_binMinimum.start(m_power.data());
+    std::fill(m_clean.begin(), m_clean.end(), 0.0f);
+    m_binsStarted = true;
+  }
+
+  for (int k = 0; k < m_bins; k++) {
+    m_noise[size_t(k)] =
+      std::max(m_config.bias * m_binMinimum.minimum(k), MINIMUM_NOISE);
+  }
+
+  wienerGain(m_power.data(),
+             m_noise.data(),
+             m_clean.data(),
+             m_gain.data(),
+             m_config.priorSmoothing,
+             std::pow(10.0f, m_config.gainFloorDb / 20.0f),
+             m_bins);
+  applyGain(m_re.data(), m_im.data(), m_gain.data(), m_bins);
+  m_fft.inverse(m_re.data(), m_im.data(), m_time.data());
+
+  for (int i = 0; i < size; i++) {
+    m_time[size_t(i)] *= m_window[size_t(i)];
+  }
+}
+
+void
+NoiseSuppressor::Minimum::resize(int count,
+                                 int subwindows,
+                                 int framesPerSubwindow)
+{
+  this->count = count;
+  this->subwindows = subwindows;
+  this->framesPerSubwindow = framesPerSubwindow;
+  smoothed.assign(size_t(count), 0.0f);
+  current.assign(size_t(count), 0.0f);
+  window.assign(size_t(count), 0.0f);
+  history.assign(size_t(count * subwindows), 0.0f);
+}
+
+/* Starts again from power, with nothing in the window yet.*/
+void
+NoiseSuppressor::Minimum::start(const float* power)
+{
+  std::copy(power, power + count, smoothed.begin());
+  std::copy(power, power + count, current.begin());
+  std::fill(history.begin(),
+            history.end(),
+            std::numeric_limits<float>::infinity());
+  std::fill(
+    window.begin(), window.end(), std::numeric_limits<float>::infinity());
+  frame = 0;
+  slot = 0;
+}
+
+/* Smooths in the next frame's power. At the end of each sub window its
+   minimum replaces the oldest and the window minimum is taken again.*/
+void
+NoiseSuppressor::Minimum::update(const float* power, float smoothing)
+{
+  for (int k = 0; k < count; k++) {
+    smoothed[size_t(k)] =
+      smoothing * smoothed[size_t(k)] + (1.0f - smoothing) * power[k];
+    current[size_t(k)] = std::min(current[size_t(k)], smoothed[size_t(k)]);
+  }
+
+  if (++frame < framesPerSubwindow) {
+    return;
+  }
+
+  std::copy(current.begin(), current.end(), history.begin() + slot * count);
+  slot = (slot + 1) % subwindows;
+  std::copy(history.begin(), history.begin() + count, window.begin());
+
+  for (int s = 1; s < subwindows; s++) {
+    const float* row = history.data() + s * count;
+
+    for (int k = 0; k < count; k++) {
+      window[size_t(k)] = std::min(window[size_t(k)], row[k]);
+    }
+  }
+
+  std::copy(smoothed.begin(), smoothed.end(), current.begin());
+  frame = 0;
+}
+
+float
+NoiseSuppressor::Minimum::minimum(int index) const
+{
+  return std::min(window[size_t(index)], current[size_t(index)]);
+}
+
+} // end of namespace SpeechRecognition
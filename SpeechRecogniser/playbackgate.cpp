@@ -0,0 +1,520 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QObject>
+#include <QtDebug>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+#include "playbackgate.h"
+#include "wavfile.h"
+
+namespace SpeechRecognition {
+
+/* How closely the block must follow the prompt, as a correlation
+   coefficient, for the echo to be lined up on it.*/
+static const double MIN_CORRELATION = 0.5;
+// the coarse echo search sums this many samples and steps this many lags.
+static const int ALIGN_DECIMATION = 4;
+// the longest block whose reference buffers are allocated up front.
+static const int RESERVE_MS = 100;
+
+/*!
+   \brief Creates a gate for capture at sampleRate, in Skip mode.
+*/
+PlaybackGate::PlaybackGate(int sampleRate, const PlaybackGateConfig& config)
+  : m_config(config)
+  , m_sampleRate(sampleRate)
+  , m_mode(Skip)
+  , m_version(0)
+  , m_next(0)
+  , m_alignedStart(-1)
+  , m_lag(0)
+  , m_skippedBlocks(0)
+  , m_skippedSamples(0)
+  , m_subtractedBlocks(0)
+  , m_echoBefore(0.0)
+  , m_echoAfter(0.0)
+{
+  for (Interval& interval : m_snapshot) {
+    interval = { -1, 0, 0 };
+  }
+
+  reserve();
+}
+
+PlaybackGateConfig
+PlaybackGate::config() const
+{
+  return m_config;
+}
+
+void
+PlaybackGate::setConfig(const PlaybackGateConfig& config)
+{
+  m_config = config;
+  reserve();
+}
+
+/*!
+   \brief Sets the capture sample rate. Prompts must be at this rate.
+*/
+void
+PlaybackGate::setSampleRate(int sampleRate)
+{
+  m_sampleRate = sampleRate;
+  reserve();
+}
+
+PlaybackGate::Mode
+PlaybackGate::mode() const
+{
+  return m_mode;
+}
+
+/*!
+   \brief Sets whether overlapping blocks are skipped or have the sound
+   subtracted. Defaults to Skip. Sounds without a prompt are always
+   skipped.
+*/
+void
+PlaybackGate::setMode(Mode mode)
+{
+  m_mode = mode;
+}
+
+/*!
+   \brief Adds the samples of a sound, at the capture rate, for Subtract
+   mode. Returns its number, which must match the player's number for the
+   same sound.
+*/
+int
+PlaybackGate::addPrompt(const float* samples, int count)
+{
+  m_prompts.emplace_back(samples, samples + count);
+  return int(m_prompts.size()) - 1;
+}
+
+/*!
+   \brief Loads the samples of a sound from a WAV file at the capture rate,
+   mixing it down to mono. Returns its number, or -1 if the file could not
+   be used.
+*/
+int
+PlaybackGate::addPrompt(const QString& filename)
+{
+  WavFile file;
+
+  if (!file.open(filename)) {
+    return -1;
+  }
+
+  if (file.format().sampleRate != m_sampleRate) {
+    qWarning() << QObject::tr("%1 is not at the capture rate of %2 Hz.")
+                    .arg(filename)
+                    .arg(m_sampleRate);
+    return -1;
+  }
+
+  const int channels = file.format().channels;
+  std::vector<std::vector<float>> planes(
+    size_t(channels), std::vector<float>(size_t(file.frames())));
+  std::vector<float*> pointers;
+
+  for (auto& plane : planes) {
+    pointers.push_back(plane.data());
+  }
+
+  file.readFrames(0, file.frames(), pointers.data());
+
+  for (int c = 1; c < channels; c++) {
+    for (size_t i = 0; i < planes[0].size(); i++) {
+      planes[0][i] += planes[size_t(c)][i];
+    }
+  }
+
+  for (float& sample : planes[0]) {
+    sample /= float(channels);
+  }
+
+  return addPrompt(planes[0].data(), int(planes[0].size()));
+}
+
+/*!
+   \brief Records that sound starts playing at start, in steady clock
+   nanoseconds, for duration nanoseconds. A sound still playing at start is
+   taken to have been cut off, as FeedbackPlayer does.
+
+   This must only ever be called from one thread at a time.
+*/
+void
+PlaybackGate::schedule(int sound, qint64 start, qint64 duration)
+{
+  unsigned version = m_version.load(std::memory_order_relaxed);
+  m_version.store(version + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  for (Slot& slot : m_slots) {
+    if (slot.end.load(std::memory_order_relaxed) > start &&
+        slot.start.load(std::memory_order_relaxed) < start) {
+      slot.end.store(start, std::memory_order_relaxed);
+    }
+  }
+
+  Slot& slot = m_slots[m_next];
+  m_next = (m_next + 1) % SLOTS;
+  slot.sound.store(sound, std::memory_order_relaxed);
+  slot.start.store(start, std::memory_order_relaxed);
+  slot.end.store(start + duration, std::memory_order_relaxed);
+
+  m_version.store(version + 2, std::memory_order_release);
+}
+
+/*!
+   \brief Checks a block captured at captureTime, the steady clock time of
+   its first sample, against the sounds played.
+
+   Returns Skipped if the block overlaps a sound and should not be
+   detected, Subtracted if the sound has been removed from data, or Clear.
+   data is only written in Subtract mode and may be null in Skip mode. A
+   captureTime of zero means the block is not timed and is always Clear.
+*/
+PlaybackGate::Result
+PlaybackGate::process(float* data, int count, qint64 captureTime)
+{
+  if (captureTime == 0 || count <= 0) {
+    return Clear;
+  }
+
+  snapshot();
+
+  const qint64 blockEnd =
+    captureTime + qint64(double(count) * 1.0e9 / m_sampleRate);
+  const qint64 margin = qint64(m_config.marginMs) * 1000000;
+  const qint64 tail = qint64(m_config.tailMs) * 1000000;
+  const Interval* overlap = nullptr;
+
+  for (const Interval& interval : m_snapshot) {
+    if (interval.sound >= 0 && captureTime < interval.end + tail + margin &&
+        blockEnd > interval.start - margin &&
+        (!overlap || interval.start > overlap->start)) {
+      overlap = &interval;
+    }
+  }
+
+  if (!overlap) {
+    return Clear;
+  }
+
+  if (m_mode == Skip || !data || overlap->sound >= int(m_prompts.size())) {
+    m_skippedBlocks++;
+    m_skippedSamples += (unsigned long long)(count);
+    return Skipped;
+  }
+
+  // line the echo up once per sound, on the first block in which it is
+  // clear. Until then the sound is taken to be exactly on time.
+  if (m_alignedStart != overlap->start) {
+    int lag = align(*overlap, data, count, captureTime);
+
+    if (lag != INT_MIN) {
+      m_lag = lag;
+      m_alignedStart = overlap->start;
+    }
+  }
+
+  const int lag = (m_alignedStart == overlap->start ? m_lag : 0);
+
+  if (!reference(*overlap, captureTime, lag, count, m_reference)) {
+    return Clear;
+  }
+
+  double cross = 0.0;
+  double energy = 0.0;
+  double before = 0.0;
+
+  for (int i = 0; i < count; i++) {
+    cross += double(data[i]) * m_reference[size_t(i)];
+    energy += double(m_reference[size_t(i)]) * m_reference[size_t(i)];
+    before += double(data[i]) * data[i];
+  }
+
+  if (energy <= 0.0) {
+    return Clear;
+  }
+
+  const float gain = float(qBound(0.0, cross / energy, 8.0));
+  double after = 0.0;
+
+  for (int i = 0; i < count; i++) {
+    data[i] -= gain * m_reference[size_t(i)];
+    after += double(data[i]) * data[i];
+  }
+
+  m_echoBefore += before;
+  m_echoAfter += after;
+  m_subtractedBlocks++;
+  return Subtracted;
+}
+
+/*!
+   \brief Forgets the echo alignment.
+
+   The timeline is left alone, it belongs to the thread calling schedule()
+   and sounds already over have no effect on later blocks.
+*/
+void
+PlaybackGate::reset()
+{
+  m_alignedStart = -1;
+  m_lag = 0;
+}
+
+/*!
+   \brief Returns the number of blocks not detected because a sound was
+   playing.
+*/
+unsigned long long
+PlaybackGate::skippedBlocks() const
+{
+  return m_skippedBlocks;
+}
+
+/*!
+   \brief Returns the number of samples not detected because a sound was
+   playing, the detection work avoided.
+*/
+unsigned long long
+PlaybackGate::skippedSamples() const
+{
+  return m_skippedSamples;
+}
+
+unsigned long long
+PlaybackGate::subtractedBlocks() const
+{
+  return m_subtractedBlocks;
+}
+
+/*!
+   \brief Returns how far subtraction has reduced the energy of the blocks
+   it was applied to, in dB.
+*/
+double
+PlaybackGate::echoReductionDb() const
+{
+  if (m_echoAfter <= 0.0 || m_echoBefore <= 0.0) {
+    return 0.0;
+  }
+
+  return 10.0 * std::log10(m_echoBefore / m_echoAfter);
+}
+
+/* Copies the timeline written by schedule(), retrying if it changed while
+   being read.*/
+void
+PlaybackGate::snapshot()
+{
+  for (;;) {
+    unsigned before = m_version.load(std::memory_order_acquire);
+
+    if (before & 1) {
+      continue;
+    }
+
+    for (int i = 0; i < SLOTS; i++) {
+      m_snapshot[i].sound = m_slots[i].sound.load(std::memory_order_relaxed);
+      m_snapshot[i].start = m_slots[i].start.load(std::memory_order_relaxed);
+      m_snapshot[i].end = m_slots[i].end.load(std::memory_order_relaxed);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (m_version.load(std::memory_order_relaxed) == before) {
+      return;
+    }
+  }
+}
+
+/* Sizes the reference buffers for blocks of up to RESERVE_MS plus the
+   search either side, so process() does not allocate for them.*/
+void
+PlaybackGate::reserve()
+{
+  const int search = m_config.searchMs * m_sampleRate / 1000;
+  const size_t block = size_t(RESERVE_MS * m_sampleRate / 1000);
+  const size_t extended = block + 2 * size_t(qMax(0, search));
+  m_reference.reserve(block);
+  m_extended.reserve(extended);
+  m_coarseData.reserve(block / ALIGN_DECIMATION);
+  m_coarseReference.reserve(extended / ALIGN_DECIMATION);
+}
+
+/* Fills out with the prompt as it should appear in a block of
+   count samples captured at captureTime, lag samples late. Returns false if
+   none of the prompt falls in the block.*/
+bool
+PlaybackGate::reference(const Interval& interval,
+                        qint64 captureTime,
+                        int lag,
+                        int count,
+                        std::vector<float>& out)
+{
+  const std::vector<float>& prompt = m_prompts[size_t(interval.sound)];
+  // the prompt stops early if the sound was cut off.
+  const qint64 played = std::min<qint64>(
+    qint64(prompt.size()),
+    qint64(double(interval.end - interval.start) * m_sampleRate / 1.0e9));
+  const qint64 first =
+    qint64(std::llround(double(captureTime - interval.start) * m_sampleRate /
+                        1.0e9)) -
+    lag;
+  bool any = false;
+  out.resize(size_t(count));
+
+  for (int i = 0; i < count; i++) {
+    qint64 index = first + i;
+    bool inside = (index >= 0 && index < played);
+    out[size_t(i)] = (inside ? prompt[size_t(index)] : 0.0f);
+    any = any || inside;
+  }
+
+  return any;
+}
+
+/* Finds the lag, within the search window, at which the prompt best
+   matches the block. Returns INT_MIN if no lag matches well enough to be
+   sure, such as in a quiet part of the prompt.
+
+   Every lag at full rate would cost count multiply-adds for each of the
+   2 * search + 1 lags, so the lags are first tried ALIGN_DECIMATION apart
+   on sums of ALIGN_DECIMATION samples, then one by one either side of the
+   best of those.*/
+int
+PlaybackGate::align(const Interval& interval,
+                    const float* data,
+                    int count,
+                    qint64 captureTime)
+{
+  const int search = m_config.searchMs * m_sampleRate / 1000;
+  const int step = ALIGN_DECIMATION;
+
+  // the prompt from search samples before the block to search after it.
+  if (!reference(
+        interval, captureTime, search, count + 2 * search, m_extended)) {
+    return INT_MIN;
+  }
+
+  double power = 0.0;
+
+  for (int i = 0; i < count; i++) {
+    power += double(data[i]) * data[i];
+  }
+
+  // coarse lags are multiples of step, so the decimated reference starts
+  // where lag 0 falls on a whole step.
+  const int steps = search / step;
+  const int origin = search - steps * step;
+  const int coarseCount = count / step;
+  m_coarseData.resize(size_t(coarseCount));
+  m_coarseReference.resize(size_t(coarseCount + 2 * steps));
+
+  std::fill(m_coarseData.begin(), m_coarseData.end(), 0.0f);
+  std::fill(m_coarseReference.begin(), m_coarseReference.end(), 0.0f);
+
+  for (int i = 0; i < coarseCount * step; i++) {
+    m_coarseData[size_t(i / step)] += data[i];
+  }
+
+  for (int i = 0; i < int(m_coarseReference.size()) * step; i++) {
+    m_coarseReference[size_t(i / step)] += m_extended[size_t(origin + i)];
+  }
+
+  int coarse = INT_MIN;
+  double bestScore = 0.0;
+  double energy = 0.0;
+
+  for (int k = -steps; k <= steps; k++) {
+    double value = score(m_coarseData.data(),
+                         m_coarseReference.data() + (steps - k),
+                         coarseCount,
+                         energy);
+
+    if (energy > 0.0 && value > bestScore) {
+      bestScore = value;
+      coarse = k * step;
+    }
+  }
+
+  if (coarse == INT_MIN) {
+    return INT_MIN;
+  }
+
+  int best = INT_MIN;
+  double bestEnergy = 0.0;
+  bestScore = 0.0;
+
+  for (int lag = qMax(-search, coarse - step + 1);
+       lag <= qMin(search, coarse + step - 1);
+       lag++) {
+    double value =
+      score(data, m_extended.data() + (search - lag), count, energy);
+
+    if (energy > 0.0 && value > bestScore) {
+      bestScore = value;
+      bestEnergy = energy;
+      best = lag;
+    }
+  }
+
+  if (best == INT_MIN ||
+      bestScore < MIN_CORRELATION * std::sqrt(power) ||
+      bestEnergy < 1.0e-4 * count) {
+    return INT_MIN;
+  }
+
+  return best;
+}
+
+/* Returns the correlation of data with reference over count samples,
+   normalised by the reference's energy, which is left in energy. By
+   Cauchy-Schwarz this peaks at the true lag even when other lags pull more
+   of the prompt into the block.*/
+double
+PlaybackGate::score(const float* data,
+                    const float* reference,
+                    int count,
+                    double& energy)
+{
+  double cross = 0.0;
+  energy = 0.0;
+
+  for (int i = 0; i < count; i++) {
+    cross += double(data[i]) * reference[i];
+    energy += double(reference[i]) * reference[i];
+  }
+
+  return (energy > 0.0 ? cross / std::sqrt(energy) : 0.0);
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,171 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef PLAYBACKGATE_H
+#define PLAYBACKGATE_H
+
+#include <QString>
+
+#include <atomic>
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \brief The settings of PlaybackGate. Times are in milliseconds.
+*/
+struct SPEECHRECOGNISER_EXPORT PlaybackGateConfig
+{
+  //! Widens every sound both ways to cover the error between the capture
+  //! and playback clocks.
+  int marginMs = 20;
+  //! How long the room keeps ringing after a sound ends.
+  int tailMs = 150;
+  //! How far either side of the scheduled time the echo is looked for in
+  //! Subtract mode.
+  int searchMs = 30;
+};
+
+/*!
+  \class PlaybackGate
+  \brief The PlaybackGate class stops the device's own feedback sounds
+  being taken for speech.
+
+  The gate is given the timeline of every sound played, normally straight
+  from FeedbackPlayer::played(), which gives the steady clock time its first
+  sample reached the speaker. Each capture block, stamped with the steady
+  clock time of its first sample, is checked against that timeline widened
+  by the clock margin and the room's tail.
+
+  In Skip mode an overlapping block is not detected at all, which saves the
+  detection work and rules out false triggers, at the cost of deafness
+  while a sound plays. In Subtract mode the gate is also given the sounds
+  themselves at the capture rate, in the same order as the player, and
+  removes a copy of the sound from the block, lined up by cross
+  correlation once the sound is clearly heard and scaled by a least squares
+  gain each block. This takes out the direct path from the speaker but not
+  the room's reflections. The search for the echo runs first on four times
+  decimated audio and then only around its best lag, and blocks of up to
+  100 ms never allocate.
+
+  schedule() is lock free and may be called from the playback callback
+  while process() runs on the detection thread.
+*/
+class SPEECHRECOGNISER_EXPORT PlaybackGate
+{
+public:
+  enum Mode
+  {
+    Skip,
+    Subtract,
+  };
+
+  enum Result
+  {
+    Clear,
+    Skipped,
+    Subtracted,
+  };
+
+  explicit PlaybackGate(int sampleRate = 16000,
+                        const PlaybackGateConfig& config = PlaybackGateConfig());
+
+  PlaybackGateConfig config() const;
+  void setConfig(const PlaybackGateConfig& config);
+  void setSampleRate(int sampleRate);
+  Mode mode() const;
+  void setMode(Mode mode);
+
+  int addPrompt(const float* samples, int count);
+  int addPrompt(const QString& filename);
+
+  void schedule(int sound, qint64 start, qint64 duration);
+  Result process(float* data, int count, qint64 captureTime);
+  void reset();
+
+  unsigned long long skippedBlocks() const;
+  unsigned long long skippedSamples() const;
+  unsigned long long subtractedBlocks() const;
+  double echoReductionDb() const;
+
+private:
+  struct Slot
+  {
+    std::atomic<int> sound{ -1 };
+    std::atomic<qint64> start{ 0 };
+    std::atomic<qint64> end{ 0 };
+  };
+
+  struct Interval
+  {
+    int sound;
+    qint64 start;
+    qint64 end;
+  };
+
+  static const int SLOTS = 8;
+
+  PlaybackGateConfig m_config;
+  int m_sampleRate;
+  Mode m_mode;
+  std::vector<std::vector<float>> m_prompts;
+
+  // written by schedule() only.
+  Slot m_slots[SLOTS];
+  std::atomic<unsigned> m_version;
+  int m_next;
+
+  // owned by process().
+  Interval m_snapshot[SLOTS];
+  qint64 m_alignedStart;
+  int m_lag;
+  std::vector<float> m_reference;
+  std::vector<float> m_extended;
+  std::vector<float> m_coarseData;
+  std::vector<float> m_coarseReference;
+  unsigned long long m_skippedBlocks;
+  unsigned long long m_skippedSamples;
+  unsigned long long m_subtractedBlocks;
+  double m_echoBefore;
+  double m_echoAfter;
+
+  void snapshot();
+  void reserve();
+  bool reference(const Interval& interval,
+                 qint64 captureTime,
+                 int lag,
+                 int count,
+                 std::vector<float>& out);
+  int align(const Interval& interval,
+            const float* data,
+            int count,
+            qint64 captureTime);
+  static double score(const float* data,
+                      const float* reference,
+                      int count,
+                      double& energy);
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // PLAYBACKGATE_H
@@ -0,0 +1,359 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <atomic>
+#include <cstdlib>
+
+#include "realtimeaudit.h"
+
+#if defined(SPEECHRECOGNISER_RTAUDIT) && defined(__GLIBC__)
+#define SR_REALTIME_INTERPOSE
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace SpeechRecognition {
+
+/* The thread's state is read on every allocation, so it must never need an
+   allocation itself, which the initial exec model guarantees.*/
+#if defined(__GNUC__)
+#define SR_REALTIME_TLS __attribute__((tls_model("initial-exec")))
+#else
+#define SR_REALTIME_TLS
+#endif
+
+static std::atomic<int> s_action{ RealtimeAudit::Count };
+static std::atomic<quint64> s_allocations{ 0 };
+static std::atomic<quint64> s_frees{ 0 };
+static std::atomic<quint64> s_locks{ 0 };
+static std::atomic<quint64> s_allowed{ 0 };
+static std::atomic<quint64> s_allowedFrees{ 0 };
+static std::atomic<const char*> s_lastScope{ nullptr };
+static thread_local int t_depth SR_REALTIME_TLS = 0;
+static thread_local int t_allowed SR_REALTIME_TLS = 0;
+static thread_local const char* t_scope SR_REALTIME_TLS = nullptr;
+
+#if defined(SR_REALTIME_INTERPOSE)
+/* Counts a call of kind from a real time scope, and aborts if asked to.
+   Nothing in here may allocate or lock.*/
+static void
+violation(std::atomic<quint64>& counter, const char* kind)
+{
+  if (t_depth == 0) {
+    return;
+  }
+
+  // an allowance only covers memory, a lock is always a violation.
+  if (t_allowed > 0 && &counter != &s_locks) {
+    (&counter == &s_frees ? s_allowedFrees : s_allowed)
+      .fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  counter.fetch_add(1, std::memory_order_relaxed);
+  s_lastScope.store(t_scope, std::memory_order_relaxed);
+
+  if (s_action.load(std::memory_order_relaxed) == RealtimeAudit::Abort) {
+    const char* parts[] = { "RealtimeAudit: ", kind, " in ", t_scope, "\n" };
+
+    for (const char* part : parts) {
+      ssize_t written = ::write(2, part, __builtin_strlen(part));
+      Q_UNUSED(written)
+    }
+
+    ::abort();
+  }
+}
+#endif
+
+/*!
+   \brief Returns true if the library was built with SPEECHRECOGNISER_RTAUDIT
+   on glibc, so allocations and locks are counted.
+*/
+bool
+RealtimeAudit::isCompiledIn()
+{
+#if defined(SR_REALTIME_INTERPOSE)
+  return true;
+#else
+  return false;
+#endif
+}
+
+/*!
+   \brief Returns what is done when a real time scope allocates or locks.
+*/
+RealtimeAudit::Action
+RealtimeAudit::action()
+{
+  return Action(s_action.load());
+}
+
+/*!
+   \brief Sets what is done when a real time scope allocates or locks.
+   Defaults to Count.
+*/
+void
+RealtimeAudit::setAction(Action action)
+{
+  s_action = action;
+}
+
+/*!
+   \brief Clears the counts, for example once a pipeline has warmed up.
+*/
+void
+RealtimeAudit::reset()
+{
+  s_allocations = 0;
+  s_frees = 0;
+  s_locks = 0;
+  s_allowed = 0;
+  s_allowedFrees = 0;
+  s_lastScope = nullptr;
+}
+
+/*!
+   \brief Returns the number of allocations made in real time scopes,
+   counting reallocations.
+*/
+quint64
+RealtimeAudit::allocations()
+{
+  return s_allocations;
+}
+
+/*!
+   \brief Returns the number of blocks freed in real time scopes, counting
+   the block a reallocation gives up.
+*/
+quint64
+RealtimeAudit::frees()
+{
+  return s_frees;
+}
+
+/*!
+   \brief Returns the number of mutexes locked in real time scopes.
+*/
+quint64
+RealtimeAudit::locks()
+{
+  return s_locks;
+}
+
+/*!
+   \brief Returns the number of allocations made where they are allowed,
+   inside a RealtimeAllowScope.
+*/
+quint64
+RealtimeAudit::allowedAllocations()
+{
+  return s_allowed;
+}
+
+/*!
+   \brief Returns the number of blocks freed where it is allowed, inside a
+   RealtimeAllowScope. Code that gives back everything it takes frees as
+   many as allowedAllocations().
+*/
+quint64
+RealtimeAudit::allowedFrees()
+{
+  return s_allowedFrees;
+}
+
+/*!
+   \brief Returns the name of the innermost scope of the last violation, or
+   nullptr if there has been none.
+*/
+const char*
+RealtimeAudit::lastScope()
+{
+  return s_lastScope;
+}
+
+/*!
+   \brief Marks the calling thread as real time until the matching leave().
+   The name must be a string literal. Returns the name of the enclosing
+   scope, nullptr if there is none, to be given back to leave().
+*/
+const char*
+RealtimeAudit::enter(const char* scope)
+{
+  const char* previous = t_scope;
+  t_depth++;
+  t_scope = scope;
+  return previous;
+}
+
+/*!
+   \brief Ends the innermost real time scope of the calling thread and
+   restores previous, the name enter() returned, as the current scope.
+*/
+void
+RealtimeAudit::leave(const char* previous)
+{
+  t_depth--;
+  t_scope = previous;
+}
+
+/*!
+   \brief Allows the calling thread to allocate and free until disallow().
+*/
+void
+RealtimeAudit::allow()
+{
+  t_allowed++;
+}
+
+/*!
+   \brief Ends the innermost allowance of the calling thread.
+*/
+void
+RealtimeAudit::disallow()
+{
+  t_allowed--;
+}
+
+} // end of namespace SpeechRecognition
+
+#if defined(SR_REALTIME_INTERPOSE)
+/* The replacements. Defining these in the library puts them ahead of
+   glibc's, which they call through its __libc_ aliases. The locks are found
+   with dlsym(), which itself only calls the allocator.*/
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void __libc_free(void* pointer);
+void* __libc_memalign(size_t alignment, size_t size);
+
+void*
+malloc(size_t size) noexcept
+{
+  SpeechRecognition::violation(SpeechRecognition::s_allocations, "malloc");
+  return __libc_malloc(size);
+}
+
+void*
+calloc(size_t count, size_t size) noexcept
+{
+  SpeechRecognition::violation(SpeechRecognition::s_allocations, "calloc");
+  return __libc_calloc(count, size);
+}
+
+void*
+realloc(void* pointer, size_t size) noexcept
+{
+  SpeechRecognition::violation(SpeechRecognition::s_allocations, "realloc");
+
+  if (pointer) {
+    SpeechRecognition::violation(SpeechRecognition::s_frees, "realloc");
+  }
+
+  return __libc_realloc(pointer, size);
+}
+
+void
+free(void* pointer) noexcept
+{
+  if (pointer) {
+    SpeechRecognition::violation(SpeechRecognition::s_frees, "free");
+  }
+
+  __libc_free(pointer);
+}
+
+void*
+memalign(size_t alignment, size_t size) noexcept
+{
+  SpeechRecognition::violation(SpeechRecognition::s_allocations, "memalign");
+  return __libc_memalign(alignment, size);
+}
+
+void*
+aligned_alloc(size_t alignment, size_t size) noexcept
+{
+  SpeechRecognition::violation(SpeechRecognition::s_allocations,
+                               "aligned_alloc");
+  return __libc_memalign(alignment, size);
+}
+
+int
+posix_memalign(void** pointer, size_t alignment, size_t size) noexcept
+{
+  if (alignment % sizeof(void*) != 0 ||
+      (alignment & (alignment - 1)) != 0) {
+    return EINVAL;
+  }
+
+  SpeechRecognition::violation(SpeechRecognition::s_allocations,
+                               "posix_memalign");
+  void* result = __libc_memalign(alignment, size);
+
+  if (!result) {
+    return ENOMEM;
+  }
+
+  *pointer = result;
+  return 0;
+}
+
+int
+pthread_mutex_lock(pthread_mutex_t* mutex) noexcept
+{
+  using Lock = int (*)(pthread_mutex_t*);
+  static std::atomic<Lock> real{ nullptr };
+  Lock lock = real.load(std::memory_order_relaxed);
+
+  if (!lock) {
+    lock = reinterpret_cast<Lock>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+    real.store(lock, std::memory_order_relaxed);
+  }
+
+  SpeechRecognition::violation(SpeechRecognition::s_locks,
+                               "pthread_mutex_lock");
+  return lock(mutex);
+}
+
+int
+pthread_mutex_trylock(pthread_mutex_t* mutex) noexcept
+{
+  using Lock = int (*)(pthread_mutex_t*);
+  static std::atomic<Lock> real{ nullptr };
+  Lock lock = real.load(std::memory_order_relaxed);
+
+  if (!lock) {
+    lock = reinterpret_cast<Lock>(dlsym(RTLD_NEXT, "pthread_mutex_trylock"));
+    real.store(lock, std::memory_order_relaxed);
+  }
+
+  SpeechRecognition::violation(SpeechRecognition::s_locks,
+                               "pthread_mutex_trylock");
+  return lock(mutex);
+}
+
+} // extern "C"
+#endif
@@ -0,0 +1,139 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef REALTIMEAUDIT_H
+#define REALTIMEAUDIT_H
+
+#include <QtGlobal>
+
+#include "SpeechRecogniser_global.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \class RealtimeAudit
+  \brief The RealtimeAudit class catches heap allocations and mutex locks on
+  the real time parts of the audio path.
+
+  Code that must not block, the capture callback, DetectionPipeline::process()
+  and the DetectionServer workers' detection, runs inside a RealtimeScope.
+  When the library is built with SPEECHRECOGNISER_RTAUDIT, qmake
+  CONFIG+=rtaudit, it replaces malloc(), calloc(), realloc(), free() and
+  the aligned allocators with versions that pass straight on to glibc's own
+  and count every call made inside a scope, and does the same for
+  pthread_mutex_lock() and pthread_mutex_trylock(). That covers operator
+  new and std::mutex, but not QMutex, which waits on a futex directly.
+
+  Third party code that is known to allocate, snowboy's RunDetection(), runs
+  inside a RealtimeAllowScope, which counts its allocations and frees apart
+  so that a check can still insist it gives back all it takes. Locks are
+  never allowed. By default a violation
+  is only counted, with setAction(Abort) it writes the scope to stderr and
+  aborts, so a debugger stops on it.
+
+  Without the option the scopes compile to nothing and isCompiledIn()
+  returns false. The audit needs glibc.
+*/
+class SPEECHRECOGNISER_EXPORT RealtimeAudit
+{
+public:
+  enum Action
+  {
+    Count,
+    Abort,
+  };
+
+  static bool isCompiledIn();
+  static Action action();
+  static void setAction(Action action);
+  static void reset();
+
+  static quint64 allocations();
+  static quint64 frees();
+  static quint64 locks();
+  static quint64 allowedAllocations();
+  static quint64 allowedFrees();
+  static const char* lastScope();
+
+  static const char* enter(const char* scope);
+  static void leave(const char* previous);
+  static void allow();
+  static void disallow();
+};
+
+/*!
+  \class RealtimeScope
+  \brief The RealtimeScope class marks the code from its construction to its
+  destruction as real time. Scopes nest, violations are reported against
+  the innermost and the outer one's name comes back when it ends.
+*/
+class SPEECHRECOGNISER_EXPORT RealtimeScope
+{
+public:
+  explicit RealtimeScope(const char* name)
+    : m_previous(RealtimeAudit::enter(name))
+  {}
+  ~RealtimeScope() { RealtimeAudit::leave(m_previous); }
+
+  RealtimeScope(const RealtimeScope&) = delete;
+  RealtimeScope& operator=(const RealtimeScope&) = delete;
+
+private:
+  const char* m_previous;
+};
+
+/*!
+  \class RealtimeAllowScope
+  \brief The RealtimeAllowScope class lets code inside a RealtimeScope
+  allocate and free, counting it apart. It must only wrap a single call into
+  code we do not control.
+*/
+class SPEECHRECOGNISER_EXPORT RealtimeAllowScope
+{
+public:
+  RealtimeAllowScope() { RealtimeAudit::allow(); }
+  ~RealtimeAllowScope() { RealtimeAudit::disallow(); }
+
+  RealtimeAllowScope(const RealtimeAllowScope&) = delete;
+  RealtimeAllowScope& operator=(const RealtimeAllowScope&) = delete;
+};
+
+} // end of namespace SpeechRecognition
+
+#define SR_REALTIME_JOIN2(a, b) a##b
+#define SR_REALTIME_JOIN(a, b) SR_REALTIME_JOIN2(a, b)
+
+#if defined(SPEECHRECOGNISER_RTAUDIT)
+#define SR_REALTIME_SCOPE(name)                                                \
+  SpeechRecognition::RealtimeScope SR_REALTIME_JOIN(srRealtime,                \
+                                                    __LINE__)(name)
+#define SR_REALTIME_ALLOW()                                                    \
+  SpeechRecognition::RealtimeAllowScope SR_REALTIME_JOIN(srRealtime, __LINE__)
+#else
+#define SR_REALTIME_SCOPE(name)                                                \
+  do {                                                                         \
+  } while (false)
+#define SR_REALTIME_ALLOW()                                                    \
+  do {                                                                         \
+  } while (false)
+#endif
+
+#endif // REALTIMEAUDIT_H
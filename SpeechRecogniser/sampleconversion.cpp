@@ -0,0 +1,164 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QtGlobal>
+
+#include "sampleconversion.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \brief Returns the bytes per sample of a PortAudio format, or 0 if the
+  format is not one of float32, int32, packed int24 or int16.
+*/
+int
+sampleBytes(PaSampleFormat format)
+{
+  switch (format & ~paNonInterleaved) {
+    case paFloat32:
+      return SampleFormat::Float32::bytes;
+
+    case paInt32:
+      return SampleFormat::Int32::bytes;
+
+    case paInt24:
+      return SampleFormat::Int24::bytes;
+
+    case paInt16:
+      return SampleFormat::Int16::bytes;
+
+    default:
+      return 0;
+  }
+}
+
+template<class From>
+static bool
+convertFrom(const void* src, PaSampleFormat to, void* dst, size_t count)
+{
+  const typename From::Type* in = static_cast<const typename From::Type*>(src);
+
+  switch (to & ~paNonInterleaved) {
+    case paFloat32:
+      convertSamples<From, SampleFormat::Float32>(
+        in, static_cast<float*>(dst), count);
+      return true;
+
+    case paInt32:
+      convertSamples<From, SampleFormat::Int32>(
+        in, static_cast<int32_t*>(dst), count);
+      return true;
+
+    case paInt24:
+      convertSamples<From, SampleFormat::Int24>(
+        in, static_cast<uint8_t*>(dst), count);
+      return true;
+
+    case paInt16:
+      convertSamples<From, SampleFormat::Int16>(
+        in, static_cast<int16_t*>(dst), count);
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+/*!
+  \brief Converts count samples between two PortAudio formats chosen at run
+  time, for example from a device's negotiated format.
+
+  Where both formats are known at compile time use the template version,
+  which avoids the switch. Returns false if either format is not supported.
+*/
+bool
+convertSamples(PaSampleFormat from,
+               const void* src,
+               PaSampleFormat to,
+               void* dst,
+               size_t count)
+{
+  switch (from & ~paNonInterleaved) {
+    case paFloat32:
+      return convertFrom<SampleFormat::Float32>(src, to, dst, count);
+
+    case paInt32:
+      return convertFrom<SampleFormat::Int32>(src, to, dst, count);
+
+    case paInt24:
+      return convertFrom<SampleFormat::Int24>(src, to, dst, count);
+
+    case paInt16:
+      return convertFrom<SampleFormat::Int16>(src, to, dst, count);
+
+    default:
+      return false;
+  }
+}
+
+// the half width of the resampling filter in input samples.
+static const int SINC_HALF_WIDTH = 16;
+
+/*!
+  \brief Resamples one channel from fromRate to toRate with a Hann windowed
+  sinc.
+
+  This favours quality over speed and allocates its result, so it is meant
+  for whole sounds when they are loaded rather than for live capture.
+*/
+std::vector<float>
+resample(const std::vector<float>& input, double fromRate, double toRate)
+{
+  if (fromRate == toRate) {
+    return input;
+  }
+
+  const double ratio = toRate / fromRate;
+  // below the lower of the two Nyquist rates, with a little room.
+  const double cutoff = 0.95 * std::min(1.0, ratio);
+  const int halfWidth = int(std::ceil(SINC_HALF_WIDTH / std::min(1.0, ratio)));
+  const qint64 inFrames = qint64(input.size());
+  std::vector<float> output(size_t(std::ceil(inFrames * ratio)));
+
+  for (size_t n = 0; n < output.size(); n++) {
+    double t = double(n) / ratio;
+    qint64 centre = qint64(std::floor(t));
+    double sum = 0.0;
+
+    for (qint64 k = centre - halfWidth + 1; k <= centre + halfWidth; k++) {
+      if (k < 0 || k >= inFrames) {
+        continue;
+      }
+
+      double x = t - double(k);
+      double sinc =
+        (x == 0.0 ? 1.0 : std::sin(M_PI * cutoff * x) / (M_PI * cutoff * x));
+      double window = 0.5 + 0.5 * std::cos(M_PI * x / halfWidth);
+      sum += input[size_t(k)] * cutoff * sinc * window;
+    }
+
+    output[n] = float(sum);
+  }
+
+  return output;
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,630 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef SAMPLECONVERSION_H
+#define SAMPLECONVERSION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "SpeechRecogniser_global.h"
+#include "portaudio.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \brief Sample format tags for the conversion kernels.
+
+  Each tag names the storage type of one sample (Int24 is three packed
+  little endian bytes) and the matching PortAudio format, so that the
+  kernel for a pair of formats is chosen at compile time wherever the
+  formats are known.
+
+  Conversions to an integer format round to nearest and saturate. Full scale
+  is -1.0 to 1.0 for floats and the symmetric power of two for integers, so
+  a float to int16 to float round trip of any int16 value is exact.
+*/
+namespace SampleFormat {
+
+struct Float32
+{
+  using Type = float;
+  static const PaSampleFormat format = paFloat32;
+  static const int bytes = 4;
+};
+
+struct Int32
+{
+  using Type = int32_t;
+  static const PaSampleFormat format = paInt32;
+  static const int bytes = 4;
+};
+
+struct Int24
+{
+  using Type = uint8_t;
+  static const PaSampleFormat format = paInt24;
+  static const int bytes = 3;
+};
+
+struct Int16
+{
+  using Type = int16_t;
+  static const PaSampleFormat format = paInt16;
+  static const int bytes = 2;
+};
+
+} // end of namespace SampleFormat
+
+namespace Detail {
+
+/* The scalar reference for every conversion goes through a normalised float
+   or a 32 bit integer. The compiler folds these into a single loop per
+   pair.*/
+template<class Format>
+struct Scalar;
+
+template<>
+struct Scalar<SampleFormat::Float32>
+{
+  static float toFloat(const float* p, size_t i) { return p[i]; }
+  static int32_t toInt32(const float* p, size_t i)
+  {
+    float x = std::min(std::max(p[i], -1.0f), 0.99999994f);
+    return int32_t(std::lrint(double(x) * 2147483648.0));
+  }
+  static void fromFloat(float* p, size_t i, float x) { p[i] = x; }
+  static void fromInt32(float* p, size_t i, int32_t x)
+  {
+    p[i] = float(x) * (1.0f / 2147483648.0f);
+  }
+};
+
+template<>
+struct Scalar<SampleFormat::Int32>
+{
+  static float toFloat(const int32_t* p, size_t i)
+  {
+    return float(p[i]) * (1.0f / 2147483648.0f);
+  }
+  static int32_t toInt32(const int32_t* p, size_t i) { return p[i]; }
+  static void fromFloat(int32_t* p, size_t i, float x)
+  {
+    p[i] = Scalar<SampleFormat::Float32>::toInt32(&x, 0);
+  }
+  static void fromInt32(int32_t* p, size_t i, int32_t x) { p[i] = x; }
+};
+
+template<>
+struct Scalar<SampleFormat::Int24>
+{
+  static int32_t toInt32(const uint8_t* p, size_t i)
+  {
+    const uint8_t* s = p + 3 * i;
+    return int32_t(uint32_t(s[0]) << 8 | uint32_t(s[1]) << 16 |
+                   uint32_t(s[2]) << 24);
+  }
+  static float toFloat(const uint8_t* p, size_t i)
+  {
+    return float(toInt32(p, i)) * (1.0f / 2147483648.0f);
+  }
+  static void fromInt32(uint8_t* p, size_t i, int32_t x)
+  {
+    // round the low byte away, saturating at the top.
+    int64_t rounded = (int64_t(x) + 0x80) >> 8;
+    int32_t v = int32_t(std::min<int64_t>(rounded, 0x7fffff));
+    uint8_t* d = p + 3 * i;
+    d[0] = uint8_t(v);
+    d[1] = uint8_t(v >> 8);
+    d[2] = uint8_t(v >> 16);
+  }
+  static void fromFloat(uint8_t* p, size_t i, float x)
+  {
+    x = std::min(std::max(x * 8388608.0f, -8388608.0f), 8388607.0f);
+    int32_t v = int32_t(std::lrint(x));
+    uint8_t* d = p + 3 * i;
+    d[0] = uint8_t(v);
+    d[1] = uint8_t(v >> 8);
+    d[2] = uint8_t(v >> 16);
+  }
+};
+
+template<>
+struct Scalar<SampleFormat::Int16>
+{
+  static float toFloat(const int16_t* p, size_t i)
+  {
+    return float(p[i]) * (1.0f / 32768.0f);
+  }
+  static int32_t toInt32(const int16_t* p, size_t i)
+  {
+    return int32_t(uint32_t(int32_t(p[i])) << 16);
+  }
+  static void fromFloat(int16_t* p, size_t i, float x)
+  {
+    x = std::min(std::max(x * 32768.0f, -32768.0f), 32767.0f);
+    p[i] = int16_t(std::lrint(x));
+  }
+  static void fromInt32(int16_t* p, size_t i, int32_t x)
+  {
+    int64_t rounded = (int64_t(x) + 0x8000) >> 16;
+    p[i] = int16_t(std::min<int64_t>(rounded, 32767));
+  }
+};
+
+/* Float is the intermediate whenever either side is float, otherwise the
+   conversion stays in integers so no precision is lost.*/
+template<class From, class To>
+struct UsesFloat
+{
+  static const bool value = std::is_same<From, SampleFormat::Float32>::value ||
+                            std::is_same<To, SampleFormat::Float32>::value;
+};
+
+template<class From, class To, bool ViaFloat = UsesFloat<From, To>::value>
+struct ScalarKernel
+{
+  static void one(const typename From::Type* src,
+                  size_t from,
+                  typename To::Type* dst,
+                  size_t to)
+  {
+    Scalar<To>::fromFloat(dst, to, Scalar<From>::toFloat(src, from));
+  }
+
+  static void run(const typename From::Type* src,
+                  typename To::Type* dst,
+                  size_t first,
+                  size_t count)
+  {
+    for (size_t i = first; i < count; i++) {
+      one(src, i, dst, i);
+    }
+  }
+};
+
+template<class From, class To>
+struct ScalarKernel<From, To, false>
+{
+  static void one(const typename From::Type* src,
+                  size_t from,
+                  typename To::Type* dst,
+                  size_t to)
+  {
+    Scalar<To>::fromInt32(dst, to, Scalar<From>::toInt32(src, from));
+  }
+
+  static void run(const typename From::Type* src,
+                  typename To::Type* dst,
+                  size_t first,
+                  size_t count)
+  {
+    for (size_t i = first; i < count; i++) {
+      one(src, i, dst, i);
+    }
+  }
+};
+
+/* The vector kernels convert as many whole vectors as they can and return
+   how many samples they did, the scalar kernel finishes the tail. Pairs
+   without a vector kernel do nothing here.*/
+template<class From, class To>
+struct VectorKernel
+{
+  static size_t run(const typename From::Type*, typename To::Type*, size_t)
+  {
+    return 0;
+  }
+};
+
+#if defined(__AVX2__)
+
+template<>
+struct VectorKernel<SampleFormat::Float32, SampleFormat::Int16>
+{
+  static size_t run(const float* src, int16_t* dst, size_t count)
+  {
+    const __m256 scale = _mm256_set1_ps(32768.0f);
+    const __m256 lo = _mm256_set1_ps(-32768.0f);
+    const __m256 hi = _mm256_set1_ps(32767.0f);
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+      __m256 a = _mm256_mul_ps(_mm256_loadu_ps(src + i), scale);
+      __m256 b = _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), scale);
+      __m256i ia = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(a, lo), hi));
+      __m256i ib = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(b, lo), hi));
+      // the pack works within 128 bit lanes, put the quarters back in order.
+      __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(ia, ib), 0xd8);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+    }
+
+    return i;
+  }
+};
+
+template<>
+struct VectorKernel<SampleFormat::Int16, SampleFormat::Float32>
+{
+  static size_t run(const int16_t* src, float* dst, size_t count)
+  {
+    const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+      __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(x));
+      _mm256_storeu_ps(dst + i, _mm256_mul_ps(f, scale));
+    }
+
+    return i;
+  }
+};
+
+template<>
+struct VectorKernel<SampleFormat::Float32, SampleFormat::Int32>
+{
+  static size_t run(const float* src, int32_t* dst, size_t count)
+  {
+    const __m256 scale = _mm256_set1_ps(2147483648.0f);
+    const __m256 lo = _mm256_set1_ps(-1.0f);
+    const __m256 hi = _mm256_set1_ps(0.99999994f);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+      __m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), lo), hi);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                          _mm256_cvtps_epi32(_mm256_mul_ps(x, scale)));
+    }
+
+    return i;
+  }
+};
+
+template<>
+struct VectorKernel<SampleFormat::Int32, SampleFormat::Float32>
+{
+  static size_t run(const int32_t* src, float* dst, size_t count)
+  {
+    const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+      __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+      _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), scale));
+    }
+
+    return i;
+  }
+};
+
+#elif defined(__SSE2__)
+
+template<>
+struct VectorKernel<SampleFormat::Float32, SampleFormat::Int16>
+{
+  static size_t run(const float* src, int16_t* dst, size_t count)
+  {
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    const __m128 lo = _mm_set1_ps(-32768.0f);
+    const __m128 hi = _mm_set1_ps(32767.0f);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+      __m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+      __m128 b = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+      __m128i ia = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(a, lo), hi));
+      __m128i ib = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(b, lo), hi));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                       _mm_packs_epi32(ia, ib));
+    }
+
+    return i;
+  }
+};
+
+template<>
+struct VectorKernel<SampleFormat::Int16, SampleFormat::Float32>
+{
+  static size_t run(const int16_t* src, float* dst, size_t count)
+  {
+    const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+      __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      // sign extend by unpacking into the high halves and shifting down.
+      __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+      __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+      _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(a), scale));
+      _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+    }
+
+    return i;
+  }
+};
+
+template<>
+struct VectorKernel<SampleFormat::Float32, SampleFormat::Int32>
+{
+  static size_t run(const float* src, int32_t* dst, size_t count)
+  {
+    const __m128 scale = _mm_set1_ps(2147483648.0f);
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    const __m128 hi = _mm_set1_ps(0.99999994f);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+      __m128 x = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo), hi);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                       _mm_cvtps_epi32(_mm_mul_ps(x, scale)));
+    }
+
+    return i;
+  }
+};
+
+template<>
+struct VectorKernel<SampleFormat::Int32, SampleFormat::Float32>
+{
+  static size_t run(const int32_t* src, float* dst, size_t count)
+  {
+    const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+      __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+    }
+
+    return i;
+  }
+};
+
+#elif defined(__ARM_NEON)
+
+/* vcvtnq rounds to nearest but is AArch64 only, 32 bit ARM rounds half away
+   from zero instead, which only differs on exact halves.*/
+static inline int32x4_t
+roundToInt(float32x4_t x)
+{
+#if defined(__aarch64__)
+  return vcvtnq_s32_f32(x);
+#else
+  uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(x), vdupq_n_u32(0x80000000));
+  float32x4_t half = vreinterpretq_f32_u32(
+    vorrq_u32(sign, vreinterpretq_u32_f32(vdupq_n_f32(0.5f))));
+  return vcvtq_s32_f32(vaddq_f32(x, half));
+#endif
+}
+
+template<>
+struct VectorKernel<SampleFormat::Float32, SampleFormat::Int16>
+{
+  static size_t run(const float* src, int16_t* dst, size_t count)
+  {
+    const float32x4_t lo = vdupq_n_f32(-32768.0f);
+    const float32x4_t hi = vdupq_n_f32(32767.0f);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+      float32x4_t a = vmulq_n_f32(vld1q_f32(src + i), 32768.0f);
+      float32x4_t b = vmulq_n_f32(vld1q_f32(src + i + 4), 32768.0f);
+      int32x4_t ia = roundToInt(vminq_f32(vmaxq_f32(a, lo), hi));
+      int32x4_t ib = roundToInt(vminq_f32(vmaxq_f32(b, lo), hi));
+      vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(ia), vqmovn_s32(ib)));
+    }
+
+    return i;
+  }
+};
+
+template<>
+struct VectorKernel<SampleFormat::Int16, SampleFormat::Float32>
+{
+  static size_t run(const int16_t* src, float* dst, size_t count)
+  {
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+      int16x8_t x = vld1q_s16(src + i);
+      float32x4_t a = vcvtq_f32_s32(vmovl_s16(vget_low_s16(x)));
+      float32x4_t b = vcvtq_f32_s32(vmovl_s16(vget_high_s16(x)));
+      vst1q_f32(dst + i, vmulq_n_f32(a, 1.0f / 32768.0f));
+      vst1q_f32(dst + i + 4, vmulq_n_f32(b, 1.0f / 32768.0f));
+    }
+
+    return i;
+  }
+};
+
+template<>
+struct VectorKernel<SampleFormat::Float32, SampleFormat::Int32>
+{
+  static size_t run(const float* src, int32_t* dst, size_t count)
+  {
+    const float32x4_t lo = vdupq_n_f32(-1.0f);
+    const float32x4_t hi = vdupq_n_f32(0.99999994f);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+      float32x4_t x = vminq_f32(vmaxq_f32(vld1q_f32(src + i), lo), hi);
+      vst1q_s32(dst + i, roundToInt(vmulq_n_f32(x, 2147483648.0f)));
+    }
+
+    return i;
+  }
+};
+
+template<>
+struct VectorKernel<SampleFormat::Int32, SampleFormat::Float32>
+{
+  static size_t run(const int32_t* src, float* dst, size_t count)
+  {
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+      float32x4_t x = vcvtq_f32_s32(vld1q_s32(src + i));
+      vst1q_f32(dst + i, vmulq_n_f32(x, 1.0f / 2147483648.0f));
+    }
+
+    return i;
+  }
+};
+
+#endif
+
+} // end of namespace Detail
+
+/*!
+  \brief Converts count samples from one format to another, using the best
+  vector kernel built in for the pair and scalar code for the rest.
+
+  The formats are SampleFormat tags, for example
+
+    convertSamples<SampleFormat::Float32, SampleFormat::Int16>(in, out, n);
+
+  Which vector kernel exists depends on the instruction set the library is
+  compiled for: AVX2 if built with -mavx2, otherwise SSE2 on x86 and NEON on
+  ARM. Packed 24 bit always uses the scalar code.
+*/
+template<class From, class To>
+inline void
+convertSamples(const typename From::Type* src,
+               typename To::Type* dst,
+               size_t count)
+{
+  if (std::is_same<From, To>::value) {
+    std::memcpy(dst, src, count * size_t(From::bytes));
+    return;
+  }
+
+  size_t done = Detail::VectorKernel<From, To>::run(src, dst, count);
+  Detail::ScalarKernel<From, To>::run(src, dst, done, count);
+}
+
+/*!
+  \brief Converts count samples using only the scalar code. This is the
+  reference the vector kernels are measured and checked against.
+*/
+template<class From, class To>
+inline void
+convertSamplesScalar(const typename From::Type* src,
+                     typename To::Type* dst,
+                     size_t count)
+{
+  Detail::ScalarKernel<From, To>::run(src, dst, 0, count);
+}
+
+/*!
+  \brief Splits interleaved frames into one buffer per channel, converting
+  the format on the way.
+
+  \param src - frames * channels interleaved samples.
+  \param dst - channels pointers, each to room for frames samples.
+*/
+template<class From, class To>
+inline void
+interleavedToPlanar(const typename From::Type* src,
+                    typename To::Type* const* dst,
+                    int channels,
+                    size_t frames)
+{
+  for (int c = 0; c < channels; c++) {
+    for (size_t i = 0; i < frames; i++) {
+      Detail::ScalarKernel<From, To>::one(
+        src, i * size_t(channels) + size_t(c), dst[c], i);
+    }
+  }
+}
+
+/*!
+  \brief Splits interleaved float frames into one buffer per channel.
+
+  This is the capture path's common case so mono is a straight copy and
+  stereo has a vector kernel.
+*/
+template<>
+inline void
+interleavedToPlanar<SampleFormat::Float32, SampleFormat::Float32>(
+  const float* src,
+  float* const* dst,
+  int channels,
+  size_t frames)
+{
+  if (channels == 1) {
+    std::memcpy(dst[0], src, frames * sizeof(float));
+    return;
+  }
+
+  size_t i = 0;
+
+  if (channels == 2) {
+#if defined(__SSE2__)
+    for (; i + 4 <= frames; i += 4) {
+      __m128 a = _mm_loadu_ps(src + 2 * i);
+      __m128 b = _mm_loadu_ps(src + 2 * i + 4);
+      _mm_storeu_ps(dst[0] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+      _mm_storeu_ps(dst[1] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= frames; i += 4) {
+      float32x4x2_t x = vld2q_f32(src + 2 * i);
+      vst1q_f32(dst[0] + i, x.val[0]);
+      vst1q_f32(dst[1] + i, x.val[1]);
+    }
+#endif
+  }
+
+  for (; i < frames; i++) {
+    for (int c = 0; c < channels; c++) {
+      dst[c][i] = src[i * size_t(channels) + size_t(c)];
+    }
+  }
+}
+
+SPEECHRECOGNISER_EXPORT int sampleBytes(PaSampleFormat format);
+SPEECHRECOGNISER_EXPORT bool convertSamples(PaSampleFormat from,
+                                            const void* src,
+                                            PaSampleFormat to,
+                                            void* dst,
+                                            size_t count);
+SPEECHRECOGNISER_EXPORT std::vector<float> resample(
+  const std::vector<float>& input,
+  double fromRate,
+  double toRate);
+
+} // end of namespace SpeechRecognition
+
+#endif // SAMPLECONVERSION_H
@@ -0,0 +1,317 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QPainter>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "spectrogram.h"
+
+namespace SpeechRecognition {
+
+static const float POWER_FLOOR = 1.0e-20f;
+static const int COLOURS = 256;
+
+static void
+multiply(const float* a, const float* b, float* out, int count)
+{
+  int i = 0;
+
+#if defined(__SSE2__)
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(a + i), y = _mm_loadu_ps(b + i);
+    _mm_storeu_ps(out + i, _mm_mul_ps(x, y));
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 4 <= count; i += 4) {
+    vst1q_f32(out + i, vmulq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+  }
+#endif
+
+  for (; i < count; i++) {
+    out[i] = a[i] * b[i];
+  }
+}
+
+/* Interpolates the 256 colours between a few stops, from near black for
+   the noise floor through purple and orange to pale yellow.*/
+static QVector<QRgb>
+buildColourTable()
+{
+  static const int stops[][3] = { { 0, 0, 4 },       { 40, 11, 84 },
+                                  { 101, 21, 110 },  { 159, 42, 99 },
+                                  { 212, 72, 66 },   { 245, 125, 21 },
+                                  { 250, 193, 39 },  { 252, 255, 164 } };
+  const int last = int(sizeof(stops) / sizeof(stops[0])) - 1;
+  QVector<QRgb> table(COLOURS);
+
+  for (int i = 0; i < COLOURS; i++) {
+    double position = double(i) * last / (COLOURS - 1);
+    int stop = qMin(int(position), last - 1);
+    double t = position - stop;
+    int rgb[3];
+
+    for (int c = 0; c < 3; c++) {
+      rgb[c] = int(std::lround(stops[stop][c] +
+                               t * (stops[stop + 1][c] - stops[stop][c])));
+    }
+
+    table[i] = qRgb(rgb[0], rgb[1], rgb[2]);
+  }
+
+  return table;
+}
+
+/*!
+  \brief Creates a spectrogram with the settings in config.
+*/
+Spectrogram::Spectrogram(const SpectrogramConfig& config, QObject* parent)
+  : QObject(parent)
+  , m_colours(colourTable())
+  , m_filled(0)
+  , m_scale(0.0f)
+  , m_offset(0.0f)
+  , m_next(0)
+  , m_written(0)
+{
+  setConfig(config);
+}
+
+/*!
+  \brief Returns the configuration, with the FFT size rounded up to a power
+  of two.
+*/
+SpectrogramConfig
+Spectrogram::config() const
+{
+  return m_config;
+}
+
+/*!
+  \brief Sets the configuration and builds the window, FFT plan and an
+  empty image for it. Call it on the thread that calls addData().
+*/
+void
+Spectrogram::setConfig(const SpectrogramConfig& config)
+{
+  m_config = config;
+  m_config.sampleRate = qMax(1, m_config.sampleRate);
+  m_fft = Fft(qMax(16, m_config.fftSize));
+  m_config.fftSize = m_fft.size();
+  m_config.hopSize = qBound(1, m_config.hopSize, m_config.fftSize);
+  m_config.displayTime = qMax(1, m_config.displayTime);
+
+  if (m_config.ceilingDb <= m_config.floorDb) {
+    m_config.ceilingDb = m_config.floorDb + 1.0f;
+  }
+
+  const int size = m_fft.size();
+  const int bins = m_fft.bins();
+  m_window.resize(size_t(size));
+  double sum = 0.0;
+
+  for (int i = 0; i < size; i++) {
+    m_window[size_t(i)] = float(0.5 - 0.5 * std::cos(2.0 * M_PI * i / size));
+    sum += m_window[size_t(i)];
+  }
+
+  m_history.assign(size_t(size), 0.0f);
+  m_frame.resize(size_t(size));
+  m_re.resize(size_t(bins));
+  m_im.resize(size_t(bins));
+  m_power.resize(size_t(bins));
+  m_column.resize(size_t(bins));
+  m_filled = 0;
+
+  // a full scale sine is 0 dBFS, its bin's power is (sum / 2)^2. The
+  // colour index is then a scale and offset of the natural log of the
+  // power.
+  double reference = 10.0 * std::log10(sum * sum / 4.0);
+  double perDb = (COLOURS - 1) / double(m_config.ceilingDb - m_config.floorDb);
+  m_scale = float(perDb * 10.0 / std::log(10.0));
+  m_offset = float(-perDb * (reference + m_config.floorDb));
+
+  int columns = int(qint64(m_config.displayTime) * m_config.sampleRate /
+                    (1000 * qint64(m_config.hopSize)));
+
+  QMutexLocker locker(&m_mutex);
+  m_image = QImage(qMax(1, columns), bins, QImage::Format_RGB32);
+  m_image.fill(m_colours.at(0));
+  m_next = 0;
+  m_written = 0;
+}
+
+/*!
+  \brief Returns the number of columns the image holds, the display time
+  over the hop.
+*/
+int
+Spectrogram::columns() const
+{
+  QMutexLocker locker(&m_mutex);
+  return m_image.width();
+}
+
+/*!
+  \brief Returns the number of rows in a column, the FFT's bins from DC at
+  the bottom to Nyquist at the top.
+*/
+int
+Spectrogram::rows() const
+{
+  QMutexLocker locker(&m_mutex);
+  return m_image.height();
+}
+
+/*!
+  \brief Returns the number of columns written since the configuration was
+  set or the spectrogram was reset.
+*/
+quint64
+Spectrogram::columnsWritten() const
+{
+  QMutexLocker locker(&m_mutex);
+  return m_written;
+}
+
+/*!
+  \brief Adds samples, as sent by SpeechRecogniser::sendData(). Connect it
+  queued to a spectrogram on a worker thread.
+*/
+void
+Spectrogram::addData(QVector<float> data)
+{
+  process(data.constData(), data.size());
+}
+
+/*!
+  \brief Adds count samples, writing a column for every hopSize of them
+  once the first frame is full.
+*/
+void
+Spectrogram::process(const float* samples, int count)
+{
+  const int size = m_fft.size();
+  const int hop = m_config.hopSize;
+
+  while (count > 0) {
+    int n = qMin(count, size - m_filled);
+    std::copy(samples, samples + n, m_history.begin() + m_filled);
+    m_filled += n;
+    samples += n;
+    count -= n;
+
+    if (m_filled == size) {
+      computeColumn();
+      std::copy(m_history.begin() + hop, m_history.end(), m_history.begin());
+      m_filled = size - hop;
+    }
+  }
+}
+
+/*!
+  \brief Forgets the audio so far and clears the image.
+*/
+void
+Spectrogram::reset()
+{
+  m_filled = 0;
+
+  QMutexLocker locker(&m_mutex);
+  m_image.fill(m_colours.at(0));
+  m_next = 0;
+  m_written = 0;
+}
+
+/*!
+  \brief Draws the image scaled into target, the oldest column at the
+  left and the newest at the right. Safe to call from the GUI thread while
+  columns are being added.
+*/
+void
+Spectrogram::paint(QPainter* painter, const QRect& target) const
+{
+  QMutexLocker locker(&m_mutex);
+  const int width = m_image.width();
+  const int height = m_image.height();
+  const int oldest = m_next;
+  const qreal scale = qreal(target.width()) / width;
+
+  QRectF older(
+    target.left(), target.top(), (width - oldest) * scale, target.height());
+  painter->drawImage(older, m_image, QRectF(oldest, 0, width - oldest, height));
+
+  if (oldest > 0) {
+    QRectF newer(older.right(), target.top(), oldest * scale, target.height());
+    painter->drawImage(newer, m_image, QRectF(0, 0, oldest, height));
+  }
+}
+
+/*!
+  \brief Returns the 256 colours levels are drawn in, from the floor to
+  the ceiling. The table is built once.
+*/
+QVector<QRgb>
+Spectrogram::colourTable()
+{
+  static const QVector<QRgb> table = buildColourTable();
+  return table;
+}
+
+/* Transforms the frame in the history into the next column. The column is
+   built outside the lock and only copied into the image inside it.*/
+void
+Spectrogram::computeColumn()
+{
+  const int size = m_fft.size();
+  const int bins = m_fft.bins();
+  const QRgb* colours = m_colours.constData();
+
+  multiply(m_history.data(), m_window.data(), m_frame.data(), size);
+  m_fft.forward(m_frame.data(), m_re.data(), m_im.data());
+  Fft::power(m_re.data(), m_im.data(), m_power.data(), bins);
+
+  for (int k = 0; k < bins; k++) {
+    float level =
+      m_scale * std::log(std::max(m_power[size_t(k)], POWER_FLOOR)) + m_offset;
+    int index = qBound(0, int(level), COLOURS - 1);
+    m_column[size_t(bins - 1 - k)] = colours[index];
+  }
+
+  QMutexLocker locker(&m_mutex);
+
+  for (int row = 0; row < bins; row++) {
+    reinterpret_cast<QRgb*>(m_image.scanLine(row))[m_next] =
+      m_column[size_t(row)];
+  }
+
+  m_next = (m_next + 1) % m_image.width();
+  m_written++;
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,125 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef SPECTROGRAM_H
+#define SPECTROGRAM_H
+
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QRect>
+#include <QVector>
+
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+#include "fft.h"
+
+class QPainter;
+
+namespace SpeechRecognition {
+
+/*!
+  \brief The settings of Spectrogram. The defaults give 32 ms columns every
+  16 ms at 16 kHz, 625 columns of 257 rows for ten seconds.
+*/
+struct SPEECHRECOGNISER_EXPORT SpectrogramConfig
+{
+  int sampleRate = 16000;
+  //! The FFT size, a power of two. Each column has fftSize / 2 + 1 rows.
+  int fftSize = 512;
+  //! Samples between the starts of columns.
+  int hopSize = 256;
+  //! Milliseconds of audio the image holds.
+  int displayTime = 10000;
+  //! The level drawn in the first colour of the table, in dBFS.
+  float floorDb = -100.0f;
+  //! The level drawn in the last colour of the table, in dBFS.
+  float ceilingDb = -20.0f;
+};
+
+/*!
+  \class Spectrogram
+  \brief The Spectrogram class turns a stream of samples into a scrolling
+  spectrogram image, one short time Fourier transform column at a time.
+
+  It is meant to live on a worker thread. addData() cuts the samples into
+  frames of fftSize every hopSize, and each frame is Hann windowed,
+  transformed by Fft and reduced to its power spectrum, the window and
+  multiply running four samples at a time with SSE or NEON. The levels in
+  dB index a 256 entry colour table and the column is written over the
+  oldest one of an RGB32 image, so only new audio is ever transformed and
+  nothing scrolls in memory. The window, FFT plan, colour table and image
+  are made by setConfig(); addData() does not allocate.
+
+  paint() may be called from the GUI thread. It blits the image in two
+  parts, oldest column first, and holds the lock only for the blit; the
+  worker holds it only to copy a finished column in.
+*/
+class SPEECHRECOGNISER_EXPORT Spectrogram : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit Spectrogram(const SpectrogramConfig& config = SpectrogramConfig(),
+                       QObject* parent = nullptr);
+
+  SpectrogramConfig config() const;
+  void setConfig(const SpectrogramConfig& config);
+
+  int columns() const;
+  int rows() const;
+  quint64 columnsWritten() const;
+
+  void addData(QVector<float> data);
+  void process(const float* samples, int count);
+  void reset();
+
+  void paint(QPainter* painter, const QRect& target) const;
+
+  static QVector<QRgb> colourTable();
+
+private:
+  SpectrogramConfig m_config;
+  Fft m_fft;
+  std::vector<float> m_window;
+  std::vector<float> m_history;
+  std::vector<float> m_frame;
+  std::vector<float> m_re;
+  std::vector<float> m_im;
+  std::vector<float> m_power;
+  std::vector<QRgb> m_column;
+  QVector<QRgb> m_colours;
+  int m_filled;
+  float m_scale;
+  float m_offset;
+
+  mutable QMutex m_mutex;
+  QImage m_image;
+  int m_next;
+  quint64 m_written;
+
+  void computeColumn();
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // SPECTROGRAM_H
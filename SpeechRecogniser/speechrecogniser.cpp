@@ -21,49 +21,450 @@
 */
 #include <QThread>
 
+#include <algorithm>
+
+#include "deviceclock.h"
 #include "speechrecogniser.h"
+#include "tracing.h"
 
 namespace SpeechRecognition {
 
+/*!
+  \brief Returns the real time factor of the whole stream after capture,
+  the channel mix and every pipeline stage.
+*/
+double
+StreamLoad::realTimeFactor() const
+{
+  return mixRealTimeFactor + pipeline.realTimeFactor();
+}
+
+/*!
+  \brief Returns the report as one line for the log.
+*/
+QString
+StreamLoad::toString() const
+{
+  QString text = QString("load over %1 s: rtf %2, callback %3, mix %4")
+                   .arg(seconds, 0, 'f', 1)
+                   .arg(realTimeFactor(), 0, 'f', 4)
+                   .arg(callbackLoad, 0, 'f', 4)
+                   .arg(mixRealTimeFactor, 0, 'f', 4);
+
+  for (int stage = 0; stage < PipelineLoad::StageCount; stage++) {
+    PipelineLoad::Stage s = PipelineLoad::Stage(stage);
+    text += QString(", %1 %2")
+              .arg(PipelineLoad::stageName(s))
+              .arg(pipeline.realTimeFactor(s), 0, 'f', 4);
+  }
+
+  return text;
+}
+
+/*!
+  \brief Creates a recogniser capturing NUM_CHANNELS channels from the
+  default input device.
+*/
 SpeechRecogniser::SpeechRecogniser(QObject* parent)
+  : SpeechRecogniser(NUM_CHANNELS, parent)
+{}
+
+/*!
+  \brief Creates a recogniser capturing channelCount channels from the default
+  input device. Multiple channels are combined into one for detection, see
+  setChannelMode().
+*/
+SpeechRecogniser::SpeechRecogniser(int channelCount, QObject* parent)
   : QObject(parent)
+  , m_reader(nullptr)
   , m_running(true)
+  , m_channelMode(Downmix)
+  , m_beamformer(SAMPLE_RATE)
+  , m_loadInterval(0)
+  , m_mixNs(0)
+  , m_loadMixNs(0)
 {
-  QThread* reader_thread = new QThread;
-  m_reader = new MicrophoneReader();
-  connect(
-    reader_thread, &QThread::started, m_reader, &MicrophoneReader::record);
-  connect(m_reader, &MicrophoneReader::finished, reader_thread, &QThread::quit);
+  startReader(new MicrophoneReader(channelCount));
+}
+
+/*!
+  \brief Creates a recogniser capturing from the device described by
+  settings, which must be captured at SAMPLE_RATE. To detect on several
+  devices at once use CaptureGroup.
+*/
+SpeechRecogniser::SpeechRecogniser(const CaptureSettings& settings,
+                                   QObject* parent)
+  : QObject(parent)
+  , m_reader(nullptr)
+  , m_running(true)
+  , m_channelMode(Downmix)
+  , m_beamformer(SAMPLE_RATE)
+  , m_loadInterval(0)
+  , m_mixNs(0)
+  , m_loadMixNs(0)
+{
+  startReader(new MicrophoneReader(settings));
+}
+
+/*!
+  \brief Creates a recogniser that takes its audio from source, for example
+  a FileAudioSource replaying a recording. The recogniser takes ownership of
+  the source and runs it on its own thread, exactly as it would a
+  microphone. With a null source nothing is captured and isRunning() is
+  false.
+
+  The parent has no default, so that SpeechRecogniser(nullptr) still means
+  the default microphone with no parent.
+*/
+SpeechRecogniser::SpeechRecogniser(AudioSource* source, QObject* parent)
+  : QObject(parent)
+  , m_reader(nullptr)
+  , m_running(true)
+  , m_channelMode(Downmix)
+  , m_beamformer(SAMPLE_RATE)
+  , m_loadInterval(0)
+  , m_mixNs(0)
+  , m_loadMixNs(0)
+{
+  if (!source) {
+    qWarning() << tr("no audio source was given.");
+    m_running = false;
+    return;
+  }
+
+  if (int(source->sampleRate()) != SAMPLE_RATE) {
+    qWarning() << tr("the detector needs %1 Hz audio, the source is %2 Hz.")
+                    .arg(SAMPLE_RATE)
+                    .arg(source->sampleRate());
+  }
+
+  startReader(source);
+}
+
+/*!
+  \brief Takes the pipeline's playback gate back from any feedback player,
+  whose callback would otherwise schedule sounds on it after it is gone.
+*/
+SpeechRecogniser::~SpeechRecogniser()
+{
+  if (m_player && m_player->playbackGate() == &m_pipeline.playbackGate()) {
+    m_player->setPlaybackGate(nullptr);
+  }
+}
+
+/*!
+  \brief Loads the hotword detector. Returns false if any of the files are
+  missing.
+
+  Until a detector is set captured data is only passed on through sendData().
+  This must be called before the recogniser is moved to its thread.
+
+  \param resourceFile - the snowboy resource file, normally common.res.
+  \param models - a comma separated list of model files.
+  \param sensitivity - a comma separated list of sensitivities, one per
+  hotword. If empty the model defaults are used.
+*/
+bool
+SpeechRecogniser::setDetector(const QString& resourceFile,
+                              const QString& models,
+                              const QString& sensitivity)
+{
+  return m_pipeline.setDetector(resourceFile, models, sensitivity);
+}
+
+/*!
+  \brief Returns the policy used to batch captured blocks into detection
+  chunks.
+*/
+ChunkPolicy
+SpeechRecogniser::chunkPolicy() const
+{
+  return m_pipeline.chunkPolicy();
+}
+
+/*!
+  \brief Sets the policy used to batch captured blocks into detection chunks.
+  Defaults to an adaptive policy with the default ChunkPolicyConfig limits.
+
+  This must be called before the recogniser is moved to its thread.
+*/
+void
+SpeechRecogniser::setChunkPolicy(const ChunkPolicy& policy)
+{
+  m_pipeline.setChunkPolicy(policy);
+}
+
+/*!
+  \brief Returns true if the energy pre-gate is skipping quiet blocks.
+*/
+bool
+SpeechRecogniser::isEnergyGateEnabled() const
+{
+  return m_pipeline.isEnergyGateEnabled();
+}
+
+/*!
+  \brief Enables or disables the energy pre-gate, which skips detection
+  altogether while the input stays near its noise floor. Defaults to false.
+
+  This must be called before the recogniser is moved to its thread.
+*/
+void
+SpeechRecogniser::setEnergyGateEnabled(bool enabled)
+{
+  m_pipeline.setEnergyGateEnabled(enabled);
+}
+
+/*!
+  \brief Returns the detection pipeline. It belongs to the recogniser's
+  thread once that has started.
+*/
+DetectionPipeline*
+SpeechRecogniser::pipeline()
+{
+  return &m_pipeline;
+}
+
+/*!
+  \brief Archives everything the source captures with recorder, which is
+  started with the source's channel count and sample rate. Returns false if
+  the recorder could not start.
+
+  The blocks are handed to the recorder on the capture thread, which never
+  waits on the disk. The recorder must outlive the source.
+*/
+bool
+SpeechRecogniser::setRecorder(WavRecorder* recorder)
+{
+  if (!m_reader ||
+      !recorder->start(m_reader->channelCount(), int(m_reader->sampleRate()))) {
+    return false;
+  }
+
   connect(
-    m_reader, &MicrophoneReader::finished, m_reader, &QObject::deleteLater);
+    m_reader,
+    &AudioSource::sendBlock,
+    m_reader,
+    [recorder](const SpeechRecognition::AudioBlock& block) {
+      recorder->push(block);
+    },
+    Qt::DirectConnection);
+  return true;
+}
+
+/*!
+  \brief Stops the sounds played by player triggering detection, by
+  enabling the pipeline's playback gate and scheduling every sound on it as
+  it reaches the speaker.
+
+  The gate skips detection while a sound plays unless it has been switched
+  to Subtract mode and given the sounds, in the order they were added to
+  the player. The player's callback schedules the sounds itself, lock
+  free, until the recogniser is destroyed.
+*/
+void
+SpeechRecogniser::setFeedbackPlayer(FeedbackPlayer* player)
+{
+  m_pipeline.setPlaybackGateEnabled(true);
+  m_player = player;
+  player->setPlaybackGate(&m_pipeline.playbackGate());
+}
+
+/*!
+  \brief Returns the seconds of audio between load reports, 0 if they are
+  off.
+*/
+int
+SpeechRecogniser::loadReportInterval() const
+{
+  return m_loadInterval;
+}
+
+/*!
+  \brief Reports the stream's CPU load every seconds of audio, in the log
+  and through loadReported(). Defaults to 0, no reports.
+
+  A report gives the source's callback load, from Pa_GetStreamCpuLoad() for
+  a microphone, and the real time factor of the channel mix and of each
+  pipeline stage: the time spent in it over the duration of the audio. The
+  stages are timed whether or not reports are on. This must be called
+  before the recogniser is moved to its thread.
+*/
+void
+SpeechRecogniser::setLoadReportInterval(int seconds)
+{
+  m_loadInterval = qMax(0, seconds);
+}
+
+/*!
+  \brief Returns the last load report. It may be called from any thread.
+*/
+StreamLoad
+SpeechRecogniser::load() const
+{
+  QMutexLocker locker(&m_loadMutex);
+  return m_load;
+}
+
+void
+SpeechRecogniser::startReader(AudioSource* reader)
+{
+  qRegisterMetaType<SpeechRecognition::AudioBlock>(
+    "SpeechRecognition::AudioBlock");
+  qRegisterMetaType<SpeechRecognition::StreamLoad>(
+    "SpeechRecognition::StreamLoad");
+
+  QThread* reader_thread = new QThread;
+  m_reader = reader;
+  connect(reader_thread, &QThread::started, m_reader, &AudioSource::record);
+  connect(m_reader, &AudioSource::finished, reader_thread, &QThread::quit);
+  connect(m_reader, &AudioSource::finished, m_reader, &QObject::deleteLater);
   connect(m_reader,
-          &MicrophoneReader::finished,
+          &AudioSource::finished,
           reader_thread,
           &QObject::deleteLater);
 
-  /* This sends the recorded data on to the application in case it wants it for
-   * something else. A plot maybe?*/
-  connect(
-    m_reader, &MicrophoneReader::sendData, this, &SpeechRecogniser::sendData);
   connect(m_reader,
-          &MicrophoneReader::sendData,
+          &AudioSource::sendBlock,
           this,
-          &SpeechRecogniser::receiveData);
+          &SpeechRecogniser::receiveBlock);
 
   m_reader->moveToThread(reader_thread);
   reader_thread->start();
 }
 
+/*!
+  \brief Returns how multiple capture channels are combined for detection.
+*/
+SpeechRecogniser::ChannelMode
+SpeechRecogniser::channelMode() const
+{
+  return m_channelMode;
+}
+
+/*!
+  \brief Sets how multiple capture channels are combined for detection.
+  Defaults to Downmix, which averages them. Beamform steers the beamformer
+  towards the talker, which must be given its geometry first.
+
+  This must be called before the recogniser is moved to its thread.
+*/
+void
+SpeechRecogniser::setChannelMode(ChannelMode mode)
+{
+  m_channelMode = mode;
+}
+
+/*!
+  \brief Returns the beamformer used in Beamform mode, to set its geometry
+  and steering.
+*/
+DelayAndSumBeamformer*
+SpeechRecogniser::beamformer()
+{
+  return &m_beamformer;
+}
+
+/*!
+  \brief Receives a captured block from the reader.
+
+  The channels are combined into one, which is sent on to the application
+  through sendData() and passed through the detection pipeline.
+*/
+void
+SpeechRecogniser::receiveBlock(AudioBlock block)
+{
+  SR_TRACE_THREAD_NAME("detection");
+  SR_TRACE_SCOPE_SEQ("receiveBlock", "detection", block.sequence());
+  SR_TRACE_FLOW_END("block", block.sequence());
+  qint64 mixStart = DeviceClock::steadyNow();
+
+  // reused, so once the receivers of the last sendData() have let it go a
+  // block costs no allocation.
+  m_mono.resize(block.channels() > 0 ? block.frames() : 0);
+
+  if (block.channels() == 1) {
+    std::copy(
+      block.channel(0), block.channel(0) + block.frames(), m_mono.begin());
+
+  } else if (block.channels() > 1) {
+    if (m_channelMode == Beamform &&
+        m_beamformer.channels() == block.channels()) {
+      m_beamformer.process(block, m_mono.data());
+
+    } else {
+      downmix(block, m_mono.data());
+    }
+  }
+
+  m_mixNs += DeviceClock::steadyNow() - mixStart;
+
+  /* This sends the recorded data on to the application in case it wants it for
+   * something else. A plot maybe?*/
+  emit sendData(m_mono);
+
+  int backlog = m_reader->queuedSamples() - block.frames();
+  int hotword = m_pipeline.process(
+    m_mono.constData(), m_mono.size(), backlog, block.captureTime());
+  m_reader->samplesConsumed(block.frames());
+
+  if (hotword > 0) {
+    emit hotwordDetected(hotword);
+  }
+
+  if (m_loadInterval > 0) {
+    reportLoad();
+  }
+}
+
+/* Once a report interval of audio has passed since the last report,
+   reports the load over it.*/
+void
+SpeechRecogniser::reportLoad()
+{
+  PipelineLoad total = m_pipeline.load();
+  quint64 interval = quint64(m_loadInterval) * quint64(total.sampleRate);
+
+  if (total.samples - m_loadMark.samples < interval) {
+    return;
+  }
+
+  StreamLoad load;
+  load.pipeline = total.since(m_loadMark);
+  load.seconds = load.pipeline.seconds();
+  load.callbackLoad = m_reader->callbackLoad();
+  load.mixRealTimeFactor = (m_mixNs - m_loadMixNs) * 1.0e-9 / load.seconds;
+  m_loadMark = total;
+  m_loadMixNs = m_mixNs;
+
+  {
+    QMutexLocker locker(&m_loadMutex);
+    m_load = load;
+  }
+
+  qInfo().noquote() << load.toString();
+  emit loadReported(load);
+}
+
+/*!
+  \brief Passes mono data from another source through the detection
+  pipeline.
+*/
 void
 SpeechRecogniser::receiveData(QVector<float> data)
 {
-  qWarning() << tr("received %1 values.").arg(data.size());
+  SR_TRACE_SCOPE("receiveData", "detection");
+  int hotword = m_pipeline.process(data.constData(), data.size());
+
+  if (hotword > 0) {
+    emit hotwordDetected(hotword);
+  }
 }
 
 bool
 SpeechRecogniser::isRunning()
 {
-  return m_reader->isRunning();
+  return (m_reader && m_reader->isRunning());
 }
 
 // void
@@ -77,7 +478,7 @@ SpeechRecogniser::isRunning()
 void
 SpeechRecogniser::stop()
 {
-  if (m_reader->isRunning()) {
+  if (m_reader && m_reader->isRunning()) {
     m_reader->stop();
   }
   m_running = false;
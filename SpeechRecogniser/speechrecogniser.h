@@ -22,38 +22,113 @@
 #ifndef SPEECHRECOGNISER_H
 #define SPEECHRECOGNISER_H
 
+#include <QMutex>
 #include <QObject>
+#include <QPointer>
 #include <QtDebug>
 
 #include "SpeechRecogniser_global.h"
+#include "audioblock.h"
+#include "audiosource.h"
+#include "beamformer.h"
+#include "detectionpipeline.h"
+#include "feedbackplayer.h"
 #include "microphonereader.h"
 #include "portaudio.h"
 #include "snowboy-detect.h"
+#include "wavrecorder.h"
 
 namespace SpeechRecognition {
 
+/*!
+  \brief One report of the CPU a SpeechRecogniser's stream is using, over
+  the last report interval.
+*/
+struct SPEECHRECOGNISER_EXPORT StreamLoad
+{
+  //! The seconds of audio the report covers.
+  double seconds = 0.0;
+  //! The source's estimate of the fraction of a core its callback uses.
+  double callbackLoad = 0.0;
+  //! The real time factor of combining the channels into one.
+  double mixRealTimeFactor = 0.0;
+  //! The time spent in each stage of the detection pipeline.
+  PipelineLoad pipeline;
+
+  double realTimeFactor() const;
+  QString toString() const;
+};
+
 class SpeechRecogniser : public QObject
 {
   Q_OBJECT
 
 public:
+  enum ChannelMode
+  {
+    Downmix,
+    Beamform,
+  };
+
   explicit SpeechRecogniser(QObject* parent = nullptr);
+  explicit SpeechRecogniser(int channelCount, QObject* parent = nullptr);
+  explicit SpeechRecogniser(const CaptureSettings& settings,
+                            QObject* parent = nullptr);
+  SpeechRecogniser(AudioSource* source, QObject* parent);
+  ~SpeechRecogniser();
 
   void stop();
   bool isRunning();
   //  void operate();
 
+  bool setDetector(const QString& resourceFile,
+                   const QString& models,
+                   const QString& sensitivity = QString());
+  ChunkPolicy chunkPolicy() const;
+  void setChunkPolicy(const ChunkPolicy& policy);
+  bool isEnergyGateEnabled() const;
+  void setEnergyGateEnabled(bool enabled);
+  DetectionPipeline* pipeline();
+
+  ChannelMode channelMode() const;
+  void setChannelMode(ChannelMode mode);
+  DelayAndSumBeamformer* beamformer();
+  bool setRecorder(WavRecorder* recorder);
+  void setFeedbackPlayer(FeedbackPlayer* player);
+  int loadReportInterval() const;
+  void setLoadReportInterval(int seconds);
+  StreamLoad load() const;
+
+  void receiveBlock(SpeechRecognition::AudioBlock block);
   void receiveData(QVector<float> data);
 
 signals:
   void sendData(QVector<float>);
+  void hotwordDetected(int hotword);
+  void loadReported(SpeechRecognition::StreamLoad load);
   void finished();
 
 private:
-  MicrophoneReader* m_reader;
+  AudioSource* m_reader;
   bool m_running;
+  DetectionPipeline m_pipeline;
+  ChannelMode m_channelMode;
+  DelayAndSumBeamformer m_beamformer;
+  int m_loadInterval;
+  qint64 m_mixNs;
+  qint64 m_loadMixNs;
+  QVector<float> m_mono;
+  PipelineLoad m_loadMark;
+  StreamLoad m_load;
+  mutable QMutex m_loadMutex;
+  QPointer<FeedbackPlayer> m_player;
+
+  void startReader(AudioSource* reader);
+  void reportLoad();
 };
 
 } // end of namespace SpeechRecognition
 
+Q_DECLARE_METATYPE(SpeechRecognition::StreamLoad)
+
 #endif // SPEECHRECOGNISER_H
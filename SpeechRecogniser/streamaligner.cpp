@@ -0,0 +1,384 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <algorithm>
+#include <cmath>
+
+#include "streamaligner.h"
+
+namespace SpeechRecognition {
+
+struct StreamAligner::Source
+{
+  int channels;
+  std::mutex mutex;
+  // one buffer per channel, the unread frames start at offset.
+  std::vector<std::vector<float>> buffers;
+  size_t offset = 0;
+  bool started = false;
+  // capture time of the first unread frame and of the frame after the last.
+  qint64 startNs = 0;
+  qint64 nextNs = 0;
+  quint64 inserted = 0;
+  quint64 dropped = 0;
+  quint64 overflowed = 0;
+  quint64 resyncs = 0;
+
+  size_t buffered() const
+  {
+    return buffers.front().size() - offset;
+  }
+
+  void discard(size_t frames)
+  {
+    offset += frames;
+
+    // compact once the read data is half the buffer, so the cost of the move
+    // is spread over many reads.
+    if (offset > buffers.front().size() / 2) {
+      for (auto& buffer : buffers) {
+        buffer.erase(buffer.begin(), buffer.begin() + long(offset));
+      }
+
+      offset = 0;
+    }
+  }
+};
+
+/*!
+  \brief Creates an aligner for sources at sampleRate.
+*/
+StreamAligner::StreamAligner(int sampleRate)
+  : m_sampleRate(sampleRate)
+  , m_tolerance(64)
+  , m_maxBuffered(5 * sampleRate)
+{}
+
+StreamAligner::~StreamAligner() {}
+
+/*!
+  \brief Adds a source with channels channels and returns its index. All
+  sources must be added before blocks are pushed.
+*/
+int
+StreamAligner::addSource(int channels)
+{
+  std::unique_ptr<Source> source(new Source);
+  source->channels = qMax(1, channels);
+  source->buffers.resize(size_t(source->channels));
+  m_sources.push_back(std::move(source));
+  return int(m_sources.size()) - 1;
+}
+
+/*!
+  \brief Returns the number of sources.
+*/
+int
+StreamAligner::sourceCount() const
+{
+  return int(m_sources.size());
+}
+
+/*!
+  \brief Returns the total number of channels over all the sources, the
+  channels of a block from read().
+*/
+int
+StreamAligner::channels() const
+{
+  int count = 0;
+
+  for (const auto& source : m_sources) {
+    count += source->channels;
+  }
+
+  return count;
+}
+
+/*!
+  \brief Returns how far, in frames, a block's capture time may stray from
+  its source's timeline before it is corrected. Defaults to 64, 4 ms at
+  16 kHz, which is well above the timestamp jitter of a normal device.
+*/
+int
+StreamAligner::tolerance() const
+{
+  return m_tolerance;
+}
+
+void
+StreamAligner::setTolerance(int frames)
+{
+  m_tolerance = qMax(1, frames);
+}
+
+/*!
+  \brief Returns the most frames a source will hold for a reader before the
+  oldest are thrown away. Defaults to five seconds.
+*/
+int
+StreamAligner::maxBuffered() const
+{
+  return m_maxBuffered;
+}
+
+void
+StreamAligner::setMaxBuffered(int frames)
+{
+  m_maxBuffered = qMax(1, frames);
+}
+
+/*!
+  \brief Adds a block captured by source. The block must have the channel
+  count given to addSource() and a capture time.
+*/
+void
+StreamAligner::push(int source, const AudioBlock& block)
+{
+  if (source < 0 || source >= int(m_sources.size()) || block.isEmpty()) {
+    return;
+  }
+
+  Source* s = m_sources[size_t(source)].get();
+  std::lock_guard<std::mutex> lock(s->mutex);
+
+  if (block.channels() != s->channels) {
+    return;
+  }
+
+  int skip = 0;
+
+  if (!s->started) {
+    s->started = true;
+    s->startNs = block.captureTime();
+    s->nextNs = block.captureTime();
+
+  } else {
+    qint64 error = nsToFrames(block.captureTime() - s->nextNs);
+
+    if (qAbs(error) > m_maxBuffered) {
+      // a jump no reader could line up, more silence than we may hold or a
+      // step back in time. Start the timeline again at this block rather
+      // than allocating for it on the capture thread.
+      s->dropped += quint64(s->buffered());
+      s->discard(s->buffered());
+      s->startNs = block.captureTime();
+      s->nextNs = block.captureTime();
+      s->resyncs++;
+
+    } else if (error > m_tolerance) {
+      // frames went missing, keep the timeline by filling with silence.
+      for (auto& buffer : s->buffers) {
+        buffer.insert(buffer.end(), size_t(error), 0.0f);
+      }
+
+      s->inserted += quint64(error);
+      s->nextNs += framesToNs(error);
+
+    } else if (-error > m_tolerance) {
+      // this block overlaps what we already have.
+      skip = int(qMin<qint64>(-error, block.frames()));
+      s->dropped += quint64(skip);
+    }
+  }
+
+  for (int c = 0; c < s->channels; c++) {
+    const float* data = block.channel(c);
+    s->buffers[size_t(c)].insert(
+      s->buffers[size_t(c)].end(), data + skip, data + block.frames());
+  }
+
+  s->nextNs += framesToNs(block.frames() - skip);
+
+  if (s->buffered() > size_t(m_maxBuffered)) {
+    size_t excess = s->buffered() - size_t(m_maxBuffered);
+    s->discard(excess);
+    s->startNs += framesToNs(qint64(excess));
+    s->overflowed += excess;
+  }
+}
+
+/*!
+  \brief Returns the number of aligned frames that can be read now. This is
+  zero until every source has delivered data covering the same moment.
+*/
+int
+StreamAligner::available()
+{
+  std::vector<std::unique_lock<std::mutex>> locks;
+
+  // always in index order, so two readers cannot deadlock.
+  for (auto& source : m_sources) {
+    locks.emplace_back(source->mutex);
+  }
+
+  return alignLocked();
+}
+
+/*!
+  \brief Reads frames aligned frames into out, with the channels of each
+  source in the order they were added. Returns false, leaving out alone, if
+  fewer frames are available.
+
+  The capture time of out is the common capture time of its first frame.
+*/
+bool
+StreamAligner::read(int frames, AudioBlock& out)
+{
+  if (m_sources.empty() || frames <= 0) {
+    return false;
+  }
+
+  std::vector<std::unique_lock<std::mutex>> locks;
+
+  for (auto& source : m_sources) {
+    locks.emplace_back(source->mutex);
+  }
+
+  if (alignLocked() < frames) {
+    return false;
+  }
+
+  int total = 0;
+
+  for (const auto& source : m_sources) {
+    total += source->channels;
+  }
+
+  out = AudioBlock(total, frames);
+  out.setCaptureTime(m_sources.front()->startNs);
+  int channel = 0;
+
+  for (auto& source : m_sources) {
+    for (int c = 0; c < source->channels; c++) {
+      const float* data = source->buffers[size_t(c)].data() + source->offset;
+      std::copy(data, data + frames, out.channel(channel++));
+    }
+
+    source->discard(size_t(frames));
+    source->startNs += framesToNs(frames);
+  }
+
+  return true;
+}
+
+/*!
+  \brief Throws away everything buffered and forgets the timelines.
+*/
+void
+StreamAligner::reset()
+{
+  for (auto& source : m_sources) {
+    std::lock_guard<std::mutex> lock(source->mutex);
+
+    for (auto& buffer : source->buffers) {
+      buffer.clear();
+    }
+
+    source->offset = 0;
+    source->started = false;
+  }
+}
+
+/*!
+  \brief Returns the frames of silence inserted into source to cover gaps.
+*/
+quint64
+StreamAligner::insertedFrames(int source) const
+{
+  return m_sources[size_t(source)]->inserted;
+}
+
+/*!
+  \brief Returns the frames of source dropped because they overlapped frames
+  already received, or were still unread when its timeline was restarted.
+*/
+quint64
+StreamAligner::droppedFrames(int source) const
+{
+  return m_sources[size_t(source)]->dropped;
+}
+
+/*!
+  \brief Returns the frames of source thrown away because nobody read them.
+*/
+quint64
+StreamAligner::overflowFrames(int source) const
+{
+  return m_sources[size_t(source)]->overflowed;
+}
+
+/*!
+  \brief Returns the number of times source's timeline was restarted because
+  a block's capture time jumped by more than maxBuffered() frames.
+*/
+quint64
+StreamAligner::resyncCount(int source) const
+{
+  return m_sources[size_t(source)]->resyncs;
+}
+
+qint64
+StreamAligner::framesToNs(qint64 frames) const
+{
+  return frames * 1000000000LL / m_sampleRate;
+}
+
+qint64
+StreamAligner::nsToFrames(qint64 ns) const
+{
+  return qint64(std::llround(double(ns) * m_sampleRate / 1.0e9));
+}
+
+/* Drops whatever each source holds from before the latest start time of all
+   of them, and returns the frames every source then has. All the source locks
+   must be held.*/
+int
+StreamAligner::alignLocked()
+{
+  qint64 start = 0;
+
+  for (const auto& source : m_sources) {
+    if (!source->started || source->buffered() == 0) {
+      return 0;
+    }
+
+    start = qMax(start, source->startNs);
+  }
+
+  size_t available = size_t(-1);
+
+  for (auto& source : m_sources) {
+    qint64 early = nsToFrames(start - source->startNs);
+
+    if (early > 0) {
+      size_t count = qMin(size_t(early), source->buffered());
+      source->discard(count);
+      source->startNs += framesToNs(qint64(count));
+    }
+
+    available = std::min(available, source->buffered());
+  }
+
+  return int(available);
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,102 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef STREAMALIGNER_H
+#define STREAMALIGNER_H
+
+#include <QtGlobal>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+#include "audioblock.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \class StreamAligner
+  \brief The StreamAligner class lines up blocks from several capture
+  sources by their capture time, so they can be read as one multi-channel
+  stream.
+
+  Each source is pushed its own blocks, normally from its own capture
+  callback, and only ever takes its own lock, so sources never hold each
+  other up. read() then returns frames that were captured at the same
+  moment on every source, with the channels of all the sources one after
+  another.
+
+  Each source keeps a nominal timeline, advanced by the frames it is given.
+  When a block's capture time strays from that timeline by more than the
+  tolerance, because blocks were lost in an overflow or because the device
+  clock drifts against the others, the gap is filled with silence or the
+  overlap is dropped and the correction is counted. A jump of more than
+  maxBuffered() frames either way is not filled, the source drops what it
+  holds and starts its timeline again at the new block, so a bad capture
+  time never costs an unbounded allocation on the capture thread.
+
+  All sources must run at the same sample rate.
+*/
+class SPEECHRECOGNISER_EXPORT StreamAligner
+{
+public:
+  explicit StreamAligner(int sampleRate = 16000);
+  ~StreamAligner();
+
+  StreamAligner(const StreamAligner&) = delete;
+  StreamAligner& operator=(const StreamAligner&) = delete;
+
+  int addSource(int channels);
+  int sourceCount() const;
+  int channels() const;
+
+  int tolerance() const;
+  void setTolerance(int frames);
+  int maxBuffered() const;
+  void setMaxBuffered(int frames);
+
+  void push(int source, const AudioBlock& block);
+  int available();
+  bool read(int frames, AudioBlock& out);
+  void reset();
+
+  quint64 insertedFrames(int source) const;
+  quint64 droppedFrames(int source) const;
+  quint64 overflowFrames(int source) const;
+  quint64 resyncCount(int source) const;
+
+private:
+  struct Source;
+
+  int m_sampleRate;
+  int m_tolerance;
+  int m_maxBuffered;
+  std::vector<std::unique_ptr<Source>> m_sources;
+
+  qint64 framesToNs(qint64 frames) const;
+  qint64 nsToFrames(qint64 ns) const;
+  int alignLocked();
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // STREAMALIGNER_H
@@ -0,0 +1,392 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QFile>
+#include <QObject>
+#include <QtDebug>
+
+#include <cstring>
+
+#include "tracing.h"
+
+namespace SpeechRecognition {
+
+/* The flush thread formats events by hand, snprintf costs more than the
+   spans themselves. Each writes at most 96 characters.*/
+static void
+appendText(char*& out, const char* text)
+{
+  size_t length = strnlen(text, 96);
+  std::memcpy(out, text, length);
+  out += length;
+}
+
+static void
+appendNumber(char*& out, quint64 value)
+{
+  char digits[20];
+  int count = 0;
+
+  do {
+    digits[count++] = char('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+
+  while (count > 0) {
+    *out++ = digits[--count];
+  }
+}
+
+/* Writes nanoseconds as microseconds with three decimals, the unit of the
+   trace format.*/
+static void
+appendMicroseconds(char*& out, qint64 nanoseconds)
+{
+  if (nanoseconds < 0) {
+    *out++ = '-';
+    nanoseconds = -nanoseconds;
+  }
+
+  appendNumber(out, quint64(nanoseconds / 1000));
+  quint64 fraction = quint64(nanoseconds % 1000);
+  *out++ = '.';
+  *out++ = char('0' + fraction / 100);
+  *out++ = char('0' + fraction / 10 % 10);
+  *out++ = char('0' + fraction % 10);
+}
+
+/* A thread's events, written only by the thread and read only by the flush
+   thread. head and tail count events ever written and read, so the ring is
+   full when they are RING_EVENTS apart.*/
+struct Tracer::Ring
+{
+  int thread = 0;
+  std::atomic<const char*> name{ nullptr };
+  std::atomic<quint64> dropped{ 0 };
+  // whether the thread's name is in the current file, flush thread only.
+  bool named = false;
+  alignas(64) std::atomic<quint64> head{ 0 };
+  alignas(64) std::atomic<quint64> tail{ 0 };
+  TraceEvent events[RING_EVENTS];
+};
+
+std::atomic<bool> Tracer::s_running(false);
+
+Tracer::Tracer()
+  : m_stopping(false)
+  , m_interval(100)
+  , m_written(0)
+  , m_flushNs(0)
+  , m_file(nullptr)
+  , m_firstEvent(true)
+  , m_base(0)
+{}
+
+Tracer::~Tracer()
+{
+  stop();
+}
+
+/*!
+   \brief Returns the process wide tracer.
+*/
+Tracer&
+Tracer::instance()
+{
+  static Tracer tracer;
+  return tracer;
+}
+
+/*!
+   \brief Starts writing spans to filename, replacing it, and flushing every
+   flushIntervalMs. Events recorded while the tracer was stopped are
+   discarded. Returns false if the file could not be written.
+*/
+bool
+Tracer::start(const QString& filename, int flushIntervalMs)
+{
+  stop();
+
+  QFile* file = new QFile(filename);
+
+  if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write trace %1").arg(filename);
+    delete file;
+    return false;
+  }
+
+  file->write("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  m_file = file;
+  m_firstEvent = true;
+  m_interval = qMax(1, flushIntervalMs);
+  m_written.store(0);
+  m_flushNs.store(0);
+  m_base = now();
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = false;
+
+    for (std::unique_ptr<Ring>& ring : m_rings) {
+      ring->tail.store(ring->head.load(std::memory_order_acquire),
+                       std::memory_order_release);
+      ring->dropped.store(0);
+      ring->named = false;
+    }
+  }
+
+  s_running.store(true);
+  m_thread = std::thread(&Tracer::run, this);
+  return true;
+}
+
+/*!
+   \brief Stops recording, writes out what is left and closes the file.
+*/
+void
+Tracer::stop()
+{
+  if (!m_thread.joinable()) {
+    return;
+  }
+
+  s_running.store(false);
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+
+  m_wake.notify_one();
+  m_thread.join();
+
+  // spans that began before the stop may still be ending, so this catches
+  // most but not necessarily all of them.
+  flush();
+  m_file->write("\n]}\n");
+  m_file->close();
+  delete m_file;
+  m_file = nullptr;
+}
+
+/*!
+   \brief Returns true if the library was built with SPEECHRECOGNISER_TRACING,
+   so the pipeline records spans. Spans can be recorded directly either way.
+*/
+bool
+Tracer::isCompiledIn()
+{
+#if defined(SPEECHRECOGNISER_TRACING)
+  return true;
+#else
+  return false;
+#endif
+}
+
+/*!
+   \brief Returns the number of events written to the current or last file.
+*/
+quint64
+Tracer::events() const
+{
+  return m_written.load();
+}
+
+/*!
+   \brief Returns the number of events lost because a thread's ring filled
+   before it was flushed, since the tracer was started.
+*/
+quint64
+Tracer::droppedEvents() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  quint64 dropped = 0;
+
+  for (const std::unique_ptr<Ring>& ring : m_rings) {
+    dropped += ring->dropped.load();
+  }
+
+  return dropped;
+}
+
+/*!
+   \brief Returns the time the flush thread has spent writing out events
+   since the tracer was started, the cost of tracing beyond the spans
+   themselves.
+*/
+double
+Tracer::flushSeconds() const
+{
+  return double(m_flushNs.load()) * 1.0e-9;
+}
+
+/*!
+   \brief Adds event to the calling thread's ring. Never blocks, the first
+   call on a thread allocates its ring.
+*/
+void
+Tracer::record(const TraceEvent& event)
+{
+  Ring* r = ring();
+  quint64 head = r->head.load(std::memory_order_relaxed);
+
+  if (head - r->tail.load(std::memory_order_acquire) >= quint64(RING_EVENTS)) {
+    r->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  r->events[head % RING_EVENTS] = event;
+  r->head.store(head + 1, std::memory_order_release);
+}
+
+/*!
+   \brief Records the start, phase 's', or the end, phase 'f', of a flow
+   from one span to another. The flow is bound to the span enclosing it on
+   each thread.
+*/
+void
+Tracer::flow(const char* name, quint64 sequence, char phase)
+{
+  record({ name, "flow", now(), 0, sequence, phase });
+}
+
+/*!
+   \brief Names the calling thread in the trace. name must be a string
+   literal.
+*/
+void
+Tracer::setThreadName(const char* name)
+{
+  ring()->name.store(name, std::memory_order_relaxed);
+}
+
+/* Returns the calling thread's ring, creating it on the thread's first
+   event.*/
+Tracer::Ring*
+Tracer::ring()
+{
+  thread_local Ring* threadRing = nullptr;
+
+  if (!threadRing) {
+    Tracer& tracer = instance();
+    std::lock_guard<std::mutex> lock(tracer.m_mutex);
+    tracer.m_rings.emplace_back(new Ring());
+    threadRing = tracer.m_rings.back().get();
+    threadRing->thread = int(tracer.m_rings.size());
+  }
+
+  return threadRing;
+}
+
+void
+Tracer::run()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  while (!m_stopping) {
+    m_wake.wait_for(lock, std::chrono::milliseconds(m_interval));
+    lock.unlock();
+    flush();
+    lock.lock();
+  }
+}
+
+/* Empties every ring into the file. Only the flush thread, or stop() once
+   it has finished, calls this.*/
+void
+Tracer::flush()
+{
+  const qint64 start = now();
+  std::vector<Ring*> rings;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (std::unique_ptr<Ring>& ring : m_rings) {
+      rings.push_back(ring.get());
+    }
+  }
+
+  QByteArray text;
+
+  for (Ring* ring : rings) {
+    QByteArray thread = QByteArray::number(ring->thread);
+    const char* name = ring->name.load();
+    quint64 tail = ring->tail.load(std::memory_order_relaxed);
+    quint64 head = ring->head.load(std::memory_order_acquire);
+
+    if (name && !ring->named && head != tail) {
+      text += (m_firstEvent ? "" : ",\n");
+      text += "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" +
+              thread + ",\"args\":{\"name\":\"" + name + "\"}}";
+      ring->named = true;
+      m_firstEvent = false;
+    }
+
+    for (; tail != head; tail++) {
+      const TraceEvent& event = ring->events[tail % RING_EVENTS];
+      char line[512];
+      char* out = line;
+      appendText(out, (m_firstEvent ? "{\"ph\":\"" : ",\n{\"ph\":\""));
+      *out++ = event.phase;
+      appendText(out, "\",\"name\":\"");
+      appendText(out, event.name);
+      appendText(out, "\",\"cat\":\"");
+      appendText(out, event.category);
+      appendText(out, "\",\"pid\":1,\"tid\":");
+      appendNumber(out, quint64(ring->thread));
+      appendText(out, ",\"ts\":");
+      appendMicroseconds(out, event.start - m_base);
+
+      if (event.phase == 'X') {
+        appendText(out, ",\"dur\":");
+        appendMicroseconds(out, event.duration);
+
+        if (event.sequence != NO_SEQUENCE) {
+          appendText(out, ",\"args\":{\"sequence\":");
+          appendNumber(out, event.sequence);
+          *out++ = '}';
+        }
+
+      } else {
+        appendText(out, ",\"id\":");
+        appendNumber(out, event.sequence);
+        appendText(out, (event.phase == 'f' ? ",\"bp\":\"e\"" : ""));
+      }
+
+      *out++ = '}';
+      text.append(line, int(out - line));
+      m_firstEvent = false;
+      m_written.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ring->tail.store(head, std::memory_order_release);
+  }
+
+  if (!text.isEmpty()) {
+    m_file->write(text);
+    m_file->flush();
+  }
+
+  m_flushNs.fetch_add(now() - start);
+}
+
+} // end of namespace SpeechRecognition
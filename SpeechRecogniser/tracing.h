@@ -0,0 +1,232 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <QString>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+
+class QFile;
+
+namespace SpeechRecognition {
+
+/*!
+  \brief One event in a thread's trace buffer. The name and category must be
+  string literals, only the pointers are kept.
+*/
+struct TraceEvent
+{
+  const char* name;
+  const char* category;
+  qint64 start;
+  qint64 duration;
+  quint64 sequence;
+  char phase;
+};
+
+/*!
+  \class Tracer
+  \brief The Tracer class records timed spans from any thread and writes
+  them to a Chrome trace JSON file, which chrome://tracing and Perfetto
+  open.
+
+  Each thread records into its own fixed size ring of TraceEvents, which
+  only it writes and only the tracer's flush thread reads, so recording
+  takes no lock and never allocates once the thread's ring exists. The
+  flush thread empties every ring at an interval and appends the events to
+  the file. A ring that fills before it is flushed drops the newest events
+  and counts them.
+
+  Spans carry the sequence number of the block they work on, and flow
+  events with the same number join the span in the capture callback that
+  sent a block to the spans on other threads that received it.
+
+  The pipeline records through the SR_TRACE macros, which are only built in
+  when SPEECHRECOGNISER_TRACING is defined, qmake CONFIG+=tracing. Without
+  it they compile to nothing. With it a span costs a relaxed load while the
+  tracer is stopped.
+*/
+class SPEECHRECOGNISER_EXPORT Tracer
+{
+public:
+  static const int RING_EVENTS = 8192;
+  static const quint64 NO_SEQUENCE = ~quint64(0);
+
+  static Tracer& instance();
+  ~Tracer();
+
+  Tracer(const Tracer&) = delete;
+  Tracer& operator=(const Tracer&) = delete;
+
+  bool start(const QString& filename, int flushIntervalMs = 100);
+  void stop();
+  static bool isRunning();
+  static bool isCompiledIn();
+
+  quint64 events() const;
+  quint64 droppedEvents() const;
+  double flushSeconds() const;
+
+  static qint64 now();
+  static void record(const TraceEvent& event);
+  static void flow(const char* name, quint64 sequence, char phase);
+  static void setThreadName(const char* name);
+
+private:
+  struct Ring;
+
+  static std::atomic<bool> s_running;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_wake;
+  bool m_stopping;
+  int m_interval;
+  std::thread m_thread;
+  std::vector<std::unique_ptr<Ring>> m_rings;
+  std::atomic<quint64> m_written;
+  std::atomic<qint64> m_flushNs;
+
+  // owned by the flush thread while it runs.
+  QFile* m_file;
+  bool m_firstEvent;
+  qint64 m_base;
+
+  Tracer();
+  static Ring* ring();
+  void run();
+  void flush();
+};
+
+/*!
+  \class TraceScope
+  \brief The TraceScope class records a span from its construction to its
+  destruction, if the tracer was running when it began.
+*/
+class SPEECHRECOGNISER_EXPORT TraceScope
+{
+public:
+  TraceScope(const char* name,
+             const char* category,
+             quint64 sequence = Tracer::NO_SEQUENCE)
+    : m_name(name)
+    , m_category(category)
+    , m_sequence(sequence)
+    , m_start(Tracer::isRunning() ? Tracer::now() : 0)
+  {}
+
+  ~TraceScope()
+  {
+    if (m_start != 0) {
+      Tracer::record({ m_name,
+                       m_category,
+                       m_start,
+                       Tracer::now() - m_start,
+                       m_sequence,
+                       'X' });
+    }
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+  const char* m_name;
+  const char* m_category;
+  quint64 m_sequence;
+  qint64 m_start;
+};
+
+/*!
+  \brief Returns true if spans are being recorded.
+*/
+inline bool
+Tracer::isRunning()
+{
+  return s_running.load(std::memory_order_relaxed);
+}
+
+/*!
+  \brief Returns the steady clock in nanoseconds, the time base of the
+  trace.
+*/
+inline qint64
+Tracer::now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+} // end of namespace SpeechRecognition
+
+#define SR_TRACE_JOIN2(a, b) a##b
+#define SR_TRACE_JOIN(a, b) SR_TRACE_JOIN2(a, b)
+
+#if defined(SPEECHRECOGNISER_TRACING)
+#define SR_TRACE_SCOPE(name, category)                                         \
+  SpeechRecognition::TraceScope SR_TRACE_JOIN(srTraceScope, __LINE__)(name,   \
+                                                                      category)
+#define SR_TRACE_SCOPE_SEQ(name, category, sequence)                           \
+  SpeechRecognition::TraceScope SR_TRACE_JOIN(srTraceScope, __LINE__)(         \
+    name, category, sequence)
+#define SR_TRACE_FLOW_BEGIN(name, sequence)                                    \
+  do {                                                                         \
+    if (SpeechRecognition::Tracer::isRunning()) {                              \
+      SpeechRecognition::Tracer::flow(name, sequence, 's');                    \
+    }                                                                          \
+  } while (false)
+#define SR_TRACE_FLOW_END(name, sequence)                                      \
+  do {                                                                         \
+    if (SpeechRecognition::Tracer::isRunning()) {                              \
+      SpeechRecognition::Tracer::flow(name, sequence, 'f');                    \
+    }                                                                          \
+  } while (false)
+#define SR_TRACE_THREAD_NAME(name)                                             \
+  SpeechRecognition::Tracer::setThreadName(name)
+#else
+#define SR_TRACE_SCOPE(name, category)                                         \
+  do {                                                                         \
+  } while (false)
+#define SR_TRACE_SCOPE_SEQ(name, category, sequence)                           \
+  do {                                                                         \
+  } while (false)
+#define SR_TRACE_FLOW_BEGIN(name, sequence)                                    \
+  do {                                                                         \
+  } while (false)
+#define SR_TRACE_FLOW_END(name, sequence)                                      \
+  do {                                                                         \
+  } while (false)
+#define SR_TRACE_THREAD_NAME(name)                                             \
+  do {                                                                         \
+  } while (false)
+#endif
+
+#endif // TRACING_H
@@ -0,0 +1,498 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QObject>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(Q_OS_UNIX)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "sampleconversion.h"
+#include "wavfile.h"
+
+namespace SpeechRecognition {
+
+static const quint16 WAVE_FORMAT_PCM = 1;
+static const quint16 WAVE_FORMAT_IEEE_FLOAT = 3;
+static const quint16 WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+// the hints given to advise().
+static const int ADVISE_SEQUENTIAL = 0;
+static const int ADVISE_WILLNEED = 1;
+
+/* RIFF is little endian throughout.*/
+static quint32
+readU32(const char* p)
+{
+  const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+  return quint32(b[0]) | quint32(b[1]) << 8 | quint32(b[2]) << 16 |
+         quint32(b[3]) << 24;
+}
+
+static quint16
+readU16(const char* p)
+{
+  const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+  return quint16(b[0] | b[1] << 8);
+}
+
+/*!
+  \brief Returns the PortAudio format of the samples, or 0 if unsupported.
+*/
+PaSampleFormat
+WavFormat::sampleFormat() const
+{
+  if (isFloat) {
+    return (bitsPerSample == 32 ? paFloat32 : 0);
+  }
+
+  switch (bitsPerSample) {
+    case 16:
+      return paInt16;
+
+    case 24:
+      return paInt24;
+
+    case 32:
+      return paInt32;
+
+    default:
+      return 0;
+  }
+}
+
+/*!
+  \brief Returns the bytes in one frame, a sample from every channel.
+*/
+int
+WavFormat::frameBytes() const
+{
+  return channels * bitsPerSample / 8;
+}
+
+WavFile::WavFile()
+  : m_mapping(nullptr)
+  , m_mappingSize(0)
+  , m_data(nullptr)
+  , m_frames(0)
+  , m_readAhead(4 * 1024 * 1024)
+  , m_prefetched(0)
+{}
+
+WavFile::~WavFile()
+{
+  close();
+}
+
+/*!
+  \brief Opens a WAV file, or a LosslessEncoder stream. Returns false if it
+  cannot be read or its header is invalid or describes an unsupported
+  format.
+
+  If memoryMap is false, or the file cannot be mapped, it is read into
+  memory instead.
+*/
+bool
+WavFile::open(const QString& filename, bool memoryMap)
+{
+  if (!load(filename, memoryMap)) {
+    return false;
+  }
+
+  if (!parse()) {
+    close();
+    return false;
+  }
+
+  advise(0, m_mappingSize, ADVISE_SEQUENTIAL);
+  prefetch(0);
+  return true;
+}
+
+/*!
+  \brief Opens a file of headerless PCM samples in the given format, which
+  defaults to 16 kHz mono 16 bit, the detector format.
+*/
+bool
+WavFile::openRaw(const QString& filename,
+                 const WavFormat& format,
+                 bool memoryMap)
+{
+  if (format.sampleFormat() == 0 || format.channels <= 0) {
+    qWarning() << QObject::tr("unsupported raw sample format");
+    return false;
+  }
+
+  if (!load(filename, memoryMap)) {
+    return false;
+  }
+
+  m_format = format;
+  m_data = m_mapping;
+  m_frames = m_mappingSize / format.frameBytes();
+  advise(0, m_mappingSize, ADVISE_SEQUENTIAL);
+  prefetch(0);
+  return true;
+}
+
+/*!
+  \brief Unmaps and closes the file.
+*/
+void
+WavFile::close()
+{
+  if (m_file.isOpen()) {
+    m_file.close(); // also unmaps.
+  }
+
+  m_fileName.clear();
+  m_bytes.clear();
+  m_mapping = nullptr;
+  m_mappingSize = 0;
+  m_data = nullptr;
+  m_frames = 0;
+  m_prefetched = 0;
+  m_format = WavFormat();
+  m_lossless.close();
+}
+
+bool
+WavFile::isOpen() const
+{
+  return m_data != nullptr;
+}
+
+/*!
+  \brief Returns true if the file is memory mapped rather than read into
+  memory.
+*/
+bool
+WavFile::isMapped() const
+{
+  return m_data != nullptr && m_bytes.isEmpty();
+}
+
+/*!
+  \brief Returns true if the file is a LosslessEncoder stream.
+*/
+bool
+WavFile::isCompressed() const
+{
+  return m_lossless.isOpen();
+}
+
+QString
+WavFile::fileName() const
+{
+  return m_fileName;
+}
+
+WavFormat
+WavFile::format() const
+{
+  return m_format;
+}
+
+/*!
+  \brief Returns the number of frames in the file.
+*/
+qint64
+WavFile::frames() const
+{
+  return m_frames;
+}
+
+/*!
+  \brief Returns the interleaved sample data, or nullptr if the file is
+  compressed.
+*/
+const char*
+WavFile::data() const
+{
+  return (isCompressed() ? nullptr : m_data);
+}
+
+/*!
+  \brief Returns how many bytes are requested ahead of the read position.
+  Defaults to 4 MB.
+*/
+qint64
+WavFile::readAhead() const
+{
+  return m_readAhead;
+}
+
+void
+WavFile::setReadAhead(qint64 bytes)
+{
+  m_readAhead = qMax<qint64>(0, bytes);
+}
+
+/*!
+  \brief Tells the file that frame is about to be read, so that the pages
+  from there to readAhead() bytes on are paged in in the background.
+
+  span() and readFrames() call this themselves. A new request is only made
+  once the reads are half way through the last one, so in steady state this
+  costs one system call per readAhead() / 2 bytes.
+*/
+void
+WavFile::prefetch(qint64 frame)
+{
+  if (!isMapped() || m_readAhead == 0) {
+    return;
+  }
+
+  qint64 offset = (isCompressed()
+                     ? m_lossless.byteOffset(frame)
+                     : (m_data - m_mapping) + frame * m_format.frameBytes());
+
+  if (offset + m_readAhead / 2 < m_prefetched) {
+    return;
+  }
+
+  qint64 from = qMax(offset, m_prefetched);
+  qint64 to = qMin(offset + m_readAhead, m_mappingSize);
+
+  if (to > from) {
+    advise(from, to - from, ADVISE_WILLNEED);
+    m_prefetched = to;
+  }
+}
+
+/*!
+  \brief Returns true if the file is 16 bit mono with aligned samples, so
+  span() can be used.
+*/
+bool
+WavFile::hasInt16Spans() const
+{
+  return isOpen() && !isCompressed() && m_format.channels == 1 &&
+         !m_format.isFloat && m_format.bitsPerSample == 16 &&
+         (reinterpret_cast<quintptr>(m_data) % alignof(int16_t)) == 0;
+}
+
+/*!
+  \brief Returns up to count samples starting at first, pointing into the
+  file itself. The span is empty past the end of the file, or if the file is
+  not one for which hasInt16Spans() is true.
+
+  The samples stay valid until the file is closed.
+*/
+Int16Span
+WavFile::span(qint64 first, int count)
+{
+  Int16Span result;
+
+  if (!hasInt16Spans() || first < 0 || first >= m_frames || count <= 0) {
+    return result;
+  }
+
+  prefetch(first);
+  result.data = reinterpret_cast<const int16_t*>(m_data) + first;
+  result.count = int(qMin<qint64>(count, m_frames - first));
+  return result;
+}
+
+/*!
+  \brief Reads up to count frames starting at first into planar float
+  channels, one pointer per channel. Returns the frames read.
+*/
+qint64
+WavFile::readFrames(qint64 first, qint64 count, float* const* channels)
+{
+  if (!isOpen() || first < 0 || first >= m_frames) {
+    return 0;
+  }
+
+  prefetch(first);
+  count = std::min(count, m_frames - first);
+
+  if (isCompressed()) {
+    return m_lossless.readFrames(first, count, channels);
+  }
+
+  const int channelCount = m_format.channels;
+  const char* src = m_data + first * m_format.frameBytes();
+  size_t samples = size_t(count) * size_t(channelCount);
+
+  if (channelCount == 1) {
+    convertSamples(m_format.sampleFormat(), src, paFloat32, channels[0], samples);
+    return count;
+  }
+
+  m_scratch.resize(samples);
+  convertSamples(
+    m_format.sampleFormat(), src, paFloat32, m_scratch.data(), samples);
+  interleavedToPlanar<SampleFormat::Float32, SampleFormat::Float32>(
+    m_scratch.data(), channels, channelCount, size_t(count));
+  return count;
+}
+
+/* Validates the RIFF header and finds the format and data chunks, or hands
+   a lossless stream to its decoder.*/
+bool
+WavFile::parse()
+{
+  const char* bytes = m_mapping;
+  const qint64 size = m_mappingSize;
+
+  if (LosslessDecoder::isLossless(bytes, size)) {
+    if (!m_lossless.open(bytes, size)) {
+      return false;
+    }
+
+    m_format = WavFormat();
+    m_format.channels = m_lossless.channels();
+    m_format.sampleRate = m_lossless.sampleRate();
+    m_data = bytes;
+    m_frames = m_lossless.frames();
+    return true;
+  }
+
+  if (size < 12 || std::memcmp(bytes, "RIFF", 4) != 0 ||
+      std::memcmp(bytes + 8, "WAVE", 4) != 0) {
+    qWarning() << QObject::tr("%1 is not a WAV file").arg(m_fileName);
+    return false;
+  }
+
+  bool haveFormat = false;
+  qint64 position = 12;
+
+  while (position + 8 <= size) {
+    const char* chunk = bytes + position;
+    qint64 chunkSize = readU32(chunk + 4);
+    const char* body = chunk + 8;
+    qint64 available = size - position - 8;
+
+    if (std::memcmp(chunk, "fmt ", 4) == 0) {
+      if (chunkSize < 16 || chunkSize > available) {
+        break;
+      }
+
+      quint16 tag = readU16(body);
+
+      // extensible files keep the real format in the sub format GUID.
+      if (tag == WAVE_FORMAT_EXTENSIBLE && chunkSize >= 26) {
+        tag = readU16(body + 24);
+      }
+
+      m_format.channels = readU16(body + 2);
+      m_format.sampleRate = int(readU32(body + 4));
+      m_format.bitsPerSample = readU16(body + 14);
+      m_format.isFloat = (tag == WAVE_FORMAT_IEEE_FLOAT);
+
+      if ((tag != WAVE_FORMAT_PCM && tag != WAVE_FORMAT_IEEE_FLOAT) ||
+          m_format.channels == 0 || m_format.sampleRate <= 0 ||
+          m_format.sampleFormat() == 0) {
+        qWarning() << QObject::tr("%1 has an unsupported sample format")
+                        .arg(m_fileName);
+        return false;
+      }
+
+      haveFormat = true;
+
+    } else if (std::memcmp(chunk, "data", 4) == 0) {
+      if (!haveFormat) {
+        break;
+      }
+
+      // a streamed file may not have had its size filled in.
+      if (chunkSize == 0 || chunkSize > available) {
+        chunkSize = available;
+      }
+
+      m_data = body;
+      m_frames = chunkSize / m_format.frameBytes();
+      return true;
+    }
+
+    // chunks are padded to an even length.
+    position += 8 + chunkSize + (chunkSize & 1);
+  }
+
+  qWarning() << QObject::tr("%1 has a missing or damaged header")
+                  .arg(m_fileName);
+  return false;
+}
+
+/* Maps the whole file, or reads it if that is not possible.*/
+bool
+WavFile::load(const QString& filename, bool memoryMap)
+{
+  close();
+  m_file.setFileName(filename);
+
+  if (!m_file.open(QIODevice::ReadOnly)) {
+    qWarning() << QObject::tr("unable to open %1").arg(filename);
+    return false;
+  }
+
+  m_fileName = filename;
+  m_mappingSize = m_file.size();
+  uchar* mapping = nullptr;
+
+  if (memoryMap && m_mappingSize > 0) {
+    mapping = m_file.map(0, m_mappingSize);
+  }
+
+  if (mapping) {
+    m_mapping = reinterpret_cast<const char*>(mapping);
+
+  } else {
+    m_bytes = m_file.readAll();
+    m_file.close();
+    m_mapping = m_bytes.constData();
+    m_mappingSize = m_bytes.size();
+  }
+
+  return true;
+}
+
+/* Passes an access pattern hint for part of the mapping to the kernel. The
+   range is widened out to whole pages as madvise needs.*/
+void
+WavFile::advise(qint64 offset, qint64 length, int advice)
+{
+#if defined(Q_OS_UNIX)
+  if (!isMapped() || length <= 0) {
+    return;
+  }
+
+  static const qint64 page = qint64(sysconf(_SC_PAGESIZE));
+  quintptr start = reinterpret_cast<quintptr>(m_mapping) + quintptr(offset);
+  quintptr aligned = start & ~quintptr(page - 1);
+  posix_madvise(reinterpret_cast<void*>(aligned),
+                size_t(length + qint64(start - aligned)),
+                advice == ADVISE_WILLNEED ? POSIX_MADV_WILLNEED
+                                          : POSIX_MADV_SEQUENTIAL);
+#else
+  Q_UNUSED(offset)
+  Q_UNUSED(length)
+  Q_UNUSED(advice)
+#endif
+}
+
+} // end of namespace SpeechRecognition
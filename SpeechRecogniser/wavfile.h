@@ -0,0 +1,136 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef WAVFILE_H
+#define WAVFILE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QtDebug>
+
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+#include "losslesscodec.h"
+#include "portaudio.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \brief The sample layout of a WAV file or raw PCM data.
+*/
+struct WavFormat
+{
+  int sampleRate = 16000;
+  int channels = 1;
+  int bitsPerSample = 16;
+  bool isFloat = false;
+
+  PaSampleFormat sampleFormat() const;
+  int frameBytes() const;
+};
+
+/*!
+  \brief A run of 16 bit mono samples pointing straight into a WavFile,
+  ready for SnowboyDetect::RunDetection().
+*/
+struct Int16Span
+{
+  const int16_t* data = nullptr;
+  int count = 0;
+};
+
+/*!
+  \class WavFile
+  \brief The WavFile class reads the samples of a WAV file, or of headerless
+  raw PCM data such as resources/snowboy.raw.
+
+  The RIFF header is validated and the "fmt " and "data" chunks found, any
+  others are skipped. 16, 24 and 32 bit integer and 32 bit float samples
+  are supported, with any number of channels. Frames can be read out as
+  planar float, converted by the sample conversion kernels.
+
+  The file is memory mapped rather than read, so opening even a very large
+  corpus file is instant and costs no heap. The kernel is told the file
+  will be read sequentially, and as reads move through the file the next
+  readAhead() bytes are requested ahead of time so the pages are already
+  in when they are needed. For 16 bit mono files span() gives out the
+  samples where they lie in the mapping, with no copy at all.
+
+  Files written by LosslessEncoder, such as compressed WavRecorder output,
+  are recognised by their header and decoded block by block as they are
+  read. They have no spans.
+*/
+class SPEECHRECOGNISER_EXPORT WavFile
+{
+public:
+  WavFile();
+
+  ~WavFile();
+
+  WavFile(const WavFile&) = delete;
+  WavFile& operator=(const WavFile&) = delete;
+
+  bool open(const QString& filename, bool memoryMap = true);
+  bool openRaw(const QString& filename,
+               const WavFormat& format = WavFormat(),
+               bool memoryMap = true);
+  void close();
+
+  bool isOpen() const;
+  bool isMapped() const;
+  bool isCompressed() const;
+  QString fileName() const;
+  WavFormat format() const;
+  qint64 frames() const;
+  const char* data() const;
+
+  qint64 readAhead() const;
+  void setReadAhead(qint64 bytes);
+  void prefetch(qint64 frame);
+
+  bool hasInt16Spans() const;
+  Int16Span span(qint64 first, int count);
+  qint64 readFrames(qint64 first, qint64 count, float* const* channels);
+
+private:
+  QString m_fileName;
+  QFile m_file;
+  QByteArray m_bytes;
+  const char* m_mapping;
+  qint64 m_mappingSize;
+  const char* m_data;
+  qint64 m_frames;
+  WavFormat m_format;
+  qint64 m_readAhead;
+  qint64 m_prefetched;
+  std::vector<float> m_scratch;
+  LosslessDecoder m_lossless;
+
+  bool load(const QString& filename, bool memoryMap);
+  bool parse();
+  void advise(qint64 offset, qint64 length, int advice);
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // WAVFILE_H
@@ -0,0 +1,556 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QFile>
+#include <QObject>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "sampleconversion.h"
+#include "wavrecorder.h"
+
+namespace SpeechRecognition {
+
+// the header page, and the alignment of every write.
+static const int PAGE = 4096;
+// the largest data chunk a 32 bit RIFF size can describe.
+static const qint64 MAX_DATA_BYTES = 0xFFFFFFFFLL - PAGE;
+
+static void
+put16(char* p, quint16 value)
+{
+  p[0] = char(value & 0xFF);
+  p[1] = char(value >> 8);
+}
+
+static void
+put32(char* p, quint32 value)
+{
+  put16(p, quint16(value & 0xFFFF));
+  put16(p + 2, quint16(value >> 16));
+}
+
+/*!
+  \brief Creates a recorder with the given settings. Nothing is allocated
+  until start().
+*/
+WavRecorder::WavRecorder(const RecorderConfig& config)
+  : m_config(config)
+  , m_channels(0)
+  , m_sampleRate(0)
+  , m_frameBytes(0)
+  , m_capacity(0)
+  , m_fileLimit(0)
+  , m_current(nullptr)
+  , m_stopping(false)
+  , m_bytesWritten(0)
+  , m_dropped(0)
+  , m_errors(0)
+  , m_file(nullptr)
+  , m_direct(false)
+  , m_preallocate(false)
+  , m_header(nullptr)
+  , m_fileBytes(0)
+  , m_fileIndex(0)
+  , m_throttleBytes(0)
+{}
+
+/*!
+  \brief Stops the recorder, writing out whatever has been pushed.
+*/
+WavRecorder::~WavRecorder()
+{
+  stop();
+}
+
+RecorderConfig
+WavRecorder::config() const
+{
+  return m_config;
+}
+
+/*!
+  \brief Allocates the buffers and starts the I/O thread for blocks of
+  channels channels at sampleRate. Returns false if already recording.
+
+  The first file is opened when the first buffer fills.
+*/
+bool
+WavRecorder::start(int channels, int sampleRate)
+{
+  if (isRecording() || channels <= 0 || sampleRate <= 0) {
+    return false;
+  }
+
+  m_channels = channels;
+  m_sampleRate = sampleRate;
+  m_frameBytes = channels * int(sizeof(int16_t));
+
+  // a whole number of both pages and frames, so every buffer can be written
+  // directly and no frame straddles two buffers.
+  size_t unit = size_t(PAGE);
+
+  while (unit % size_t(m_frameBytes) != 0) {
+    unit += size_t(PAGE);
+  }
+
+  m_capacity = std::max(unit, size_t(m_config.bufferBytes) / unit * unit);
+
+  // the size and time limits both come down to a number of sample bytes.
+  m_fileLimit = MAX_DATA_BYTES;
+
+  if (m_config.maxFileBytes > 0) {
+    m_fileLimit = std::min(m_fileLimit, m_config.maxFileBytes);
+  }
+
+  if (m_config.maxFileSeconds > 0) {
+    m_fileLimit = std::min(m_fileLimit,
+                           qint64(m_config.maxFileSeconds) * sampleRate *
+                             m_frameBytes);
+  }
+
+  // direct writes start on a page, so there the limit is whole pages and a
+  // buffer is only ever split on a page boundary. A file always gets at
+  // least one of those units, so a tiny limit cannot stall the writer.
+  qint64 step = m_frameBytes;
+
+  if (m_config.directIo && !m_config.compress) {
+    step = qint64(unit);
+  }
+
+  m_fileLimit = std::max(step, m_fileLimit - m_fileLimit % step);
+
+  m_buffers.resize(size_t(std::max(2, m_config.bufferCount)));
+  m_free.clear();
+
+  for (Buffer& buffer : m_buffers) {
+    buffer.data = static_cast<char*>(qMallocAligned(m_capacity, PAGE));
+    buffer.used = 0;
+    m_free.push_back(&buffer);
+  }
+
+  m_scratch.resize(m_capacity / sizeof(int16_t));
+  m_header = static_cast<char*>(qMallocAligned(PAGE, PAGE));
+  m_preallocate = m_config.preallocate;
+  m_current = nullptr;
+  m_stopping = false;
+  m_throttleStart = std::chrono::steady_clock::now();
+  m_throttleBytes = 0;
+  m_thread = std::thread(&WavRecorder::run, this);
+  return true;
+}
+
+/*!
+  \brief Writes out everything pushed so far, closes the current file and
+  stops the I/O thread.
+*/
+void
+WavRecorder::stop()
+{
+  if (!isRecording()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_current && m_current->used > 0) {
+      m_full.push_back(m_current);
+    }
+
+    m_current = nullptr;
+    m_stopping = true;
+  }
+
+  m_wake.notify_one();
+  m_thread.join();
+
+  for (Buffer& buffer : m_buffers) {
+    qFreeAligned(buffer.data);
+  }
+
+  m_buffers.clear();
+  m_free.clear();
+  qFreeAligned(m_header);
+  m_header = nullptr;
+}
+
+/*!
+  \brief Returns true between start() and stop().
+*/
+bool
+WavRecorder::isRecording() const
+{
+  return m_thread.joinable();
+}
+
+/*!
+  \brief Adds a captured block to the recording, converting it to 16 bit
+  interleaved samples. The block must have the channel count given to
+  start().
+
+  This never waits on the disk. If every buffer is waiting to be written
+  the block, or what is left of it, is dropped and counted.
+*/
+void
+WavRecorder::push(const AudioBlock& block)
+{
+  if (!isRecording() || block.isEmpty() || block.channels() != m_channels) {
+    return;
+  }
+
+  int frame = 0;
+
+  while (frame < block.frames()) {
+    if (!m_current) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+
+      if (m_free.empty()) {
+        m_dropped++;
+        return;
+      }
+
+      m_current = m_free.back();
+      m_free.pop_back();
+      m_current->used = 0;
+    }
+
+    int room = int((m_capacity - m_current->used) / size_t(m_frameBytes));
+    int count = std::min(room, block.frames() - frame);
+    int16_t* out = reinterpret_cast<int16_t*>(m_current->data + m_current->used);
+
+    if (m_channels == 1) {
+      convertSamples<SampleFormat::Float32, SampleFormat::Int16>(
+        block.channel(0) + frame, out, size_t(count));
+
+    } else {
+      for (int c = 0; c < m_channels; c++) {
+        convertSamples<SampleFormat::Float32, SampleFormat::Int16>(
+          block.channel(c) + frame, m_scratch.data(), size_t(count));
+
+        for (int i = 0; i < count; i++) {
+          out[i * m_channels + c] = m_scratch[size_t(i)];
+        }
+      }
+    }
+
+    m_current->used += size_t(count * m_frameBytes);
+    frame += count;
+
+    if (m_current->used == m_capacity) {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_full.push_back(m_current);
+      }
+
+      m_current = nullptr;
+      m_wake.notify_one();
+    }
+  }
+}
+
+/*!
+  \brief Returns the sample bytes written to disk so far, after compression
+  if that is on.
+*/
+quint64
+WavRecorder::bytesWritten() const
+{
+  return m_bytesWritten;
+}
+
+/*!
+  \brief Returns the number of blocks, or parts of blocks, dropped because
+  the disk could not keep up.
+*/
+quint64
+WavRecorder::droppedBlocks() const
+{
+  return m_dropped;
+}
+
+/*!
+  \brief Returns the number of failed writes or file opens.
+*/
+quint64
+WavRecorder::writeErrors() const
+{
+  return m_errors;
+}
+
+/*!
+  \brief Returns the number of full buffers waiting for the I/O thread.
+*/
+int
+WavRecorder::queuedBuffers() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return int(m_full.size());
+}
+
+/*!
+  \brief Returns the files written or being written so far.
+*/
+QStringList
+WavRecorder::files() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_files;
+}
+
+/* The I/O thread, writes everything queued each time it wakes.*/
+void
+WavRecorder::run()
+{
+  for (;;) {
+    std::deque<Buffer*> batch;
+
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wake.wait(lock, [this] { return m_stopping || !m_full.empty(); });
+      batch.swap(m_full);
+
+      if (batch.empty()) {
+        break;
+      }
+    }
+
+    for (Buffer* buffer : batch) {
+      writeBuffer(buffer);
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_free.push_back(buffer);
+    }
+  }
+
+  closeFile();
+}
+
+void
+WavRecorder::writeBuffer(Buffer* buffer)
+{
+  size_t offset = 0;
+
+  while (offset < buffer->used) {
+    if (!m_file && !openFile()) {
+      m_errors++;
+      return;
+    }
+
+    // the limit is checked before writing, so no file can pass it and
+    // wrap the 32 bit sizes in its header. What does not fit goes to the
+    // next file.
+    size_t bytes =
+      std::min(buffer->used - offset, size_t(m_fileLimit - m_fileBytes));
+    size_t written = bytes;
+    const char* data = buffer->data + offset;
+
+    if (m_direct) {
+      // only the last buffer can be part full, pad it to the page and trim
+      // the file when it is closed.
+      written = (bytes + PAGE - 1) / PAGE * PAGE;
+      std::memset(buffer->data + offset + bytes, 0, written - bytes);
+    }
+
+    if (m_config.compress) {
+      m_encoded.clear();
+      m_encoder.encode(reinterpret_cast<const int16_t*>(data),
+                       int(bytes / size_t(m_frameBytes)),
+                       m_encoded);
+      data = m_encoded.constData();
+      written = size_t(m_encoded.size());
+    }
+
+    if (m_file->write(data, qint64(written)) != qint64(written)) {
+      m_errors++;
+    }
+
+    throttle(qint64(written));
+    offset += bytes;
+    m_fileBytes += qint64(bytes);
+    m_bytesWritten += written;
+
+    if (m_fileBytes >= m_fileLimit) {
+      closeFile();
+    }
+  }
+}
+
+bool
+WavRecorder::openFile()
+{
+  QString name = QDir(m_config.directory)
+                   .filePath(QString("%1-%2.%3")
+                               .arg(m_config.prefix)
+                               .arg(++m_fileIndex)
+                               .arg(m_config.compress ? "sla" : "wav"));
+  m_file = new QFile(name);
+  m_direct = false;
+  bool opened = false;
+
+#if defined(Q_OS_LINUX)
+  if (m_config.directIo && !m_config.compress) {
+    int fd = ::open(QFile::encodeName(name).constData(),
+                    O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT,
+                    0644);
+
+    // not every filesystem supports O_DIRECT, tmpfs for one.
+    if (fd >= 0) {
+      opened = m_file->open(fd,
+                            QIODevice::WriteOnly | QIODevice::Unbuffered,
+                            QFileDevice::AutoCloseHandle);
+      m_direct = opened;
+    }
+  }
+#endif
+
+  if (!opened) {
+    opened = m_file->open(QIODevice::WriteOnly | QIODevice::Truncate |
+                          QIODevice::Unbuffered);
+  }
+
+  if (!opened) {
+    qWarning() << QObject::tr("unable to open %1").arg(name);
+    delete m_file;
+    m_file = nullptr;
+    return false;
+  }
+
+#if defined(Q_OS_LINUX)
+  if (m_preallocate && !m_config.compress && m_fileLimit < MAX_DATA_BYTES) {
+    // reserve the blocks without changing the size, so the file still reads
+    // correctly if it is never finished. Not every filesystem supports it,
+    // the files are then written without the reservation.
+    if (fallocate(m_file->handle(),
+                  FALLOC_FL_KEEP_SIZE,
+                  0,
+                  PAGE + m_fileLimit) != 0) {
+      qWarning() << QObject::tr("unable to preallocate %1: %2")
+                      .arg(name)
+                      .arg(QString::fromLocal8Bit(strerror(errno)));
+      m_preallocate = false;
+    }
+  }
+#endif
+
+  if (m_config.compress) {
+    m_encoder = LosslessEncoder(m_channels, m_sampleRate);
+    m_file->write(m_encoder.header());
+
+  } else {
+    fillHeader(0);
+    m_file->write(m_header, PAGE);
+  }
+
+  m_fileBytes = 0;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_files.append(name);
+  return true;
+}
+
+void
+WavRecorder::closeFile()
+{
+  if (!m_file) {
+    return;
+  }
+
+  if (m_config.compress) {
+    m_encoded.clear();
+    m_encoder.flush(m_encoded);
+
+    if (m_file->write(m_encoded) != m_encoded.size()) {
+      m_errors++;
+    }
+
+    m_bytesWritten += quint64(m_encoded.size());
+    m_file->seek(0);
+
+    if (m_file->write(m_encoder.header()) != LosslessEncoder::HEADER_BYTES) {
+      m_errors++;
+    }
+
+  } else {
+    fillHeader(m_fileBytes);
+    m_file->seek(0);
+
+    if (m_file->write(m_header, PAGE) != PAGE) {
+      m_errors++;
+    }
+  }
+
+  if (m_direct) {
+    m_file->resize(PAGE + m_fileBytes);
+  }
+
+  m_file->close();
+  delete m_file;
+  m_file = nullptr;
+}
+
+/* A 16 bit PCM header, with a JUNK chunk padding the data out to PAGE.*/
+void
+WavRecorder::fillHeader(qint64 dataBytes)
+{
+  char* h = m_header;
+  std::memset(h, 0, PAGE);
+  std::memcpy(h, "RIFF", 4);
+  put32(h + 4, quint32(PAGE - 8 + dataBytes));
+  std::memcpy(h + 8, "WAVE", 4);
+  std::memcpy(h + 12, "fmt ", 4);
+  put32(h + 16, 16);
+  put16(h + 20, 1);
+  put16(h + 22, quint16(m_channels));
+  put32(h + 24, quint32(m_sampleRate));
+  put32(h + 28, quint32(m_sampleRate * m_frameBytes));
+  put16(h + 32, quint16(m_frameBytes));
+  put16(h + 34, 16);
+  std::memcpy(h + 36, "JUNK", 4);
+  put32(h + 40, PAGE - 44 - 8);
+  std::memcpy(h + PAGE - 8, "data", 4);
+  put32(h + PAGE - 4, quint32(dataBytes));
+}
+
+/* Sleeps long enough to hold the writes to the configured rate.*/
+void
+WavRecorder::throttle(qint64 bytes)
+{
+  if (m_config.throttleBytesPerSecond <= 0) {
+    return;
+  }
+
+  m_throttleBytes += bytes;
+  auto due = m_throttleStart +
+             std::chrono::nanoseconds(qint64(
+               double(m_throttleBytes) * 1.0e9 /
+               double(m_config.throttleBytesPerSecond)));
+  std::this_thread::sleep_until(due);
+}
+
+} // end of namespace SpeechRecognition
@@ -0,0 +1,173 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef WAVRECORDER_H
+#define WAVRECORDER_H
+
+#include <QString>
+#include <QStringList>
+#include <QtDebug>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+#include "audioblock.h"
+#include "losslesscodec.h"
+
+class QFile;
+
+namespace SpeechRecognition {
+
+/*!
+  \brief The settings of a WavRecorder.
+
+  Files are named prefix-N.wav in directory, N counting up from 1. A file
+  is closed and the next one started when it reaches maxFileBytes of
+  samples or maxFileSeconds of audio, whichever comes first, zero meaning
+  no limit. throttleBytesPerSecond caps the write rate to simulate a slow
+  disk, zero meaning no cap.
+
+  With compress the files are prefix-N.sla, coded by LosslessEncoder on the
+  I/O thread. The limits still count uncompressed bytes, and directIo and
+  preallocate are ignored as the write sizes are no longer known.
+*/
+struct RecorderConfig
+{
+  QString directory = ".";
+  QString prefix = "capture";
+  qint64 maxFileBytes = 0;
+  int maxFileSeconds = 0;
+  int bufferBytes = 1 << 20;
+  int bufferCount = 8;
+  bool directIo = false;
+  bool preallocate = false;
+  qint64 throttleBytesPerSecond = 0;
+  bool compress = false;
+};
+
+/*!
+  \class WavRecorder
+  \brief The WavRecorder class archives captured audio to 16 bit WAV files
+  without ever holding up the capture.
+
+  push() only converts a block into the current buffer, a large page
+  aligned buffer from a pool allocated up front. Full buffers are queued to
+  a dedicated I/O thread which writes everything queued in one go. If the
+  disk falls so far behind that no buffer is free, the block is dropped and
+  counted rather than making the caller wait, so a slow disk costs archive
+  audio, never capture overflows.
+
+  Each file starts with a 4 KB header page, the format followed by a JUNK
+  chunk that pads the samples out to the page boundary, so every write is
+  page aligned and can use O_DIRECT to keep the archive out of the page
+  cache. The RIFF and data sizes are patched when the file is closed. A
+  file left by a crash has zero sizes, which WavFile reads as running to
+  the end of the file. With preallocate the space for a whole file is
+  reserved up front with fallocate, keeping it contiguous. If the
+  filesystem refuses, a warning is logged and the rest of the files are
+  written without it. Both of those are Linux only.
+
+  A file is cut before the write that would take it past its limit, the
+  rest of that buffer starting the next file, so it never holds more than
+  the limit. With direct I/O the limit is rounded down to whole pages.
+
+  push() must always be called from the same thread.
+*/
+class SPEECHRECOGNISER_EXPORT WavRecorder
+{
+public:
+  explicit WavRecorder(const RecorderConfig& config = RecorderConfig());
+  ~WavRecorder();
+
+  WavRecorder(const WavRecorder&) = delete;
+  WavRecorder& operator=(const WavRecorder&) = delete;
+
+  RecorderConfig config() const;
+  bool start(int channels, int sampleRate);
+  void stop();
+  bool isRecording() const;
+
+  void push(const AudioBlock& block);
+
+  quint64 bytesWritten() const;
+  quint64 droppedBlocks() const;
+  quint64 writeErrors() const;
+  int queuedBuffers() const;
+  QStringList files() const;
+
+private:
+  struct Buffer
+  {
+    char* data = nullptr;
+    size_t used = 0;
+  };
+
+  RecorderConfig m_config;
+  int m_channels;
+  int m_sampleRate;
+  int m_frameBytes;
+  size_t m_capacity;
+  qint64 m_fileLimit;
+
+  std::vector<Buffer> m_buffers;
+  std::vector<int16_t> m_scratch;
+  Buffer* m_current;
+  std::vector<Buffer*> m_free;
+  std::deque<Buffer*> m_full;
+  mutable std::mutex m_mutex;
+  std::condition_variable m_wake;
+  bool m_stopping;
+  std::thread m_thread;
+
+  std::atomic<quint64> m_bytesWritten;
+  std::atomic<quint64> m_dropped;
+  std::atomic<quint64> m_errors;
+  QStringList m_files;
+
+  // owned by the I/O thread.
+  QFile* m_file;
+  bool m_direct;
+  bool m_preallocate;
+  char* m_header;
+  qint64 m_fileBytes;
+  int m_fileIndex;
+  std::chrono::steady_clock::time_point m_throttleStart;
+  qint64 m_throttleBytes;
+  LosslessEncoder m_encoder;
+  QByteArray m_encoded;
+
+  void run();
+  void writeBuffer(Buffer* buffer);
+  bool openFile();
+  void closeFile();
+  void fillHeader(qint64 dataBytes);
+  void throttle(qint64 bytes);
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // WAVRECORDER_H
@@ -0,0 +1,217 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include "workstealingpool.h"
+
+namespace SpeechRecognition {
+
+/* The pool that owns the current thread and the worker index within it, -1 if
+   the current thread is not a pool worker.*/
+static thread_local const WorkStealingPool* t_pool = nullptr;
+static thread_local int t_workerIndex = -1;
+
+/*!
+   \brief Creates a pool with threadCount workers.
+
+   If threadCount is zero or less the pool is sized to the number of hardware
+   threads.
+*/
+WorkStealingPool::WorkStealingPool(int threadCount)
+  : m_running(true)
+  , m_nextWorker(0)
+  , m_queued(0)
+{
+  if (threadCount <= 0) {
+    threadCount = int(std::thread::hardware_concurrency());
+  }
+
+  if (threadCount <= 0) {
+    threadCount = 1;
+  }
+
+  for (int i = 0; i < threadCount; i++) {
+    m_workers.emplace_back(new Worker);
+  }
+
+  // start the threads only after every deque exists, as they steal from each
+  // other straight away.
+  for (int i = 0; i < threadCount; i++) {
+    m_workers[size_t(i)]->thread = std::thread(&WorkStealingPool::run, this, i);
+  }
+}
+
+/*!
+   \brief Stops the workers, discarding any tasks that have not yet started.
+*/
+WorkStealingPool::~WorkStealingPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    m_running = false;
+  }
+  m_wake.notify_all();
+
+  for (auto& worker : m_workers) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+}
+
+/*!
+   \brief Queues a task.
+
+   When called from one of this pool's workers the task goes to the front of
+   that worker's own deque, otherwise the workers are filled round robin.
+*/
+void
+WorkStealingPool::submit(Task task)
+{
+  enqueue(std::move(task), false);
+}
+
+/*!
+   \brief Queues a task behind everything already waiting on the calling
+   worker.
+
+   This is used by long running jobs to yield to other work without giving up
+   their place in the pool. Called from outside the pool it behaves like
+   submit().
+*/
+void
+WorkStealingPool::defer(Task task)
+{
+  enqueue(std::move(task), true);
+}
+
+/*!
+   \brief Returns the number of worker threads.
+*/
+int
+WorkStealingPool::threadCount() const
+{
+  return int(m_workers.size());
+}
+
+/*!
+   \brief Returns the index of the calling worker thread, or -1 if the caller
+   is not one of this pool's workers.
+*/
+int
+WorkStealingPool::currentWorker() const
+{
+  return (t_pool == this ? t_workerIndex : -1);
+}
+
+void
+WorkStealingPool::enqueue(Task task, bool atBack)
+{
+  int index = currentWorker();
+
+  if (index < 0) {
+    index = int(m_nextWorker.fetch_add(1, std::memory_order_relaxed) %
+                unsigned(m_workers.size()));
+    atBack = false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_workers[size_t(index)]->mutex);
+
+    if (atBack) {
+      m_workers[size_t(index)]->tasks.push_back(std::move(task));
+
+    } else {
+      m_workers[size_t(index)]->tasks.push_front(std::move(task));
+    }
+  }
+
+  {
+    // taking the sleep lock closes the window between a worker finding no
+    // work and going to sleep.
+    std::lock_guard<std::mutex> lock(m_sleepMutex);
+    m_queued.fetch_add(1, std::memory_order_release);
+  }
+  m_wake.notify_one();
+}
+
+bool
+WorkStealingPool::popLocal(int index, Task& task)
+{
+  Worker* worker = m_workers[size_t(index)].get();
+  std::lock_guard<std::mutex> lock(worker->mutex);
+
+  if (worker->tasks.empty()) {
+    return false;
+  }
+
+  task = std::move(worker->tasks.front());
+  worker->tasks.pop_front();
+  return true;
+}
+
+bool
+WorkStealingPool::steal(int index, Task& task)
+{
+  int count = int(m_workers.size());
+
+  for (int i = 1; i < count; i++) {
+    Worker* victim = m_workers[size_t((index + i) % count)].get();
+    std::unique_lock<std::mutex> lock(victim->mutex, std::try_to_lock);
+
+    // a busy victim is most likely pushing, so move on rather than wait.
+    if (!lock.owns_lock() || victim->tasks.empty()) {
+      continue;
+    }
+
+    task = std::move(victim->tasks.back());
+    victim->tasks.pop_back();
+    return true;
+  }
+
+  return false;
+}
+
+void
+WorkStealingPool::run(int index)
+{
+  t_pool = this;
+  t_workerIndex = index;
+  Task task;
+
+  while (m_running) {
+    if (popLocal(index, task) || steal(index, task)) {
+      m_queued.fetch_sub(1, std::memory_order_acq_rel);
+      task();
+      task = nullptr;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(m_sleepMutex);
+    m_wake.wait(lock, [this] {
+      return !m_running || m_queued.load(std::memory_order_acquire) > 0;
+    });
+  }
+
+  t_pool = nullptr;
+  t_workerIndex = -1;
+}
+
+} // end of namespace SpeechRecognition
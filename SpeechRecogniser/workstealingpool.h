@@ -0,0 +1,91 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SpeechRecogniser_global.h"
+
+namespace SpeechRecognition {
+
+/*!
+  \class WorkStealingPool
+  \brief The WorkStealingPool class runs tasks on a fixed set of worker
+  threads, each with its own task deque.
+
+  Tasks submitted from a worker thread are pushed onto that worker's own deque
+  and popped LIFO, which keeps a stream's follow-on work hot in the cache.
+  Tasks submitted from outside the pool are spread round robin. An idle worker
+  steals FIFO from the far end of the other workers' deques.
+
+  The pool makes no ordering guarantees between tasks, anything that needs
+  ordering, such as the chunks of one audio stream, must serialise itself (see
+  DetectionServer).
+*/
+class SPEECHRECOGNISER_EXPORT WorkStealingPool
+{
+public:
+  using Task = std::function<void()>;
+
+  explicit WorkStealingPool(int threadCount = 0);
+  ~WorkStealingPool();
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  void submit(Task task);
+  void defer(Task task);
+  int threadCount() const;
+  int currentWorker() const;
+
+private:
+  struct Worker
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    std::thread thread;
+  };
+
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  std::atomic<bool> m_running;
+  std::atomic<unsigned> m_nextWorker;
+  std::atomic<int> m_queued;
+  std::mutex m_sleepMutex;
+  std::condition_variable m_wake;
+
+  void enqueue(Task task, bool atBack);
+  void run(int index);
+  bool popLocal(int index, Task& task);
+  bool steal(int index, Task& task);
+};
+
+} // end of namespace SpeechRecognition
+
+#endif // WORKSTEALINGPOOL_H
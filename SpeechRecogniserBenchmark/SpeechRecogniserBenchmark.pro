@@ -0,0 +1,93 @@
+QT += gui widgets
+
+TARGET   = SpeechRecogniserBenchmark
+TEMPLATE = app
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+# The following define makes your compiler emit warnings if you use
+# any Qt feature that has been marked deprecated (the exact warnings
+# depend on your compiler). Please consult the documentation of the
+# deprecated API in order to know how to port your code away from it.
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# must match the library, see SpeechRecogniser.pro
+DEFINES += _GLIBCXX_USE_CXX11_ABI=0
+
+# header file for common projects
+INCLUDEPATH += ../include
+
+# default location of the snowboy resource and model files
+DEFINES += RESOURCES_DIR=\\\"$$PWD/../resources\\\"
+
+# recorded in the suite's JSON so results can be traced to a revision
+GIT_REVISION = $$system(git -C $$PWD describe --always --dirty 2>/dev/null)
+!isEmpty(GIT_REVISION): DEFINES += GIT_REVISION=\\\"$$GIT_REVISION\\\"
+
+SOURCES += \
+    auditbenchmark.cpp \
+    benchmarkaudio.cpp \
+    beamformerbenchmark.cpp \
+    chunkpolicybenchmark.cpp \
+    codecbenchmark.cpp \
+    conversionbenchmark.cpp \
+    echobenchmark.cpp \
+    energygatebenchmark.cpp \
+    featurebenchmark.cpp \
+    feedbackbenchmark.cpp \
+    gainbenchmark.cpp \
+    goldenbenchmark.cpp \
+    loadbenchmark.cpp \
+    main.cpp \
+    metricsbenchmark.cpp \
+    multidevicebenchmark.cpp \
+    multistreambenchmark.cpp \
+    noisebenchmark.cpp \
+    recorderbenchmark.cpp \
+    replaybenchmark.cpp \
+    selftriggerbenchmark.cpp \
+    simulationbenchmark.cpp \
+    suitebenchmark.cpp \
+    sweepbenchmark.cpp \
+    tracebenchmark.cpp \
+    wavfilebenchmark.cpp
+
+HEADERS += \
+    auditbenchmark.h \
+    benchmarkaudio.h \
+    beamformerbenchmark.h \
+    chunkpolicybenchmark.h \
+    codecbenchmark.h \
+    conversionbenchmark.h \
+    echobenchmark.h \
+    energygatebenchmark.h \
+    featurebenchmark.h \
+    feedbackbenchmark.h \
+    gainbenchmark.h \
+    goldenbenchmark.h \
+    loadbenchmark.h \
+    metricsbenchmark.h \
+    multidevicebenchmark.h \
+    multistreambenchmark.h \
+    noisebenchmark.h \
+    recorderbenchmark.h \
+    replaybenchmark.h \
+    selftriggerbenchmark.h \
+    simulationbenchmark.h \
+    suitebenchmark.h \
+    sweepbenchmark.h \
+    tracebenchmark.h \
+    wavfilebenchmark.h
+
+unix|win32: {
+    LIBS += -L/usr/local/lib -lportaudiocpp
+}
+
+LIBS += -L$$PWD/../lib -lsnowboy-detect -lcblas
+
+win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../SpeechRecogniser/release/ -lSpeechRecogniser
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../SpeechRecogniser/debug/ -lSpeechRecogniser
+else:unix: LIBS += -L$$OUT_PWD/../SpeechRecogniser/ -lSpeechRecogniser
+
+INCLUDEPATH += $$PWD/../SpeechRecogniser
+DEPENDPATH += $$PWD/../SpeechRecogniser
@@ -0,0 +1,320 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <QtDebug>
+
+#include <algorithm>
+#include <vector>
+
+#include "audiosource.h"
+#include "auditbenchmark.h"
+#include "detectionpipeline.h"
+#include "detectionserver.h"
+#include "microphonereader.h"
+#include "realtimeaudit.h"
+#include "sampleconversion.h"
+#include "wavfile.h"
+
+using namespace SpeechRecognition;
+
+// the passes over the recording counted after the first, about 19 seconds.
+static const int PASSES = 20;
+
+/* A source with no device of its own, fed by auditCapture() as PortAudio
+   would feed a MicrophoneReader.*/
+class AuditSource : public AudioSource
+{
+public:
+  void record() override {}
+  int channelCount() const override { return 1; }
+  double sampleRate() const override { return SAMPLE_RATE; }
+};
+
+AuditBenchmark::AuditBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+{}
+
+/*!
+   \brief Audits the pipeline and the server. Returns false if either
+   allocated in steady state, or if the audit is not built in or the
+   resources could not be loaded.
+*/
+bool
+AuditBenchmark::run()
+{
+  m_results.clear();
+
+  if (!RealtimeAudit::isCompiledIn()) {
+    qWarning() << QObject::tr("the audit needs the library built with "
+                              "qmake CONFIG+=rtaudit on glibc.");
+    return false;
+  }
+
+  WavFile file;
+  QString filename = QDir(m_resourceDir).filePath("snowboy.wav");
+
+  if (!file.open(filename)) {
+    return false;
+  }
+
+  if (file.format().channels != 1) {
+    qWarning() << QObject::tr("%1 is not mono.").arg(filename);
+    return false;
+  }
+
+  std::vector<float> recording(size_t(file.frames()));
+  float* channels[] = { recording.data() };
+
+  if (file.readFrames(0, file.frames(), channels) != file.frames()) {
+    return false;
+  }
+
+  bool ok = auditCapture(recording) && auditPipeline(recording) &&
+            auditServer(recording);
+
+  for (const AuditResult& result : m_results) {
+    qInfo().noquote()
+      << QString("%1: %2 blocks, %3 allocations, %4 frees, %5 locks, "
+                 "%6 allocations and %7 frees in snowboy")
+           .arg(result.part, -10)
+           .arg(result.blocks)
+           .arg(result.allocations)
+           .arg(result.frees)
+           .arg(result.locks)
+           .arg(result.allowed)
+           .arg(result.allowedFrees);
+
+    if (result.allocations > 0 || result.frees > 0 || result.locks > 0) {
+      qWarning() << QObject::tr("%1 allocates or locks in steady state, "
+                                "last in %2.")
+                      .arg(result.part)
+                      .arg(result.lastScope);
+      ok = false;
+    }
+
+    if (result.allowed != result.allowedFrees) {
+      qWarning()
+        << QObject::tr("%1 keeps memory snowboy allocated in steady state.")
+             .arg(result.part);
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+/* Replays the recording through MicrophoneReader::deliverBlock(), the work
+   of the capture callback, with the source sending each block on through a
+   queued connection, as its thread does, to a consumer that lets it go.*/
+bool
+AuditBenchmark::auditCapture(const std::vector<float>& recording)
+{
+  AuditSource source;
+  QObject consumer;
+  DeviceClock clock;
+  QObject::connect(
+    &source,
+    &AudioSource::sendBlock,
+    &consumer,
+    [&source](const AudioBlock& block) {
+      source.samplesConsumed(block.frames());
+    },
+    Qt::QueuedConnection);
+
+  PaStreamCallbackTimeInfo timeInfo = {};
+  qint64 captured = 0;
+  quint64 blocks = 0;
+
+  for (int pass = 0; pass <= PASSES; pass++) {
+    if (pass == 1) {
+      RealtimeAudit::reset();
+      blocks = 0;
+    }
+
+    for (size_t offset = 0; offset + FRAMES_PER_BUFFER <= recording.size();
+         offset += FRAMES_PER_BUFFER) {
+      timeInfo.currentTime = double(captured) / SAMPLE_RATE;
+      timeInfo.inputBufferAdcTime = timeInfo.currentTime;
+      MicrophoneReader::deliverBlock(&source,
+                                     recording.data() + offset,
+                                     1,
+                                     FRAMES_PER_BUFFER,
+                                     &timeInfo,
+                                     0.0,
+                                     SAMPLE_RATE,
+                                     &clock);
+      source.emitPending();
+      QCoreApplication::sendPostedEvents(&consumer);
+      captured += FRAMES_PER_BUFFER;
+      blocks++;
+    }
+  }
+
+  m_results.append(take("capture", blocks));
+  return true;
+}
+
+/* Replays the recording through a pipeline with the echo canceller, noise
+   suppressor, gain control and energy gate enabled, in capture sized blocks
+   stamped with capture times.*/
+bool
+AuditBenchmark::auditPipeline(const std::vector<float>& recording)
+{
+  QDir dir(m_resourceDir);
+  DetectionPipeline pipeline;
+
+  if (!pipeline.setDetector(dir.filePath("common.res"),
+                            dir.filePath("models/snowboy.umdl"))) {
+    return false;
+  }
+
+  pipeline.setEchoCancellerEnabled(true);
+  pipeline.setNoiseSuppressorEnabled(true);
+  pipeline.setGainControlEnabled(true);
+  pipeline.setFeatureExtractorEnabled(true);
+  pipeline.setEnergyGateEnabled(true);
+
+  std::vector<float> block(FRAMES_PER_BUFFER);
+  std::vector<float> reference(FRAMES_PER_BUFFER);
+  const qint64 start = 1000000000;
+  qint64 captured = 0;
+  quint64 blocks = 0;
+
+  for (int pass = 0; pass <= PASSES; pass++) {
+    if (pass == 1) {
+      RealtimeAudit::reset();
+      blocks = 0;
+    }
+
+    for (size_t offset = 0; offset < recording.size();
+         offset += FRAMES_PER_BUFFER) {
+      size_t frames =
+        std::min(size_t(FRAMES_PER_BUFFER), recording.size() - offset);
+      qint64 time = start + captured * 1000000000 / SAMPLE_RATE;
+
+      // something quiet for the canceller to cancel, as the player would.
+      for (size_t i = 0; i < frames; i++) {
+        reference[i] = 0.1f * recording[offset + i];
+      }
+
+      pipeline.echoCanceller().writeReference(
+        reference.data(), int(frames), time);
+
+      std::copy(recording.begin() + long(offset),
+                recording.begin() + long(offset + frames),
+                block.begin());
+      pipeline.process(block.data(), int(frames), 0, time);
+      captured += qint64(frames);
+      blocks++;
+    }
+  }
+
+  m_results.append(take("pipeline", blocks));
+  return true;
+}
+
+/* Replays the recording through one DetectionServer stream in detector
+   sized chunks, waiting for each pass to finish.*/
+bool
+AuditBenchmark::auditServer(const std::vector<float>& recording)
+{
+  QDir dir(m_resourceDir);
+  DetectionServer server(1);
+
+  if (server.addStream(dir.filePath("common.res"),
+                       dir.filePath("models/snowboy.umdl")) < 0) {
+    return false;
+  }
+
+  std::vector<int16_t> samples(recording.size());
+  convertSamples<SampleFormat::Float32, SampleFormat::Int16>(
+    recording.data(), samples.data(), samples.size());
+  const int chunk = 1600;
+  quint64 warmUp = 0;
+
+  for (int pass = 0; pass <= PASSES; pass++) {
+    if (pass == 1) {
+      RealtimeAudit::reset();
+      warmUp = server.processedChunks(0);
+    }
+
+    for (size_t offset = 0; offset + size_t(chunk) <= samples.size();
+         offset += size_t(chunk)) {
+      server.pushData(0, samples.data() + offset, chunk);
+    }
+
+    server.waitForIdle();
+  }
+
+  m_results.append(take("server", server.processedChunks(0) - warmUp));
+  return true;
+}
+
+/* Returns the counts since the last reset as the result for part.*/
+AuditResult
+AuditBenchmark::take(const QString& part, quint64 blocks) const
+{
+  AuditResult result;
+  result.part = part;
+  result.blocks = blocks;
+  result.allocations = RealtimeAudit::allocations();
+  result.frees = RealtimeAudit::frees();
+  result.locks = RealtimeAudit::locks();
+  result.allowed = RealtimeAudit::allowedAllocations();
+  result.allowedFrees = RealtimeAudit::allowedFrees();
+  result.lastScope = QString::fromLatin1(RealtimeAudit::lastScope());
+  return result;
+}
+
+QVector<AuditResult>
+AuditBenchmark::results() const
+{
+  return m_results;
+}
+
+/*!
+   \brief Writes the results as comma separated values.
+*/
+bool
+AuditBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "part,blocks,allocations,frees,locks,allowed,allowed_frees\n";
+
+  for (const AuditResult& r : m_results) {
+    out << r.part << ',' << r.blocks << ',' << r.allocations << ','
+        << r.frees << ',' << r.locks << ',' << r.allowed << ','
+        << r.allowedFrees << '\n';
+  }
+
+  return true;
+}
@@ -0,0 +1,81 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef AUDITBENCHMARK_H
+#define AUDITBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+#include <vector>
+
+/*!
+  \brief What one part of the audio path did in its real time scopes once
+  it had warmed up.
+*/
+struct AuditResult
+{
+  QString part;
+  quint64 blocks = 0;
+  quint64 allocations = 0;
+  quint64 frees = 0;
+  quint64 locks = 0;
+  quint64 allowed = 0;
+  quint64 allowedFrees = 0;
+  QString lastScope;
+};
+
+/*!
+  \class AuditBenchmark
+  \brief The AuditBenchmark class checks that the real time parts of the
+  audio path neither allocate nor lock once they are running.
+
+  resources/snowboy.wav is replayed over and over, first through
+  MicrophoneReader::deliverBlock(), the work of the capture callback, into
+  a source that sends its blocks on through a queued connection, then
+  through a DetectionPipeline with every stage enabled and last through a
+  DetectionServer stream. The first pass warms the buffers up; over the
+  passes after it RealtimeAudit must count no allocations, frees or locks.
+  Snowboy's RunDetection() is the one call allowed to allocate, and it must
+  free as many blocks as it allocates.
+
+  It needs the library built with qmake CONFIG+=rtaudit.
+*/
+class AuditBenchmark
+{
+public:
+  explicit AuditBenchmark(const QString& resourceDir);
+
+  bool run();
+  QVector<AuditResult> results() const;
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  QVector<AuditResult> m_results;
+
+  bool auditCapture(const std::vector<float>& recording);
+  bool auditPipeline(const std::vector<float>& recording);
+  bool auditServer(const std::vector<float>& recording);
+  AuditResult take(const QString& part, quint64 blocks) const;
+};
+
+#endif // AUDITBENCHMARK_H
@@ -0,0 +1,307 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QFile>
+#include <QTextStream>
+#include <QVector3D>
+#include <QtDebug>
+#include <QtMath>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "beamformer.h"
+#include "beamformerbenchmark.h"
+
+using namespace SpeechRecognition;
+
+static const int SAMPLE_RATE = 16000;
+static const int FRAMES = 1600;
+static const double SECONDS = 0.25;
+
+// the synthesised array, four microphones 5 cm apart along the x axis with
+// the talker 30 degrees off axis.
+static const int MICS = 4;
+static const float SPACING = 0.05f;
+static const float SOURCE_AZIMUTH = 30.0f;
+static const int TEST_SECONDS = 4;
+
+BeamformerBenchmark::BeamformerBenchmark() {}
+
+/*!
+   \brief Runs both parts of the benchmark. Returns false if the beamformer
+   did not improve on a single microphone when steered at the source.
+*/
+bool
+BeamformerBenchmark::run()
+{
+  m_costs.clear();
+  m_quality.clear();
+
+  for (int channels : { 1, 2, 4, 8 }) {
+    measureCost(channels);
+  }
+
+  for (const BeamformerCost& c : m_costs) {
+    qInfo().noquote() << QString("%1 channels: downmix %2 ns, beamform %3 ns "
+                                 "per channel sample")
+                           .arg(c.channels)
+                           .arg(c.downmixNs, 0, 'f', 3)
+                           .arg(c.beamformNs, 0, 'f', 3);
+  }
+
+  bool ok = measureQuality();
+
+  for (const BeamformerQuality& q : m_quality) {
+    qInfo().noquote() << QString("%1 SNR %2 dB, gain %3 dB")
+                           .arg(q.name, -24)
+                           .arg(q.snrDb, 6, 'f', 2)
+                           .arg(q.gainDb, 6, 'f', 2);
+  }
+
+  return ok;
+}
+
+QVector<BeamformerCost>
+BeamformerBenchmark::costs() const
+{
+  return m_costs;
+}
+
+QVector<BeamformerQuality>
+BeamformerBenchmark::quality() const
+{
+  return m_quality;
+}
+
+/* Runs the kernel repeatedly for SECONDS and returns nanoseconds per call.*/
+template<class Kernel>
+static double
+timePerCall(Kernel kernel)
+{
+  kernel();
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed(0);
+  size_t runs = 0;
+
+  while (elapsed.count() < SECONDS) {
+    kernel();
+    runs++;
+    elapsed = std::chrono::steady_clock::now() - start;
+  }
+
+  return elapsed.count() * 1.0e9 / double(runs);
+}
+
+void
+BeamformerBenchmark::measureCost(int channels)
+{
+  AudioBlock block(channels, FRAMES);
+
+  for (int c = 0; c < channels; c++) {
+    float* data = block.channel(c);
+
+    for (int i = 0; i < FRAMES; i++) {
+      data[i] = float((i * (c + 3)) % 200 - 100) / 100.0f;
+    }
+  }
+
+  // a line array steered off axis, so every channel has a fractional delay.
+  DelayAndSumBeamformer beamformer(SAMPLE_RATE);
+  QVector<QVector3D> geometry;
+
+  for (int c = 0; c < channels; c++) {
+    geometry.append(QVector3D(SPACING * c, 0.0f, 0.0f));
+  }
+
+  beamformer.setGeometry(geometry);
+  beamformer.setSteering(SOURCE_AZIMUTH);
+
+  std::vector<float> out(FRAMES);
+  const double samples = double(channels) * FRAMES;
+  BeamformerCost cost;
+  cost.channels = channels;
+  cost.downmixNs = timePerCall([&] { downmix(block, out.data()); }) / samples;
+  cost.beamformNs =
+    timePerCall([&] { beamformer.process(block, out.data()); }) / samples;
+  m_costs.append(cost);
+}
+
+static double
+power(const std::vector<float>& data)
+{
+  double sum = 0.0;
+
+  for (float value : data) {
+    sum += double(value) * double(value);
+  }
+
+  return sum / double(data.size());
+}
+
+/* Runs the planar channels through a beamformer steered at azimuth, or
+   through downmix() if azimuth is NaN.*/
+static std::vector<float>
+combine(const std::vector<std::vector<float>>& channels, float azimuth)
+{
+  const int frames = int(channels.front().size());
+  std::vector<float> out(size_t(frames));
+  std::vector<const float*> planes;
+
+  for (const auto& channel : channels) {
+    planes.push_back(channel.data());
+  }
+
+  if (std::isnan(azimuth)) {
+    downmix(planes.data(), int(planes.size()), frames, out.data());
+    return out;
+  }
+
+  DelayAndSumBeamformer beamformer(SAMPLE_RATE);
+  QVector<QVector3D> geometry;
+
+  for (int c = 0; c < int(channels.size()); c++) {
+    geometry.append(QVector3D(SPACING * c, 0.0f, 0.0f));
+  }
+
+  beamformer.setGeometry(geometry);
+  beamformer.setSteering(azimuth);
+  std::vector<const float*> block(planes.size());
+
+  // in capture sized blocks, to exercise the history between blocks.
+  for (int first = 0; first < frames; first += FRAMES) {
+    for (size_t c = 0; c < planes.size(); c++) {
+      block[c] = planes[c] + first;
+    }
+
+    beamformer.process(
+      block.data(), std::min(FRAMES, frames - first), out.data() + first);
+  }
+
+  return out;
+}
+
+bool
+BeamformerBenchmark::measureQuality()
+{
+  const int frames = TEST_SECONDS * SAMPLE_RATE;
+  const float azimuth = qDegreesToRadians(SOURCE_AZIMUTH);
+  const int tones = 24;
+
+  /* The source is a band of tones from 300 Hz to 3.5 kHz with random phases.
+     A tone can be delayed by any fraction of a sample exactly, so each
+     microphone hears precisely what a plane wave would give it.*/
+  std::vector<double> frequency(tones), phase(tones);
+  quint32 seed = 12345;
+
+  for (int t = 0; t < tones; t++) {
+    seed = seed * 1664525u + 1013904223u;
+    frequency[size_t(t)] = 300.0 + 3200.0 * t / (tones - 1);
+    phase[size_t(t)] = 2.0 * M_PI * double(seed >> 8) / double(1 << 24);
+  }
+
+  std::vector<std::vector<float>> speech(MICS), noise(MICS);
+
+  for (int c = 0; c < MICS; c++) {
+    // the wave reaches microphones further along its direction first.
+    double lead = SPACING * c * std::cos(azimuth) / 343.0;
+    speech[size_t(c)].resize(size_t(frames));
+    noise[size_t(c)].resize(size_t(frames));
+
+    for (int i = 0; i < frames; i++) {
+      double t = double(i) / SAMPLE_RATE + lead;
+      double sum = 0.0;
+
+      for (int k = 0; k < tones; k++) {
+        sum += std::sin(2.0 * M_PI * frequency[size_t(k)] * t +
+                        phase[size_t(k)]);
+      }
+
+      speech[size_t(c)][size_t(i)] = float(0.02 * sum);
+      seed = seed * 1664525u + 1013904223u;
+      noise[size_t(c)][size_t(i)] =
+        0.1f * (float(seed >> 8) / float(1 << 23) - 1.0f);
+    }
+  }
+
+  // the system is linear so speech and noise can be put through separately.
+  // The first block is skipped while the history fills.
+  auto snr = [&](float steering) {
+    std::vector<float> s = combine(speech, steering);
+    std::vector<float> n = combine(noise, steering);
+    s.erase(s.begin(), s.begin() + FRAMES);
+    n.erase(n.begin(), n.begin() + FRAMES);
+    return 10.0 * std::log10(power(s) / power(n));
+  };
+
+  double single = 10.0 * std::log10(power(speech.front()) /
+                                    power(noise.front()));
+  const float none = std::numeric_limits<float>::quiet_NaN();
+  m_quality.append({ "single microphone", single, 0.0 });
+  m_quality.append({ "downmix", snr(none), 0.0 });
+  m_quality.append({ "steered at source", snr(SOURCE_AZIMUTH), 0.0 });
+  m_quality.append({ "steered away", snr(SOURCE_AZIMUTH + 90.0f), 0.0 });
+
+  for (BeamformerQuality& q : m_quality) {
+    q.gainDb = q.snrDb - single;
+  }
+
+  // the ideal is 10log10(4) = 6 dB, linear interpolation costs some of it.
+  if (m_quality.at(2).gainDb < 4.0) {
+    qWarning() << QObject::tr("the steered beamformer gained only %1 dB")
+                    .arg(m_quality.at(2).gainDb, 0, 'f', 2);
+    return false;
+  }
+
+  return true;
+}
+
+/*!
+   \brief Writes the costs and the quality results as comma separated values.
+*/
+bool
+BeamformerBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "channels,downmix_ns_per_sample,beamform_ns_per_sample\n";
+
+  for (const BeamformerCost& c : m_costs) {
+    out << c.channels << ',' << c.downmixNs << ',' << c.beamformNs << '\n';
+  }
+
+  out << "\ncombination,snr_db,gain_db\n";
+
+  for (const BeamformerQuality& q : m_quality) {
+    out << q.name << ',' << q.snrDb << ',' << q.gainDb << '\n';
+  }
+
+  return true;
+}
@@ -0,0 +1,79 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef BEAMFORMERBENCHMARK_H
+#define BEAMFORMERBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+/*!
+  \brief The cost of combining one block size of multi-channel audio, in
+  nanoseconds per input sample, that is per frame per channel.
+*/
+struct BeamformerCost
+{
+  int channels;
+  double downmixNs;
+  double beamformNs;
+};
+
+/*!
+  \brief The SNR of the synthesised array test for one way of combining the
+  channels, and its gain over a single microphone.
+*/
+struct BeamformerQuality
+{
+  QString name;
+  double snrDb;
+  double gainDb;
+};
+
+/*!
+  \class BeamformerBenchmark
+  \brief The BeamformerBenchmark class measures the multi-channel front end.
+
+  The cost of downmix() and DelayAndSumBeamformer is measured per channel at
+  1, 2, 4 and 8 channels. The beamformer is then checked offline on a
+  synthesised four microphone array, a band of tones arriving from one
+  direction with the matching delay on every microphone plus independent
+  noise on each. Steered at the source it should gain close to 6 dB over a
+  single microphone, steered away it should gain much less.
+*/
+class BeamformerBenchmark
+{
+public:
+  BeamformerBenchmark();
+
+  bool run();
+  QVector<BeamformerCost> costs() const;
+  QVector<BeamformerQuality> quality() const;
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QVector<BeamformerCost> m_costs;
+  QVector<BeamformerQuality> m_quality;
+
+  void measureCost(int channels);
+  bool measureQuality();
+};
+
+#endif // BEAMFORMERBENCHMARK_H
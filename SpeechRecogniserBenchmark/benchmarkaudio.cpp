@@ -0,0 +1,235 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QFile>
+#include <QObject>
+#include <QtDebug>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "benchmarkaudio.h"
+#include "detectionpipeline.h"
+#include "wavfile.h"
+
+using namespace SpeechRecognition;
+
+static const int DETECTOR_RATE = 16000;
+
+BenchmarkAudio::BenchmarkAudio()
+  : m_seconds(0)
+{}
+
+/*!
+   \brief Builds seconds of audio. Returns false if the hotword recording
+   could not be read.
+
+   \param noiseAmplitude - the peak noise level in 16 bit steps, zero gives
+   digital silence between hotwords.
+   \param spacing - the seconds between hotword starts.
+*/
+bool
+BenchmarkAudio::build(const QString& resourceDir,
+                      int seconds,
+                      int noiseAmplitude,
+                      int spacing)
+{
+  QFile file(QDir(resourceDir).filePath("snowboy.raw"));
+
+  if (!file.open(QIODevice::ReadOnly)) {
+    qWarning() << QObject::tr("unable to open %1").arg(file.fileName());
+    return false;
+  }
+
+  QByteArray bytes = file.readAll();
+  const int16_t* hotword = reinterpret_cast<const int16_t*>(bytes.constData());
+  size_t hotwordLength = size_t(bytes.size()) / sizeof(int16_t);
+
+  // a fixed seed so every case and every run sees the same noise.
+  quint32 seed = 12345;
+  m_seconds = seconds;
+  m_samples.resize(size_t(seconds * DETECTOR_RATE));
+
+  for (int16_t& sample : m_samples) {
+    seed = seed * 1664525u + 1013904223u;
+    sample = int16_t((int(seed >> 16) - 32768) * noiseAmplitude / 32768);
+  }
+
+  m_hotwordEnds.clear();
+
+  for (size_t start = size_t(DETECTOR_RATE);
+       start + hotwordLength < m_samples.size();
+       start += size_t(spacing * DETECTOR_RATE)) {
+    for (size_t i = 0; i < hotwordLength; i++) {
+      int value = m_samples[start + i] + hotword[i];
+      m_samples[start + i] = int16_t(qBound(-32768, value, 32767));
+    }
+
+    m_hotwordEnds.push_back(start + hotwordLength);
+  }
+
+  return true;
+}
+
+/*!
+   \brief Scales the whole recording by gainDb, clipping at full scale, as
+   a quieter or hotter microphone would have captured it.
+*/
+void
+BenchmarkAudio::scale(float gainDb)
+{
+  const float gain = std::pow(10.0f, gainDb / 20.0f);
+
+  for (int16_t& sample : m_samples) {
+    sample = int16_t(qBound(-32768.0f, std::round(sample * gain), 32767.0f));
+  }
+}
+
+/*!
+   \brief Returns the audio as 16 bit samples.
+*/
+const std::vector<int16_t>&
+BenchmarkAudio::samples() const
+{
+  return m_samples;
+}
+
+/*!
+   \brief Returns the audio as float samples, as MicrophoneReader captures it.
+*/
+std::vector<float>
+BenchmarkAudio::floatSamples() const
+{
+  std::vector<float> result(m_samples.size());
+
+  for (size_t i = 0; i < m_samples.size(); i++) {
+    result[i] = float(m_samples[i]) / 32768.0f;
+  }
+
+  return result;
+}
+
+/*!
+   \brief Returns the sample offsets at which each inserted hotword ends.
+*/
+const std::vector<size_t>&
+BenchmarkAudio::hotwordEnds() const
+{
+  return m_hotwordEnds;
+}
+
+int
+BenchmarkAudio::sampleRate() const
+{
+  return DETECTOR_RATE;
+}
+
+int
+BenchmarkAudio::seconds() const
+{
+  return m_seconds;
+}
+
+/*!
+   \brief Feeds the audio through a pipeline in blocks of blockSize samples,
+   as MicrophoneReader would deliver it, and times and scores the result.
+
+   A detection is matched to the latest hotword that has ended and not yet
+   been matched, anything else counts as a false alarm.
+*/
+ReplayResult
+BenchmarkAudio::replay(DetectionPipeline& pipeline, int blockSize) const
+{
+  ReplayResult result;
+  result.expected = int(m_hotwordEnds.size());
+  std::vector<float> audio = floatSamples();
+  quint64 callsBefore = pipeline.stats().detectionCalls;
+  size_t nextHotword = 0;
+  double totalLatencyMs = 0;
+
+  for (size_t captured = 0; captured < audio.size();) {
+    size_t block = std::min(size_t(blockSize), audio.size() - captured);
+    auto start = std::chrono::steady_clock::now();
+    int hotword = pipeline.process(audio.data() + captured, int(block));
+    std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+    result.busyMs += elapsed.count();
+    captured += block;
+
+    if (hotword <= 0) {
+      continue;
+    }
+
+    bool found = false;
+    size_t latest = 0;
+
+    while (nextHotword < m_hotwordEnds.size() &&
+           m_hotwordEnds[nextHotword] <= captured) {
+      latest = nextHotword++;
+      found = true;
+    }
+
+    if (!found) {
+      result.falseAlarms++;
+      continue;
+    }
+
+    double latencyMs =
+      1000.0 * double(captured - m_hotwordEnds[latest]) / DETECTOR_RATE +
+      elapsed.count();
+    totalLatencyMs += latencyMs;
+    result.maxLatencyMs = std::max(result.maxLatencyMs, latencyMs);
+    result.detections++;
+  }
+
+  result.calls = qint64(pipeline.stats().detectionCalls - callsBefore);
+  result.cpuPercent = 100.0 * result.busyMs / (1000.0 * m_seconds);
+  result.meanLatencyMs =
+    (result.detections > 0 ? totalLatencyMs / result.detections : 0);
+  return result;
+}
+
+/*!
+   \brief Reads a mono WAV file at the detector rate, such as
+   resources/ding.wav, into samples. Returns false if it could not be read
+   or is in another format.
+*/
+bool
+BenchmarkAudio::loadSound(const QString& filename, std::vector<float>& samples)
+{
+  WavFile file;
+
+  if (!file.open(filename)) {
+    return false;
+  }
+
+  if (file.format().channels != 1 ||
+      file.format().sampleRate != DETECTOR_RATE) {
+    qWarning() << QObject::tr("%1 is not 16 kHz mono.").arg(filename);
+    return false;
+  }
+
+  samples.resize(size_t(file.frames()));
+  float* channels[] = { samples.data() };
+  return file.readFrames(0, file.frames(), channels) == file.frames();
+}
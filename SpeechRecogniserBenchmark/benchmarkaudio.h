@@ -0,0 +1,90 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef BENCHMARKAUDIO_H
+#define BENCHMARKAUDIO_H
+
+#include <QString>
+
+#include <vector>
+
+namespace SpeechRecognition {
+class DetectionPipeline;
+}
+
+/*!
+  \brief The outcome of replaying BenchmarkAudio through a pipeline.
+
+  Latency runs from the end of an inserted hotword to the end of the
+  process() call that reported it, counting the time spent waiting for the
+  rest of the block and chunk as if captured live.
+*/
+struct ReplayResult
+{
+  int detections = 0;
+  int falseAlarms = 0;
+  int expected = 0;
+  qint64 calls = 0;
+  double busyMs = 0;
+  double cpuPercent = 0;
+  double meanLatencyMs = 0;
+  double maxLatencyMs = 0;
+};
+
+/*!
+  \class BenchmarkAudio
+  \brief The BenchmarkAudio class builds the labelled test audio shared by
+  the detection benchmarks.
+
+  The audio is 16 kHz mono, low level noise from a fixed seed with
+  resources/snowboy.raw mixed in every spacing seconds, starting after one
+  second. hotwordEnds() holds the sample offset at which each inserted
+  hotword ends, which is where a detection is expected.
+*/
+class BenchmarkAudio
+{
+public:
+  BenchmarkAudio();
+
+  bool build(const QString& resourceDir,
+             int seconds,
+             int noiseAmplitude = 128,
+             int spacing = 4);
+  void scale(float gainDb);
+
+  const std::vector<int16_t>& samples() const;
+  std::vector<float> floatSamples() const;
+  const std::vector<size_t>& hotwordEnds() const;
+  int sampleRate() const;
+  int seconds() const;
+
+  ReplayResult replay(SpeechRecognition::DetectionPipeline& pipeline,
+                      int blockSize) const;
+
+  static bool loadSound(const QString& filename, std::vector<float>& samples);
+
+private:
+  std::vector<int16_t> m_samples;
+  std::vector<size_t> m_hotwordEnds;
+  int m_seconds;
+};
+
+#endif // BENCHMARKAUDIO_H
@@ -0,0 +1,127 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <QtDebug>
+
+#include "chunkpolicybenchmark.h"
+#include "detectionpipeline.h"
+#include "microphonereader.h"
+
+using namespace SpeechRecognition;
+
+ChunkPolicyBenchmark::ChunkPolicyBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+{}
+
+/*!
+   \brief Runs each policy over the same audio. Returns false if the audio or
+   the models could not be loaded.
+*/
+bool
+ChunkPolicyBenchmark::run()
+{
+  m_results.clear();
+
+  if (!m_audio.build(m_resourceDir, 60)) {
+    return false;
+  }
+
+  ChunkPolicyConfig config;
+  ChunkPolicyConfig minimum = config;
+  minimum.fixedChunk = config.minChunk;
+  ChunkPolicyConfig maximum = config;
+  maximum.fixedChunk = config.maxChunk;
+
+  if (!runPolicy("fixed-min", ChunkPolicy(ChunkPolicy::Fixed, minimum)) ||
+      !runPolicy("fixed-default", ChunkPolicy(ChunkPolicy::Fixed, config)) ||
+      !runPolicy("fixed-max", ChunkPolicy(ChunkPolicy::Fixed, maximum)) ||
+      !runPolicy("adaptive", ChunkPolicy(ChunkPolicy::Adaptive, config))) {
+    return false;
+  }
+
+  for (const ChunkPolicyResult& r : m_results) {
+    qInfo().noquote() << QString("%1: cpu %2%, %3 calls, latency mean %4 ms "
+                                 "max %5 ms, %6 of %7 detected")
+                           .arg(r.name, -14)
+                           .arg(r.replay.cpuPercent, 0, 'f', 2)
+                           .arg(r.replay.calls)
+                           .arg(r.replay.meanLatencyMs, 0, 'f', 1)
+                           .arg(r.replay.maxLatencyMs, 0, 'f', 1)
+                           .arg(r.replay.detections)
+                           .arg(r.replay.expected);
+  }
+
+  return true;
+}
+
+QVector<ChunkPolicyResult>
+ChunkPolicyBenchmark::results() const
+{
+  return m_results;
+}
+
+bool
+ChunkPolicyBenchmark::runPolicy(const QString& name, const ChunkPolicy& policy)
+{
+  QDir dir(m_resourceDir);
+  DetectionPipeline pipeline;
+
+  if (!pipeline.setDetector(dir.filePath("common.res"),
+                            dir.filePath("models/snowboy.umdl"))) {
+    return false;
+  }
+
+  pipeline.setChunkPolicy(policy);
+  ChunkPolicyResult result;
+  result.name = name;
+  result.replay = m_audio.replay(pipeline, FRAMES_PER_BUFFER);
+  m_results.append(result);
+  return true;
+}
+
+/*!
+   \brief Writes the results as comma separated values.
+*/
+bool
+ChunkPolicyBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "policy,cpu_percent,calls,mean_latency_ms,max_latency_ms,"
+         "detections,expected\n";
+
+  for (const ChunkPolicyResult& r : m_results) {
+    out << r.name << ',' << r.replay.cpuPercent << ',' << r.replay.calls << ','
+        << r.replay.meanLatencyMs << ',' << r.replay.maxLatencyMs << ','
+        << r.replay.detections << ',' << r.replay.expected << '\n';
+  }
+
+  return true;
+}
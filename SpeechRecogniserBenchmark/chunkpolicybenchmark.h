@@ -0,0 +1,68 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef CHUNKPOLICYBENCHMARK_H
+#define CHUNKPOLICYBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+#include "benchmarkaudio.h"
+#include "chunkpolicy.h"
+
+/*!
+  \brief The cost and latency of one chunk policy over the benchmark audio.
+*/
+struct ChunkPolicyResult
+{
+  QString name;
+  ReplayResult replay;
+};
+
+/*!
+  \class ChunkPolicyBenchmark
+  \brief The ChunkPolicyBenchmark class compares chunk policies on the same
+  audio.
+
+  A minute of BenchmarkAudio is replayed through a DetectionPipeline in
+  FRAMES_PER_BUFFER blocks, exactly as SpeechRecogniser sees the capture,
+  once per policy. The time spent in the pipeline is given as a percentage
+  of the audio length.
+*/
+class ChunkPolicyBenchmark
+{
+public:
+  explicit ChunkPolicyBenchmark(const QString& resourceDir);
+
+  bool run();
+  QVector<ChunkPolicyResult> results() const;
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  BenchmarkAudio m_audio;
+  QVector<ChunkPolicyResult> m_results;
+
+  bool runPolicy(const QString& name,
+                 const SpeechRecognition::ChunkPolicy& policy);
+};
+
+#endif // CHUNKPOLICYBENCHMARK_H
@@ -0,0 +1,201 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QtDebug>
+
+#include <vector>
+
+#include "codecbenchmark.h"
+#include "losslesscodec.h"
+#include "sampleconversion.h"
+#include "wavfile.h"
+
+using namespace SpeechRecognition;
+
+// short files are coded this many times over so the timings mean something.
+static const int MIN_FRAMES = 16000 * 60;
+
+CodecBenchmark::CodecBenchmark(const QString& resourceDir)
+{
+  QDir resources(resourceDir);
+
+  for (const QString& name :
+       resources.entryList(QStringList() << "*.wav", QDir::Files)) {
+    m_files.append(resources.filePath(name));
+  }
+}
+
+/*!
+   \brief Sets the files to measure instead of the resource WAVs.
+*/
+void
+CodecBenchmark::setFiles(const QStringList& files)
+{
+  m_files = files;
+}
+
+/*!
+   \brief Measures every file. Returns false if one could not be read or
+   did not decode exactly.
+*/
+bool
+CodecBenchmark::run()
+{
+  m_results.clear();
+  bool ok = true;
+
+  for (const QString& file : m_files) {
+    ok = measure(file) && ok;
+  }
+
+  return ok && !m_results.isEmpty();
+}
+
+/*!
+   \brief Writes the results as comma separated values.
+*/
+bool
+CodecBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "file,audio_s,ratio,encode_x_realtime,decode_x_realtime,exact\n";
+
+  for (const CodecResult& result : m_results) {
+    out << '"' << result.file << "\"," << result.seconds << ','
+        << result.ratio << ',' << result.encodeRealTime << ','
+        << result.decodeRealTime << ',' << (result.exact ? 1 : 0) << '\n';
+  }
+
+  return true;
+}
+
+bool
+CodecBenchmark::measure(const QString& filename)
+{
+  WavFile wav;
+
+  if (!wav.open(filename)) {
+    return false;
+  }
+
+  const int channels = wav.format().channels;
+  const qint64 frames = wav.frames();
+
+  if (frames == 0) {
+    return false;
+  }
+
+  // the file as 16 bit interleaved, as the recorder hands it over.
+  std::vector<std::vector<float>> planes(size_t(channels),
+                                         std::vector<float>(size_t(frames)));
+  std::vector<float*> planePointers;
+
+  for (auto& plane : planes) {
+    planePointers.push_back(plane.data());
+  }
+
+  wav.readFrames(0, frames, planePointers.data());
+  std::vector<int16_t> samples(size_t(frames) * size_t(channels));
+
+  for (int c = 0; c < channels; c++) {
+    std::vector<int16_t> converted(size_t(frames));
+    convertSamples<SampleFormat::Float32, SampleFormat::Int16>(
+      planes[size_t(c)].data(), converted.data(), size_t(frames));
+
+    for (qint64 i = 0; i < frames; i++) {
+      samples[size_t(i * channels + c)] = converted[size_t(i)];
+    }
+  }
+
+  int passes = int(qMax<qint64>(1, (MIN_FRAMES + frames - 1) / frames));
+  LosslessEncoder encoder(channels, wav.format().sampleRate);
+  QByteArray encoded = encoder.header();
+  QElapsedTimer timer;
+  timer.start();
+
+  for (int pass = 0; pass < passes; pass++) {
+    for (qint64 first = 0; first < frames; first += 512) {
+      int count = int(qMin<qint64>(512, frames - first));
+      encoder.encode(samples.data() + first * channels, count, encoded);
+    }
+  }
+
+  encoder.flush(encoded);
+  double encodeSeconds = timer.nsecsElapsed() / 1.0e9;
+
+  LosslessDecoder decoder;
+
+  if (!decoder.open(encoded.constData(), encoded.size())) {
+    return false;
+  }
+
+  qint64 total = frames * passes;
+  std::vector<std::vector<int16_t>> decoded(
+    size_t(channels), std::vector<int16_t>(size_t(total)));
+  std::vector<int16_t*> decodedPointers;
+
+  for (auto& plane : decoded) {
+    decodedPointers.push_back(plane.data());
+  }
+
+  timer.restart();
+  qint64 read = decoder.readFrames(0, total, decodedPointers.data());
+  double decodeSeconds = timer.nsecsElapsed() / 1.0e9;
+  bool exact = (read == total);
+
+  for (qint64 i = 0; i < read && exact; i++) {
+    for (int c = 0; c < channels; c++) {
+      if (decoded[size_t(c)][size_t(i)] !=
+          samples[size_t((i % frames) * channels + c)]) {
+        exact = false;
+      }
+    }
+  }
+
+  CodecResult result;
+  result.file = QFileInfo(filename).fileName();
+  result.seconds = double(total) / wav.format().sampleRate;
+  result.ratio = double(total) * channels * 2 / encoded.size();
+  result.encodeRealTime = result.seconds / encodeSeconds;
+  result.decodeRealTime = result.seconds / decodeSeconds;
+  result.exact = exact;
+  m_results.append(result);
+
+  qInfo().noquote() << QString("%1: ratio %2, encode x%3, decode x%4%5")
+                         .arg(result.file)
+                         .arg(result.ratio, 0, 'f', 2)
+                         .arg(result.encodeRealTime, 0, 'f', 0)
+                         .arg(result.decodeRealTime, 0, 'f', 0)
+                         .arg(exact ? "" : ", NOT EXACT");
+  return exact;
+}
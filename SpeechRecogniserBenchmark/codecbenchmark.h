@@ -0,0 +1,72 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef CODECBENCHMARK_H
+#define CODECBENCHMARK_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/*!
+  \brief The lossless codec results for one file.
+*/
+struct CodecResult
+{
+  QString file;
+  double seconds;
+  double ratio;
+  double encodeRealTime;
+  double decodeRealTime;
+  bool exact;
+};
+
+/*!
+  \class CodecBenchmark
+  \brief The CodecBenchmark class measures LosslessEncoder and
+  LosslessDecoder on recordings.
+
+  Each file is encoded in 512 frame pushes, as the recorder would, and
+  decoded back in one sequential pass. The compression ratio is the 16 bit
+  PCM size over the encoded size, and throughput is given as multiples of
+  real time on one core, which is also roughly the number of streams of
+  that audio one core can encode. The decoded samples must match exactly.
+
+  The files default to the WAVs in the resources directory.
+*/
+class CodecBenchmark
+{
+public:
+  explicit CodecBenchmark(const QString& resourceDir);
+
+  void setFiles(const QStringList& files);
+
+  bool run();
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QStringList m_files;
+  QVector<CodecResult> m_results;
+
+  bool measure(const QString& filename);
+};
+
+#endif // CODECBENCHMARK_H
@@ -0,0 +1,169 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QFile>
+#include <QTextStream>
+#include <QtDebug>
+
+#include <chrono>
+#include <vector>
+
+#include "conversionbenchmark.h"
+#include "sampleconversion.h"
+
+using namespace SpeechRecognition;
+
+static const size_t SAMPLES = 1 << 20;
+static const double SECONDS = 0.25;
+
+ConversionBenchmark::ConversionBenchmark() {}
+
+/*!
+   \brief Measures every kernel.
+*/
+void
+ConversionBenchmark::run()
+{
+  m_results.clear();
+  measure<SampleFormat::Float32, SampleFormat::Int16>("float32->int16");
+  measure<SampleFormat::Int16, SampleFormat::Float32>("int16->float32");
+  measure<SampleFormat::Float32, SampleFormat::Int32>("float32->int32");
+  measure<SampleFormat::Int32, SampleFormat::Float32>("int32->float32");
+  measure<SampleFormat::Int32, SampleFormat::Int16>("int32->int16");
+  measure<SampleFormat::Int16, SampleFormat::Int32>("int16->int32");
+  measure<SampleFormat::Float32, SampleFormat::Int24>("float32->int24");
+  measure<SampleFormat::Int24, SampleFormat::Float32>("int24->float32");
+  measure<SampleFormat::Int24, SampleFormat::Int16>("int24->int16");
+  measureDeinterleave();
+
+  for (const ConversionResult& r : m_results) {
+    qInfo().noquote() << QString("%1 scalar %2 GB/s, kernel %3 GB/s (x%4)")
+                           .arg(r.name, -24)
+                           .arg(r.scalarGBs, 6, 'f', 2)
+                           .arg(r.vectorGBs, 6, 'f', 2)
+                           .arg(r.vectorGBs / r.scalarGBs, 0, 'f', 1);
+  }
+}
+
+QVector<ConversionResult>
+ConversionBenchmark::results() const
+{
+  return m_results;
+}
+
+/* Runs the kernel repeatedly for SECONDS and returns GB/s.*/
+double
+ConversionBenchmark::throughput(size_t bytes,
+                                const std::function<void()>& kernel)
+{
+  kernel(); // warm the caches and page in the buffers.
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed(0);
+  size_t runs = 0;
+
+  while (elapsed.count() < SECONDS) {
+    kernel();
+    runs++;
+    elapsed = std::chrono::steady_clock::now() - start;
+  }
+
+  return double(bytes) * double(runs) / elapsed.count() / 1.0e9;
+}
+
+template<class From, class To>
+void
+ConversionBenchmark::measure(const QString& name)
+{
+  // filled with in range values of the source format.
+  std::vector<float> reference(SAMPLES);
+  quint32 seed = 1;
+
+  for (float& value : reference) {
+    seed = seed * 1664525u + 1013904223u;
+    value = float(int(seed >> 8) - (1 << 23)) / float(1 << 23);
+  }
+
+  std::vector<uint8_t> src(SAMPLES * size_t(From::bytes) + 32);
+  std::vector<uint8_t> dst(SAMPLES * size_t(To::bytes) + 32);
+  auto in = reinterpret_cast<typename From::Type*>(src.data());
+  auto out = reinterpret_cast<typename To::Type*>(dst.data());
+  convertSamples<SampleFormat::Float32, From>(reference.data(), in, SAMPLES);
+
+  size_t bytes = SAMPLES * size_t(From::bytes + To::bytes);
+  ConversionResult result;
+  result.name = name;
+  result.scalarGBs = throughput(
+    bytes, [&] { convertSamplesScalar<From, To>(in, out, SAMPLES); });
+  result.vectorGBs =
+    throughput(bytes, [&] { convertSamples<From, To>(in, out, SAMPLES); });
+  m_results.append(result);
+}
+
+void
+ConversionBenchmark::measureDeinterleave()
+{
+  std::vector<float> src(SAMPLES);
+  std::vector<float> left(SAMPLES / 2), right(SAMPLES / 2);
+  float* planes[2] = { left.data(), right.data() };
+  const size_t frames = SAMPLES / 2;
+
+  for (size_t i = 0; i < SAMPLES; i++) {
+    src[i] = float(i % 1000) / 1000.0f;
+  }
+
+  size_t bytes = SAMPLES * 2 * sizeof(float);
+  ConversionResult result;
+  result.name = "float32 stereo->planar";
+  result.scalarGBs = throughput(bytes, [&] {
+    for (size_t i = 0; i < frames; i++) {
+      left[i] = src[2 * i];
+      right[i] = src[2 * i + 1];
+    }
+  });
+  result.vectorGBs = throughput(bytes, [&] {
+    interleavedToPlanar<SampleFormat::Float32, SampleFormat::Float32>(
+      src.data(), planes, 2, frames);
+  });
+  m_results.append(result);
+}
+
+/*!
+   \brief Writes the results as comma separated values.
+*/
+bool
+ConversionBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "kernel,scalar_gbs,vector_gbs\n";
+
+  for (const ConversionResult& r : m_results) {
+    out << r.name << ',' << r.scalarGBs << ',' << r.vectorGBs << '\n';
+  }
+
+  return true;
+}
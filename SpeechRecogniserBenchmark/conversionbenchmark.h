@@ -0,0 +1,67 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef CONVERSIONBENCHMARK_H
+#define CONVERSIONBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+#include <functional>
+
+/*!
+  \brief The throughput of one conversion kernel and its scalar reference,
+  in GB/s of input plus output.
+*/
+struct ConversionResult
+{
+  QString name;
+  double scalarGBs;
+  double vectorGBs;
+};
+
+/*!
+  \class ConversionBenchmark
+  \brief The ConversionBenchmark class measures the sample conversion
+  kernels against their scalar loops.
+
+  Each kernel converts a buffer of a million samples, larger than the
+  caches, repeatedly for a fixed time.
+*/
+class ConversionBenchmark
+{
+public:
+  ConversionBenchmark();
+
+  void run();
+  QVector<ConversionResult> results() const;
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QVector<ConversionResult> m_results;
+
+  template<class From, class To>
+  void measure(const QString& name);
+  void measureDeinterleave();
+  static double throughput(size_t bytes, const std::function<void()>& kernel);
+};
+
+#endif // CONVERSIONBENCHMARK_H
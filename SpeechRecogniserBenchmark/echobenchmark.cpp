@@ -0,0 +1,343 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <QtDebug>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "benchmarkaudio.h"
+#include "echobenchmark.h"
+#include "echocanceller.h"
+#include "fft.h"
+#include "microphonereader.h"
+
+using namespace SpeechRecognition;
+
+static const int RATE = 16000;
+static const int SECONDS = 40;
+
+/* The room, the direct path 3 ms out and 200 ms of reflections.*/
+static const int DIRECT_DELAY = 48;
+static const int ROOM_LENGTH = 3200;
+static const double ROOM_GAIN = 0.1;
+
+/* The reference is written in playback callback sized pieces.*/
+static const int PLAYBACK_PIECE = 160;
+
+/* The far end pauses here, long enough to test the reference gap.*/
+static const int PAUSE_START = 20 * RATE;
+static const int PAUSE_END = 23 * RATE;
+
+/* Where the filter has surely converged and the ERLE is measured from.*/
+static const int SETTLED = 5 * RATE;
+
+static const double CPU_BUDGET_PERCENT = 2.0;
+
+/* Convolves signal with response using the FFT, overlap add.*/
+static std::vector<float>
+convolve(const std::vector<float>& signal, const std::vector<float>& response)
+{
+  const int block = 4096;
+  Fft fft(2 * block);
+  const size_t bins = size_t(fft.bins());
+  std::vector<float> time(size_t(fft.size()), 0.0f);
+  std::vector<float> hr(bins), hi(bins), xr(bins), xi(bins), yr(bins), yi(bins);
+  std::copy(response.begin(), response.end(), time.begin());
+  fft.forward(time.data(), hr.data(), hi.data());
+  std::vector<float> result(signal.size() + size_t(2 * block), 0.0f);
+
+  for (size_t start = 0; start < signal.size(); start += size_t(block)) {
+    size_t length = std::min(size_t(block), signal.size() - start);
+    std::fill(time.begin(), time.end(), 0.0f);
+    std::copy(signal.begin() + long(start),
+              signal.begin() + long(start + length),
+              time.begin());
+    fft.forward(time.data(), xr.data(), xi.data());
+    std::fill(yr.begin(), yr.end(), 0.0f);
+    std::fill(yi.begin(), yi.end(), 0.0f);
+    Fft::multiplyAccumulate(xr.data(),
+                            xi.data(),
+                            hr.data(),
+                            hi.data(),
+                            yr.data(),
+                            yi.data(),
+                            int(bins));
+    fft.inverse(yr.data(), yi.data(), time.data());
+
+    for (int i = 0; i < fft.size(); i++) {
+      result[start + size_t(i)] += time[size_t(i)];
+    }
+  }
+
+  result.resize(signal.size());
+  return result;
+}
+
+EchoBenchmark::EchoBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+{}
+
+/*!
+   \brief Builds the audio and cancels its echo with each tail length.
+   Returns false if the sounds could not be loaded or a tail is over the
+   CPU budget.
+*/
+bool
+EchoBenchmark::run()
+{
+  m_results.clear();
+  QDir dir(m_resourceDir);
+  std::vector<float> ding, dong, hotword;
+
+  if (!BenchmarkAudio::loadSound(dir.filePath("ding.wav"), ding) ||
+      !BenchmarkAudio::loadSound(dir.filePath("dong.wav"), dong) ||
+      !BenchmarkAudio::loadSound(dir.filePath("snowboy.wav"), hotword)) {
+    return false;
+  }
+
+  const size_t length = size_t(SECONDS * RATE);
+  quint32 seed = 4242;
+  auto random = [&seed]() {
+    seed = seed * 1664525u + 1013904223u;
+    return float(int(seed >> 16) - 32768) / 32768.0f;
+  };
+
+  // the far end, noise shaped like speech, syllables at 4 Hz in phrases,
+  // with the acknowledgement sounds over it.
+  std::vector<float> far(length, 0.0f);
+  float low = 0.0f, lower = 0.0f;
+
+  for (size_t i = 0; i < length; i++) {
+    low += 0.2f * (random() - low);
+    lower += 0.2f * (low - lower);
+    double t = double(i) / RATE;
+    double syllable = 0.5 + 0.5 * std::sin(2.0 * M_PI * 4.0 * t);
+    bool phrase = std::fmod(t, 2.5) < 2.1;
+    far[i] = (phrase ? float(syllable * syllable) * 2.0f * lower : 0.0f);
+  }
+
+  for (size_t at = size_t(RATE); at + dong.size() < length;
+       at += size_t(3 * RATE)) {
+    const std::vector<float>& sound = ((at / size_t(RATE)) % 2 ? ding : dong);
+
+    for (size_t i = 0; i < sound.size(); i++) {
+      far[at + i] += 0.5f * sound[i];
+    }
+  }
+
+  std::fill(far.begin() + PAUSE_START, far.begin() + PAUSE_END, 0.0f);
+
+  // the room, scaled to the wanted echo return loss.
+  std::vector<float> room(size_t(ROOM_LENGTH), 0.0f);
+  room[DIRECT_DELAY] = 1.0f;
+
+  for (int i = DIRECT_DELAY + 32; i < ROOM_LENGTH; i++) {
+    room[size_t(i)] = 0.5f * random() * std::exp(-6.9f * i / ROOM_LENGTH);
+  }
+
+  double roomEnergy = 0.0;
+
+  for (float tap : room) {
+    roomEnergy += double(tap) * tap;
+  }
+
+  for (float& tap : room) {
+    tap *= float(std::sqrt(ROOM_GAIN / roomEnergy));
+  }
+
+  std::vector<float> echo = convolve(far, room);
+
+  // the near end, hotwords and a little noise.
+  std::vector<float> nearEnd(length, 0.0f);
+  std::vector<bool> talking(length, false);
+
+  for (int second : { 7, 14, 21, 27, 35 }) {
+    size_t at = size_t(second * RATE);
+
+    for (size_t i = 0; i < hotword.size(); i++) {
+      nearEnd[at + i] = hotword[i];
+      talking[at + i] = true;
+    }
+  }
+
+  for (float& sample : nearEnd) {
+    sample += 0.0005f * random();
+  }
+
+  std::vector<float> capture(length);
+
+  for (size_t i = 0; i < length; i++) {
+    capture[i] = echo[i] + nearEnd[i];
+  }
+
+  // how the hotwords fare with nothing done.
+  double speech = 0.0, damage = 0.0;
+
+  for (size_t i = 0; i < length; i++) {
+    if (talking[i]) {
+      speech += double(nearEnd[i]) * nearEnd[i];
+      damage += double(echo[i]) * echo[i];
+    }
+  }
+
+  qInfo().noquote() << QString("near end SNR without cancelling %1 dB")
+                         .arg(10.0 * std::log10(speech / damage), 0, 'f', 1);
+  bool ok = true;
+
+  for (int tail : { 64, 128, 256 }) {
+    EchoCancellerConfig config;
+    config.tailMs = tail;
+    EchoCanceller canceller(RATE, config);
+    std::vector<float> output = capture;
+    const qint64 start = 1000000000;
+    auto timeOf = [start](size_t sample) {
+      return start + qint64(sample) * 1000000000 / RATE;
+    };
+    size_t played = 0;
+    double busyUs = 0.0;
+
+    for (size_t captured = 0; captured + FRAMES_PER_BUFFER <= length;
+         captured += FRAMES_PER_BUFFER) {
+      // the player is always a little ahead of the microphone.
+      while (played < captured + 2 * FRAMES_PER_BUFFER && played < length) {
+        if (played < size_t(PAUSE_START) || played >= size_t(PAUSE_END)) {
+          canceller.writeReference(
+            far.data() + played, PLAYBACK_PIECE, timeOf(played));
+        }
+
+        played += PLAYBACK_PIECE;
+      }
+
+      auto begin = std::chrono::steady_clock::now();
+      canceller.process(
+        output.data() + captured, FRAMES_PER_BUFFER, timeOf(captured));
+      std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - begin;
+      busyUs += elapsed.count();
+    }
+
+    EchoResult result;
+    result.tailMs = tail;
+    result.partitions = canceller.partitions();
+    result.estimatedErleDb = canceller.erleDb();
+    result.doubleTalkBlocks = canceller.doubleTalkBlocks();
+    result.blockUs = busyUs / qMax(1ULL, canceller.blocks());
+    result.cpuPercent = 100.0 * busyUs / (1.0e6 * SECONDS);
+    result.convergenceMs = -1.0;
+
+    // the residual is whatever is left that is not the near end.
+    double echoEnergy = 0.0, residualEnergy = 0.0;
+    double speechEnergy = 0.0, speechDamage = 0.0;
+    const size_t window = size_t(RATE / 10);
+
+    for (size_t from = 0; from + window <= length; from += window) {
+      double windowEcho = 0.0, windowResidual = 0.0;
+      bool farOnly = true;
+
+      for (size_t i = from; i < from + window; i++) {
+        double residual = double(output[i]) - nearEnd[i];
+
+        if (talking[i]) {
+          speechEnergy += double(nearEnd[i]) * nearEnd[i];
+          speechDamage += residual * residual;
+          farOnly = false;
+        }
+
+        windowEcho += double(echo[i]) * echo[i];
+        windowResidual += residual * residual;
+      }
+
+      if (!farOnly || windowEcho < 1.0e-6 * window) {
+        continue;
+      }
+
+      if (result.convergenceMs < 0 && windowEcho > 100.0 * windowResidual) {
+        result.convergenceMs = 1000.0 * double(from + window) / RATE;
+      }
+
+      if (from >= size_t(SETTLED)) {
+        echoEnergy += windowEcho;
+        residualEnergy += windowResidual;
+      }
+    }
+
+    result.erleDb = 10.0 * std::log10(echoEnergy / residualEnergy);
+    result.nearEndSnrDb = 10.0 * std::log10(speechEnergy / speechDamage);
+    bool withinBudget = (result.cpuPercent <= CPU_BUDGET_PERCENT);
+    ok = ok && withinBudget;
+
+    qInfo().noquote()
+      << QString("tail %1 ms (%2 partitions): ERLE %3 dB (estimated %4 dB), "
+                 "20 dB after %5 ms, near end SNR %6 dB, %7 double talk "
+                 "blocks, %8 us per block, cpu %9%%10")
+           .arg(tail, 3)
+           .arg(result.partitions)
+           .arg(result.erleDb, 0, 'f', 1)
+           .arg(result.estimatedErleDb, 0, 'f', 1)
+           .arg(result.convergenceMs, 0, 'f', 0)
+           .arg(result.nearEndSnrDb, 0, 'f', 1)
+           .arg(result.doubleTalkBlocks)
+           .arg(result.blockUs, 0, 'f', 1)
+           .arg(result.cpuPercent, 0, 'f', 3)
+           .arg(withinBudget ? "" : " OVER BUDGET");
+    m_results.append(result);
+  }
+
+  return ok;
+}
+
+QVector<EchoResult>
+EchoBenchmark::results() const
+{
+  return m_results;
+}
+
+/*!
+   \brief Writes the results as comma separated values.
+*/
+bool
+EchoBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "tail_ms,partitions,erle_db,estimated_erle_db,convergence_ms,"
+         "near_end_snr_db,double_talk_blocks,block_us,cpu_percent\n";
+
+  for (const EchoResult& r : m_results) {
+    out << r.tailMs << ',' << r.partitions << ',' << r.erleDb << ','
+        << r.estimatedErleDb << ',' << r.convergenceMs << ','
+        << r.nearEndSnrDb << ',' << r.doubleTalkBlocks << ',' << r.blockUs
+        << ',' << r.cpuPercent << '\n';
+  }
+
+  return true;
+}
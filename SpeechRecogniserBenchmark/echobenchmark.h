@@ -0,0 +1,76 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef ECHOBENCHMARK_H
+#define ECHOBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+/*!
+  \brief The outcome of cancelling the echo with one tail length.
+*/
+struct EchoResult
+{
+  int tailMs;
+  int partitions;
+  double erleDb;
+  double estimatedErleDb;
+  double nearEndSnrDb;
+  double convergenceMs;
+  double blockUs;
+  double cpuPercent;
+  unsigned long long doubleTalkBlocks;
+};
+
+/*!
+  \class EchoBenchmark
+  \brief The EchoBenchmark class measures how much echo the EchoCanceller
+  removes and what it costs.
+
+  The far end, standing in for media, is speech shaped noise with
+  resources/ding.wav and dong.wav over it. It is played through a synthetic
+  room, a direct path and 200 ms of decaying reflections 10 dB down, and
+  resources/snowboy.wav is spoken over the echo now and then at the near
+  end. The reference is written in 10 ms pieces stamped with their
+  playback time and the capture is processed in MicrophoneReader sized
+  blocks, as it would be live.
+
+  Since the echo is known exactly, the ERLE is measured on the true
+  residual once the filter has converged, alongside the canceller's own
+  estimate. The near end SNR shows how much the hotwords are damaged. The
+  run fails if any tail costs more than the 2% of a core budgeted.
+*/
+class EchoBenchmark
+{
+public:
+  explicit EchoBenchmark(const QString& resourceDir);
+
+  bool run();
+  QVector<EchoResult> results() const;
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  QVector<EchoResult> m_results;
+};
+
+#endif // ECHOBENCHMARK_H
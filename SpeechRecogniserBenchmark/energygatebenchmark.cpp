@@ -0,0 +1,138 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <QtDebug>
+
+#include "detectionpipeline.h"
+#include "energygatebenchmark.h"
+#include "microphonereader.h"
+
+using namespace SpeechRecognition;
+
+EnergyGateBenchmark::EnergyGateBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+{}
+
+/*!
+   \brief Runs every noise level with and without the gate. Returns false if
+   the audio or the models could not be loaded.
+*/
+bool
+EnergyGateBenchmark::run()
+{
+  m_results.clear();
+  QDir dir(m_resourceDir);
+
+  for (int noise : { 0, 32, 128, 512, 2048 }) {
+    BenchmarkAudio audio;
+
+    if (!audio.build(m_resourceDir, 60, noise)) {
+      return false;
+    }
+
+    EnergyGateResult result;
+    result.noiseAmplitude = noise;
+
+    for (bool gate : { false, true }) {
+      DetectionPipeline pipeline;
+
+      if (!pipeline.setDetector(dir.filePath("common.res"),
+                                dir.filePath("models/snowboy.umdl"))) {
+        return false;
+      }
+
+      pipeline.setChunkPolicy(ChunkPolicy(ChunkPolicy::Fixed));
+      pipeline.setEnergyGateEnabled(gate);
+      ReplayResult replay = audio.replay(pipeline, FRAMES_PER_BUFFER);
+
+      if (gate) {
+        result.gated = replay;
+        result.blocks = pipeline.stats().blocks;
+        result.gatedBlocks = pipeline.stats().gatedBlocks;
+
+      } else {
+        result.ungated = replay;
+      }
+    }
+
+    qint64 avoided = result.ungated.calls - result.gated.calls;
+    double avoidedPercent =
+      100.0 * avoided / qMax<qint64>(1, result.ungated.calls);
+    qInfo().noquote()
+      << QString("noise %1: %2 of %3 detector/VAD calls avoided (%4%), "
+                 "%5 of %6 blocks gated, recall %7/%8 -> %9/%10, "
+                 "cpu %11% -> %12%")
+           .arg(noise, 4)
+           .arg(avoided)
+           .arg(result.ungated.calls)
+           .arg(avoidedPercent, 0, 'f', 1)
+           .arg(result.gatedBlocks)
+           .arg(result.blocks)
+           .arg(result.ungated.detections)
+           .arg(result.ungated.expected)
+           .arg(result.gated.detections)
+           .arg(result.gated.expected)
+           .arg(result.ungated.cpuPercent, 0, 'f', 2)
+           .arg(result.gated.cpuPercent, 0, 'f', 2);
+    m_results.append(result);
+  }
+
+  return true;
+}
+
+QVector<EnergyGateResult>
+EnergyGateBenchmark::results() const
+{
+  return m_results;
+}
+
+/*!
+   \brief Writes the results as comma separated values.
+*/
+bool
+EnergyGateBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "noise,calls_ungated,calls_gated,blocks,gated_blocks,"
+         "detections_ungated,detections_gated,expected,"
+         "false_alarms_ungated,false_alarms_gated,cpu_ungated,cpu_gated\n";
+
+  for (const EnergyGateResult& r : m_results) {
+    out << r.noiseAmplitude << ',' << r.ungated.calls << ',' << r.gated.calls
+        << ',' << r.blocks << ',' << r.gatedBlocks << ','
+        << r.ungated.detections << ',' << r.gated.detections << ','
+        << r.ungated.expected << ',' << r.ungated.falseAlarms << ','
+        << r.gated.falseAlarms << ',' << r.ungated.cpuPercent << ','
+        << r.gated.cpuPercent << '\n';
+  }
+
+  return true;
+}
@@ -0,0 +1,66 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef ENERGYGATEBENCHMARK_H
+#define ENERGYGATEBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+#include "benchmarkaudio.h"
+
+/*!
+  \brief The effect of the energy gate at one noise level.
+*/
+struct EnergyGateResult
+{
+  int noiseAmplitude;
+  ReplayResult ungated;
+  ReplayResult gated;
+  quint64 blocks;
+  quint64 gatedBlocks;
+};
+
+/*!
+  \class EnergyGateBenchmark
+  \brief The EnergyGateBenchmark class reports how much detector work the
+  EnergyGate avoids and what it costs in recall.
+
+  At each noise level the same BenchmarkAudio is replayed through a
+  DetectionPipeline twice, once without the gate and once with it. Every
+  RunDetection() call includes snowboy's own VAD, so the drop in calls is
+  the number of VAD invocations avoided.
+*/
+class EnergyGateBenchmark
+{
+public:
+  explicit EnergyGateBenchmark(const QString& resourceDir);
+
+  bool run();
+  QVector<EnergyGateResult> results() const;
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  QVector<EnergyGateResult> m_results;
+};
+
+#endif // ENERGYGATEBENCHMARK_H
@@ -0,0 +1,180 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QFile>
+#include <QTextStream>
+#include <QtDebug>
+
+#include <chrono>
+
+#include "benchmarkaudio.h"
+#include "featurebenchmark.h"
+#include "featureextractor.h"
+#include "microphonereader.h"
+
+using namespace SpeechRecognition;
+
+static const int SECONDS = 60;
+static const int READERS = 4;
+static const double CPU_BUDGET_PERCENT = 1.0;
+static const size_t MEMORY_BUDGET = 128 * 1024;
+
+FeatureBenchmark::FeatureBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+{}
+
+/*!
+   \brief Runs each configuration over the audio. Returns false if the
+   audio could not be built or a configuration was over budget.
+*/
+bool
+FeatureBenchmark::run()
+{
+  m_results.clear();
+  BenchmarkAudio audio;
+
+  if (!audio.build(m_resourceDir, SECONDS, 64)) {
+    return false;
+  }
+
+  const std::vector<float> capture = audio.floatSamples();
+  struct Case
+  {
+    const char* name;
+    int melBands;
+    int cepstra;
+  };
+  const Case cases[] = {
+    { "logmel40", 40, 0 },
+    { "mfcc13", 40, 13 },
+    { "logmel80", 80, 0 },
+  };
+  bool ok = true;
+
+  for (const Case& c : cases) {
+    FeatureConfig config;
+    config.sampleRate = audio.sampleRate();
+    config.melBands = c.melBands;
+    config.cepstra = c.cepstra;
+    FeatureExtractor extractor(config);
+    std::vector<FeatureReader> readers;
+
+    for (int r = 0; r < READERS; r++) {
+      readers.emplace_back(extractor.ring());
+    }
+
+    std::vector<float> frame(size_t(extractor.frameSize()));
+    double computeNs = 0, readNs = 0;
+    quint64 reads = 0;
+
+    for (size_t captured = 0; captured + FRAMES_PER_BUFFER <= capture.size();
+         captured += FRAMES_PER_BUFFER) {
+      auto start = std::chrono::steady_clock::now();
+      extractor.process(capture.data() + captured, FRAMES_PER_BUFFER);
+      auto computed = std::chrono::steady_clock::now();
+
+      for (FeatureReader& reader : readers) {
+        while (reader.next(frame.data())) {
+          reads++;
+        }
+      }
+
+      std::chrono::duration<double, std::nano> compute = computed - start;
+      std::chrono::duration<double, std::nano> read =
+        std::chrono::steady_clock::now() - computed;
+      computeNs += compute.count();
+      readNs += read.count();
+    }
+
+    FeatureResult result;
+    result.name = c.name;
+    result.melBands = c.melBands;
+    result.cepstra = c.cepstra;
+    result.frames = extractor.frames();
+    result.frameNs = computeNs / qMax<quint64>(1, result.frames);
+    result.readNs = readNs / qMax<quint64>(1, reads);
+    result.cpuPercent = 100.0 * computeNs * 1.0e-9 / audio.seconds();
+    result.memoryBytes = extractor.memoryBytes();
+    result.ringBytes = extractor.ring()->memoryBytes();
+
+    for (const FeatureReader& reader : readers) {
+      result.lostFrames += reader.lost();
+    }
+
+    bool withinBudget = (result.cpuPercent <= CPU_BUDGET_PERCENT &&
+                         result.memoryBytes <= MEMORY_BUDGET);
+    ok = ok && withinBudget;
+    double shared = result.frameNs + READERS * result.readNs;
+    double separate = READERS * result.frameNs;
+
+    qInfo().noquote()
+      << QString("%1: %2 frames, %3 us a frame, %4 ns a read, cpu %5%, "
+                 "%6 KiB (ring %7 KiB), %8 readers sharing it cost %9% of "
+                 "computing their own%10")
+           .arg(result.name, -8)
+           .arg(result.frames)
+           .arg(result.frameNs / 1000.0, 0, 'f', 2)
+           .arg(result.readNs, 0, 'f', 0)
+           .arg(result.cpuPercent, 0, 'f', 3)
+           .arg(result.memoryBytes / 1024.0, 0, 'f', 1)
+           .arg(result.ringBytes / 1024.0, 0, 'f', 1)
+           .arg(READERS)
+           .arg(100.0 * shared / separate, 0, 'f', 0)
+           .arg(withinBudget ? "" : " OVER BUDGET");
+    m_results.append(result);
+  }
+
+  return ok;
+}
+
+QVector<FeatureResult>
+FeatureBenchmark::results() const
+{
+  return m_results;
+}
+
+/*!
+   \brief Writes the results as comma separated values, one row per
+   configuration.
+*/
+bool
+FeatureBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "name,mel_bands,cepstra,frames,frame_ns,read_ns,cpu_percent,"
+         "memory_bytes,ring_bytes,lost_frames\n";
+
+  for (const FeatureResult& r : m_results) {
+    out << r.name << ',' << r.melBands << ',' << r.cepstra << ','
+        << r.frames << ',' << r.frameNs << ',' << r.readNs << ','
+        << r.cpuPercent << ',' << r.memoryBytes << ',' << r.ringBytes << ','
+        << r.lostFrames << '\n';
+  }
+
+  return true;
+}
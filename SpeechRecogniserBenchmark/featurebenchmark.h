@@ -0,0 +1,75 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef FEATUREBENCHMARK_H
+#define FEATUREBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+/*!
+  \brief The cost of one FeatureExtractor configuration.
+*/
+struct FeatureResult
+{
+  QString name;
+  int melBands = 0;
+  int cepstra = 0;
+  quint64 frames = 0;
+  //! The time to compute one frame.
+  double frameNs = 0;
+  //! The time for one reader to copy one frame out of the ring.
+  double readNs = 0;
+  double cpuPercent = 0;
+  //! The extractor's tables and scratch and its ring.
+  size_t memoryBytes = 0;
+  size_t ringBytes = 0;
+  quint64 lostFrames = 0;
+};
+
+/*!
+  \class FeatureBenchmark
+  \brief The FeatureBenchmark class reports what FeatureExtractor costs a
+  stream for log mel and MFCC frames: the time per frame, the share of a
+  core, the memory, and the time for each reader of its FeatureRing.
+
+  BenchmarkAudio is fed through each configuration in capture blocks,
+  with four readers draining the ring after each block as the energy
+  gate, a VAD, analytics and a detector might. Computing once and reading
+  four times is compared with four consumers each computing their own.
+  The run fails if any configuration costs more than 1% of a core or
+  128 KiB.
+*/
+class FeatureBenchmark
+{
+public:
+  explicit FeatureBenchmark(const QString& resourceDir);
+
+  bool run();
+  QVector<FeatureResult> results() const;
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  QVector<FeatureResult> m_results;
+};
+
+#endif // FEATUREBENCHMARK_H
@@ -0,0 +1,165 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QEventLoop>
+#include <QFile>
+#include <QTextStream>
+#include <QTimer>
+#include <QtDebug>
+
+#include <algorithm>
+
+#include "feedbackbenchmark.h"
+#include "feedbackplayer.h"
+#include "fileaudiosource.h"
+#include "speechrecogniser.h"
+
+using namespace SpeechRecognition;
+
+// the acknowledgement budget in milliseconds.
+static const double BUDGET_MS = 50.0;
+
+FeedbackBenchmark::FeedbackBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+  , m_loops(10)
+  , m_outputLatency(0)
+  , m_sampleRate(0)
+  , m_underflows(0)
+{}
+
+/*!
+   \brief Sets the number of times the recording is played, and so about
+   how many sounds are measured. Defaults to 10.
+*/
+void
+FeedbackBenchmark::setLoops(int loops)
+{
+  m_loops = qMax(1, loops);
+}
+
+/*!
+   \brief Runs the replay. Returns false if the output device, the sounds
+   or the models could not be opened, or a latency was over budget.
+*/
+bool
+FeedbackBenchmark::run()
+{
+  QDir resources(m_resourceDir);
+  FeedbackPlayer player;
+  int ding = player.addSound(resources.filePath("ding.wav"));
+
+  if (ding < 0 || !player.open()) {
+    return false;
+  }
+
+  m_outputLatency = player.outputLatency();
+  m_sampleRate = player.settings().sampleRate;
+  m_latencies.clear();
+
+  FileAudioSource* source = new FileAudioSource;
+
+  if (!source->open(resources.filePath("snowboy.wav"))) {
+    delete source;
+    return false;
+  }
+
+  source->setLoops(m_loops);
+
+  QEventLoop loop;
+  QObject::connect(source, &AudioSource::finished, &loop, &QEventLoop::quit);
+  QObject::connect(&player,
+                   &FeedbackPlayer::played,
+                   &loop,
+                   [this](int, qint64 requested, qint64 firstSample) {
+                     m_latencies.append((firstSample - requested) / 1.0e6);
+                   });
+
+  SpeechRecogniser recogniser(source, nullptr);
+
+  if (!recogniser.setDetector(resources.filePath("common.res"),
+                              resources.filePath("models/snowboy.umdl"))) {
+    recogniser.stop();
+    return false;
+  }
+
+  // straight from the detection thread, no event loop in between.
+  QObject::connect(
+    &recogniser,
+    &SpeechRecogniser::hotwordDetected,
+    &player,
+    [&player, ding](int) { player.play(ding); },
+    Qt::DirectConnection);
+
+  loop.exec();
+
+  // let the last sound start.
+  QEventLoop tail;
+  QTimer::singleShot(500, &tail, &QEventLoop::quit);
+  tail.exec();
+  m_underflows = player.underflowCount();
+  player.close();
+
+  if (m_latencies.isEmpty()) {
+    qWarning() << QObject::tr("nothing was detected");
+    return false;
+  }
+
+  QVector<double> sorted = m_latencies;
+  std::sort(sorted.begin(), sorted.end());
+  double median = sorted[sorted.size() / 2];
+  double worst = sorted.last();
+
+  qInfo().noquote()
+    << QString("%1 sounds at %2 Hz, output latency %3 ms, detection to "
+               "first sample median %4 ms, worst %5 ms, %6 underflows")
+         .arg(sorted.size())
+         .arg(m_sampleRate)
+         .arg(m_outputLatency * 1000.0, 0, 'f', 1)
+         .arg(median, 0, 'f', 1)
+         .arg(worst, 0, 'f', 1)
+         .arg(m_underflows);
+  return worst <= BUDGET_MS;
+}
+
+/*!
+   \brief Writes each latency as comma separated values.
+*/
+bool
+FeedbackBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "sound,latency_ms,output_latency_ms,sample_rate,underflows\n";
+
+  for (int i = 0; i < m_latencies.size(); i++) {
+    out << i << ',' << m_latencies[i] << ',' << m_outputLatency * 1000.0
+        << ',' << m_sampleRate << ',' << m_underflows << '\n';
+  }
+
+  return true;
+}
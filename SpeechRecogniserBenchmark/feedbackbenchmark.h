@@ -0,0 +1,60 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef FEEDBACKBENCHMARK_H
+#define FEEDBACKBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+/*!
+  \class FeedbackBenchmark
+  \brief The FeedbackBenchmark class measures the time from a hotword
+  detection to the first sample of the acknowledgement sound reaching the
+  speaker.
+
+  resources/snowboy.wav is replayed in real time through a SpeechRecogniser
+  and every detection plays ding.wav through a FeedbackPlayer, straight
+  from the detection thread. The player stamps each request and maps the
+  DAC time of the buffer that starts the sound onto the same clock. The
+  run fails if any latency is over the 50 ms budget. It needs a working
+  default output device.
+*/
+class FeedbackBenchmark
+{
+public:
+  explicit FeedbackBenchmark(const QString& resourceDir);
+
+  void setLoops(int loops);
+
+  bool run();
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  int m_loops;
+  double m_outputLatency;
+  double m_sampleRate;
+  quint64 m_underflows;
+  QVector<double> m_latencies;
+};
+
+#endif // FEEDBACKBENCHMARK_H
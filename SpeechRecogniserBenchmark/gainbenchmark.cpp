@@ -0,0 +1,161 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <QtDebug>
+
+#include <chrono>
+
+#include "detectionpipeline.h"
+#include "gainbenchmark.h"
+#include "microphonereader.h"
+
+using namespace SpeechRecognition;
+
+/* The ways the gain is applied, in the order they are run.*/
+enum Mode
+{
+  Off,
+  Samples,
+  Detector,
+};
+
+static const char* const MODE_NAMES[] = { "off", "samples", "detector" };
+
+GainBenchmark::GainBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+{}
+
+/*!
+   \brief Runs every microphone level in every mode. Returns false if the
+   audio or the models could not be loaded.
+*/
+bool
+GainBenchmark::run()
+{
+  m_results.clear();
+  QDir dir(m_resourceDir);
+
+  for (int microphoneDb : { -30, -20, -10, 0, 6, 12 }) {
+    BenchmarkAudio audio;
+
+    if (!audio.build(m_resourceDir, 60, 64)) {
+      return false;
+    }
+
+    audio.scale(float(microphoneDb));
+
+    // the gain control by itself, blocked as the pipeline would see it.
+    std::vector<float> samples = audio.floatSamples();
+    GainControl timed(audio.sampleRate());
+    size_t blocks = samples.size() / FRAMES_PER_BUFFER;
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t block = 0; block < blocks; block++) {
+      timed.process(samples.data() + block * FRAMES_PER_BUFFER,
+                    FRAMES_PER_BUFFER);
+    }
+
+    std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+    for (Mode mode : { Off, Samples, Detector }) {
+      DetectionPipeline pipeline;
+
+      if (!pipeline.setDetector(dir.filePath("common.res"),
+                                dir.filePath("models/snowboy.umdl"))) {
+        return false;
+      }
+
+      pipeline.setChunkPolicy(ChunkPolicy(ChunkPolicy::Fixed));
+      pipeline.setGainControlEnabled(mode != Off);
+      pipeline.gainControl().setMode(
+        mode == Detector ? GainControl::Detector : GainControl::Samples);
+
+      GainResult result;
+      result.microphoneDb = microphoneDb;
+      result.mode = MODE_NAMES[mode];
+      result.replay = audio.replay(pipeline, FRAMES_PER_BUFFER);
+
+      if (mode != Off) {
+        const GainControl& agc = pipeline.gainControl();
+        result.gainDb = agc.gainDb();
+        result.speechLevelDb = agc.speechLevelDb();
+        result.speechBlocks = agc.speechBlocks();
+        result.limitedBlocks = agc.limitedBlocks();
+        result.blockNs = elapsed.count() / qMax<size_t>(1, blocks);
+      }
+
+      qInfo().noquote()
+        << QString("microphone %1 dB %2: recall %3/%4, false alarms %5, "
+                   "gain %6 dB, speech %7 dBFS, %8 blocks limited, "
+                   "%9 ns a block")
+             .arg(microphoneDb, 3)
+             .arg(result.mode, -8)
+             .arg(result.replay.detections)
+             .arg(result.replay.expected)
+             .arg(result.replay.falseAlarms)
+             .arg(result.gainDb, 0, 'f', 1)
+             .arg(result.speechLevelDb, 0, 'f', 1)
+             .arg(result.limitedBlocks)
+             .arg(result.blockNs, 0, 'f', 0);
+      m_results.append(result);
+    }
+  }
+
+  return true;
+}
+
+QVector<GainResult>
+GainBenchmark::results() const
+{
+  return m_results;
+}
+
+/*!
+   \brief Writes the results as comma separated values.
+*/
+bool
+GainBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "microphone_db,mode,detections,expected,false_alarms,cpu,gain_db,"
+         "speech_level_db,speech_blocks,limited_blocks,block_ns\n";
+
+  for (const GainResult& r : m_results) {
+    out << r.microphoneDb << ',' << r.mode << ',' << r.replay.detections
+        << ',' << r.replay.expected << ',' << r.replay.falseAlarms << ','
+        << r.replay.cpuPercent << ',' << r.gainDb << ',' << r.speechLevelDb
+        << ',' << r.speechBlocks << ',' << r.limitedBlocks << ','
+        << r.blockNs << '\n';
+  }
+
+  return true;
+}
@@ -0,0 +1,70 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef GAINBENCHMARK_H
+#define GAINBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+#include "benchmarkaudio.h"
+
+/*!
+  \brief The outcome of one gain control mode at one microphone level.
+*/
+struct GainResult
+{
+  int microphoneDb = 0;
+  QString mode;
+  ReplayResult replay;
+  double gainDb = 0;
+  double speechLevelDb = 0;
+  quint64 speechBlocks = 0;
+  quint64 limitedBlocks = 0;
+  double blockNs = 0;
+};
+
+/*!
+  \class GainBenchmark
+  \brief The GainBenchmark class measures how well the GainControl keeps
+  detection working with weak and hot microphones.
+
+  BenchmarkAudio is scaled from 30 dB below its recorded level to 12 dB
+  above it, where it clips, and replayed through a DetectionPipeline
+  without gain control, with the gain on the samples and with the gain
+  passed to the detector. Each run reports recall, the gain it settled on
+  and what a GainControl::process() call costs, measured on its own.
+*/
+class GainBenchmark
+{
+public:
+  explicit GainBenchmark(const QString& resourceDir);
+
+  bool run();
+  QVector<GainResult> results() const;
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  QVector<GainResult> m_results;
+};
+
+#endif // GAINBENCHMARK_H
@@ -0,0 +1,418 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QtDebug>
+
+#include <algorithm>
+#include <cmath>
+
+#include "benchmarkaudio.h"
+#include "detectionpipeline.h"
+#include "goldenbenchmark.h"
+#include "microphonereader.h"
+#include "suitebenchmark.h"
+
+using namespace SpeechRecognition;
+
+// written baselines leave this much room for an ordinary slow run.
+static const double BASELINE_HEADROOM = 1.5;
+
+static double
+median(std::vector<double> values)
+{
+  if (values.empty()) {
+    return 0.0;
+  }
+
+  size_t middle = values.size() / 2;
+  std::nth_element(values.begin(), values.begin() + long(middle), values.end());
+  return values[middle];
+}
+
+GoldenBenchmark::GoldenBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+  , m_goldenFile(QDir(resourceDir).filePath("golden.json"))
+  , m_repetitions(5)
+{}
+
+/*!
+   \brief Returns the file holding the recordings, labels and baselines,
+   by default resources/golden.json.
+*/
+QString
+GoldenBenchmark::goldenFile() const
+{
+  return m_goldenFile;
+}
+
+void
+GoldenBenchmark::setGoldenFile(const QString& filename)
+{
+  m_goldenFile = filename;
+}
+
+/*!
+   \brief Returns the number of timed runs the real time factor is the
+   median of, after one run that also checks the detections.
+*/
+int
+GoldenBenchmark::repetitions() const
+{
+  return m_repetitions;
+}
+
+void
+GoldenBenchmark::setRepetitions(int repetitions)
+{
+  m_repetitions = qMax(1, repetitions);
+}
+
+/*!
+   \brief Runs every model over every recording. Returns false if anything
+   failed or the golden file, a recording or a model could not be read.
+*/
+bool
+GoldenBenchmark::run()
+{
+  m_results.clear();
+  m_failures = QJsonArray();
+
+  if (!load()) {
+    return false;
+  }
+
+  QDir dir(m_resourceDir);
+  QJsonObject baselines = m_golden.value("baselines").toObject();
+  QString reference =
+    m_golden.value("reference").toObject().value("cpu").toString();
+  QString cpu = SuiteBenchmark::environment().value("cpu").toString();
+
+  // speed is only comparable on the machine the baselines came from.
+  if (!reference.isEmpty() && reference != cpu) {
+    qWarning() << QObject::tr("the baselines were measured on %1, not %2.")
+                    .arg(reference, cpu);
+  }
+
+  QStringList models =
+    QDir(dir.filePath("models"))
+      .entryList(QStringList() << "*.umdl" << "*.pmdl", QDir::Files,
+                 QDir::Name);
+
+  for (const QString& model : models) {
+    DetectionPipeline pipeline;
+
+    if (!pipeline.setDetector(dir.filePath("common.res"),
+                              dir.filePath("models/" + model))) {
+      return false;
+    }
+
+    pipeline.setChunkPolicy(ChunkPolicy(ChunkPolicy::Fixed));
+    GoldenResult result;
+    result.model = model;
+    std::vector<double> factors;
+
+    for (int rep = 0; rep <= m_repetitions; rep++) {
+      pipeline.resetLoad();
+
+      for (const GoldenRecording& recording : m_recordings) {
+        std::vector<std::pair<double, int>> detections;
+        const std::vector<float>& audio = recording.samples;
+        pipeline.reset();
+
+        for (size_t captured = 0; captured < audio.size();) {
+          size_t block =
+            std::min(size_t(FRAMES_PER_BUFFER), audio.size() - captured);
+          int hotword = pipeline.process(audio.data() + captured, int(block));
+          captured += block;
+
+          if (hotword > 0) {
+            double ms = 1000.0 * double(captured - recording.lead) /
+                        pipeline.load().sampleRate;
+            detections.push_back(std::make_pair(ms, hotword));
+          }
+        }
+
+        // detection does not depend on the timing so one check is enough.
+        if (rep == 0 && recording.model == model) {
+          check(recording, detections, result);
+        }
+      }
+
+      if (rep > 0) {
+        factors.push_back(pipeline.load().realTimeFactor());
+      }
+    }
+
+    result.realTimeFactor = median(factors);
+    result.baseline =
+      baselines.value(model).toObject().value("realTimeFactor").toDouble();
+
+    // a model is only held to a baseline measured on the reference machine.
+    if (result.baseline <= 0) {
+      qWarning() << QObject::tr("%1 has no baseline, its speed is not checked.")
+                      .arg(model);
+
+    } else if (result.realTimeFactor > result.baseline) {
+      QJsonObject failure;
+      failure["kind"] = "rtf";
+      failure["model"] = model;
+      failure["baseline"] = result.baseline;
+      failure["measured"] = result.realTimeFactor;
+      failure["ratio"] = result.realTimeFactor / result.baseline;
+      m_failures.append(failure);
+    }
+
+    qInfo().noquote() << QString("%1: rtf %2 (baseline %3), %4/%5 labels "
+                                 "found, largest error %6 ms")
+                           .arg(model, -24)
+                           .arg(result.realTimeFactor, 0, 'f', 4)
+                           .arg(result.baseline, 0, 'f', 4)
+                           .arg(result.matched)
+                           .arg(result.labels)
+                           .arg(result.maxErrorMs, 0, 'f', 0);
+    m_results.append(result);
+  }
+
+  for (const QJsonValue& failure : m_failures) {
+    qWarning().noquote() << QJsonDocument(failure.toObject())
+                              .toJson(QJsonDocument::Compact);
+  }
+
+  return m_failures.isEmpty();
+}
+
+QVector<GoldenResult>
+GoldenBenchmark::results() const
+{
+  return m_results;
+}
+
+/*!
+   \brief Returns the failures of the last run, each a JSON object whose
+   kind is rtf, missed or unexpected.
+*/
+QJsonArray
+GoldenBenchmark::failures() const
+{
+  return m_failures;
+}
+
+/*!
+   \brief Writes the outcome of the last run as JSON: whether it passed,
+   the failures, every model's figures and the machine and revision they
+   came from.
+*/
+bool
+GoldenBenchmark::writeDiff(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QJsonArray results;
+
+  for (const GoldenResult& r : m_results) {
+    QJsonObject result;
+    result["model"] = r.model;
+    result["realTimeFactor"] = r.realTimeFactor;
+    result["baseline"] = r.baseline;
+    result["labels"] = r.labels;
+    result["matched"] = r.matched;
+    result["maxErrorMs"] = r.maxErrorMs;
+    results.append(result);
+  }
+
+  QJsonObject root;
+  root["environment"] = SuiteBenchmark::environment();
+  root["golden"] = m_goldenFile;
+  root["reference"] = m_golden.value("reference");
+  root["passed"] = m_failures.isEmpty();
+  root["failures"] = m_failures;
+  root["results"] = results;
+  file.write(QJsonDocument(root).toJson());
+  return true;
+}
+
+/*!
+   \brief Writes a copy of the golden file with every model's baseline set
+   from the last run, with room for an ordinary slow run. The machine they
+   were measured on and the headroom are recorded with them. Copy it over
+   resources/golden.json to adopt it.
+*/
+bool
+GoldenBenchmark::writeBaselines(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QJsonObject golden = m_golden;
+  QJsonObject baselines = golden.value("baselines").toObject();
+
+  for (const GoldenResult& r : m_results) {
+    QJsonObject baseline;
+    baseline["realTimeFactor"] =
+      std::ceil(r.realTimeFactor * BASELINE_HEADROOM * 1000.0) / 1000.0;
+    baselines[r.model] = baseline;
+  }
+
+  golden["baselines"] = baselines;
+  golden["reference"] = SuiteBenchmark::environment();
+  golden["headroom"] = BASELINE_HEADROOM;
+  file.write(QJsonDocument(golden).toJson());
+  return true;
+}
+
+/* Reads the golden file and pads each recording with the same low noise
+   BenchmarkAudio uses.*/
+bool
+GoldenBenchmark::load()
+{
+  QFile file(m_goldenFile);
+
+  if (!file.open(QIODevice::ReadOnly)) {
+    qWarning() << QObject::tr("unable to open %1").arg(m_goldenFile);
+    return false;
+  }
+
+  QJsonParseError error;
+  QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+
+  if (!document.isObject()) {
+    qWarning() << QObject::tr("%1 is not valid: %2")
+                    .arg(m_goldenFile, error.errorString());
+    return false;
+  }
+
+  m_golden = document.object();
+  m_recordings.clear();
+  const double rate = BenchmarkAudio().sampleRate();
+  const double leadMs = m_golden.value("leadMs").toDouble(1000);
+  const double tailMs = m_golden.value("tailMs").toDouble(1500);
+  const size_t lead = size_t(leadMs * rate / 1000);
+  const size_t tail = size_t(tailMs * rate / 1000);
+  const float noise = float(m_golden.value("noise").toInt(64)) / 32768.0f;
+  const double toleranceMs = m_golden.value("toleranceMs").toDouble(500);
+  QDir dir(QFileInfo(m_goldenFile).absolutePath());
+
+  for (const QJsonValue& value : m_golden.value("recordings").toArray()) {
+    QJsonObject object = value.toObject();
+    GoldenRecording recording;
+    recording.file = object.value("file").toString();
+    recording.model = object.value("model").toString();
+    recording.toleranceMs = object.value("toleranceMs").toDouble(toleranceMs);
+    recording.lead = lead;
+
+    for (const QJsonValue& label : object.value("labels").toArray()) {
+      GoldenLabel l;
+      l.hotword = label.toObject().value("hotword").toInt(1);
+      l.endMs = label.toObject().value("endMs").toDouble();
+      recording.labels.append(l);
+    }
+
+    std::vector<float> sound;
+
+    if (!BenchmarkAudio::loadSound(dir.filePath(recording.file), sound)) {
+      qWarning() << QObject::tr("unable to read %1").arg(recording.file);
+      return false;
+    }
+
+    // a fixed seed so every model and every run sees the same noise.
+    quint32 seed = 12345;
+    recording.samples.resize(lead + sound.size() + tail);
+
+    for (float& sample : recording.samples) {
+      seed = seed * 1664525u + 1013904223u;
+      sample = float(int(seed >> 16) - 32768) / 32768.0f * noise;
+    }
+
+    for (size_t i = 0; i < sound.size(); i++) {
+      recording.samples[lead + i] += sound[i];
+    }
+
+    m_recordings.append(recording);
+  }
+
+  return true;
+}
+
+/* Matches each detection to the first label for its hotword that is
+   within the tolerance and not yet taken. Detections left over and labels
+   never matched are failures.*/
+void
+GoldenBenchmark::check(const GoldenRecording& recording,
+                       const std::vector<std::pair<double, int>>& detections,
+                       GoldenResult& result)
+{
+  QVector<bool> taken(recording.labels.size(), false);
+
+  for (const std::pair<double, int>& detection : detections) {
+    bool found = false;
+
+    for (int i = 0; i < recording.labels.size() && !found; i++) {
+      const GoldenLabel& label = recording.labels[i];
+      double errorMs = detection.first - label.endMs;
+
+      if (!taken[i] && label.hotword == detection.second &&
+          std::abs(errorMs) <= recording.toleranceMs) {
+        taken[i] = true;
+        found = true;
+        result.matched++;
+        result.maxErrorMs = std::max(result.maxErrorMs, std::abs(errorMs));
+      }
+    }
+
+    if (!found) {
+      QJsonObject failure;
+      failure["kind"] = "unexpected";
+      failure["model"] = result.model;
+      failure["recording"] = recording.file;
+      failure["hotword"] = detection.second;
+      failure["detectedMs"] = detection.first;
+      m_failures.append(failure);
+    }
+  }
+
+  for (int i = 0; i < recording.labels.size(); i++) {
+    result.labels++;
+
+    if (!taken[i]) {
+      QJsonObject failure;
+      failure["kind"] = "missed";
+      failure["model"] = result.model;
+      failure["recording"] = recording.file;
+      failure["hotword"] = recording.labels[i].hotword;
+      failure["endMs"] = recording.labels[i].endMs;
+      failure["toleranceMs"] = recording.toleranceMs;
+      m_failures.append(failure);
+    }
+  }
+}
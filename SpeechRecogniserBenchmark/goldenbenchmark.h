@@ -0,0 +1,129 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef GOLDENBENCHMARK_H
+#define GOLDENBENCHMARK_H
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+#include <vector>
+
+/*!
+  \brief A hotword labelled in a golden recording.
+*/
+struct GoldenLabel
+{
+  //! The hotword index the model should report, from 1.
+  int hotword = 1;
+  //! Where the hotword ends, in milliseconds from the start of the file.
+  double endMs = 0;
+};
+
+/*!
+  \brief A labelled recording, padded with noise before and after so the
+  detector has context and time to report the last hotword.
+*/
+struct GoldenRecording
+{
+  QString file;
+  //! The model whose detections are checked against the labels.
+  QString model;
+  double toleranceMs = 0;
+  QVector<GoldenLabel> labels;
+  //! The padded audio at the detector rate.
+  std::vector<float> samples;
+  //! The samples of padding in front of the recording.
+  size_t lead = 0;
+};
+
+/*!
+  \brief One model's run over every golden recording.
+*/
+struct GoldenResult
+{
+  QString model;
+  //! The median real time factor over the repetitions.
+  double realTimeFactor = 0;
+  //! The stored baseline, 0 if the model has none.
+  double baseline = 0;
+  int labels = 0;
+  int matched = 0;
+  //! The largest distance of a matched detection from its label.
+  double maxErrorMs = 0;
+};
+
+/*!
+  \class GoldenBenchmark
+  \brief The GoldenBenchmark class checks every model in resources/models
+  against labelled recordings and stored real time factor baselines, so a
+  change that costs accuracy or speed is caught before it ships.
+
+  The recordings, their labels and the baselines are in
+  resources/golden.json. Each model runs over every recording; its
+  detections on the recordings labelled for it must each fall within the
+  tolerance of a label with the same hotword, and every label must be
+  found. The median real time factor of the pipeline's own PipelineLoad
+  over repetitions() runs must not exceed the model's baseline; a model
+  with no baseline only gets a warning that its speed went unchecked.
+
+  Every failure goes into the diff, written as JSON by writeDiff(), and
+  writeBaselines() writes a copy of the golden file with baselines from
+  this machine for when the hardware or an intended change moves them,
+  recording the machine as the reference. A run on a different CPU warns
+  that its speed is not comparable.
+*/
+class GoldenBenchmark
+{
+public:
+  explicit GoldenBenchmark(const QString& resourceDir);
+
+  QString goldenFile() const;
+  void setGoldenFile(const QString& filename);
+
+  int repetitions() const;
+  void setRepetitions(int repetitions);
+
+  bool run();
+  QVector<GoldenResult> results() const;
+  QJsonArray failures() const;
+
+  bool writeDiff(const QString& filename) const;
+  bool writeBaselines(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  QString m_goldenFile;
+  int m_repetitions;
+  QJsonObject m_golden;
+  QVector<GoldenRecording> m_recordings;
+  QVector<GoldenResult> m_results;
+  QJsonArray m_failures;
+
+  bool load();
+  void check(const GoldenRecording& recording,
+             const std::vector<std::pair<double, int>>& detections,
+             GoldenResult& result);
+};
+
+#endif // GOLDENBENCHMARK_H
@@ -0,0 +1,171 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <QtDebug>
+
+#include <chrono>
+
+#include "benchmarkaudio.h"
+#include "loadbenchmark.h"
+#include "microphonereader.h"
+
+using namespace SpeechRecognition;
+
+static const int SECONDS = 60;
+
+LoadBenchmark::LoadBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+{}
+
+/*!
+   \brief Replays the audio through a fully enabled pipeline with each model.
+   Returns false if the audio or the models could not be loaded.
+*/
+bool
+LoadBenchmark::run()
+{
+  m_results.clear();
+  QDir dir(m_resourceDir);
+  BenchmarkAudio audio;
+
+  if (!audio.build(m_resourceDir, SECONDS, 64)) {
+    return false;
+  }
+
+  const std::vector<float> capture = audio.floatSamples();
+  const int rate = audio.sampleRate();
+  const qint64 start = 1000000000;
+  auto timeOf = [start, rate](size_t sample) {
+    return start + qint64(sample) * 1000000000 / rate;
+  };
+
+  QStringList models =
+    QDir(dir.filePath("models"))
+      .entryList(QStringList() << "*.umdl" << "*.pmdl", QDir::Files,
+                 QDir::Name);
+
+  for (const QString& model : models) {
+    DetectionPipeline pipeline;
+
+    if (!pipeline.setDetector(dir.filePath("common.res"),
+                              dir.filePath("models/" + model))) {
+      return false;
+    }
+
+    pipeline.setEchoCancellerEnabled(true);
+    pipeline.setNoiseSuppressorEnabled(true);
+    pipeline.setGainControlEnabled(true);
+    pipeline.setFeatureExtractorEnabled(true);
+    pipeline.setEnergyGateEnabled(true);
+
+    std::vector<float> block(FRAMES_PER_BUFFER);
+    double busyNs = 0;
+
+    for (size_t captured = 0; captured + FRAMES_PER_BUFFER <= capture.size();
+         captured += FRAMES_PER_BUFFER) {
+      // a quiet copy of the capture stands in for what the speaker played,
+      // it is only there to give the canceller its full work load.
+      for (int i = 0; i < FRAMES_PER_BUFFER; i++) {
+        block[size_t(i)] = 0.1f * capture[captured + size_t(i)];
+      }
+
+      pipeline.echoCanceller().writeReference(
+        block.data(), FRAMES_PER_BUFFER, timeOf(captured));
+
+      auto begin = std::chrono::steady_clock::now();
+      pipeline.process(
+        capture.data() + captured, FRAMES_PER_BUFFER, 0, timeOf(captured));
+      std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - begin;
+      busyNs += elapsed.count();
+    }
+
+    LoadResult result;
+    result.model = model;
+    result.load = pipeline.load();
+    result.busyRealTimeFactor = busyNs * 1.0e-9 / result.load.seconds();
+
+    QString text = QString("%1: rtf %2 (%3 measured around process), "
+                           "%4 streams a core")
+                     .arg(model, -24)
+                     .arg(result.load.realTimeFactor(), 0, 'f', 4)
+                     .arg(result.busyRealTimeFactor, 0, 'f', 4)
+                     .arg(1.0 / result.load.realTimeFactor(), 0, 'f', 0);
+
+    for (int stage = 0; stage < PipelineLoad::StageCount; stage++) {
+      PipelineLoad::Stage s = PipelineLoad::Stage(stage);
+      text += QString(", %1 %2")
+                .arg(PipelineLoad::stageName(s))
+                .arg(result.load.realTimeFactor(s), 0, 'f', 4);
+    }
+
+    qInfo().noquote() << text;
+    m_results.append(result);
+  }
+
+  return true;
+}
+
+QVector<LoadResult>
+LoadBenchmark::results() const
+{
+  return m_results;
+}
+
+/*!
+   \brief Writes the results as comma separated values, one row per model
+   with a column per stage.
+*/
+bool
+LoadBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "model,seconds";
+
+  for (int stage = 0; stage < PipelineLoad::StageCount; stage++) {
+    out << ',' << PipelineLoad::stageName(PipelineLoad::Stage(stage));
+  }
+
+  out << ",total,measured\n";
+
+  for (const LoadResult& r : m_results) {
+    out << r.model << ',' << r.load.seconds();
+
+    for (int stage = 0; stage < PipelineLoad::StageCount; stage++) {
+      out << ',' << r.load.realTimeFactor(PipelineLoad::Stage(stage));
+    }
+
+    out << ',' << r.load.realTimeFactor() << ',' << r.busyRealTimeFactor
+        << '\n';
+  }
+
+  return true;
+}
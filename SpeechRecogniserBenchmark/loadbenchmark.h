@@ -0,0 +1,66 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef LOADBENCHMARK_H
+#define LOADBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+#include "detectionpipeline.h"
+
+/*!
+  \brief The load of the whole pipeline with one model.
+*/
+struct LoadResult
+{
+  QString model;
+  SpeechRecognition::PipelineLoad load;
+  double busyRealTimeFactor = 0;
+};
+
+/*!
+  \class LoadBenchmark
+  \brief The LoadBenchmark class reports the real time factor of every
+  pipeline stage for every model in resources/models.
+
+  BenchmarkAudio is replayed through a DetectionPipeline with the echo
+  canceller, noise suppressor, gain control, feature extractor and energy
+  gate all enabled, in blocks stamped with capture times as a microphone would deliver them. The
+  stage times are the pipeline's own PipelineLoad, and are checked against
+  the time measured around each process() call. The inverse of the total is
+  the number of streams one core could keep up with.
+*/
+class LoadBenchmark
+{
+public:
+  explicit LoadBenchmark(const QString& resourceDir);
+
+  bool run();
+  QVector<LoadResult> results() const;
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  QVector<LoadResult> m_results;
+};
+
+#endif // LOADBENCHMARK_H
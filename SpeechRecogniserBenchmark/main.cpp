@@ -0,0 +1,421 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QCommandLineParser>
+#include <QDir>
+#include <QApplication>
+#include <QtDebug>
+
+#include "auditbenchmark.h"
+#include "beamformerbenchmark.h"
+#include "chunkpolicybenchmark.h"
+#include "codecbenchmark.h"
+#include "conversionbenchmark.h"
+#include "echobenchmark.h"
+#include "energygatebenchmark.h"
+#include "featurebenchmark.h"
+#include "feedbackbenchmark.h"
+#include "gainbenchmark.h"
+#include "goldenbenchmark.h"
+#include "loadbenchmark.h"
+#include "metricsbenchmark.h"
+#include "multidevicebenchmark.h"
+#include "multistreambenchmark.h"
+#include "noisebenchmark.h"
+#include "recorderbenchmark.h"
+#include "replaybenchmark.h"
+#include "selftriggerbenchmark.h"
+#include "simulationbenchmark.h"
+#include "suitebenchmark.h"
+#include "sweepbenchmark.h"
+#include "tracebenchmark.h"
+#include "wavfilebenchmark.h"
+
+/*
+  Runs one of the benchmarks by name, for example
+
+    SpeechRecogniserBenchmark multistream --streams 1,8,64
+
+  Images are drawn offscreen so on a headless box add -platform offscreen.
+*/
+int
+main(int argc, char* argv[])
+{
+  QApplication app(argc, argv);
+  QCommandLineParser parser;
+  parser.setApplicationDescription("SpeechRecogniser benchmarks");
+  parser.addHelpOption();
+  parser.addPositionalArgument(
+    "benchmark",
+    "The benchmark to run: multistream, chunkpolicy, energygate, conversion, "
+    "beamformer, multidevice, replay, wavfile, recorder, codec, feedback, "
+    "selftrigger, echo, noise, gain, suite, metrics, trace, load, audit, "
+    "simulation, golden, sweep, features");
+  QCommandLineOption resourcesOption(
+    "resources", "The resources directory.", "dir", RESOURCES_DIR);
+  QCommandLineOption outputOption(
+    "output", "The directory results are written to.", "dir", ".");
+  QCommandLineOption durationOption(
+    "duration", "Seconds to run each case for.", "seconds", "10");
+  QCommandLineOption threadsOption(
+    "threads", "Worker threads, 0 for one per core.", "count", "0");
+  QCommandLineOption streamsOption(
+    "streams", "Comma separated stream counts.", "list", "1,2,4,8,16,32,64");
+  QCommandLineOption loopbackOption(
+    "loopback",
+    "Comma separated playback:capture device pairs.",
+    "list",
+    "loop0p:loop0c,loop1p:loop1c,loop2p:loop2c,loop3p:loop3c");
+  QCommandLineOption fileOption(
+    "file", "The WAV or raw file to replay or read.", "file", QString());
+  QCommandLineOption fastOption(
+    "fast", "Replay as fast as possible instead of in real time.");
+  QCommandLineOption loopsOption(
+    "loops", "Times the file is replayed.", "count", "10");
+  QCommandLineOption jitterOption(
+    "jitter", "Maximum delivery jitter of each block.", "ms", "0");
+  QCommandLineOption stallsOption(
+    "stalls", "Stall probability per block and length.", "p:ms", "0:0");
+  QCommandLineOption repetitionsOption(
+    "repetitions",
+    "Timed repetitions of each suite or golden case.",
+    "count",
+    "5");
+  QCommandLineOption seedOption(
+    "seed", "The seed of a simulation's delays and stalls.", "seed", "1");
+  QCommandLineOption sensitivitiesOption(
+    "sensitivities",
+    "Comma separated sensitivities to sweep.",
+    "list",
+    "0.1,0.2,0.3,0.4,0.5,0.6,0.7,0.8,0.9");
+  QCommandLineOption highSensitivitiesOption(
+    "high-sensitivities",
+    "Comma separated high sensitivities to sweep, 0 for none.",
+    "list",
+    "0");
+  QCommandLineOption baselinesOption(
+    "update-baselines",
+    "Also write golden.json with baselines measured on this machine.");
+  parser.addOption(resourcesOption);
+  parser.addOption(outputOption);
+  parser.addOption(durationOption);
+  parser.addOption(threadsOption);
+  parser.addOption(streamsOption);
+  parser.addOption(loopbackOption);
+  parser.addOption(fileOption);
+  parser.addOption(fastOption);
+  parser.addOption(loopsOption);
+  parser.addOption(jitterOption);
+  parser.addOption(stallsOption);
+  parser.addOption(repetitionsOption);
+  parser.addOption(seedOption);
+  parser.addOption(sensitivitiesOption);
+  parser.addOption(highSensitivitiesOption);
+  parser.addOption(baselinesOption);
+  parser.process(app);
+
+  QStringList args = parser.positionalArguments();
+
+  if (args.isEmpty()) {
+    parser.showHelp(1);
+  }
+
+  QString resources = parser.value(resourcesOption);
+  QDir output(parser.value(outputOption));
+
+  if (args.first() == "multistream") {
+    MultiStreamBenchmark benchmark(resources);
+    QList<int> streams;
+
+    for (const QString& value : parser.value(streamsOption).split(',')) {
+      streams.append(value.toInt());
+    }
+
+    benchmark.setStreamCounts(streams);
+    benchmark.setDuration(parser.value(durationOption).toInt());
+    benchmark.setThreadCount(parser.value(threadsOption).toInt());
+
+    if (!benchmark.run()) {
+      return 1;
+    }
+
+    benchmark.writeCsv(output.filePath("multistream.csv"));
+    benchmark.writePlot(output.filePath("multistream.png"));
+    return 0;
+  }
+
+  if (args.first() == "chunkpolicy") {
+    ChunkPolicyBenchmark benchmark(resources);
+
+    if (!benchmark.run()) {
+      return 1;
+    }
+
+    benchmark.writeCsv(output.filePath("chunkpolicy.csv"));
+    return 0;
+  }
+
+  if (args.first() == "energygate") {
+    EnergyGateBenchmark benchmark(resources);
+
+    if (!benchmark.run()) {
+      return 1;
+    }
+
+    benchmark.writeCsv(output.filePath("energygate.csv"));
+    return 0;
+  }
+
+  if (args.first() == "conversion") {
+    ConversionBenchmark benchmark;
+    benchmark.run();
+    benchmark.writeCsv(output.filePath("conversion.csv"));
+    return 0;
+  }
+
+  if (args.first() == "beamformer") {
+    BeamformerBenchmark benchmark;
+    bool ok = benchmark.run();
+    benchmark.writeCsv(output.filePath("beamformer.csv"));
+    return (ok ? 0 : 1);
+  }
+
+  if (args.first() == "multidevice") {
+    MultiDeviceBenchmark benchmark(resources);
+    benchmark.setLoopbacks(parser.value(loopbackOption).split(','));
+    benchmark.setDuration(parser.value(durationOption).toInt());
+    benchmark.setThreadCount(parser.value(threadsOption).toInt());
+    bool ok = benchmark.run();
+    benchmark.writeCsv(output.filePath("multidevice.csv"));
+    return (ok ? 0 : 1);
+  }
+
+  if (args.first() == "replay") {
+    ReplayBenchmark benchmark(resources);
+    QStringList stalls = parser.value(stallsOption).split(':');
+
+    if (parser.isSet(fileOption)) {
+      benchmark.setFile(parser.value(fileOption));
+    }
+
+    benchmark.setFastAsPossible(parser.isSet(fastOption));
+    benchmark.setLoops(parser.value(loopsOption).toInt());
+    benchmark.setJitter(parser.value(jitterOption).toInt());
+    benchmark.setStalls(stalls.value(0).toDouble(), stalls.value(1).toInt());
+
+    if (!benchmark.run()) {
+      return 1;
+    }
+
+    benchmark.writeCsv(output.filePath("replay.csv"));
+    return 0;
+  }
+
+  if (args.first() == "wavfile") {
+    WavFileBenchmark benchmark(resources);
+
+    if (parser.isSet(fileOption)) {
+      benchmark.setFile(parser.value(fileOption));
+    }
+
+    if (!benchmark.run()) {
+      return 1;
+    }
+
+    benchmark.writeCsv(output.filePath("wavfile.csv"));
+    return 0;
+  }
+
+  if (args.first() == "recorder") {
+    RecorderBenchmark benchmark(output.path());
+    benchmark.setDuration(parser.value(durationOption).toInt());
+    bool ok = benchmark.run();
+    benchmark.writeCsv(output.filePath("recorder.csv"));
+    return (ok ? 0 : 1);
+  }
+
+  if (args.first() == "codec") {
+    CodecBenchmark benchmark(resources);
+
+    if (parser.isSet(fileOption)) {
+      benchmark.setFiles(parser.value(fileOption).split(','));
+    }
+
+    bool ok = benchmark.run();
+    benchmark.writeCsv(output.filePath("codec.csv"));
+    return (ok ? 0 : 1);
+  }
+
+  if (args.first() == "feedback") {
+    FeedbackBenchmark benchmark(resources);
+    benchmark.setLoops(parser.value(loopsOption).toInt());
+    bool ok = benchmark.run();
+    benchmark.writeCsv(output.filePath("feedback.csv"));
+    return (ok ? 0 : 1);
+  }
+
+  if (args.first() == "selftrigger") {
+    SelfTriggerBenchmark benchmark(resources);
+    bool ok = benchmark.run();
+    benchmark.writeCsv(output.filePath("selftrigger.csv"));
+    return (ok ? 0 : 1);
+  }
+
+  if (args.first() == "echo") {
+    EchoBenchmark benchmark(resources);
+    bool ok = benchmark.run();
+    benchmark.writeCsv(output.filePath("echo.csv"));
+    return (ok ? 0 : 1);
+  }
+
+  if (args.first() == "noise") {
+    NoiseBenchmark benchmark(resources);
+
+    if (!benchmark.run()) {
+      return 1;
+    }
+
+    benchmark.writeCsv(output.filePath("noise.csv"));
+    return 0;
+  }
+
+  if (args.first() == "gain") {
+    GainBenchmark benchmark(resources);
+
+    if (!benchmark.run()) {
+      return 1;
+    }
+
+    benchmark.writeCsv(output.filePath("gain.csv"));
+    return 0;
+  }
+
+  if (args.first() == "suite") {
+    SuiteBenchmark benchmark(resources);
+    benchmark.setRepetitions(parser.value(repetitionsOption).toInt());
+    bool ok = benchmark.run();
+    benchmark.writeJson(output.filePath("suite.json"));
+    return (ok ? 0 : 1);
+  }
+
+  if (args.first() == "metrics") {
+    MetricsBenchmark benchmark;
+    bool ok = benchmark.run();
+    benchmark.writeCsv(output.filePath("metrics.csv"));
+    return (ok ? 0 : 1);
+  }
+
+  if (args.first() == "trace") {
+    TraceBenchmark benchmark(resources);
+    bool ok = benchmark.run(output.filePath("trace.json"));
+    benchmark.writeCsv(output.filePath("trace.csv"));
+    return (ok ? 0 : 1);
+  }
+
+  if (args.first() == "load") {
+    LoadBenchmark benchmark(resources);
+
+    if (!benchmark.run()) {
+      return 1;
+    }
+
+    benchmark.writeCsv(output.filePath("load.csv"));
+    return 0;
+  }
+
+  if (args.first() == "audit") {
+    AuditBenchmark benchmark(resources);
+    bool ok = benchmark.run();
+    benchmark.writeCsv(output.filePath("audit.csv"));
+    return (ok ? 0 : 1);
+  }
+
+  if (args.first() == "simulation") {
+    SimulationBenchmark benchmark(resources);
+    benchmark.setSeed(parser.value(seedOption).toUInt());
+    bool ok = benchmark.run(output.path());
+    benchmark.writeCsv(output.filePath("simulation.csv"));
+    return (ok ? 0 : 1);
+  }
+
+  if (args.first() == "golden") {
+    GoldenBenchmark benchmark(resources);
+    benchmark.setRepetitions(parser.value(repetitionsOption).toInt());
+
+    if (parser.isSet(fileOption)) {
+      benchmark.setGoldenFile(parser.value(fileOption));
+    }
+
+    bool ok = benchmark.run();
+    benchmark.writeDiff(output.filePath("golden-diff.json"));
+
+    if (parser.isSet(baselinesOption)) {
+      benchmark.writeBaselines(output.filePath("golden.json"));
+    }
+
+    return (ok ? 0 : 1);
+  }
+
+  if (args.first() == "sweep") {
+    SweepBenchmark benchmark(resources);
+    QList<double> sensitivities, highSensitivities;
+
+    for (const QString& value :
+         parser.value(sensitivitiesOption).split(',')) {
+      sensitivities.append(value.toDouble());
+    }
+
+    for (const QString& value :
+         parser.value(highSensitivitiesOption).split(',')) {
+      highSensitivities.append(value.toDouble());
+    }
+
+    benchmark.setSensitivities(sensitivities);
+    benchmark.setHighSensitivities(highSensitivities);
+    benchmark.setThreads(parser.value(threadsOption).toInt());
+
+    if (parser.isSet(durationOption)) {
+      benchmark.setSeconds(parser.value(durationOption).toInt());
+    }
+
+    if (parser.isSet(fileOption)) {
+      benchmark.setNegatives(parser.value(fileOption).split(','));
+    }
+
+    if (!benchmark.run()) {
+      return 1;
+    }
+
+    benchmark.writeCsv(output.filePath("sweep.csv"));
+    benchmark.writePlot(output.filePath("sweep.png"));
+    return 0;
+  }
+
+  if (args.first() == "features") {
+    FeatureBenchmark benchmark(resources);
+    bool ok = benchmark.run();
+    benchmark.writeCsv(output.filePath("features.csv"));
+    return (ok ? 0 : 1);
+  }
+
+  qWarning() << QObject::tr("unknown benchmark %1").arg(args.first());
+  return 1;
+}
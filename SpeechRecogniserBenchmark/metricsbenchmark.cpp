@@ -0,0 +1,210 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+#include <QtDebug>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "metrics.h"
+#include "metricsbenchmark.h"
+
+using namespace SpeechRecognition;
+
+static const int CALLS = 1 << 22;
+
+MetricsBenchmark::MetricsBenchmark() {}
+
+/*!
+   \brief Measures every kind of metric at each thread count. Returns false
+   if a counter lost a count.
+*/
+bool
+MetricsBenchmark::run()
+{
+  m_results.clear();
+  bool ok = true;
+  int cores = std::max(1, QThread::idealThreadCount());
+  QVector<int> threadCounts;
+
+  for (int threads = 1; threads < cores; threads *= 2) {
+    threadCounts.append(threads);
+  }
+
+  threadCounts.append(cores);
+
+  for (int threads : threadCounts) {
+    Counter counter;
+    Gauge gauge;
+    Histogram histogram(Histogram::exponentialBounds(0.0001, 2, 12));
+    std::atomic<quint64> shared(0);
+
+    m_results.append({ "atomic", threads, measure(threads, [&](int) {
+                         shared.fetch_add(1, std::memory_order_relaxed);
+                       }) });
+    m_results.append(
+      { "counter", threads, measure(threads, [&](int) { counter.add(); }) });
+    m_results.append({ "gauge", threads, measure(threads, [&](int i) {
+                         gauge.set(double(i));
+                       }) });
+    // spread the observations over the buckets like real latencies.
+    m_results.append({ "histogram", threads, measure(threads, [&](int i) {
+                         histogram.observe(0.0001 * double(i & 1023));
+                       }) });
+
+    // the warm up pass counts too.
+    const quint64 expected = quint64(threads) * quint64(CALLS) * 2;
+
+    if (counter.value() != expected || histogram.count() != expected) {
+      qWarning() << QObject::tr("%1 threads: counted %2 and %3 of %4.")
+                      .arg(threads)
+                      .arg(counter.value())
+                      .arg(histogram.count())
+                      .arg(expected);
+      ok = false;
+    }
+  }
+
+  measureExposition();
+
+  for (const MetricsResult& r : m_results) {
+    qInfo().noquote() << QString("%1 %2 threads: %3 ns per call")
+                           .arg(r.name, -10)
+                           .arg(r.threads, 3)
+                           .arg(r.nsPerCall, 8, 'f', 2);
+  }
+
+  return ok;
+}
+
+QVector<MetricsResult>
+MetricsBenchmark::results() const
+{
+  return m_results;
+}
+
+/*!
+   \brief Writes the results as comma separated values.
+*/
+bool
+MetricsBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "metric,threads,ns_per_call\n";
+
+  for (const MetricsResult& r : m_results) {
+    out << r.name << ',' << r.threads << ',' << r.nsPerCall << '\n';
+  }
+
+  return true;
+}
+
+/* Calls record CALLS times on each of threads threads, all started
+   together, once to warm up and once timed. Returns the mean nanoseconds
+   per call seen by a thread.*/
+double
+MetricsBenchmark::measure(int threads, const std::function<void(int)>& record)
+{
+  double totalNs = 0;
+
+  for (int pass = 0; pass < 2; pass++) {
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<double> elapsedNs(size_t(threads), 0.0);
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < threads; t++) {
+      workers.emplace_back([&, t]() {
+        ready.fetch_add(1);
+
+        while (!go.load()) {
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < CALLS; i++) {
+          record(i);
+        }
+
+        std::chrono::duration<double, std::nano> elapsed =
+          std::chrono::steady_clock::now() - start;
+        elapsedNs[size_t(t)] = elapsed.count();
+      });
+    }
+
+    while (ready.load() < threads) {
+    }
+
+    go.store(true);
+
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+
+    totalNs = 0;
+
+    for (double ns : elapsedNs) {
+      totalNs += ns;
+    }
+  }
+
+  return totalNs / threads / CALLS;
+}
+
+/* Times writing out the pipeline's metrics, with some history in the
+   histograms, as a scrape would.*/
+void
+MetricsBenchmark::measureExposition()
+{
+  const PipelineMetrics& metrics = PipelineMetrics::instance();
+
+  for (int i = 0; i < 1000; i++) {
+    metrics.detectionSeconds->observe(0.0001 * i);
+    metrics.detectionLatency->observe(0.001 * i);
+  }
+
+  const int scrapes = 1000;
+  size_t bytes = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  for (int i = 0; i < scrapes; i++) {
+    bytes += size_t(MetricsRegistry::instance().exposition().size());
+  }
+
+  std::chrono::duration<double, std::nano> elapsed =
+    std::chrono::steady_clock::now() - start;
+  m_results.append({ "exposition", 1, elapsed.count() / scrapes });
+  qInfo().noquote() << QString("a scrape is %1 bytes")
+                         .arg(bytes / size_t(scrapes));
+}
@@ -0,0 +1,67 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef METRICSBENCHMARK_H
+#define METRICSBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+#include <functional>
+
+/*!
+  \brief The cost of recording one metric from threads threads at once, in
+  nanoseconds per call on each thread.
+*/
+struct MetricsResult
+{
+  QString name;
+  int threads;
+  double nsPerCall;
+};
+
+/*!
+  \class MetricsBenchmark
+  \brief The MetricsBenchmark class measures the overhead the metrics
+  registry adds to the capture and detection path.
+
+  Counter::add(), Gauge::set() and Histogram::observe() are called in a
+  tight loop from one thread up to one per core, alongside a single shared
+  atomic counter as the unsharded baseline. The time to write the whole
+  registry out for a scrape is measured too.
+*/
+class MetricsBenchmark
+{
+public:
+  MetricsBenchmark();
+
+  bool run();
+  QVector<MetricsResult> results() const;
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QVector<MetricsResult> m_results;
+
+  static double measure(int threads, const std::function<void(int)>& record);
+  void measureExposition();
+};
+
+#endif // METRICSBENCHMARK_H
@@ -0,0 +1,375 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QEventLoop>
+#include <QFile>
+#include <QTextStream>
+#include <QTimer>
+#include <QtDebug>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <mutex>
+
+#include "capturegroup.h"
+#include "multidevicebenchmark.h"
+#include "portaudio.h"
+
+using namespace SpeechRecognition;
+
+/* One playback side, looping the benchmark audio.*/
+struct Player
+{
+  const std::vector<int16_t>* samples;
+  size_t position = 0;
+  PaStream* stream = nullptr;
+};
+
+static int
+playCallback(const void* /*inputBuffer*/,
+             void* outputBuffer,
+             unsigned long framesPerBuffer,
+             const PaStreamCallbackTimeInfo* /*timeInfo*/,
+             PaStreamCallbackFlags /*statusFlags*/,
+             void* data)
+{
+  Player* player = static_cast<Player*>(data);
+  int16_t* out = static_cast<int16_t*>(outputBuffer);
+
+  for (unsigned long i = 0; i < framesPerBuffer; i++) {
+    out[i] = (*player->samples)[player->position];
+    player->position = (player->position + 1) % player->samples->size();
+  }
+
+  return paContinue;
+}
+
+static int
+findOutputDevice(const QString& name)
+{
+  for (int device = 0; device < Pa_GetDeviceCount(); device++) {
+    const PaDeviceInfo* info = Pa_GetDeviceInfo(device);
+
+    if (info && info->maxOutputChannels > 0 &&
+        QString::fromLocal8Bit(info->name).contains(name)) {
+      return device;
+    }
+  }
+
+  return -1;
+}
+
+static double
+percentile(std::vector<qint64>& values, double fraction)
+{
+  if (values.empty()) {
+    return 0.0;
+  }
+
+  size_t index = size_t(std::ceil(fraction * double(values.size())));
+  index = std::min(values.size() - 1, index > 0 ? index - 1 : 0);
+  std::nth_element(values.begin(), values.begin() + long(index), values.end());
+  return double(values[index]) / 1.0e6;
+}
+
+MultiDeviceBenchmark::MultiDeviceBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+  , m_pairs({ "loop0p:loop0c", "loop1p:loop1c", "loop2p:loop2c",
+              "loop3p:loop3c" })
+  , m_duration(10)
+  , m_threadCount(0)
+  , m_alignedFrames(0)
+{}
+
+/*!
+   \brief Sets the devices as playback:capture name pairs. Defaults to the
+   four pairs loop0p:loop0c to loop3p:loop3c.
+*/
+void
+MultiDeviceBenchmark::setLoopbacks(const QStringList& pairs)
+{
+  m_pairs = pairs;
+}
+
+/*!
+   \brief Sets the time in seconds the devices are run for. Defaults to 10
+   seconds.
+*/
+void
+MultiDeviceBenchmark::setDuration(int seconds)
+{
+  m_duration = seconds;
+}
+
+/*!
+   \brief Sets the number of detection threads, zero sizes the pool to the
+   cores.
+*/
+void
+MultiDeviceBenchmark::setThreadCount(int threadCount)
+{
+  m_threadCount = threadCount;
+}
+
+/*!
+   \brief Runs the devices for the duration. Returns false if a device could
+   not be opened or any device lost audio.
+*/
+bool
+MultiDeviceBenchmark::run()
+{
+  m_results.clear();
+  m_alignedFrames = 0;
+
+  if (!m_audio.build(m_resourceDir, m_duration)) {
+    return false;
+  }
+
+  QDir resources(m_resourceDir);
+  CaptureGroup group(m_threadCount);
+
+  if (!group.setDetector(resources.filePath("common.res"),
+                         resources.filePath("models/snowboy.umdl"))) {
+    return false;
+  }
+
+  // latencies and detections per device, filled in on the pool threads.
+  std::mutex mutex;
+  std::vector<std::vector<qint64>> latencies(size_t(m_pairs.size()));
+  std::vector<int> detections(size_t(m_pairs.size()), 0);
+  group.server()->setResultHandler([&](const DetectionResult& result) {
+    int device = group.deviceOfStream(result.stream);
+
+    if (device < 0) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    latencies[size_t(device)].push_back(result.finishedNs -
+                                        result.enqueuedNs);
+
+    if (result.result > 0) {
+      detections[size_t(device)]++;
+    }
+  });
+
+  // keeps PortAudio up between the capture streams being opened and the
+  // players starting.
+  if (Pa_Initialize() != paNoError) {
+    qWarning() << QObject::tr("unable to intialise PortAudio.");
+    return false;
+  }
+
+  std::vector<std::unique_ptr<Player>> players;
+  bool ok = true;
+
+  for (const QString& pair : m_pairs) {
+    QStringList names = pair.split(':');
+    int output = (names.size() == 2 ? findOutputDevice(names.at(0)) : -1);
+    CaptureSettings settings;
+    settings.device =
+      (names.size() == 2 ? MicrophoneReader::findInputDevice(names.at(1)) : -1);
+
+    if (output < 0 || settings.device < 0) {
+      qWarning() << QObject::tr("unable to find loopback pair %1").arg(pair);
+      ok = false;
+      break;
+    }
+
+    if (group.addDevice(settings) < 0) {
+      ok = false;
+      break;
+    }
+
+    std::unique_ptr<Player> player(new Player);
+    player->samples = &m_audio.samples();
+    PaStreamParameters parameters;
+    parameters.device = output;
+    parameters.channelCount = 1;
+    parameters.sampleFormat = paInt16;
+    parameters.suggestedLatency =
+      Pa_GetDeviceInfo(output)->defaultLowOutputLatency;
+    parameters.hostApiSpecificStreamInfo = nullptr;
+
+    if (Pa_OpenStream(&player->stream,
+                      nullptr,
+                      &parameters,
+                      m_audio.sampleRate(),
+                      FRAMES_PER_BUFFER,
+                      paClipOff,
+                      playCallback,
+                      player.get()) != paNoError) {
+      qWarning() << QObject::tr("unable to open %1").arg(names.at(0));
+      ok = false;
+      break;
+    }
+
+    players.push_back(std::move(player));
+  }
+
+  if (ok) {
+    QVector<qint64> startOffsets;
+
+    group.start();
+
+    for (auto& player : players) {
+      Pa_StartStream(player->stream);
+    }
+
+    // the consumer, reading every device lined up by capture time.
+    QTimer reader;
+    AudioBlock aligned;
+    QObject::connect(&reader, &QTimer::timeout, [&] {
+      if (startOffsets.isEmpty() && group.reader(0)->clock()->isValid()) {
+        for (int d = 0; d < group.deviceCount(); d++) {
+          startOffsets.append(group.reader(d)->clock()->offset());
+        }
+      }
+
+      while (group.aligner()->read(FRAMES_PER_BUFFER, aligned)) {
+        m_alignedFrames += aligned.frames();
+      }
+    });
+    reader.start(20);
+
+    QEventLoop loop;
+    QTimer::singleShot(m_duration * 1000, &loop, &QEventLoop::quit);
+    loop.exec();
+    reader.stop();
+
+    for (auto& player : players) {
+      Pa_StopStream(player->stream);
+    }
+
+    group.server()->waitForIdle();
+
+    for (int d = 0; d < group.deviceCount(); d++) {
+      MicrophoneReader* device = group.reader(d);
+      MultiDeviceResult result;
+      result.device = device->deviceName();
+      result.overflows = device->overflowCount();
+      result.underflows = device->underflowCount();
+      result.processedChunks = group.server()->processedChunks(group.stream(d));
+      result.droppedChunks = group.server()->droppedChunks(group.stream(d));
+      result.insertedFrames = group.aligner()->insertedFrames(d);
+      result.droppedFrames = group.aligner()->droppedFrames(d);
+      result.clockDriftUs =
+        startOffsets.isEmpty()
+          ? 0.0
+          : double(device->clock()->offset() - startOffsets.at(d)) / 1000.0;
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        result.detections = detections[size_t(d)];
+        result.p99Ms = percentile(latencies[size_t(d)], 0.99);
+      }
+
+      // the audio is as long as the run, so every hotword is played once.
+      result.expected = int(m_audio.hotwordEnds().size());
+      m_results.append(result);
+
+      if (result.overflows > 0 || result.droppedChunks > 0) {
+        ok = false;
+      }
+
+      qInfo().noquote()
+        << QString("%1: %2 overflows, %3 dropped chunks, %4 gap frames, "
+                   "%5 overlap frames, %6/%7 hotwords, clock drift %8 us, "
+                   "p99 %9 ms")
+             .arg(result.device)
+             .arg(result.overflows)
+             .arg(result.droppedChunks)
+             .arg(result.insertedFrames)
+             .arg(result.droppedFrames)
+             .arg(result.detections)
+             .arg(result.expected)
+             .arg(result.clockDriftUs, 0, 'f', 1)
+             .arg(result.p99Ms, 0, 'f', 2);
+    }
+
+    qInfo().noquote()
+      << QString("read %1 s of aligned audio from %2 devices")
+           .arg(double(m_alignedFrames) / m_audio.sampleRate(), 0, 'f', 1)
+           .arg(group.deviceCount());
+  }
+
+  if (group.deviceCount() > 0) {
+    // let the readers close their streams before the group goes.
+    QEventLoop loop;
+    QObject::connect(&group, &CaptureGroup::finished, &loop, &QEventLoop::quit);
+    QTimer::singleShot(2000, &loop, &QEventLoop::quit);
+    group.stop();
+    loop.exec();
+  }
+
+  for (auto& player : players) {
+    Pa_CloseStream(player->stream);
+  }
+
+  Pa_Terminate();
+  return ok;
+}
+
+QVector<MultiDeviceResult>
+MultiDeviceBenchmark::results() const
+{
+  return m_results;
+}
+
+/*!
+   \brief Returns the frames read from the aligner across all devices.
+*/
+qint64
+MultiDeviceBenchmark::alignedFrames() const
+{
+  return m_alignedFrames;
+}
+
+/*!
+   \brief Writes the results as comma separated values.
+*/
+bool
+MultiDeviceBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "device,overflows,underflows,chunks,dropped_chunks,gap_frames,"
+         "overlap_frames,detections,expected,clock_drift_us,p99_ms\n";
+
+  for (const MultiDeviceResult& r : m_results) {
+    out << '"' << r.device << "\"," << r.overflows << ',' << r.underflows
+        << ',' << r.processedChunks << ',' << r.droppedChunks << ','
+        << r.insertedFrames << ',' << r.droppedFrames << ',' << r.detections
+        << ',' << r.expected << ',' << r.clockDriftUs << ',' << r.p99Ms
+        << '\n';
+  }
+
+  return true;
+}
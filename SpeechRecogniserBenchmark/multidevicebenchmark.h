@@ -0,0 +1,96 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef MULTIDEVICEBENCHMARK_H
+#define MULTIDEVICEBENCHMARK_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "benchmarkaudio.h"
+
+/*!
+  \brief What one capture device of the stress test saw.
+*/
+struct MultiDeviceResult
+{
+  QString device;
+  quint64 overflows;
+  quint64 underflows;
+  quint64 processedChunks;
+  quint64 droppedChunks;
+  quint64 insertedFrames;
+  quint64 droppedFrames;
+  int detections;
+  int expected;
+  double clockDriftUs;
+  double p99Ms;
+};
+
+/*!
+  \class MultiDeviceBenchmark
+  \brief The MultiDeviceBenchmark class stress tests CaptureGroup with
+  several capture devices at once.
+
+  It is meant for the ALSA loopback driver, which gives virtual devices
+  whose capture side returns whatever is played into the playback side.
+  Each pair is given as playback:capture device names. The benchmark plays
+  BenchmarkAudio into every playback device and captures and detects on
+  every capture device through one CaptureGroup, while a consumer reads the
+  devices aligned by capture time.
+
+  To make four pairs load the driver with
+
+    modprobe snd-aloop pcms=1 pcm_substreams=4
+
+  and name the substreams in ~/.asoundrc, for pair 0
+
+    pcm.loop0p { type plug slave.pcm "hw:Loopback,0,0" }
+    pcm.loop0c { type plug slave.pcm "hw:Loopback,1,0" }
+
+  The test fails if any device overflows or has chunks dropped.
+*/
+class MultiDeviceBenchmark
+{
+public:
+  explicit MultiDeviceBenchmark(const QString& resourceDir);
+
+  void setLoopbacks(const QStringList& pairs);
+  void setDuration(int seconds);
+  void setThreadCount(int threadCount);
+
+  bool run();
+  QVector<MultiDeviceResult> results() const;
+  qint64 alignedFrames() const;
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  QStringList m_pairs;
+  int m_duration;
+  int m_threadCount;
+  BenchmarkAudio m_audio;
+  QVector<MultiDeviceResult> m_results;
+  qint64 m_alignedFrames;
+};
+
+#endif // MULTIDEVICEBENCHMARK_H
@@ -0,0 +1,336 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QPainter>
+#include <QPainterPath>
+#include <QTextStream>
+#include <QtDebug>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+#include "detectionserver.h"
+#include "multistreambenchmark.h"
+
+using namespace SpeechRecognition;
+
+static const int DETECTOR_RATE = 16000;
+
+static double
+percentile(std::vector<qint64>& values, double fraction)
+{
+  if (values.empty()) {
+    return 0.0;
+  }
+
+  size_t index = size_t(std::ceil(fraction * double(values.size())));
+  index = std::min(values.size() - 1, index > 0 ? index - 1 : 0);
+  std::nth_element(values.begin(), values.begin() + long(index), values.end());
+  return double(values[index]) / 1.0e6;
+}
+
+MultiStreamBenchmark::MultiStreamBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+  , m_streamCounts({ 1, 2, 4, 8, 16, 32, 64 })
+  , m_duration(10)
+  , m_chunkTime(100)
+  , m_threadCount(0)
+{}
+
+/*!
+   \brief Sets the stream counts to measure. Defaults to 1 to 64 in powers of
+   two.
+*/
+void
+MultiStreamBenchmark::setStreamCounts(const QList<int>& streamCounts)
+{
+  m_streamCounts = streamCounts;
+}
+
+/*!
+   \brief Sets the time in seconds that each stream count is run for.
+   Defaults to 10 seconds.
+*/
+void
+MultiStreamBenchmark::setDuration(int seconds)
+{
+  m_duration = seconds;
+}
+
+/*!
+   \brief Sets the length of each pushed chunk in milliseconds. Defaults to
+   100mS, the chunk size suggested by snowboy.
+*/
+void
+MultiStreamBenchmark::setChunkTime(int milliseconds)
+{
+  m_chunkTime = milliseconds;
+}
+
+/*!
+   \brief Sets the number of pool threads, zero sizes the pool to the cores.
+*/
+void
+MultiStreamBenchmark::setThreadCount(int threadCount)
+{
+  m_threadCount = threadCount;
+}
+
+/*!
+   \brief Runs every stream count in turn. Returns false if the audio or the
+   models could not be loaded.
+*/
+bool
+MultiStreamBenchmark::run()
+{
+  m_results.clear();
+
+  if (!loadAudio()) {
+    return false;
+  }
+
+  for (int streams : m_streamCounts) {
+    MultiStreamResult result = runStreams(streams);
+
+    if (result.streams == 0) {
+      return false;
+    }
+
+    qInfo().noquote() << QString("%1 streams: p50 %2 ms, p99 %3 ms, "
+                                 "max %4 ms, %5 dropped of %6")
+                           .arg(result.streams)
+                           .arg(result.p50Ms, 0, 'f', 2)
+                           .arg(result.p99Ms, 0, 'f', 2)
+                           .arg(result.maxMs, 0, 'f', 2)
+                           .arg(result.dropped)
+                           .arg(result.chunks);
+    m_results.append(result);
+  }
+
+  return true;
+}
+
+QVector<MultiStreamResult>
+MultiStreamBenchmark::results() const
+{
+  return m_results;
+}
+
+bool
+MultiStreamBenchmark::loadAudio()
+{
+  QFile file(QDir(m_resourceDir).filePath("snowboy.raw"));
+
+  if (!file.open(QIODevice::ReadOnly)) {
+    qWarning() << QObject::tr("unable to open %1").arg(file.fileName());
+    return false;
+  }
+
+  QByteArray bytes = file.readAll();
+  size_t count = size_t(bytes.size()) / sizeof(int16_t);
+  m_audio.assign(size_t(DETECTOR_RATE), 0);
+  const int16_t* samples = reinterpret_cast<const int16_t*>(bytes.constData());
+  m_audio.insert(m_audio.end(), samples, samples + count);
+  return true;
+}
+
+MultiStreamResult
+MultiStreamBenchmark::runStreams(int streamCount)
+{
+  MultiStreamResult result = {};
+  DetectionServer server(m_threadCount);
+  QDir dir(m_resourceDir);
+
+  for (int i = 0; i < streamCount; i++) {
+    if (server.addStream(dir.filePath("common.res"),
+                         dir.filePath("models/snowboy.umdl")) < 0) {
+      return result;
+    }
+  }
+
+  std::mutex latencyMutex;
+  std::vector<qint64> latencies;
+  server.setResultHandler(
+    [&latencyMutex, &latencies](const DetectionResult& detection) {
+      std::lock_guard<std::mutex> lock(latencyMutex);
+      latencies.push_back(detection.finishedNs - detection.enqueuedNs);
+    });
+
+  const size_t chunkSize = size_t(DETECTOR_RATE * m_chunkTime / 1000);
+  const qint64 period = qint64(m_chunkTime) * 1000000;
+  const qint64 rounds = qint64(m_duration) * 1000 / m_chunkTime;
+  std::vector<size_t> positions(size_t(streamCount));
+  std::vector<int16_t> chunk(chunkSize);
+
+  for (int i = 0; i < streamCount; i++) {
+    positions[size_t(i)] = (m_audio.size() / size_t(streamCount)) * size_t(i);
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+
+  for (qint64 round = 0; round < rounds; round++) {
+    for (int i = 0; i < streamCount; i++) {
+      qint64 due = round * period + (period / streamCount) * i;
+      std::this_thread::sleep_until(start + std::chrono::nanoseconds(due));
+
+      size_t& position = positions[size_t(i)];
+
+      for (size_t j = 0; j < chunkSize; j++) {
+        chunk[j] = m_audio[position];
+        position = (position + 1) % m_audio.size();
+      }
+
+      server.pushData(i, chunk.data(), int(chunkSize));
+    }
+  }
+
+  server.waitForIdle();
+
+  result.streams = streamCount;
+  result.threads = server.threadCount();
+  result.chunks = qint64(latencies.size());
+
+  for (int i = 0; i < streamCount; i++) {
+    result.dropped += qint64(server.droppedChunks(i));
+  }
+
+  result.p50Ms = percentile(latencies, 0.50);
+  result.p99Ms = percentile(latencies, 0.99);
+  result.maxMs = percentile(latencies, 1.0);
+  return result;
+}
+
+/*!
+   \brief Writes the results as comma separated values.
+*/
+bool
+MultiStreamBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "streams,threads,chunks,dropped,p50_ms,p99_ms,max_ms\n";
+
+  for (const MultiStreamResult& r : m_results) {
+    out << r.streams << ',' << r.threads << ',' << r.chunks << ','
+        << r.dropped << ',' << r.p50Ms << ',' << r.p99Ms << ',' << r.maxMs
+        << '\n';
+  }
+
+  return true;
+}
+
+/*!
+   \brief Plots p50 and p99 latency against stream count into an image file.
+
+   The stream count axis is evenly spaced by result, which with the default
+   doubling stream counts gives a log scale.
+*/
+bool
+MultiStreamBenchmark::writePlot(const QString& filename) const
+{
+  if (m_results.isEmpty()) {
+    return false;
+  }
+
+  const int width = 800, height = 500, margin = 60;
+  QImage image(width, height, QImage::Format_RGB32);
+  image.fill(Qt::white);
+  QPainter painter(&image);
+  painter.setRenderHint(QPainter::Antialiasing);
+
+  double maxMs = 1.0;
+
+  for (const MultiStreamResult& r : m_results) {
+    maxMs = std::max(maxMs, r.p99Ms);
+  }
+
+  maxMs *= 1.1;
+  const QRectF area(margin, margin / 2, width - margin * 3 / 2,
+                    height - margin * 3 / 2);
+  int count = m_results.size();
+  auto xAt = [&](int i) {
+    return area.left() +
+           (count > 1 ? area.width() * i / (count - 1) : area.width() / 2);
+  };
+  auto yAt = [&](double ms) { return area.bottom() - area.height() * ms / maxMs; };
+
+  painter.setPen(Qt::black);
+  painter.drawRect(area);
+
+  for (int i = 0; i < count; i++) {
+    painter.drawText(QPointF(xAt(i) - 8, area.bottom() + 18),
+                     QString::number(m_results.at(i).streams));
+  }
+
+  for (int i = 0; i <= 5; i++) {
+    double ms = maxMs * i / 5;
+    painter.drawText(QPointF(4, yAt(ms) + 4), QString::number(ms, 'f', 1));
+  }
+
+  painter.drawText(QPointF(area.center().x() - 40, height - 8),
+                   QObject::tr("streams"));
+  painter.drawText(QPointF(4, 16), QObject::tr("latency (ms)"));
+
+  QPainterPath p50, p99;
+
+  for (int i = 0; i < count; i++) {
+    QPointF a(xAt(i), yAt(m_results.at(i).p50Ms));
+    QPointF b(xAt(i), yAt(m_results.at(i).p99Ms));
+
+    if (i == 0) {
+      p50.moveTo(a);
+      p99.moveTo(b);
+
+    } else {
+      p50.lineTo(a);
+      p99.lineTo(b);
+    }
+  }
+
+  QPen pen(QColor("blue"), 2);
+  painter.setPen(pen);
+  painter.drawPath(p50);
+  painter.drawText(QPointF(area.right() - 60, area.top() + 16), "p50");
+  pen.setColor(QColor("red"));
+  painter.setPen(pen);
+  painter.drawPath(p99);
+  painter.drawText(QPointF(area.right() - 60, area.top() + 32), "p99");
+  painter.end();
+
+  if (!image.save(filename)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  return true;
+}
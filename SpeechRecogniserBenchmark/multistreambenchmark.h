@@ -0,0 +1,87 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef MULTISTREAMBENCHMARK_H
+#define MULTISTREAMBENCHMARK_H
+
+#include <QList>
+#include <QString>
+#include <QVector>
+
+#include <vector>
+
+/*!
+  \brief The detection latency measured for one stream count.
+
+  Latency is the time from a chunk being pushed to its RunDetection() call
+  returning.
+*/
+struct MultiStreamResult
+{
+  int streams;
+  int threads;
+  qint64 chunks;
+  qint64 dropped;
+  double p50Ms;
+  double p99Ms;
+  double maxMs;
+};
+
+/*!
+  \class MultiStreamBenchmark
+  \brief The MultiStreamBenchmark class is a load generator for
+  DetectionServer.
+
+  For each stream count it creates a server with that many streams and
+  pushes a chunk of audio for every stream once every chunk period, spread
+  evenly over the period as real capture devices would be. The audio is
+  resources/snowboy.raw looped with a second of silence between repeats, each
+  stream starting at a different offset.
+*/
+class MultiStreamBenchmark
+{
+public:
+  explicit MultiStreamBenchmark(const QString& resourceDir);
+
+  void setStreamCounts(const QList<int>& streamCounts);
+  void setDuration(int seconds);
+  void setChunkTime(int milliseconds);
+  void setThreadCount(int threadCount);
+
+  bool run();
+  QVector<MultiStreamResult> results() const;
+  bool writeCsv(const QString& filename) const;
+  bool writePlot(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  QList<int> m_streamCounts;
+  int m_duration;
+  int m_chunkTime;
+  int m_threadCount;
+  std::vector<int16_t> m_audio;
+  QVector<MultiStreamResult> m_results;
+
+  bool loadAudio();
+  MultiStreamResult runStreams(int streamCount);
+};
+
+#endif // MULTISTREAMBENCHMARK_H
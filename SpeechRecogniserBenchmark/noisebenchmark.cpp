@@ -0,0 +1,169 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <QtDebug>
+
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include "detectionpipeline.h"
+#include "microphonereader.h"
+#include "noisebenchmark.h"
+#include "snowboy-detect.h"
+
+using namespace SpeechRecognition;
+
+/* The front ends compared, in the order they are run.*/
+enum Mode
+{
+  Off,
+  Frontend,
+  Suppressor,
+  Both,
+};
+
+static const char* const MODE_NAMES[] = { "off",
+                                          "frontend",
+                                          "suppressor",
+                                          "both" };
+
+NoiseBenchmark::NoiseBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+{}
+
+/*!
+   \brief Runs every noise level with every front end. Returns false if the
+   audio or the models could not be loaded.
+*/
+bool
+NoiseBenchmark::run()
+{
+  m_results.clear();
+  QDir dir(m_resourceDir);
+
+  for (int noise : { 0, 128, 512, 1024, 2048, 4096 }) {
+    BenchmarkAudio audio;
+
+    if (!audio.build(m_resourceDir, 60, noise)) {
+      return false;
+    }
+
+    // the noise is uniform, so its RMS is the peak over root three.
+    double noiseDb =
+      (noise > 0 ? 20.0 * std::log10(noise / std::sqrt(3.0) / 32768.0)
+                 : -std::numeric_limits<double>::infinity());
+
+    // the suppressor by itself, blocked as the pipeline would see it.
+    std::vector<float> samples = audio.floatSamples();
+    NoiseSuppressor suppressor(audio.sampleRate());
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t offset = 0; offset + FRAMES_PER_BUFFER <= samples.size();
+         offset += FRAMES_PER_BUFFER) {
+      suppressor.process(samples.data() + offset, FRAMES_PER_BUFFER);
+    }
+
+    std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+    for (Mode mode : { Off, Frontend, Suppressor, Both }) {
+      DetectionPipeline pipeline;
+
+      if (!pipeline.setDetector(dir.filePath("common.res"),
+                                dir.filePath("models/snowboy.umdl"))) {
+        return false;
+      }
+
+      pipeline.setChunkPolicy(ChunkPolicy(ChunkPolicy::Fixed));
+      pipeline.detector()->ApplyFrontend(mode == Frontend || mode == Both);
+      pipeline.setNoiseSuppressorEnabled(mode == Suppressor || mode == Both);
+
+      NoiseResult result;
+      result.noiseAmplitude = noise;
+      result.noiseDb = noiseDb;
+      result.mode = MODE_NAMES[mode];
+      result.replay = audio.replay(pipeline, FRAMES_PER_BUFFER);
+
+      if (mode == Suppressor || mode == Both) {
+        const NoiseSuppressor& used = pipeline.noiseSuppressor();
+        result.suppressorCpuPercent =
+          100.0 * elapsed.count() / (1000.0 * audio.seconds());
+        result.bypassedPercent =
+          100.0 * used.bypassedFrames() / qMax(1ULL, used.frames());
+        result.noiseFloorDb = used.noiseFloorDb();
+      }
+
+      qInfo().noquote()
+        << QString("noise %1 (%2 dBFS) %3: recall %4/%5, false alarms %6, "
+                   "cpu %7%, suppressor cpu %8%, %9% bypassed")
+             .arg(noise, 4)
+             .arg(noiseDb, 0, 'f', 1)
+             .arg(result.mode, -10)
+             .arg(result.replay.detections)
+             .arg(result.replay.expected)
+             .arg(result.replay.falseAlarms)
+             .arg(result.replay.cpuPercent, 0, 'f', 2)
+             .arg(result.suppressorCpuPercent, 0, 'f', 3)
+             .arg(result.bypassedPercent, 0, 'f', 0);
+      m_results.append(result);
+    }
+  }
+
+  return true;
+}
+
+QVector<NoiseResult>
+NoiseBenchmark::results() const
+{
+  return m_results;
+}
+
+/*!
+   \brief Writes the results as comma separated values.
+*/
+bool
+NoiseBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "noise,noise_db,mode,detections,expected,false_alarms,"
+         "mean_latency_ms,cpu,suppressor_cpu,bypassed,noise_floor_db\n";
+
+  for (const NoiseResult& r : m_results) {
+    out << r.noiseAmplitude << ',' << r.noiseDb << ',' << r.mode << ','
+        << r.replay.detections << ',' << r.replay.expected << ','
+        << r.replay.falseAlarms << ',' << r.replay.meanLatencyMs << ','
+        << r.replay.cpuPercent << ',' << r.suppressorCpuPercent << ','
+        << r.bypassedPercent << ',' << r.noiseFloorDb << '\n';
+  }
+
+  return true;
+}
@@ -0,0 +1,70 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef NOISEBENCHMARK_H
+#define NOISEBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+#include "benchmarkaudio.h"
+
+/*!
+  \brief The outcome of one front end at one noise level.
+*/
+struct NoiseResult
+{
+  int noiseAmplitude = 0;
+  double noiseDb = 0;
+  QString mode;
+  ReplayResult replay;
+  double suppressorCpuPercent = 0;
+  double bypassedPercent = 0;
+  double noiseFloorDb = 0;
+};
+
+/*!
+  \class NoiseBenchmark
+  \brief The NoiseBenchmark class weighs the NoiseSuppressor against
+  snowboy's own front end, in recall and in CPU.
+
+  At each noise level the same BenchmarkAudio is replayed through a
+  DetectionPipeline four times: with no noise removal, with
+  SnowboyDetect::ApplyFrontend(true), with the NoiseSuppressor and with
+  both. The CPU of each run covers the whole pipeline, so it includes the
+  front end hidden inside RunDetection(). The suppressor is also timed on
+  its own, along with the share of frames it bypassed.
+*/
+class NoiseBenchmark
+{
+public:
+  explicit NoiseBenchmark(const QString& resourceDir);
+
+  bool run();
+  QVector<NoiseResult> results() const;
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  QVector<NoiseResult> m_results;
+};
+
+#endif // NOISEBENCHMARK_H
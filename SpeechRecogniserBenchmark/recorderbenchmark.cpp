@@ -0,0 +1,259 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <QtDebug>
+
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#include "recorderbenchmark.h"
+#include "wavrecorder.h"
+
+using namespace SpeechRecognition;
+
+static const int CHANNELS = 8;
+static const int CAPTURE_RATE = 48000;
+static const int BLOCK_FRAMES = 512;
+
+/* Fills a block with a different tone on each channel.*/
+static void
+fillBlock(AudioBlock& block, qint64 first)
+{
+  for (int c = 0; c < block.channels(); c++) {
+    float* out = block.channel(c);
+    double step = 2.0 * M_PI * 220.0 * (c + 1) / CAPTURE_RATE;
+
+    for (int i = 0; i < block.frames(); i++) {
+      out[i] = float(0.25 * std::sin(step * double(first + i)));
+    }
+  }
+}
+
+RecorderBenchmark::RecorderBenchmark(const QString& outputDir)
+  : m_directory(QDir(outputDir).filePath("recorder"))
+  , m_duration(10)
+{}
+
+/*!
+   \brief Sets the seconds each case runs for. Defaults to 10.
+*/
+void
+RecorderBenchmark::setDuration(int seconds)
+{
+  m_duration = qMax(1, seconds);
+}
+
+/*!
+   \brief Runs every case. Returns false if the recorder could not write or
+   a slow disk made capture late.
+*/
+bool
+RecorderBenchmark::run()
+{
+  m_results.clear();
+  QDir(m_directory).removeRecursively();
+
+  if (!QDir().mkpath(m_directory)) {
+    qWarning() << QObject::tr("unable to create %1").arg(m_directory);
+    return false;
+  }
+
+  qint64 dataRate = qint64(CHANNELS) * CAPTURE_RATE * 2;
+  bool ok = sustained(false) && sustained(true) && capture(0) &&
+            capture(dataRate * 2) && capture(dataRate / 2);
+
+  QDir(m_directory).removeRecursively();
+  return ok;
+}
+
+/*!
+   \brief Writes the results as comma separated values.
+*/
+bool
+RecorderBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "case,channels,direct_io,throttle_bytes_s,written_mb_s,blocks,"
+         "dropped_blocks,late_blocks,max_push_us,files\n";
+
+  for (const RecorderResult& result : m_results) {
+    out << result.name << ',' << result.channels << ','
+        << (result.directIo ? 1 : 0) << ',' << result.throttleBytesPerSecond
+        << ',' << result.writtenMBs << ',' << result.blocks << ','
+        << result.droppedBlocks << ',' << result.lateBlocks << ','
+        << result.maxPushUs << ',' << result.files << '\n';
+  }
+
+  return true;
+}
+
+/* Pushes blocks as fast as the recorder drains them. The producer only
+   backs off while every buffer is queued, so nothing is dropped and the
+   rate is the rate of the disk path.*/
+bool
+RecorderBenchmark::sustained(bool directIo)
+{
+  RecorderConfig config;
+  config.directory = m_directory;
+  config.prefix = (directIo ? "direct" : "buffered");
+  config.maxFileSeconds = 60;
+  config.directIo = directIo;
+  config.preallocate = true;
+
+  WavRecorder recorder(config);
+
+  if (!recorder.start(CHANNELS, CAPTURE_RATE)) {
+    return false;
+  }
+
+  AudioBlock block(CHANNELS, BLOCK_FRAMES);
+  fillBlock(block, 0);
+  QElapsedTimer timer;
+  qint64 limit = qint64(m_duration) * 1000000000LL;
+  quint64 blocks = 0;
+  timer.start();
+
+  while (timer.nsecsElapsed() < limit) {
+    if (recorder.queuedBuffers() >= config.bufferCount - 1) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      continue;
+    }
+
+    recorder.push(block);
+    blocks++;
+  }
+
+  recorder.stop();
+  double seconds = timer.nsecsElapsed() / 1.0e9;
+
+  RecorderResult result;
+  result.name = (directIo ? "sustained_direct" : "sustained_buffered");
+  result.channels = CHANNELS;
+  result.directIo = directIo;
+  result.throttleBytesPerSecond = 0;
+  result.writtenMBs = recorder.bytesWritten() / seconds / (1024.0 * 1024.0);
+  result.blocks = blocks;
+  result.droppedBlocks = recorder.droppedBlocks();
+  result.lateBlocks = 0;
+  result.maxPushUs = 0;
+  result.files = recorder.files().size();
+  m_results.append(result);
+
+  qInfo().noquote() << QString("%1: %2 MB/s, %3 files, %4 write errors")
+                         .arg(result.name)
+                         .arg(result.writtenMBs, 0, 'f', 1)
+                         .arg(result.files)
+                         .arg(recorder.writeErrors());
+  return recorder.writeErrors() == 0;
+}
+
+/* Pushes blocks at the capture rate from a thread standing in for the audio
+   callback, timing every push() against the block period.*/
+bool
+RecorderBenchmark::capture(qint64 throttleBytesPerSecond)
+{
+  RecorderConfig config;
+  config.directory = m_directory;
+  config.prefix = "capture";
+  config.maxFileSeconds = qMax(1, m_duration / 3);
+  config.throttleBytesPerSecond = throttleBytesPerSecond;
+
+  WavRecorder recorder(config);
+
+  if (!recorder.start(CHANNELS, CAPTURE_RATE)) {
+    return false;
+  }
+
+  RecorderResult result;
+  result.name =
+    (throttleBytesPerSecond == 0 ? "capture_unthrottled" : "capture_throttled");
+  result.channels = CHANNELS;
+  result.directIo = false;
+  result.throttleBytesPerSecond = throttleBytesPerSecond;
+  result.blocks = 0;
+  result.lateBlocks = 0;
+  result.maxPushUs = 0;
+
+  std::thread callback([&] {
+    AudioBlock block(CHANNELS, BLOCK_FRAMES);
+    auto period = std::chrono::nanoseconds(qint64(BLOCK_FRAMES) *
+                                           1000000000LL / CAPTURE_RATE);
+    quint64 total = quint64(m_duration) * CAPTURE_RATE / BLOCK_FRAMES;
+    auto due = std::chrono::steady_clock::now();
+
+    for (quint64 i = 0; i < total; i++) {
+      due += period;
+      std::this_thread::sleep_until(due);
+      fillBlock(block, qint64(i) * BLOCK_FRAMES);
+
+      auto start = std::chrono::steady_clock::now();
+      recorder.push(block);
+      auto took = std::chrono::steady_clock::now() - start;
+
+      result.maxPushUs = qMax(
+        result.maxPushUs,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(took).count() /
+          1000.0);
+
+      if (took > period) {
+        result.lateBlocks++;
+      }
+
+      result.blocks++;
+    }
+  });
+
+  QElapsedTimer timer;
+  timer.start();
+  callback.join();
+  recorder.stop();
+
+  result.writtenMBs =
+    recorder.bytesWritten() / (timer.nsecsElapsed() / 1.0e9) /
+    (1024.0 * 1024.0);
+  result.droppedBlocks = recorder.droppedBlocks();
+  result.files = recorder.files().size();
+  m_results.append(result);
+
+  qInfo().noquote()
+    << QString("%1 at %2 KB/s: %3 blocks, %4 dropped, %5 late, max push "
+               "%6 us, %7 files")
+         .arg(result.name)
+         .arg(throttleBytesPerSecond / 1024)
+         .arg(result.blocks)
+         .arg(result.droppedBlocks)
+         .arg(result.lateBlocks)
+         .arg(result.maxPushUs, 0, 'f', 1)
+         .arg(result.files);
+  return result.lateBlocks == 0 && recorder.writeErrors() == 0;
+}
@@ -0,0 +1,81 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef RECORDERBENCHMARK_H
+#define RECORDERBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+/*!
+  \brief The outcome of one WavRecorder case.
+*/
+struct RecorderResult
+{
+  QString name;
+  int channels;
+  bool directIo;
+  qint64 throttleBytesPerSecond;
+  double writtenMBs;
+  quint64 blocks;
+  quint64 droppedBlocks;
+  quint64 lateBlocks;
+  double maxPushUs;
+  int files;
+};
+
+/*!
+  \class RecorderBenchmark
+  \brief The RecorderBenchmark class measures how fast a WavRecorder gets
+  audio onto disk and whether a slow disk ever reaches back into capture.
+
+  The sustained cases push 8 channel blocks as fast as the recorder drains
+  them, through the page cache and with direct I/O, and report MB/s. The
+  capture cases pace 8 channels of 48 kHz audio in real time like an audio
+  callback, with the recorder throttled above and below the data rate. A
+  block whose push() overruns its period would have been a capture
+  overflow, so those are counted as late blocks alongside the blocks the
+  recorder had to drop. A disk slower than the data rate should cost
+  dropped blocks only, never late ones.
+
+  Files are written under recorder/ in the output directory and removed
+  afterwards.
+*/
+class RecorderBenchmark
+{
+public:
+  explicit RecorderBenchmark(const QString& outputDir);
+
+  void setDuration(int seconds);
+
+  bool run();
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QString m_directory;
+  int m_duration;
+  QVector<RecorderResult> m_results;
+
+  bool sustained(bool directIo);
+  bool capture(qint64 throttleBytesPerSecond);
+};
+
+#endif // RECORDERBENCHMARK_H
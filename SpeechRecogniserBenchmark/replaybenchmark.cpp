@@ -0,0 +1,189 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QTextStream>
+#include <QtDebug>
+
+#include "fileaudiosource.h"
+#include "replaybenchmark.h"
+#include "speechrecogniser.h"
+
+using namespace SpeechRecognition;
+
+ReplayBenchmark::ReplayBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+  , m_file(QDir(resourceDir).filePath("snowboy.wav"))
+  , m_fast(false)
+  , m_loops(10)
+  , m_jitter(0)
+  , m_stallProbability(0.0)
+  , m_stall(0)
+  , m_audioSeconds(0)
+  , m_wallSeconds(0)
+  , m_blocks(0)
+  , m_overflows(0)
+  , m_hotwords(0)
+  , m_detectionCalls(0)
+  , m_gatedBlocks(0)
+{}
+
+/*!
+   \brief Sets the WAV, compressed or raw file to replay. A file that does
+   not end in .wav or .sla is read as 16 kHz mono 16 bit raw samples.
+   Defaults to resources/snowboy.wav.
+*/
+void
+ReplayBenchmark::setFile(const QString& filename)
+{
+  m_file = filename;
+}
+
+/*!
+   \brief Replays as fast as the pipeline takes the audio instead of in real
+   time.
+*/
+void
+ReplayBenchmark::setFastAsPossible(bool fast)
+{
+  m_fast = fast;
+}
+
+/*!
+   \brief Sets the number of times the file is played. Defaults to 10.
+*/
+void
+ReplayBenchmark::setLoops(int loops)
+{
+  m_loops = qMax(1, loops);
+}
+
+void
+ReplayBenchmark::setJitter(int maxMilliseconds)
+{
+  m_jitter = maxMilliseconds;
+}
+
+void
+ReplayBenchmark::setStalls(double probability, int milliseconds)
+{
+  m_stallProbability = probability;
+  m_stall = milliseconds;
+}
+
+/*!
+   \brief Replays the file. Returns false if the file or the models could
+   not be loaded.
+*/
+bool
+ReplayBenchmark::run()
+{
+  FileAudioSource* source = new FileAudioSource;
+  bool opened = (m_file.endsWith(".wav", Qt::CaseInsensitive) ||
+                     m_file.endsWith(".sla", Qt::CaseInsensitive)
+                   ? source->open(m_file)
+                   : source->openRaw(m_file));
+
+  if (!opened) {
+    delete source;
+    return false;
+  }
+
+  source->setPacing(m_fast ? FileAudioSource::AsFastAsPossible
+                           : FileAudioSource::RealTime);
+  source->setLoops(m_loops);
+  source->setJitter(m_jitter);
+  source->setStalls(m_stallProbability, m_stall);
+  m_audioSeconds = double(source->frames()) * m_loops / source->sampleRate();
+
+  QEventLoop loop;
+  QElapsedTimer timer;
+  m_hotwords = 0;
+
+  // the source is owned by the recogniser from here, and deleted on its own
+  // thread once it finishes, so take its counts as it does.
+  QObject::connect(source, &AudioSource::finished, &loop, [&] {
+    m_blocks = source->blocksSent();
+    m_overflows = source->overflowCount();
+    loop.quit();
+  });
+
+  SpeechRecogniser recogniser(source, nullptr);
+  QDir resources(m_resourceDir);
+
+  if (!recogniser.setDetector(resources.filePath("common.res"),
+                              resources.filePath("models/snowboy.umdl"))) {
+    recogniser.stop();
+    return false;
+  }
+
+  QObject::connect(&recogniser,
+                   &SpeechRecogniser::hotwordDetected,
+                   [this](int) { m_hotwords++; });
+
+  timer.start();
+  loop.exec();
+  m_wallSeconds = timer.nsecsElapsed() / 1.0e9;
+
+  DetectionStats stats = recogniser.pipeline()->stats();
+  m_detectionCalls = stats.detectionCalls;
+  m_gatedBlocks = stats.gatedBlocks;
+
+  qInfo().noquote()
+    << QString("%1 s of audio in %2 s (x%3), %4 blocks, %5 overflows, "
+               "%6 detection calls, %7 hotwords of %8 played")
+         .arg(m_audioSeconds, 0, 'f', 2)
+         .arg(m_wallSeconds, 0, 'f', 2)
+         .arg(m_audioSeconds / m_wallSeconds, 0, 'f', 1)
+         .arg(m_blocks)
+         .arg(m_overflows)
+         .arg(m_detectionCalls)
+         .arg(m_hotwords)
+         .arg(m_loops);
+  return true;
+}
+
+/*!
+   \brief Writes the results as comma separated values.
+*/
+bool
+ReplayBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "file,pacing,jitter_ms,stall_probability,stall_ms,audio_s,wall_s,"
+         "blocks,overflows,detection_calls,gated_blocks,hotwords,played\n";
+  out << '"' << m_file << "\"," << (m_fast ? "fast" : "realtime") << ','
+      << m_jitter << ',' << m_stallProbability << ',' << m_stall << ','
+      << m_audioSeconds << ',' << m_wallSeconds << ',' << m_blocks << ','
+      << m_overflows << ',' << m_detectionCalls << ',' << m_gatedBlocks
+      << ',' << m_hotwords << ',' << m_loops << '\n';
+  return true;
+}
@@ -0,0 +1,70 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef REPLAYBENCHMARK_H
+#define REPLAYBENCHMARK_H
+
+#include <QString>
+
+/*!
+  \class ReplayBenchmark
+  \brief The ReplayBenchmark class replays a recording through a
+  SpeechRecogniser with a FileAudioSource, the same pipeline as a live
+  microphone, and reports how fast it ran and what it detected.
+
+  Paced in real time with jitter and stalls it shows how the pipeline copes
+  with an uneven audio thread, and whether blocks overflow. As fast as
+  possible it measures the throughput of the whole pipeline.
+*/
+class ReplayBenchmark
+{
+public:
+  explicit ReplayBenchmark(const QString& resourceDir);
+
+  void setFile(const QString& filename);
+  void setFastAsPossible(bool fast);
+  void setLoops(int loops);
+  void setJitter(int maxMilliseconds);
+  void setStalls(double probability, int milliseconds);
+
+  bool run();
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  QString m_file;
+  bool m_fast;
+  int m_loops;
+  int m_jitter;
+  double m_stallProbability;
+  int m_stall;
+
+  // results
+  double m_audioSeconds;
+  double m_wallSeconds;
+  quint64 m_blocks;
+  quint64 m_overflows;
+  int m_hotwords;
+  quint64 m_detectionCalls;
+  quint64 m_gatedBlocks;
+};
+
+#endif // REPLAYBENCHMARK_H
@@ -0,0 +1,255 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <QtDebug>
+
+#include <algorithm>
+#include <chrono>
+
+#include "detectionpipeline.h"
+#include "microphonereader.h"
+#include "selftriggerbenchmark.h"
+
+using namespace SpeechRecognition;
+
+/* The sounds the device plays, numbered as they are added to the gate.*/
+enum Sound
+{
+  Ding,
+  Reply,
+};
+
+/* How the playback reaches the microphone, in samples and linear gain.*/
+static const int DIRECT_DELAY = 192;
+static const float DIRECT_GAIN = 0.5f;
+static const int REFLECTION_DELAY = 720;
+static const float REFLECTION_GAIN = 0.2f;
+
+/* The difference between the player's clock and the capture clock.*/
+static const qint64 CLOCK_ERROR_NS = 3000000;
+
+/* Any non zero steady clock time for the first captured sample.*/
+static const qint64 CAPTURE_START_NS = 1000000000;
+
+SelfTriggerBenchmark::SelfTriggerBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+{}
+
+/*!
+   \brief Runs the audio without the gate and in each gate mode. Returns
+   false if the audio, the sounds or the models could not be loaded.
+*/
+bool
+SelfTriggerBenchmark::run()
+{
+  m_results.clear();
+  QDir dir(m_resourceDir);
+  BenchmarkAudio audio;
+  std::vector<std::vector<float>> sounds(2);
+
+  if (!audio.build(m_resourceDir, 60) ||
+      !BenchmarkAudio::loadSound(dir.filePath("ding.wav"), sounds[Ding]) ||
+      !BenchmarkAudio::loadSound(dir.filePath("snowboy.wav"),
+                                 sounds[Reply])) {
+    return false;
+  }
+
+  const int rate = audio.sampleRate();
+  const std::vector<size_t>& ends = audio.hotwordEnds();
+  auto timeOf = [rate](size_t sample) {
+    return CAPTURE_START_NS + qint64(sample) * 1000000000 / rate;
+  };
+
+  for (int mode : { -1, int(PlaybackGate::Skip), int(PlaybackGate::Subtract) }) {
+    DetectionPipeline pipeline;
+
+    if (!pipeline.setDetector(dir.filePath("common.res"),
+                              dir.filePath("models/snowboy.umdl"))) {
+      return false;
+    }
+
+    pipeline.setChunkPolicy(ChunkPolicy(ChunkPolicy::Fixed));
+    PlaybackGate& gate = pipeline.playbackGate();
+
+    if (mode >= 0) {
+      pipeline.setPlaybackGateEnabled(true);
+      gate.setMode(PlaybackGate::Mode(mode));
+
+      for (const std::vector<float>& sound : sounds) {
+        gate.addPrompt(sound.data(), int(sound.size()));
+      }
+    }
+
+    SelfTriggerResult result;
+    result.mode =
+      (mode < 0 ? "off" : mode == PlaybackGate::Skip ? "skip" : "subtract");
+    result.replay.expected = int(ends.size());
+    std::vector<float> mic = audio.floatSamples();
+
+    // plays a sound whose first sample leaves the speaker at start.
+    auto play = [&](int sound, size_t start) {
+      const std::vector<float>& samples = sounds[size_t(sound)];
+
+      for (size_t i = 0; i < samples.size(); i++) {
+        size_t direct = start + DIRECT_DELAY + i;
+        size_t reflection = start + REFLECTION_DELAY + i;
+
+        if (direct < mic.size()) {
+          mic[direct] += DIRECT_GAIN * samples[i];
+        }
+
+        if (reflection < mic.size()) {
+          mic[reflection] += REFLECTION_GAIN * samples[i];
+        }
+      }
+
+      gate.schedule(sound,
+                    timeOf(start) + CLOCK_ERROR_NS,
+                    qint64(samples.size()) * 1000000000 / rate);
+      result.soundsPlayed++;
+    };
+
+    // the reply starts 1.6 s after each hotword, well clear of the next.
+    std::vector<size_t> replies;
+
+    for (size_t end : ends) {
+      replies.push_back(end + size_t(rate) * 8 / 5);
+    }
+
+    size_t nextReply = 0;
+    size_t nextHotword = 0;
+    double totalLatencyMs = 0;
+
+    for (size_t captured = 0; captured < mic.size();) {
+      size_t block = std::min(size_t(FRAMES_PER_BUFFER), mic.size() - captured);
+
+      // played() comes as the buffer holding the start is rendered.
+      while (nextReply < replies.size() &&
+             replies[nextReply] < captured + 2 * block) {
+        play(Reply, replies[nextReply++]);
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      int hotword = pipeline.process(
+        mic.data() + captured, int(block), 0, timeOf(captured));
+      std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+      result.replay.busyMs += elapsed.count();
+      captured += block;
+
+      if (hotword <= 0) {
+        continue;
+      }
+
+      play(Ding, captured + size_t(rate) / 50);
+      bool found = false;
+      size_t latest = 0;
+
+      while (nextHotword < ends.size() && ends[nextHotword] <= captured) {
+        latest = nextHotword++;
+        found = true;
+      }
+
+      if (!found) {
+        result.replay.falseAlarms++;
+        continue;
+      }
+
+      double latencyMs =
+        1000.0 * double(captured - ends[latest]) / rate + elapsed.count();
+      totalLatencyMs += latencyMs;
+      result.replay.maxLatencyMs =
+        std::max(result.replay.maxLatencyMs, latencyMs);
+      result.replay.detections++;
+    }
+
+    result.replay.calls = qint64(pipeline.stats().detectionCalls);
+    result.replay.cpuPercent =
+      100.0 * result.replay.busyMs / (1000.0 * audio.seconds());
+    result.replay.meanLatencyMs =
+      (result.replay.detections > 0
+         ? totalLatencyMs / result.replay.detections
+         : 0);
+    result.blocks = pipeline.stats().blocks;
+    result.skippedBlocks = pipeline.stats().playbackSkippedBlocks;
+    result.skippedSamples = pipeline.stats().playbackSkippedSamples;
+    result.echoReductionDb = gate.echoReductionDb();
+
+    qint64 avoided = (m_results.isEmpty()
+                        ? 0
+                        : m_results.first().replay.calls - result.replay.calls);
+    qInfo().noquote()
+      << QString("%1: hotwords %2/%3, self triggers %4, %5 sounds, "
+                 "%6 of %7 blocks skipped (%8 s), %9 detector calls avoided, "
+                 "echo reduced %10 dB, cpu %11%")
+           .arg(result.mode, 8)
+           .arg(result.replay.detections)
+           .arg(result.replay.expected)
+           .arg(result.replay.falseAlarms)
+           .arg(result.soundsPlayed)
+           .arg(result.skippedBlocks)
+           .arg(result.blocks)
+           .arg(double(result.skippedSamples) / rate, 0, 'f', 1)
+           .arg(avoided)
+           .arg(result.echoReductionDb, 0, 'f', 1)
+           .arg(result.replay.cpuPercent, 0, 'f', 2);
+    m_results.append(result);
+  }
+
+  return true;
+}
+
+QVector<SelfTriggerResult>
+SelfTriggerBenchmark::results() const
+{
+  return m_results;
+}
+
+/*!
+   \brief Writes the results as comma separated values.
+*/
+bool
+SelfTriggerBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "mode,detections,expected,false_alarms,sounds,calls,blocks,"
+         "skipped_blocks,skipped_samples,echo_reduction_db,cpu_percent\n";
+
+  for (const SelfTriggerResult& r : m_results) {
+    out << r.mode << ',' << r.replay.detections << ',' << r.replay.expected
+        << ',' << r.replay.falseAlarms << ',' << r.soundsPlayed << ','
+        << r.replay.calls << ',' << r.blocks << ',' << r.skippedBlocks << ','
+        << r.skippedSamples << ',' << r.echoReductionDb << ','
+        << r.replay.cpuPercent << '\n';
+  }
+
+  return true;
+}
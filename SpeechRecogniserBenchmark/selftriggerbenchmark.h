@@ -0,0 +1,74 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef SELFTRIGGERBENCHMARK_H
+#define SELFTRIGGERBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+#include "benchmarkaudio.h"
+
+/*!
+  \brief The outcome of one playback gate mode.
+*/
+struct SelfTriggerResult
+{
+  QString mode;
+  ReplayResult replay;
+  int soundsPlayed = 0;
+  quint64 blocks = 0;
+  quint64 skippedBlocks = 0;
+  quint64 skippedSamples = 0;
+  double echoReductionDb = 0;
+};
+
+/*!
+  \class SelfTriggerBenchmark
+  \brief The SelfTriggerBenchmark class measures how well the PlaybackGate
+  stops the device's own sounds triggering detection.
+
+  BenchmarkAudio is replayed through a DetectionPipeline with the echo of
+  the device's playback mixed in, as the microphone would hear it: a direct
+  path 12 ms late and a weaker reflection. Every detection plays ding.wav
+  20 ms later, and between hotwords the device plays a spoken reply,
+  snowboy.wav, which is exactly what a self trigger sounds like. The
+  player's timeline is given to the gate a buffer ahead, 3 ms out, as
+  FeedbackPlayer::played() would give it.
+
+  The audio is run without the gate, in Skip mode and in Subtract mode.
+  Detections of the reply count as false alarms.
+*/
+class SelfTriggerBenchmark
+{
+public:
+  explicit SelfTriggerBenchmark(const QString& resourceDir);
+
+  bool run();
+  QVector<SelfTriggerResult> results() const;
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  QVector<SelfTriggerResult> m_results;
+};
+
+#endif // SELFTRIGGERBENCHMARK_H
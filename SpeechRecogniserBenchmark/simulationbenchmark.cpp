@@ -0,0 +1,189 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <QtDebug>
+
+#include <functional>
+
+#include "benchmarkaudio.h"
+#include "detectionpipeline.h"
+#include "simulationbenchmark.h"
+
+using namespace SpeechRecognition;
+
+static const int SECONDS = 60;
+
+SimulationBenchmark::SimulationBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+  , m_seed(1)
+{}
+
+/*!
+   \brief Sets the seed every scenario starts from. Defaults to 1.
+*/
+void
+SimulationBenchmark::setSeed(quint32 seed)
+{
+  m_seed = seed;
+}
+
+/*!
+   \brief Runs every scenario twice. Returns false if a scenario did not
+   repeat exactly, or the audio or the model could not be loaded.
+*/
+bool
+SimulationBenchmark::run(const QString& outputDir)
+{
+  m_results.clear();
+  BenchmarkAudio audio;
+
+  if (!audio.build(m_resourceDir, SECONDS, 64)) {
+    return false;
+  }
+
+  const std::vector<float> samples = audio.floatSamples();
+  QDir dir(m_resourceDir);
+
+  struct Scenario
+  {
+    const char* name;
+    std::function<void(SimulationConfig&)> load;
+  };
+
+  const Scenario scenarios[] = {
+    { "idle", [](SimulationConfig&) {} },
+    { "stalled_consumer",
+      [](SimulationConfig& config) {
+        config.consumerRealTimeFactor = 0.5;
+        config.consumerStallProbability = 0.02;
+        config.consumerStallMs = 400;
+        config.maxQueued = 8 * config.framesPerBuffer;
+      } },
+    { "preempted_callback",
+      [](SimulationConfig& config) {
+        config.callbackJitterUs = 5000;
+        config.callbackStallProbability = 0.01;
+        config.callbackStallMs = 200;
+      } },
+    { "drifting_clock",
+      [](SimulationConfig& config) {
+        config.clockDriftPpm = 200.0;
+        config.adcTimeReported = false;
+        config.callbackJitterUs = 2000;
+      } },
+  };
+
+  bool ok = true;
+
+  for (const Scenario& scenario : scenarios) {
+    SimulationResult result;
+    result.scenario = scenario.name;
+    result.seed = m_seed;
+    quint64 digests[2] = {};
+
+    for (int repeat = 0; repeat < 2; repeat++) {
+      SimulationConfig config;
+      config.seed = m_seed;
+      scenario.load(config);
+
+      DetectionPipeline pipeline;
+
+      if (!pipeline.setDetector(dir.filePath("common.res"),
+                                dir.filePath("models/snowboy.umdl"))) {
+        return false;
+      }
+
+      CaptureSimulator simulator(config);
+      simulator.setAudio(samples);
+      simulator.setPipeline(&pipeline);
+      simulator.run(SECONDS);
+      digests[repeat] = simulator.digest();
+
+      if (repeat == 0) {
+        result.stats = simulator.stats();
+        simulator.writeCsv(QDir(outputDir).filePath(
+          QString("simulation-%1.csv").arg(scenario.name)));
+      }
+    }
+
+    result.digest = digests[0];
+    result.repeatable = (digests[0] == digests[1]);
+    ok = ok && result.repeatable;
+
+    const SimulationStats& stats = result.stats;
+    qInfo().noquote()
+      << QString("%1: %2 callbacks, %3 buffers lost, %4 blocks dropped, "
+                 "%5 detections, queue up to %6 frames, latency up to "
+                 "%7 ms, digest %8 %9")
+           .arg(result.scenario, -18)
+           .arg(stats.callbacks)
+           .arg(stats.lostBuffers)
+           .arg(stats.droppedBlocks)
+           .arg(stats.detections)
+           .arg(stats.maxQueued)
+           .arg(stats.maxLatencyMs, 0, 'f', 1)
+           .arg(result.digest, 16, 16, QChar('0'))
+           .arg(result.repeatable ? "repeated" : "DIFFERED");
+    m_results.append(result);
+  }
+
+  return ok;
+}
+
+QVector<SimulationResult>
+SimulationBenchmark::results() const
+{
+  return m_results;
+}
+
+/*!
+   \brief Writes the totals of each scenario as comma separated values.
+*/
+bool
+SimulationBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "scenario,seed,callbacks,lost_buffers,overflows,dropped_blocks,"
+         "consumed_blocks,detections,max_queued,max_latency_ms,digest,"
+         "repeatable\n";
+
+  for (const SimulationResult& r : m_results) {
+    out << r.scenario << ',' << r.seed << ',' << r.stats.callbacks << ','
+        << r.stats.lostBuffers << ',' << r.stats.overflows << ','
+        << r.stats.droppedBlocks << ',' << r.stats.consumedBlocks << ','
+        << r.stats.detections << ',' << r.stats.maxQueued << ','
+        << r.stats.maxLatencyMs << ','
+        << QString("%1").arg(r.digest, 16, 16, QChar('0')) << ','
+        << (r.repeatable ? 1 : 0) << '\n';
+  }
+
+  return true;
+}
@@ -0,0 +1,70 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef SIMULATIONBENCHMARK_H
+#define SIMULATIONBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+#include "capturesimulator.h"
+
+/*!
+  \brief The outcome of one simulated scenario.
+*/
+struct SimulationResult
+{
+  QString scenario;
+  quint32 seed = 0;
+  SpeechRecognition::SimulationStats stats;
+  quint64 digest = 0;
+  bool repeatable = false;
+};
+
+/*!
+  \class SimulationBenchmark
+  \brief The SimulationBenchmark class runs the capture path through a
+  CaptureSimulator under a set of loads and checks that every run repeats
+  exactly.
+
+  Each scenario replays BenchmarkAudio through a DetectionPipeline: an idle
+  machine, a consumer that stalls, a capture thread that is preempted, and
+  a drifting device clock on a host API without ADC times. Every scenario
+  is run twice from the same seed, and the two event digests must match.
+  The events of the first run are written to simulation-<scenario>.csv.
+*/
+class SimulationBenchmark
+{
+public:
+  explicit SimulationBenchmark(const QString& resourceDir);
+
+  void setSeed(quint32 seed);
+  bool run(const QString& outputDir);
+  QVector<SimulationResult> results() const;
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  quint32 m_seed;
+  QVector<SimulationResult> m_results;
+};
+
+#endif // SIMULATIONBENCHMARK_H
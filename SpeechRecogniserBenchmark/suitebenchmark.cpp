@@ -0,0 +1,605 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QPainter>
+#include <QSysInfo>
+#include <QThread>
+#include <QtDebug>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "audioblock.h"
+#include "benchmarkaudio.h"
+#include "circularbuffer.h"
+#include "detectionpipeline.h"
+#include "microphoneplot.h"
+#include "microphonereader.h"
+#include "sampleconversion.h"
+#include "spectrogram.h"
+#include "suitebenchmark.h"
+
+using namespace SpeechRecognition;
+
+using Clock = std::chrono::steady_clock;
+
+/* Blocks sent through the handoff in each repetition, and the gap between
+   them, short enough to keep the run quick and long enough that the
+   consumer is idle when each one arrives, as it is when keeping up.*/
+static const int HANDOFF_BLOCKS = 1000;
+static const int HANDOFF_GAP_US = 500;
+
+/* Seconds of BenchmarkAudio run through each model.*/
+static const int MODEL_SECONDS = 30;
+
+/* Stops the compiler dropping a result nothing reads.*/
+static volatile float g_sink;
+
+static double
+elapsedNs(Clock::time_point start)
+{
+  return std::chrono::duration<double, std::nano>(Clock::now() - start)
+    .count();
+}
+
+static double
+percentile(std::vector<double> values, double fraction)
+{
+  if (values.empty()) {
+    return 0.0;
+  }
+
+  size_t index = size_t(fraction * double(values.size() - 1) + 0.5);
+  std::nth_element(values.begin(), values.begin() + long(index), values.end());
+  return values[index];
+}
+
+/* Fills count samples with a fixed, speech like mix of two tones.*/
+static std::vector<float>
+testSignal(size_t count, double sampleRate)
+{
+  std::vector<float> samples(count);
+
+  for (size_t i = 0; i < count; i++) {
+    double t = double(i) / sampleRate;
+    samples[i] = float(0.3 * std::sin(2.0 * M_PI * 220.0 * t) +
+                       0.1 * std::sin(2.0 * M_PI * 1870.0 * t));
+  }
+
+  return samples;
+}
+
+SuiteBenchmark::SuiteBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+  , m_repetitions(5)
+{}
+
+/*!
+   \brief Returns the number of timed repetitions of each case. Defaults to
+   5.
+*/
+int
+SuiteBenchmark::repetitions() const
+{
+  return m_repetitions;
+}
+
+/*!
+   \brief Sets the number of timed repetitions of each case.
+*/
+void
+SuiteBenchmark::setRepetitions(int repetitions)
+{
+  m_repetitions = qMax(1, repetitions);
+}
+
+/*!
+   \brief Runs every case. Returns false if the models or audio could not
+   be loaded, the results so far are kept.
+*/
+bool
+SuiteBenchmark::run()
+{
+  m_results.clear();
+  measureCircularBuffer();
+  measureConversion();
+  measureResampling();
+  measureHandoff();
+  measurePlot();
+  measureSpectrogram();
+  return measureModels();
+}
+
+QVector<SuiteResult>
+SuiteBenchmark::results() const
+{
+  return m_results;
+}
+
+/*!
+   \brief Writes the environment and results as a JSON document.
+*/
+bool
+SuiteBenchmark::writeJson(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QJsonArray results;
+
+  for (const SuiteResult& r : m_results) {
+    QJsonObject result;
+    result["name"] = r.name;
+    result["kind"] = r.kind;
+    result["unit"] = r.unit;
+    result["repetitions"] = r.repetitions;
+    result["median"] = r.median;
+    result["min"] = r.minimum;
+    result["max"] = r.maximum;
+    result["parameters"] = r.parameters;
+    results.append(result);
+  }
+
+  QJsonObject root;
+  root["schema"] = 1;
+  root["suite"] = "SpeechRecogniserBenchmark";
+  root["environment"] = environment();
+  root["results"] = results;
+  file.write(QJsonDocument(root).toJson());
+  return true;
+}
+
+/*!
+   \brief Returns what the results depend on: the machine, its operating
+   system, the build and the source revision.
+*/
+QJsonObject
+SuiteBenchmark::environment()
+{
+  QJsonObject env;
+  env["timestamp"] =
+    QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+  env["host"] = QSysInfo::machineHostName();
+  env["os"] = QSysInfo::prettyProductName();
+  env["kernel"] = QSysInfo::kernelType() + " " + QSysInfo::kernelVersion();
+  env["architecture"] = QSysInfo::currentCpuArchitecture();
+  env["abi"] = QSysInfo::buildAbi();
+  env["cores"] = QThread::idealThreadCount();
+  env["qt_runtime"] = QString(qVersion());
+  env["qt_build"] = QString(QT_VERSION_STR);
+
+  // the CPU name is "model name" on x86 and "Hardware" or "Model" on ARM.
+  QString cpu;
+  QFile cpuinfo("/proc/cpuinfo");
+
+  if (cpuinfo.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    for (const QString& line : QString(cpuinfo.readAll()).split('\n')) {
+      QString key = line.section(':', 0, 0).trimmed();
+
+      if (key == "model name" || key == "Hardware" || key == "Model") {
+        cpu = line.section(':', 1).trimmed();
+        break;
+      }
+    }
+  }
+
+  env["cpu"] = cpu;
+
+  // anything but "performance" lets the clock wander between runs.
+  QFile governor("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor");
+
+  if (governor.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    env["governor"] = QString(governor.readAll()).trimmed();
+  }
+
+#if defined(__clang__)
+  env["compiler"] = QString("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+  env["compiler"] = QString("gcc ") + __VERSION__;
+#elif defined(_MSC_VER)
+  env["compiler"] = QString("msvc %1").arg(_MSC_VER);
+#endif
+
+#if defined(__AVX2__)
+  env["simd"] = "avx2";
+#elif defined(__SSE2__)
+  env["simd"] = "sse2";
+#elif defined(__ARM_NEON)
+  env["simd"] = "neon";
+#else
+  env["simd"] = "none";
+#endif
+
+#if defined(QT_NO_DEBUG)
+  env["build"] = "release";
+#else
+  env["build"] = "debug";
+#endif
+
+#if defined(GIT_REVISION)
+  env["revision"] = QString(GIT_REVISION);
+#endif
+
+  return env;
+}
+
+/* Runs repetition once to warm up, then repetitions() times, and records
+   the values it returns.*/
+void
+SuiteBenchmark::measure(const QString& name,
+                        const QString& kind,
+                        const QString& unit,
+                        const std::function<double()>& repetition,
+                        const QJsonObject& parameters)
+{
+  repetition();
+  std::vector<double> values;
+
+  for (int i = 0; i < m_repetitions; i++) {
+    values.push_back(repetition());
+  }
+
+  record(name, kind, unit, values, parameters);
+}
+
+/* Summarises the values of one case.*/
+void
+SuiteBenchmark::record(const QString& name,
+                       const QString& kind,
+                       const QString& unit,
+                       std::vector<double> values,
+                       const QJsonObject& parameters)
+{
+  std::sort(values.begin(), values.end());
+  SuiteResult result;
+  result.name = name;
+  result.kind = kind;
+  result.unit = unit;
+  result.repetitions = int(values.size());
+  result.median = percentile(values, 0.5);
+  result.minimum = values.front();
+  result.maximum = values.back();
+  result.parameters = parameters;
+  m_results.append(result);
+
+  qInfo().noquote() << QString("%1 %2 %3 (min %4, max %5)")
+                         .arg(name, -32)
+                         .arg(result.median, 10, 'f', 3)
+                         .arg(unit)
+                         .arg(result.minimum, 0, 'f', 3)
+                         .arg(result.maximum, 0, 'f', 3);
+}
+
+/* Appends capture blocks to the buffer MicrophonePlot draws from, and reads
+   it back the way paintEvent() does.*/
+void
+SuiteBenchmark::measureCircularBuffer()
+{
+  const int size = 8000;
+  const int blocks = 2000;
+  QVector<float> block(FRAMES_PER_BUFFER, 0.25f);
+  CircularBuffer<float> buffer(size);
+  QJsonObject parameters;
+  parameters["capacity"] = size;
+  parameters["block"] = FRAMES_PER_BUFFER;
+
+  measure("circularbuffer.append", "micro", "ns/block", [&] {
+    auto start = Clock::now();
+
+    for (int i = 0; i < blocks; i++) {
+      buffer << block;
+    }
+
+    return elapsedNs(start) / blocks;
+  }, parameters);
+
+  measure("circularbuffer.read", "micro", "ns/sample", [&] {
+    const int passes = 100;
+    float sum = 0.0f;
+    auto start = Clock::now();
+
+    for (int pass = 0; pass < passes; pass++) {
+      for (int i = 0; i < buffer.size(); i++) {
+        sum += buffer.get(i);
+      }
+    }
+
+    g_sink = sum;
+    return elapsedNs(start) / (double(passes) * buffer.size());
+  }, parameters);
+}
+
+/* The conversions on the capture path, on a cache sized buffer.*/
+void
+SuiteBenchmark::measureConversion()
+{
+  const size_t count = 16384;
+  const int passes = 200;
+  std::vector<float> floats = testSignal(count, 16000.0);
+  std::vector<int16_t> shorts(count);
+  std::vector<float> left(count / 2), right(count / 2);
+  float* planes[] = { left.data(), right.data() };
+  QJsonObject parameters;
+  parameters["samples"] = int(count);
+
+  measure("conversion.float32_int16", "micro", "ns/sample", [&] {
+    auto start = Clock::now();
+
+    for (int pass = 0; pass < passes; pass++) {
+      convertSamples<SampleFormat::Float32, SampleFormat::Int16>(
+        floats.data(), shorts.data(), count);
+    }
+
+    return elapsedNs(start) / (double(passes) * count);
+  }, parameters);
+
+  measure("conversion.int16_float32", "micro", "ns/sample", [&] {
+    auto start = Clock::now();
+
+    for (int pass = 0; pass < passes; pass++) {
+      convertSamples<SampleFormat::Int16, SampleFormat::Float32>(
+        shorts.data(), floats.data(), count);
+    }
+
+    return elapsedNs(start) / (double(passes) * count);
+  }, parameters);
+
+  measure("conversion.deinterleave_stereo", "micro", "ns/sample", [&] {
+    auto start = Clock::now();
+
+    for (int pass = 0; pass < passes; pass++) {
+      interleavedToPlanar<SampleFormat::Float32, SampleFormat::Float32>(
+        floats.data(), planes, 2, count / 2);
+    }
+
+    return elapsedNs(start) / (double(passes) * count);
+  }, parameters);
+}
+
+/* Common capture rates down to the detector rate, one second at a time.*/
+void
+SuiteBenchmark::measureResampling()
+{
+  for (int from : { 48000, 44100 }) {
+    std::vector<float> second = testSignal(size_t(from), double(from));
+    QJsonObject parameters;
+    parameters["from"] = from;
+    parameters["to"] = 16000;
+
+    measure(QString("resample.%1_16000").arg(from),
+            "micro",
+            "ms/s",
+            [&] {
+              auto start = Clock::now();
+              std::vector<float> out = resample(second, from, 16000.0);
+              g_sink = out.back();
+              return elapsedNs(start) / 1.0e6;
+            },
+            parameters);
+  }
+}
+
+/* Builds AudioBlocks from interleaved stereo on a producer thread, as
+   recordCallback does, and posts them with a queued call to a QObject on a
+   consumer thread, as the reader's signal does. The latency runs from
+   stamping the block to the consumer receiving it.*/
+void
+SuiteBenchmark::measureHandoff()
+{
+  const int channels = 2;
+  std::vector<float> interleaved =
+    testSignal(size_t(channels * FRAMES_PER_BUFFER), 16000.0);
+  QThread thread;
+  QObject consumer;
+  consumer.moveToThread(&thread);
+  thread.start();
+
+  std::vector<double> p50, p99, produced;
+
+  for (int rep = 0; rep <= m_repetitions; rep++) {
+    // written only by the consumer, read once it has received everything.
+    std::vector<double> latencies(HANDOFF_BLOCKS);
+    std::atomic<int> received(0);
+    double producerNs = 0.0;
+
+    std::thread producer([&] {
+      for (int i = 0; i < HANDOFF_BLOCKS; i++) {
+        auto start = Clock::now();
+        AudioBlock block(channels, FRAMES_PER_BUFFER);
+        float* planes[] = { block.channel(0), block.channel(1) };
+        interleavedToPlanar<SampleFormat::Float32, SampleFormat::Float32>(
+          interleaved.data(), planes, channels, FRAMES_PER_BUFFER);
+        block.setSequence(quint64(i));
+        block.setCaptureTime(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+            start.time_since_epoch())
+            .count());
+        QMetaObject::invokeMethod(
+          &consumer,
+          [&, block] {
+            qint64 now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           Clock::now().time_since_epoch())
+                           .count();
+            latencies[size_t(block.sequence())] =
+              double(now - block.captureTime()) / 1000.0;
+            received.fetch_add(1, std::memory_order_release);
+          },
+          Qt::QueuedConnection);
+        producerNs += elapsedNs(start);
+        std::this_thread::sleep_for(std::chrono::microseconds(HANDOFF_GAP_US));
+      }
+    });
+
+    producer.join();
+
+    while (received.load(std::memory_order_acquire) < HANDOFF_BLOCKS) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // the first pass only warms up.
+    if (rep > 0) {
+      p50.push_back(percentile(latencies, 0.5));
+      p99.push_back(percentile(latencies, 0.99));
+      produced.push_back(producerNs / HANDOFF_BLOCKS);
+    }
+  }
+
+  thread.quit();
+  thread.wait();
+
+  QJsonObject parameters;
+  parameters["blocks"] = HANDOFF_BLOCKS;
+  parameters["channels"] = channels;
+  parameters["frames"] = FRAMES_PER_BUFFER;
+  parameters["gap_us"] = HANDOFF_GAP_US;
+  record("handoff.latency_p50", "macro", "us", p50, parameters);
+  record("handoff.latency_p99", "macro", "us", p99, parameters);
+  record("handoff.producer", "macro", "ns/block", produced, parameters);
+}
+
+/* Paints a full MicrophonePlot offscreen, the work the GUI thread does on
+   every update.*/
+void
+SuiteBenchmark::measurePlot()
+{
+  const QSize size(800, 200);
+  const int frames = 20;
+  MicrophonePlot plot(16000, 500);
+  plot.resize(size);
+  std::vector<float> signal = testSignal(8000, 16000.0);
+  plot.addData(QVector<float>(signal.begin(), signal.end()));
+  QImage image(size, QImage::Format_ARGB32_Premultiplied);
+  QJsonObject parameters;
+  parameters["width"] = size.width();
+  parameters["height"] = size.height();
+  parameters["samples"] = int(signal.size());
+
+  measure("plot.paint", "macro", "ms/frame", [&] {
+    auto start = Clock::now();
+
+    for (int i = 0; i < frames; i++) {
+      plot.render(&image);
+    }
+
+    return elapsedNs(start) / 1.0e6 / frames;
+  }, parameters);
+}
+
+/* Times the work of the spectrogram's worker thread for each column, and
+   the blit of a full ten second window that is all a spectrogram paint
+   does on the GUI thread.*/
+void
+SuiteBenchmark::measureSpectrogram()
+{
+  const QSize size(800, 200);
+  const int frames = 20;
+  SpectrogramConfig config;
+  Spectrogram spectrogram(config);
+  std::vector<float> signal =
+    testSignal(size_t(config.displayTime / 1000 * config.sampleRate),
+               double(config.sampleRate));
+  QImage image(size, QImage::Format_ARGB32_Premultiplied);
+  QJsonObject parameters;
+  parameters["fft"] = spectrogram.config().fftSize;
+  parameters["hop"] = spectrogram.config().hopSize;
+  parameters["columns"] = spectrogram.columns();
+  parameters["rows"] = spectrogram.rows();
+
+  measure("spectrogram.column", "micro", "us/column", [&] {
+    spectrogram.reset();
+    auto start = Clock::now();
+    spectrogram.process(signal.data(), int(signal.size()));
+    return elapsedNs(start) / 1.0e3 / double(spectrogram.columnsWritten());
+  }, parameters);
+
+  parameters["width"] = size.width();
+  parameters["height"] = size.height();
+
+  measure("spectrogram.paint", "macro", "ms/frame", [&] {
+    QPainter painter(&image);
+    auto start = Clock::now();
+
+    for (int i = 0; i < frames; i++) {
+      spectrogram.paint(&painter, image.rect());
+    }
+
+    return elapsedNs(start) / 1.0e6 / frames;
+  }, parameters);
+}
+
+/* Runs the same audio through every model in resources/models and records
+   its real time factor, the detector time over the audio time.*/
+bool
+SuiteBenchmark::measureModels()
+{
+  QDir dir(m_resourceDir);
+  BenchmarkAudio audio;
+
+  if (!audio.build(m_resourceDir, MODEL_SECONDS)) {
+    return false;
+  }
+
+  QStringList models =
+    QDir(dir.filePath("models"))
+      .entryList(QStringList() << "*.umdl" << "*.pmdl", QDir::Files,
+                 QDir::Name);
+
+  for (const QString& model : models) {
+    DetectionPipeline pipeline;
+
+    if (!pipeline.setDetector(dir.filePath("common.res"),
+                              dir.filePath("models/" + model))) {
+      return false;
+    }
+
+    pipeline.setChunkPolicy(ChunkPolicy(ChunkPolicy::Fixed));
+    QJsonObject parameters;
+    parameters["model"] = model;
+    parameters["seconds"] = MODEL_SECONDS;
+
+    measure(QString("snowboy.rtf.%1").arg(QFileInfo(model).baseName()),
+            "macro",
+            "rtf",
+            [&] {
+              pipeline.reset();
+              ReplayResult replay = audio.replay(pipeline, FRAMES_PER_BUFFER);
+              return replay.busyMs / (1000.0 * audio.seconds());
+            },
+            parameters);
+  }
+
+  return true;
+}
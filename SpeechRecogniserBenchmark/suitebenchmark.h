@@ -0,0 +1,103 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef SUITEBENCHMARK_H
+#define SUITEBENCHMARK_H
+
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+#include <functional>
+#include <vector>
+
+/*!
+  \brief One case of the suite, summarised over its repetitions.
+*/
+struct SuiteResult
+{
+  QString name;
+  QString kind;
+  QString unit;
+  int repetitions = 0;
+  double median = 0;
+  double minimum = 0;
+  double maximum = 0;
+  QJsonObject parameters;
+};
+
+/*!
+  \class SuiteBenchmark
+  \brief The SuiteBenchmark class runs a fixed set of micro and macro
+  benchmarks over the whole audio pipeline and writes them as JSON, so
+  results can be compared across releases and hardware.
+
+  The micro benchmarks time the building blocks: the CircularBuffer behind
+  MicrophonePlot, sample conversion and resampling. The macro benchmarks
+  time the capture to consumer handoff of an AudioBlock through a queued
+  call to another thread, a MicrophonePlot paint rendered offscreen into a
+  QImage, the Spectrogram's columns and its blit of a ten second window,
+  and the real time factor of every model in resources/models.
+
+  Every case runs once to warm up and then repetitions() times on fixed
+  input. The median is the figure to compare, the minimum and maximum show
+  how steady the machine was. The JSON also records the machine, the
+  build and the revision it came from.
+*/
+class SuiteBenchmark
+{
+public:
+  explicit SuiteBenchmark(const QString& resourceDir);
+
+  int repetitions() const;
+  void setRepetitions(int repetitions);
+
+  bool run();
+  QVector<SuiteResult> results() const;
+  bool writeJson(const QString& filename) const;
+
+  static QJsonObject environment();
+
+private:
+  QString m_resourceDir;
+  int m_repetitions;
+  QVector<SuiteResult> m_results;
+
+  void measure(const QString& name,
+               const QString& kind,
+               const QString& unit,
+               const std::function<double()>& repetition,
+               const QJsonObject& parameters = QJsonObject());
+  void record(const QString& name,
+              const QString& kind,
+              const QString& unit,
+              std::vector<double> values,
+              const QJsonObject& parameters);
+  void measureCircularBuffer();
+  void measureConversion();
+  void measureResampling();
+  void measureHandoff();
+  void measurePlot();
+  void measureSpectrogram();
+  bool measureModels();
+};
+
+#endif // SUITEBENCHMARK_H
@@ -0,0 +1,420 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QColor>
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QPainter>
+#include <QPainterPath>
+#include <QTextStream>
+#include <QThread>
+#include <QtDebug>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "benchmarkaudio.h"
+#include "detectionpipeline.h"
+#include "microphonereader.h"
+#include "snowboy-detect.h"
+#include "sweepbenchmark.h"
+
+using namespace SpeechRecognition;
+
+// how far from a hotword's end a detection may be and still find it.
+static const int MATCH_WINDOW_MS = 750;
+
+/* A sensitivity string with value for each of count hotwords.*/
+static std::string
+repeated(double value, int count)
+{
+  QStringList values;
+
+  for (int i = 0; i < count; i++) {
+    values << QString::number(value, 'f', 3);
+  }
+
+  return values.join(',').toStdString();
+}
+
+SweepBenchmark::SweepBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+  , m_model("snowboy.umdl")
+  , m_seconds(600)
+  , m_sensitivities({ 0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9 })
+  , m_highSensitivities({ 0.0 })
+  , m_threads(0)
+{}
+
+/*!
+   \brief Sets the model in resources/models to sweep, by default
+   snowboy.umdl, the hotword in BenchmarkAudio.
+*/
+void
+SweepBenchmark::setModel(const QString& model)
+{
+  m_model = model;
+}
+
+/*!
+   \brief Sets the seconds of hotwords in noise at the start of the corpus,
+   by default ten minutes.
+*/
+void
+SweepBenchmark::setSeconds(int seconds)
+{
+  m_seconds = seconds;
+}
+
+/*!
+   \brief Sets 16 kHz mono WAV files with no hotword in them, speech, music
+   or whatever the device will hear, added to the corpus for false alarms.
+*/
+void
+SweepBenchmark::setNegatives(const QStringList& files)
+{
+  m_negatives = files;
+}
+
+void
+SweepBenchmark::setSensitivities(const QList<double>& sensitivities)
+{
+  m_sensitivities = sensitivities;
+}
+
+/*!
+   \brief Sets the high sensitivities tried with each sensitivity. 0 leaves
+   it unset, and a high sensitivity no higher than the sensitivity is
+   skipped as snowboy would ignore it.
+*/
+void
+SweepBenchmark::setHighSensitivities(const QList<double>& sensitivities)
+{
+  m_highSensitivities = sensitivities;
+}
+
+/*!
+   \brief Sets the threads the shards run on, 0 for one per core.
+*/
+void
+SweepBenchmark::setThreads(int threads)
+{
+  m_threads = threads;
+}
+
+/*!
+   \brief Builds the corpus and runs every setting over it. Returns false if
+   the corpus or the model could not be loaded.
+*/
+bool
+SweepBenchmark::run()
+{
+  m_results.clear();
+  QDir dir(m_resourceDir);
+  BenchmarkAudio audio;
+
+  if (!audio.build(m_resourceDir, m_seconds, 64)) {
+    return false;
+  }
+
+  std::vector<float> corpus = audio.floatSamples();
+  const std::vector<size_t>& ends = audio.hotwordEnds();
+  const int rate = audio.sampleRate();
+
+  for (const QString& negative : m_negatives) {
+    std::vector<float> sound;
+
+    if (!BenchmarkAudio::loadSound(negative, sound)) {
+      qWarning() << QObject::tr("unable to read %1").arg(negative);
+      return false;
+    }
+
+    corpus.insert(corpus.end(), sound.begin(), sound.end());
+  }
+
+  const double seconds = double(corpus.size()) / rate;
+  std::vector<SweepResult> shards;
+
+  for (double sensitivity : m_sensitivities) {
+    for (double high : m_highSensitivities) {
+      if (high > 0 && high <= sensitivity) {
+        continue;
+      }
+
+      SweepResult shard;
+      shard.sensitivity = sensitivity;
+      shard.highSensitivity = high;
+      shard.hotwords = int(ends.size());
+      shards.push_back(shard);
+    }
+  }
+
+  int threads = (m_threads > 0 ? m_threads : QThread::idealThreadCount());
+  threads = std::max(1, std::min(threads, int(shards.size())));
+  std::atomic<int> next(0);
+  std::atomic<bool> ok(true);
+  const size_t window = size_t(MATCH_WINDOW_MS * rate / 1000);
+  auto start = std::chrono::steady_clock::now();
+
+  auto work = [&]() {
+    for (int i = next.fetch_add(1); i < int(shards.size());
+         i = next.fetch_add(1)) {
+      SweepResult& shard = shards[size_t(i)];
+      DetectionPipeline pipeline;
+
+      if (!pipeline.setDetector(dir.filePath("common.res"),
+                                dir.filePath("models/" + m_model))) {
+        ok = false;
+        continue;
+      }
+
+      pipeline.setChunkPolicy(ChunkPolicy(ChunkPolicy::Fixed));
+      snowboy::SnowboyDetect* detector = pipeline.detector();
+      const int hotwords = detector->NumHotwords();
+      detector->SetSensitivity(repeated(shard.sensitivity, hotwords));
+
+      if (shard.highSensitivity > 0) {
+        detector->SetHighSensitivity(
+          repeated(shard.highSensitivity, hotwords));
+      }
+
+      std::vector<size_t> detections;
+      auto begin = std::chrono::steady_clock::now();
+
+      for (size_t captured = 0; captured < corpus.size();) {
+        size_t block =
+          std::min(size_t(FRAMES_PER_BUFFER), corpus.size() - captured);
+
+        if (pipeline.process(corpus.data() + captured, int(block)) > 0) {
+          detections.push_back(captured + block);
+        }
+
+        captured += block;
+      }
+
+      std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - begin;
+      shard.speed = seconds / elapsed.count();
+
+      // both lists are in order, so one pass pairs each hotword with the
+      // first detection near its end.
+      size_t hotword = 0;
+
+      for (size_t at : detections) {
+        while (hotword < ends.size() && ends[hotword] + window < at) {
+          hotword++;
+        }
+
+        if (hotword < ends.size() && ends[hotword] <= at + window) {
+          shard.detected++;
+          hotword++;
+
+        } else {
+          shard.falseAlarms++;
+        }
+      }
+
+      shard.missRate =
+        (shard.hotwords > 0 ? 1.0 - double(shard.detected) / shard.hotwords
+                            : 0.0);
+      shard.falseAlarmsPerHour = shard.falseAlarms * 3600.0 / seconds;
+    }
+  };
+
+  std::vector<std::thread> workers;
+
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back(work);
+  }
+
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  if (!ok) {
+    return false;
+  }
+
+  for (const SweepResult& r : shards) {
+    qInfo().noquote()
+      << QString("sensitivity %1 high %2: miss %3% (%4 of %5), "
+                 "%6 false alarms, %7 an hour, %8 times real time")
+           .arg(r.sensitivity, 0, 'f', 3)
+           .arg(r.highSensitivity > 0
+                  ? QString::number(r.highSensitivity, 'f', 3)
+                  : QString("-"))
+           .arg(100.0 * r.missRate, 0, 'f', 1)
+           .arg(r.hotwords - r.detected)
+           .arg(r.hotwords)
+           .arg(r.falseAlarms)
+           .arg(r.falseAlarmsPerHour, 0, 'f', 2)
+           .arg(r.speed, 0, 'f', 0);
+    m_results.append(r);
+  }
+
+  qInfo().noquote() << QString("%1 settings over %2 s of audio on %3 "
+                               "threads in %4 s, %5 times real time")
+                         .arg(shards.size())
+                         .arg(seconds, 0, 'f', 0)
+                         .arg(threads)
+                         .arg(elapsed.count(), 0, 'f', 1)
+                         .arg(shards.size() * seconds / elapsed.count(),
+                              0,
+                              'f',
+                              0);
+  return true;
+}
+
+QVector<SweepResult>
+SweepBenchmark::results() const
+{
+  return m_results;
+}
+
+/*!
+   \brief Writes the results as comma separated values, one row per setting.
+*/
+bool
+SweepBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "sensitivity,high_sensitivity,hotwords,detected,false_alarms,"
+         "miss_rate,false_alarms_per_hour,speed\n";
+
+  for (const SweepResult& r : m_results) {
+    out << r.sensitivity << ',' << r.highSensitivity << ',' << r.hotwords
+        << ',' << r.detected << ',' << r.falseAlarms << ',' << r.missRate
+        << ',' << r.falseAlarmsPerHour << ',' << r.speed << '\n';
+  }
+
+  return true;
+}
+
+/*!
+   \brief Plots the ROC curve, the hotwords found against false alarms per
+   hour, and beside it the DET curve, the miss rate against false alarms
+   per hour, with a line for each high sensitivity.
+*/
+bool
+SweepBenchmark::writePlot(const QString& filename) const
+{
+  if (m_results.isEmpty()) {
+    return false;
+  }
+
+  const int width = 1000, height = 500, margin = 60;
+  QImage image(width, height, QImage::Format_RGB32);
+  image.fill(Qt::white);
+  QPainter painter(&image);
+  painter.setRenderHint(QPainter::Antialiasing);
+
+  double maxRate = 1.0;
+
+  for (const SweepResult& r : m_results) {
+    maxRate = std::max(maxRate, r.falseAlarmsPerHour);
+  }
+
+  maxRate *= 1.1;
+  const QStringList colours = { "blue", "red", "green", "magenta", "orange" };
+
+  for (int panel = 0; panel < 2; panel++) {
+    const bool roc = (panel == 0);
+    const QRectF area(margin + panel * width / 2,
+                      margin / 2,
+                      width / 2 - margin * 3 / 2,
+                      height - margin * 3 / 2);
+    auto xAt = [&](double rate) {
+      return area.left() + area.width() * rate / maxRate;
+    };
+    auto yAt = [&](double fraction) {
+      return area.bottom() - area.height() * fraction;
+    };
+
+    painter.setPen(Qt::black);
+    painter.drawRect(area);
+
+    for (int i = 0; i <= 5; i++) {
+      painter.drawText(QPointF(xAt(maxRate * i / 5) - 8, area.bottom() + 18),
+                       QString::number(maxRate * i / 5, 'f', 1));
+      painter.drawText(QPointF(area.left() - 36, yAt(i / 5.0) + 4),
+                       QString::number(i / 5.0, 'f', 1));
+    }
+
+    painter.drawText(QPointF(area.center().x() - 60, height - 8),
+                     QObject::tr("false alarms per hour"));
+    painter.drawText(QPointF(area.left() - 36, 16),
+                     roc ? QObject::tr("ROC: hotwords found")
+                         : QObject::tr("DET: miss rate"));
+
+    for (int h = 0; h < m_highSensitivities.size(); h++) {
+      QPainterPath path;
+      bool first = true;
+
+      for (const SweepResult& r : m_results) {
+        if (r.highSensitivity != m_highSensitivities.at(h)) {
+          continue;
+        }
+
+        QPointF point(xAt(r.falseAlarmsPerHour),
+                      yAt(roc ? 1.0 - r.missRate : r.missRate));
+
+        if (first) {
+          path.moveTo(point);
+          first = false;
+
+        } else {
+          path.lineTo(point);
+        }
+      }
+
+      QPen pen(QColor(colours.at(h % colours.size())), 2);
+      painter.setPen(pen);
+      painter.drawPath(path);
+      painter.drawText(
+        QPointF(area.right() - 90, area.top() + 16 * (h + 1)),
+        m_highSensitivities.at(h) > 0
+          ? QString("high %1").arg(m_highSensitivities.at(h), 0, 'f', 2)
+          : QString("no high"));
+    }
+  }
+
+  painter.end();
+
+  if (!image.save(filename)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  return true;
+}
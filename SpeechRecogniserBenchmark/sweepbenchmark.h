@@ -0,0 +1,95 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef SWEEPBENCHMARK_H
+#define SWEEPBENCHMARK_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <vector>
+
+/*!
+  \brief How one sensitivity setting did over the whole corpus.
+*/
+struct SweepResult
+{
+  double sensitivity = 0;
+  //! The high sensitivity, 0 when it was not set.
+  double highSensitivity = 0;
+  int hotwords = 0;
+  int detected = 0;
+  int falseAlarms = 0;
+  double missRate = 0;
+  double falseAlarmsPerHour = 0;
+  //! The corpus seconds this shard got through per second.
+  double speed = 0;
+};
+
+/*!
+  \class SweepBenchmark
+  \brief The SweepBenchmark class replays a labelled corpus through a
+  model at many sensitivity settings at once, to choose the
+  SetSensitivity() and SetHighSensitivity() values from the trade off
+  between misses and false alarms rather than by guesswork.
+
+  The corpus is BenchmarkAudio's hotwords in noise, whose ends are known,
+  followed by any number of recordings that hold no hotword at all. It is
+  decoded once and every shard reads the same copy; a shard is a
+  DetectionPipeline with its own detector at one sensitivity and high
+  sensitivity. The shards run on threads() threads. A detection within
+  the match window of a hotword's end finds it, any other is a false
+  alarm.
+
+  writeCsv() writes the curve, a row per setting with its miss rate and
+  false alarms per hour, and writePlot() draws it as ROC and DET curves.
+*/
+class SweepBenchmark
+{
+public:
+  explicit SweepBenchmark(const QString& resourceDir);
+
+  void setModel(const QString& model);
+  void setSeconds(int seconds);
+  void setNegatives(const QStringList& files);
+  void setSensitivities(const QList<double>& sensitivities);
+  void setHighSensitivities(const QList<double>& sensitivities);
+  void setThreads(int threads);
+
+  bool run();
+  QVector<SweepResult> results() const;
+  bool writeCsv(const QString& filename) const;
+  bool writePlot(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  QString m_model;
+  int m_seconds;
+  QStringList m_negatives;
+  QList<double> m_sensitivities;
+  QList<double> m_highSensitivities;
+  int m_threads;
+  QVector<SweepResult> m_results;
+};
+
+#endif // SWEEPBENCHMARK_H
@@ -0,0 +1,212 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <QtDebug>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "benchmarkaudio.h"
+#include "detectionpipeline.h"
+#include "microphonereader.h"
+#include "tracebenchmark.h"
+#include "tracing.h"
+
+using namespace SpeechRecognition;
+
+// half a ring, so a running tracer can always take the whole batch.
+static const int BATCH = Tracer::RING_EVENTS / 2;
+static const int BATCHES = 200;
+static const int PASSES = 3;
+
+TraceBenchmark::TraceBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+{}
+
+/*!
+   \brief Measures a span and the traced pipeline, writing the pipeline's
+   trace to traceFile. Returns false if the audio, the models or the trace
+   file could not be opened, or the overhead is over 1%.
+*/
+bool
+TraceBenchmark::run(const QString& traceFile)
+{
+  Tracer& tracer = Tracer::instance();
+  m_result = TraceResult();
+  m_result.spanNsStopped = spanCost();
+
+  if (!tracer.start(traceFile, 10)) {
+    return false;
+  }
+
+  m_result.spanNsRunning = spanCost();
+  tracer.stop();
+  m_result.flushNsPerEvent =
+    tracer.flushSeconds() * 1.0e9 / double(qMax<quint64>(1, tracer.events()));
+
+  BenchmarkAudio audio;
+  QDir dir(m_resourceDir);
+
+  if (!audio.build(m_resourceDir, 60, 128)) {
+    return false;
+  }
+
+  DetectionPipeline pipeline;
+
+  if (!pipeline.setDetector(dir.filePath("common.res"),
+                            dir.filePath("models/snowboy.umdl"))) {
+    return false;
+  }
+
+  pipeline.setEnergyGateEnabled(true);
+  double stopped = 0, running = 0;
+
+  // alternate the two and keep the best of each, to take out the noise of
+  // the machine.
+  for (int pass = 0; pass < PASSES; pass++) {
+    pipeline.reset();
+    double busyMs = audio.replay(pipeline, FRAMES_PER_BUFFER).busyMs;
+    stopped = (pass == 0 ? busyMs : std::min(stopped, busyMs));
+
+    if (!tracer.start(traceFile)) {
+      return false;
+    }
+
+    pipeline.reset();
+    busyMs = audio.replay(pipeline, FRAMES_PER_BUFFER).busyMs;
+    running = (pass == 0 ? busyMs : std::min(running, busyMs));
+    tracer.stop();
+  }
+
+  m_result.busyMsStopped = stopped;
+  m_result.busyMsRunning = running;
+  m_result.dropped = tracer.droppedEvents();
+  double events = double(tracer.events());
+
+  if (Tracer::isCompiledIn()) {
+    m_result.events = tracer.events();
+    m_result.measuredPercent = 100.0 * (running - stopped) / stopped;
+
+  } else {
+    // a traced build records a process span per block, a gate span and a
+    // span per detector call. The stats cover every pass.
+    DetectionStats stats = pipeline.stats();
+    events = double(2 * stats.blocks + stats.detectionCalls) / (2 * PASSES);
+  }
+
+  m_result.eventsPerSecond = events / audio.seconds();
+  m_result.overheadPercent =
+    100.0 * events *
+    (m_result.spanNsRunning + m_result.flushNsPerEvent) * 1.0e-6 / stopped;
+
+  qInfo().noquote()
+    << QString("span %1 ns stopped, %2 ns running, flush %3 ns per event")
+         .arg(m_result.spanNsStopped, 0, 'f', 2)
+         .arg(m_result.spanNsRunning, 0, 'f', 2)
+         .arg(m_result.flushNsPerEvent, 0, 'f', 2);
+  qInfo().noquote()
+    << QString("pipeline %1 ms, %2 events/s (%3% of a core), overhead %4%%5")
+         .arg(stopped, 0, 'f', 1)
+         .arg(m_result.eventsPerSecond, 0, 'f', 0)
+         .arg(m_result.eventsPerSecond *
+                (m_result.spanNsRunning + m_result.flushNsPerEvent) * 1.0e-7,
+              0,
+              'f',
+              4)
+         .arg(m_result.overheadPercent, 0, 'f', 3)
+         .arg(Tracer::isCompiledIn()
+                ? QString(", traced %1 ms, %2 dropped")
+                    .arg(running, 0, 'f', 1)
+                    .arg(m_result.dropped)
+                : QString(" (built without tracing)"));
+
+  if (m_result.overheadPercent >= 1.0) {
+    qWarning() << QObject::tr("tracing costs %1%, over the 1% budget.")
+                    .arg(m_result.overheadPercent, 0, 'f', 2);
+    return false;
+  }
+
+  return true;
+}
+
+TraceResult
+TraceBenchmark::result() const
+{
+  return m_result;
+}
+
+/*!
+   \brief Writes the result as comma separated values.
+*/
+bool
+TraceBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  const TraceResult& r = m_result;
+  QTextStream out(&file);
+  out << "span_ns_stopped,span_ns_running,flush_ns_per_event,"
+         "busy_ms_stopped,busy_ms_running,events,dropped,events_per_second,"
+         "measured_percent,overhead_percent,compiled_in\n";
+  out << r.spanNsStopped << ',' << r.spanNsRunning << ','
+      << r.flushNsPerEvent << ',' << r.busyMsStopped << ',' << r.busyMsRunning
+      << ',' << r.events << ',' << r.dropped << ',' << r.eventsPerSecond
+      << ',' << r.measuredPercent << ',' << r.overheadPercent << ','
+      << (Tracer::isCompiledIn() ? 1 : 0) << '\n';
+  return true;
+}
+
+/* Returns the mean nanoseconds a span costs, recording in batches that fit
+   the ring and waiting for the flush between them.*/
+double
+TraceBenchmark::spanCost()
+{
+  Tracer& tracer = Tracer::instance();
+  double totalNs = 0;
+
+  for (int batch = 0; batch < BATCHES; batch++) {
+    quint64 before = tracer.events();
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < BATCH; i++) {
+      TraceScope scope("span", "benchmark", quint64(i));
+    }
+
+    std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+    totalNs += elapsed.count();
+
+    while (Tracer::isRunning() && tracer.events() < before + BATCH) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  return totalNs / (double(BATCH) * BATCHES);
+}
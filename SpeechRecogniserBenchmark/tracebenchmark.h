@@ -0,0 +1,74 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef TRACEBENCHMARK_H
+#define TRACEBENCHMARK_H
+
+#include <QString>
+
+/*!
+  \brief What tracing costs the detection path.
+*/
+struct TraceResult
+{
+  double spanNsStopped = 0;
+  double spanNsRunning = 0;
+  double flushNsPerEvent = 0;
+  double busyMsStopped = 0;
+  double busyMsRunning = 0;
+  quint64 events = 0;
+  quint64 dropped = 0;
+  double eventsPerSecond = 0;
+  double measuredPercent = 0;
+  double overheadPercent = 0;
+};
+
+/*!
+  \class TraceBenchmark
+  \brief The TraceBenchmark class measures the cost of the trace spans
+  against the 1% budget.
+
+  A span is timed on its own with the tracer stopped and running, along
+  with the flush thread's time per event. Then the benchmark audio is
+  replayed through a DetectionPipeline with the tracer stopped and
+  running, writing trace.json. The overhead is the cost of an event times
+  the events recorded, against the untraced busy time. The difference in
+  busy time is reported too, but it is within the noise when detection is
+  cheap. If the library was built without tracing the pipeline records
+  nothing, so the events are those a traced build would record.
+*/
+class TraceBenchmark
+{
+public:
+  explicit TraceBenchmark(const QString& resourceDir);
+
+  bool run(const QString& traceFile);
+  TraceResult result() const;
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  TraceResult m_result;
+
+  static double spanCost();
+};
+
+#endif // TRACEBENCHMARK_H
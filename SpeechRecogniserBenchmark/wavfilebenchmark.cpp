@@ -0,0 +1,205 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <QtDebug>
+
+#if defined(Q_OS_LINUX)
+#include <unistd.h>
+#endif
+
+#include "snowboy-detect.h"
+#include "wavfile.h"
+#include "wavfilebenchmark.h"
+
+using namespace SpeechRecognition;
+
+/* Returns the resident set size in MB, or 0 where /proc is not available.*/
+static double
+residentMB()
+{
+#if defined(Q_OS_LINUX)
+  QFile statm("/proc/self/statm");
+
+  if (!statm.open(QIODevice::ReadOnly)) {
+    return 0.0;
+  }
+
+  QList<QByteArray> fields = statm.readAll().split(' ');
+  return fields.value(1).toDouble() * double(sysconf(_SC_PAGESIZE)) /
+         (1024.0 * 1024.0);
+#else
+  return 0.0;
+#endif
+}
+
+WavFileBenchmark::WavFileBenchmark(const QString& resourceDir)
+  : m_resourceDir(resourceDir)
+  , m_file(QDir(resourceDir).filePath("snowboy.wav"))
+  , m_detectionRtf(0)
+{}
+
+/*!
+   \brief Sets the 16 bit mono WAV file to read. Defaults to
+   resources/snowboy.wav.
+*/
+void
+WavFileBenchmark::setFile(const QString& filename)
+{
+  m_file = filename;
+}
+
+/*!
+   \brief Runs the comparison and the detection pass. Returns false if the
+   file or the models could not be loaded.
+*/
+bool
+WavFileBenchmark::run()
+{
+  m_results.clear();
+
+  // mapped first, so the heap read does not start with a warm page cache
+  // that the mapping then also benefits from.
+  if (!measure("mapped", true) || !measure("heap", false)) {
+    return false;
+  }
+
+  for (const WavFileResult& r : m_results) {
+    qInfo().noquote() << QString("%1 open %2 ms, scan %3 GB/s, +%4 MB resident")
+                           .arg(r.name, -8)
+                           .arg(r.openMs, 0, 'f', 3)
+                           .arg(r.scanGBs, 0, 'f', 2)
+                           .arg(r.residentMB, 0, 'f', 1);
+  }
+
+  return measureDetection();
+}
+
+bool
+WavFileBenchmark::measure(const QString& name, bool memoryMap)
+{
+  double before = residentMB();
+  QElapsedTimer timer;
+  timer.start();
+  WavFile file;
+
+  if (!file.open(m_file, memoryMap)) {
+    return false;
+  }
+
+  if (!file.hasInt16Spans()) {
+    qWarning() << QObject::tr("%1 is not 16 bit mono").arg(m_file);
+    return false;
+  }
+
+  WavFileResult result;
+  result.name = name;
+  result.openMs = timer.nsecsElapsed() / 1.0e6;
+
+  // touch every sample, the least any consumer will do.
+  timer.restart();
+  qint64 sum = 0;
+
+  for (qint64 first = 0; first < file.frames(); first += 16000) {
+    Int16Span span = file.span(first, 16000);
+
+    for (int i = 0; i < span.count; i++) {
+      sum += span.data[i];
+    }
+  }
+
+  result.scanGBs = double(file.frames()) * 2.0 / timer.nsecsElapsed();
+  result.residentMB = residentMB() - before;
+  m_results.append(result);
+
+  // keeps the loop from being optimised away.
+  static volatile qint64 sink;
+  sink = sum;
+  return true;
+}
+
+bool
+WavFileBenchmark::measureDetection()
+{
+  QDir resources(m_resourceDir);
+  QString common = resources.filePath("common.res");
+  QString model = resources.filePath("models/snowboy.umdl");
+
+  if (!QFile::exists(common) || !QFile::exists(model)) {
+    qWarning() << QObject::tr("unable to find the snowboy model files");
+    return false;
+  }
+
+  WavFile file;
+
+  if (!file.open(m_file)) {
+    return false;
+  }
+
+  snowboy::SnowboyDetect detector(common.toStdString(), model.toStdString());
+  QElapsedTimer timer;
+  timer.start();
+  int hotwords = 0;
+  const int chunk = file.format().sampleRate / 10;
+
+  for (qint64 first = 0; first < file.frames(); first += chunk) {
+    Int16Span span = file.span(first, chunk);
+
+    if (detector.RunDetection(span.data, span.count) > 0) {
+      hotwords++;
+    }
+  }
+
+  double audioSeconds = double(file.frames()) / file.format().sampleRate;
+  m_detectionRtf = timer.nsecsElapsed() / 1.0e9 / audioSeconds;
+  qInfo().noquote() << QString("detection off the mapping: RTF %1, %2 hotwords")
+                         .arg(m_detectionRtf, 0, 'f', 4)
+                         .arg(hotwords);
+  return true;
+}
+
+/*!
+   \brief Writes the results as comma separated values.
+*/
+bool
+WavFileBenchmark::writeCsv(const QString& filename) const
+{
+  QFile file(filename);
+
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << QObject::tr("unable to write %1").arg(filename);
+    return false;
+  }
+
+  QTextStream out(&file);
+  out << "reader,open_ms,scan_gbs,resident_mb\n";
+
+  for (const WavFileResult& r : m_results) {
+    out << r.name << ',' << r.openMs << ',' << r.scanGBs << ','
+        << r.residentMB << '\n';
+  }
+
+  out << "detection_rtf," << m_detectionRtf << ",,\n";
+  return true;
+}
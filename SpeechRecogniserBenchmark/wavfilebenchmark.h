@@ -0,0 +1,70 @@
+/**
+  Copyright 2020 Simon Meaden
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+#ifndef WAVFILEBENCHMARK_H
+#define WAVFILEBENCHMARK_H
+
+#include <QString>
+#include <QVector>
+
+/*!
+  \brief The cost of one way of reading a WAV file.
+*/
+struct WavFileResult
+{
+  QString name;
+  double openMs;
+  double scanGBs;
+  double residentMB;
+};
+
+/*!
+  \class WavFileBenchmark
+  \brief The WavFileBenchmark class compares reading a WAV file into the
+  heap with memory mapping it, and runs the detector straight off the
+  mapped samples.
+
+  For each way it times opening the file, a sequential pass over every
+  sample and the growth in resident memory. Then the file is fed to
+  SnowboyDetect in 100 ms spans with no copy. Use a large file to see the
+  difference, the page cache should be dropped first for cold numbers.
+*/
+class WavFileBenchmark
+{
+public:
+  explicit WavFileBenchmark(const QString& resourceDir);
+
+  void setFile(const QString& filename);
+
+  bool run();
+  bool writeCsv(const QString& filename) const;
+
+private:
+  QString m_resourceDir;
+  QString m_file;
+  QVector<WavFileResult> m_results;
+  double m_detectionRtf;
+
+  bool measure(const QString& name, bool memoryMap);
+  bool measureDetection();
+};
+
+#endif // WAVFILEBENCHMARK_H
@@ -17,9 +17,15 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# must match the library, see SpeechRecogniser.pro
+DEFINES += _GLIBCXX_USE_CXX11_ABI=0
+
 # header file for common projects
 INCLUDEPATH += ../include
 
+# location of the snowboy resource and model files
+DEFINES += RESOURCES_DIR=\\\"$$PWD/../resources\\\"
+
 SOURCES += \
     main.cpp \
     mainwindow.cpp
@@ -30,8 +30,11 @@ MainWindow::MainWindow(QWidget* parent)
   , m_y(0)
   , m_w(500)
   , m_h(400)
-  , m_sampleRate(44100)
+  , m_sampleRate(SAMPLE_RATE)
   , m_displayTime(500)
+  , m_player(nullptr)
+  , m_ding(-1)
+  , m_metrics(nullptr)
 {
   QScreen* screen = QGuiApplication::primaryScreen();
   QSize size = screen->size();
@@ -53,6 +56,14 @@ MainWindow::initGui()
 
   QThread* recogniser_thread = new QThread;
   recogniser = new SpeechRecogniser();
+  recogniser->setDetector(QString(RESOURCES_DIR) + "/common.res",
+                          QString(RESOURCES_DIR) + "/models/snowboy.umdl");
+  recogniser->setEnergyGateEnabled(true);
+  recogniser->setLoadReportInterval(LOAD_REPORT_INTERVAL);
+  connect(recogniser,
+          &SpeechRecogniser::hotwordDetected,
+          this,
+          &MainWindow::hotwordDetected);
   connect(
     recogniser, &SpeechRecogniser::finished, recogniser_thread, &QThread::quit);
   connect(
@@ -61,6 +72,23 @@ MainWindow::initGui()
           &SpeechRecogniser::finished,
           recogniser_thread,
           &QObject::deleteLater);
+
+  // acknowledge a hotword from the detection thread itself, the GUI thread
+  // may be busy drawing.
+  m_player = new FeedbackPlayer(PlaybackSettings(), this);
+  m_ding = m_player->addSound(QString(RESOURCES_DIR) + "/ding.wav");
+
+  if (m_ding >= 0 && m_player->open()) {
+    connect(
+      recogniser,
+      &SpeechRecogniser::hotwordDetected,
+      m_player,
+      [this](int) { m_player->play(m_ding); },
+      Qt::DirectConnection);
+    // and don't listen to ourselves while the ding plays.
+    recogniser->setFeedbackPlayer(m_player);
+  }
+
   recogniser->moveToThread(recogniser_thread);
   recogniser_thread->start();
 
@@ -69,9 +97,26 @@ MainWindow::initGui()
     recogniser, &SpeechRecogniser::sendData, m_plot, &MicrophonePlot::addData);
   main_layout->addWidget(m_plot, 0, 0);
 
+  // noise spectra for field debugging.
+  QCheckBox* spectrogram = new QCheckBox(tr("Spectrogram"), this);
+  connect(spectrogram, &QCheckBox::toggled, m_plot, [this](bool checked) {
+    m_plot->setMode(checked ? MicrophonePlot::SpectrogramMode
+                            : MicrophonePlot::AmplitudeMode);
+  });
+  main_layout->addWidget(spectrogram, 1, 0);
+
+  m_metrics = new MetricsServer(this);
+  m_metrics->listen(quint16(METRICS_PORT));
+
   setCentralWidget(frm);
 }
 
+void
+MainWindow::hotwordDetected(int hotword)
+{
+  statusBar()->showMessage(tr("Hotword %1 detected").arg(hotword), 2000);
+}
+
 void
 MainWindow::closeEvent(QCloseEvent* event)
 {
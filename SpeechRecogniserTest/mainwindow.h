@@ -22,6 +22,7 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include <QCheckBox>
 #include <QCloseEvent>
 #include <QFrame>
 #include <QGridLayout>
@@ -30,11 +31,19 @@
 #include <QPoint>
 #include <QScreen>
 #include <QSize>
+#include <QStatusBar>
 #include <QThread>
 
+#include "feedbackplayer.h"
+#include "metricsserver.h"
 #include "microphoneplot.h"
 #include "speechrecogniser.h"
 
+// the localhost port Prometheus scrapes the pipeline metrics from.
+#define METRICS_PORT 9477
+// the seconds of audio between CPU load reports in the log.
+#define LOAD_REPORT_INTERVAL 60
+
 using namespace SpeechRecognition;
 
 class MainWindow : public QMainWindow
@@ -51,8 +60,12 @@ private:
   int m_displayTime;
   MicrophonePlot* m_plot;
   SpeechRecogniser* recogniser;
+  FeedbackPlayer* m_player;
+  int m_ding;
+  MetricsServer* m_metrics;
 
   void initGui();
+  void hotwordDetected(int hotword);
   void closeEvent(QCloseEvent* event);
 };
 #endif // MAINWINDOW_H